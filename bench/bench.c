@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#include <stdio.h>
+
+#include "bench.h"
+
+#ifdef BENCH_HOST
+
+#include <time.h>
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void bench_init()
+{
+}
+
+struct bench_stamp bench_start()
+{
+    uint64_t ns = now_ns();
+    struct bench_stamp stamp = { (uint32_t)ns, (uint32_t)(ns / 1000) };
+
+    return stamp;
+}
+
+struct bench_elapsed bench_stop(struct bench_stamp start)
+{
+    struct bench_stamp end = bench_start();
+    struct bench_elapsed elapsed = { end.ticks - start.ticks, end.us - start.us };
+
+    return elapsed;
+}
+
+const char* bench_unit()
+{
+    return "ns";
+}
+
+static bool ticks_wrapped(struct bench_elapsed elapsed)
+{
+    // 32-bit nanoseconds wrap after 4.29 s
+    return elapsed.us >= 4000000;
+}
+
+#else
+
+#include "hardware/clocks.h"
+#include "hardware/structs/systick.h"
+#include "hardware/timer.h"
+
+#define SYSTICK_MASK 0x00ffffff
+
+static uint32_t systick_wrap_us;
+
+void bench_init()
+{
+    // SysTick clocked from the processor clock, free running, no interrupt
+    systick_hw->rvr = SYSTICK_MASK;
+    systick_hw->cvr = 0;
+    systick_hw->csr = M0PLUS_SYST_CSR_CLKSOURCE_BITS | M0PLUS_SYST_CSR_ENABLE_BITS;
+
+    // ~134 ms at 125 MHz
+    systick_wrap_us = (SYSTICK_MASK + 1) / (clock_get_hz(clk_sys) / 1000000);
+}
+
+struct bench_stamp bench_start()
+{
+    struct bench_stamp stamp;
+
+    stamp.us = time_us_32();
+    stamp.ticks = systick_hw->cvr;
+
+    return stamp;
+}
+
+struct bench_elapsed bench_stop(struct bench_stamp start)
+{
+    struct bench_elapsed elapsed;
+
+    // SysTick counts down
+    elapsed.ticks = (start.ticks - systick_hw->cvr) & SYSTICK_MASK;
+    elapsed.us = time_us_32() - start.us;
+
+    return elapsed;
+}
+
+const char* bench_unit()
+{
+    return "cycles";
+}
+
+static bool ticks_wrapped(struct bench_elapsed elapsed)
+{
+    // one microsecond of margin for the two clocks not being read together
+    return elapsed.us + 1 >= systick_wrap_us;
+}
+
+#endif
+
+static void counter_reset(struct bench_counter* counter)
+{
+    counter->min = UINT32_MAX;
+    counter->max = 0;
+    counter->total = 0;
+}
+
+static void counter_add(struct bench_counter* counter, uint32_t value)
+{
+    counter->total += value;
+
+    if (value < counter->min) {
+        counter->min = value;
+    }
+
+    if (value > counter->max) {
+        counter->max = value;
+    }
+}
+
+void bench_result_reset(struct bench_result* result)
+{
+    result->iterations = 0;
+    result->ticks_wrapped = false;
+    counter_reset(&result->ticks);
+    counter_reset(&result->us);
+}
+
+void bench_result_add(struct bench_result* result, struct bench_elapsed elapsed)
+{
+    result->iterations++;
+    counter_add(&result->ticks, elapsed.ticks);
+    counter_add(&result->us, elapsed.us);
+
+    if (ticks_wrapped(elapsed)) {
+        result->ticks_wrapped = true;
+    }
+}
+
+static void report_counter(const char* group, const char* name, uint32_t iterations,
+                           const struct bench_counter* counter, uint32_t scale, uint32_t per, const char* unit)
+{
+    uint64_t mean = iterations ? counter->total / iterations : 0;
+
+    printf(
+        "BENCH,%s,%s,%lu,%lu,%lu,%lu,%s\n",
+        group, name,
+        (unsigned long)iterations,
+        (unsigned long)((uint64_t)(iterations ? counter->min : 0) * scale / per),
+        (unsigned long)(mean * scale / per),
+        (unsigned long)((uint64_t)counter->max * scale / per),
+        unit
+    );
+}
+
+void bench_report_per(const char* group, const char* name, const struct bench_result* result, uint32_t per)
+{
+    if (!result->ticks_wrapped) {
+        report_counter(group, name, result->iterations, &result->ticks, 1, per, bench_unit());
+    }
+
+#ifndef BENCH_HOST
+    // hardware timer line, the host only prints nanoseconds
+    if (per == 1) {
+        report_counter(group, name, result->iterations, &result->us, 1, 1, "us");
+        return;
+    }
+#endif
+
+    if (result->ticks_wrapped) {
+        // per-unit microseconds would mostly round to zero
+        report_counter(group, name, result->iterations, &result->us, 1000, per, "ns");
+    }
+}
+
+void bench_report(const char* group, const char* name, const struct bench_result* result)
+{
+    bench_report_per(group, name, result, 1);
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/*
+ * Benchmark bodies are plain C and build both for the RP2040 and for the
+ * host (BENCH_HOST defined). Every measurement is taken with two clocks:
+ * on the RP2040 CPU cycles from SysTick and microseconds from the hardware
+ * timer, on the host nanoseconds and microseconds from the monotonic clock.
+ *
+ * Every result is printed as one machine readable line per clock, on the
+ * host the nanosecond line only:
+ *
+ *   BENCH,<group>,<name>,<iterations>,<min>,<mean>,<max>,<unit>
+ *
+ * SysTick wraps every 2^24 cycles, the cycle line of a result is left out
+ * when any of its measurements took longer than that.
+ */
+
+#include <stdbool.h>
+
+void bench_init();
+
+struct bench_stamp {
+    uint32_t ticks;
+    uint32_t us;
+};
+
+struct bench_elapsed {
+    uint32_t ticks;
+    uint32_t us;
+};
+
+struct bench_stamp bench_start();
+
+struct bench_elapsed bench_stop(struct bench_stamp start);
+
+// Unit of the ticks clock, "cycles" or "ns"
+const char* bench_unit();
+
+struct bench_counter {
+    uint32_t min;
+    uint32_t max;
+    uint64_t total;
+};
+
+struct bench_result {
+    uint32_t iterations;
+    struct bench_counter ticks;
+    struct bench_counter us;
+    bool ticks_wrapped;
+};
+
+void bench_result_reset(struct bench_result* result);
+
+void bench_result_add(struct bench_result* result, struct bench_elapsed elapsed);
+
+void bench_report(const char* group, const char* name, const struct bench_result* result);
+
+// Same, with min / mean / max divided by per, e.g. the cost per sample of
+// a call that processes per samples
+void bench_report_per(const char* group, const char* name, const struct bench_result* result, uint32_t per);
+
+// Bodies
+void bench_soft_se();
+void bench_format();
+void bench_spi();
+void bench_nvm();
+void bench_metering();
+void bench_codec();
+void bench_display();
+void bench_fuota();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
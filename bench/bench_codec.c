@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+/*
+ * Lossless waveform codec on stream blocks: 512 voltage / current pairs,
+ * interleaved as the ADC round robin writes them, each input encoded on
+ * its own. The synthesized waveforms get +-2 counts of pseudo-random noise
+ * like the ADC. Encode and decode times are per sample, the compressed
+ * size of each case is printed as a comment line, in bits per sample and
+ * as the ratio to 16-bit samples.
+ */
+
+#include <stdio.h>
+
+#include "meter/source.h"
+#include "meter/wave_codec.h"
+
+#include "bench.h"
+
+#define CODEC_BENCH_BLOCKS  32
+#define BLOCK_PAIRS         512
+
+static uint16_t block[CODEC_BENCH_BLOCKS][2 * BLOCK_PAIRS];
+static uint16_t decoded[2 * BLOCK_PAIRS];
+static uint8_t encoded[2][METER_WAVE_ENCODED_MAX_SIZE(BLOCK_PAIRS)];
+
+static uint32_t noise_state = 1;
+
+static int32_t noise(int32_t range)
+{
+    noise_state = noise_state * 1664525 + 1013904223;
+
+    return (int32_t)((noise_state >> 16) % (2 * range + 1)) - range;
+}
+
+static void fill_synth(double rate, int32_t noise_range)
+{
+    struct meter_synth synth;
+    struct meter_source source;
+
+    meter_synth_init(&synth, rate, 60);
+    meter_synth_add_harmonic(&synth, 1, 1000, 500, 0);
+    meter_synth_add_harmonic(&synth, 3, 0, 100, 0);
+    synth.phase = 3.14159265358979323846 / 3;
+    meter_synth_source(&synth, &source);
+
+    // same sample period for both inputs, as in the round robin
+    for (int b = 0; b < CODEC_BENCH_BLOCKS; b++) {
+        for (int i = 0; i < BLOCK_PAIRS; i++) {
+            for (int input = 0; input < 2; input++) {
+                int32_t value;
+
+                meter_source_select(&source, input == 0 ? METER_INPUT_VOLTAGE : METER_INPUT_CURRENT);
+                synth.index = (uint64_t)b * BLOCK_PAIRS + i;
+                value = meter_source_read(&source) + noise(noise_range);
+
+                block[b][2 * i + input] = (value < 0) ? 0 : (value > 4095) ? 4095 : value;
+            }
+        }
+    }
+}
+
+static void fill_random()
+{
+    for (int b = 0; b < CODEC_BENCH_BLOCKS; b++) {
+        for (int i = 0; i < 2 * BLOCK_PAIRS; i++) {
+            block[b][i] = 2048 + noise(2047);
+        }
+    }
+}
+
+static void bench_case(const char* name)
+{
+    struct bench_result encode_result;
+    struct bench_result decode_result;
+    uint32_t total_size = 0;
+    uint32_t errors = 0;
+    char result_name[48];
+
+    bench_result_reset(&encode_result);
+    bench_result_reset(&decode_result);
+
+    for (int b = 0; b < CODEC_BENCH_BLOCKS; b++) {
+        size_t size[2];
+
+        struct bench_stamp start = bench_start();
+        size[0] = meter_wave_encode(block[b], BLOCK_PAIRS, 2, encoded[0]);
+        size[1] = meter_wave_encode(block[b] + 1, BLOCK_PAIRS, 2, encoded[1]);
+        bench_result_add(&encode_result, bench_stop(start));
+
+        start = bench_start();
+        int used0 = meter_wave_decode(encoded[0], size[0], decoded, BLOCK_PAIRS, 2);
+        int used1 = meter_wave_decode(encoded[1], size[1], decoded + 1, BLOCK_PAIRS, 2);
+        bench_result_add(&decode_result, bench_stop(start));
+
+        if (used0 != (int)size[0] || used1 != (int)size[1]) {
+            errors++;
+        }
+
+        for (int i = 0; i < 2 * BLOCK_PAIRS; i++) {
+            if (decoded[i] != block[b][i]) {
+                errors++;
+                break;
+            }
+        }
+
+        total_size += size[0] + size[1];
+    }
+
+    snprintf(result_name, sizeof(result_name), "encode_%s_per_sample", name);
+    bench_report_per("codec", result_name, &encode_result, 2 * BLOCK_PAIRS);
+    snprintf(result_name, sizeof(result_name), "decode_%s_per_sample", name);
+    bench_report_per("codec", result_name, &decode_result, 2 * BLOCK_PAIRS);
+
+    uint32_t samples = CODEC_BENCH_BLOCKS * 2 * BLOCK_PAIRS;
+    uint32_t centibits = (uint32_t)(((uint64_t)total_size * 800) / samples);
+    uint32_t ratio = (uint32_t)(((uint64_t)samples * 200) / total_size);
+
+    printf("# codec %s: %lu samples in %lu bytes, %lu.%02lu bits per sample, %lu.%02lu x smaller than 16-bit%s\n",
+           name, (unsigned long)samples, (unsigned long)total_size,
+           (unsigned long)(centibits / 100), (unsigned long)(centibits % 100),
+           (unsigned long)(ratio / 100), (unsigned long)(ratio % 100),
+           errors ? ", DECODE MISMATCH" : "");
+}
+
+void bench_codec()
+{
+    // full stream rate, 250 ksps per input
+    fill_synth(250000, 2);
+    bench_case("sine_250k");
+
+    // adc_set_clkdiv(959), 25 ksps per input
+    fill_synth(25000, 2);
+    bench_case("sine_25k");
+
+    // nothing to predict, stored verbatim
+    fill_random();
+    bench_case("random");
+}
@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+/*
+ * Display refresh of the current_voltage_sensor example: drawing the six
+ * value fields, and flushing a full frame, one changed field, and an
+ * unchanged frame to the SSD1306 over I2C at 1 MHz, waiting for the DMA
+ * transfer to finish.
+ *
+ * On the host the I2C controller and DMA are stubs that complete at once
+ * (host/include/hardware), so only the CPU part is measured.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#ifndef BENCH_HOST
+#include "pico/stdlib.h"
+#include "hardware/gpio.h"
+#endif
+
+#include "hardware/i2c.h"
+
+#include "meter_display.h"
+
+#include "bench.h"
+
+#define DISPLAY_BENCH_ITERATIONS 20
+
+// Display wiring of the current_voltage_sensor example
+#define DISPLAY_I2C_ADDRESS 0x3c
+#define DISPLAY_SDA_PIN     4
+#define DISPLAY_SCL_PIN     5
+
+#define FONT_WIDTH  8
+#define FONT_HEIGHT 8
+#define FONT_GLYPHS 95
+
+// pico_ssd1306 font layout: width, height, then the glyphs from ' ', one
+// byte per column. The pattern does not matter for the timing.
+static unsigned char font[2 + FONT_GLYPHS * FONT_WIDTH];
+
+static void font_init()
+{
+    font[0] = FONT_WIDTH;
+    font[1] = FONT_HEIGHT;
+
+    for (int i = 2; i < (int)sizeof(font); i++) {
+        font[i] = (unsigned char)(i * 37);
+    }
+}
+
+static void draw_fields(MeterDisplay& display, int value)
+{
+    char text[16];
+
+    display.clear();
+
+    for (int field = 0; field < 6; field++) {
+        snprintf(text, sizeof(text), "%c: %d.%02d", "IVPSQF"[field], value + field, value % 100);
+        display.draw_text(font, text, 0, field * 8);
+    }
+}
+
+extern "C" void bench_display()
+{
+    struct bench_result draw_result;
+    struct bench_result full_result;
+    struct bench_result changed_result;
+    struct bench_result unchanged_result;
+
+#ifndef BENCH_HOST
+    i2c_init(i2c0, 1000000);
+    gpio_set_function(DISPLAY_SDA_PIN, GPIO_FUNC_I2C);
+    gpio_set_function(DISPLAY_SCL_PIN, GPIO_FUNC_I2C);
+    gpio_pull_up(DISPLAY_SDA_PIN);
+    gpio_pull_up(DISPLAY_SCL_PIN);
+#endif
+
+    font_init();
+
+    MeterDisplay display(i2c0, DISPLAY_I2C_ADDRESS);
+
+    bench_result_reset(&draw_result);
+    bench_result_reset(&full_result);
+    bench_result_reset(&changed_result);
+    bench_result_reset(&unchanged_result);
+
+    for (int i = 0; i < DISPLAY_BENCH_ITERATIONS; i++) {
+        struct bench_stamp start = bench_start();
+        draw_fields(display, 100 + i);
+        bench_result_add(&draw_result, bench_stop(start));
+
+        display.invalidate();
+        start = bench_start();
+        display.flush();
+        bench_result_add(&full_result, bench_stop(start));
+
+        // one digit of one field
+        char text[2] = { (char)('0' + i % 10), '\0' };
+        display.draw_text(font, text, 40, 0);
+        start = bench_start();
+        display.flush();
+        bench_result_add(&changed_result, bench_stop(start));
+
+        start = bench_start();
+        display.flush();
+        bench_result_add(&unchanged_result, bench_stop(start));
+    }
+
+    bench_report("display", "draw_6_fields", &draw_result);
+    bench_report("display", "flush_full", &full_result);
+    bench_report("display", "flush_one_digit", &changed_result);
+    bench_report("display", "flush_unchanged", &unchanged_result);
+
+    // without a panel every transfer is aborted on the address NACK
+    if (display.get_stats().aborts > 0) {
+        printf("# display: %lu I2C transfers aborted, is the panel connected?\n",
+               (unsigned long)display.get_stats().aborts);
+    }
+}
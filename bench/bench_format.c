@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+/*
+ * Cost of rendering one display field, "V: 230.45 V", with newlib's
+ * sprintf("%0.2f") against the integer fixed_format_field. The "fixed"
+ * variant starts from a value that is already scaled, the "double" variant
+ * includes the fixed_from_double conversion the example still needs while
+ * the metering loop works in floating point.
+ */
+
+#include <stdio.h>
+
+#include "meter/fixed_format.h"
+
+#include "bench.h"
+
+#define FORMAT_BENCH_ITERATIONS 200
+
+static volatile double sink_value = 230.4567;
+
+static void bench_format_value(const char* name, double value)
+{
+    struct bench_result sprintf_result;
+    struct bench_result double_result;
+    struct bench_result fixed_result;
+    int32_t fixed = fixed_from_double(value, 2);
+    char buffer[32];
+    char result_name[32];
+
+    bench_result_reset(&sprintf_result);
+    bench_result_reset(&double_result);
+    bench_result_reset(&fixed_result);
+
+    for (int i = 0; i < FORMAT_BENCH_ITERATIONS; i++) {
+        struct bench_stamp start;
+
+        sink_value = value;
+
+        start = bench_start();
+        sprintf(buffer, "V: %0.2f V", sink_value);
+        bench_result_add(&sprintf_result, bench_stop(start));
+
+        start = bench_start();
+        fixed_format_field(buffer, sizeof(buffer), "V: ", fixed_from_double(sink_value, 2), 2, " V");
+        bench_result_add(&double_result, bench_stop(start));
+
+        start = bench_start();
+        fixed_format_field(buffer, sizeof(buffer), "V: ", fixed, 2, " V");
+        bench_result_add(&fixed_result, bench_stop(start));
+    }
+
+    snprintf(result_name, sizeof(result_name), "sprintf_%s", name);
+    bench_report("format", result_name, &sprintf_result);
+
+    snprintf(result_name, sizeof(result_name), "double_%s", name);
+    bench_report("format", result_name, &double_result);
+
+    snprintf(result_name, sizeof(result_name), "fixed_%s", name);
+    bench_report("format", result_name, &fixed_result);
+}
+
+void bench_format()
+{
+    bench_format_value("small", 0.05);
+    bench_format_value("mains", 230.4567);
+    bench_format_value("large", -12345.678);
+}
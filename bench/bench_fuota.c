@@ -0,0 +1,340 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+/*
+ * FragDecoder of the firmware update, per fragment: a file of up to 1024
+ * fragments as large as FRAG_MAX_SIZE, every n-th uncoded fragment lost,
+ * then parity fragments built as TS004 specifies until the decoder has
+ * recovered the lost ones. Reported separately are an uncoded fragment, a
+ * parity fragment that does not complete the file, and the one that does,
+ * which includes solving for the lost fragments.
+ *
+ * The file store is a stand-in that keeps the lost fragments only, the
+ * received ones are generated from their address, so the time is the
+ * decoder's own; the flash store adds a page program per fragment, see
+ * max_write_us of lorawan_fuota_get_stats(...). A comment line has the
+ * session and whether the recovered fragments match.
+ *
+ * With the update code at hand, pico_lorawan built with PICO_LORAWAN_FUOTA
+ * or the host build, also timed are a step of the Ed25519 signature check
+ * and the whole check of a short message, after the RFC 8032 test vectors
+ * and a changed message were checked, and a comment line has when the
+ * bootloader's watchdog resets an unconfirmed image that never joins.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "FragDecoder.h"
+
+#ifdef PICO_LORAWAN_FUOTA_APP_DATA_SECTORS
+#include "pico/lorawan_fuota.h"
+#include "pico/lorawan_fuota_ed25519.h"
+#endif
+
+#include "bench.h"
+
+#define FUOTA_BENCH_MAX_FRAGMENTS   1024
+
+#if (FRAG_MAX_NB < FUOTA_BENCH_MAX_FRAGMENTS)
+#define FUOTA_BENCH_FRAGMENTS       FRAG_MAX_NB
+#else
+#define FUOTA_BENCH_FRAGMENTS       FUOTA_BENCH_MAX_FRAGMENTS
+#endif
+
+#define FUOTA_BENCH_FRAGMENT_SIZE   FRAG_MAX_SIZE
+
+// half of what the decoder can recover, some parity fragments do not add
+// a new equation
+#define FUOTA_BENCH_LOST_MAX        ((FRAG_MAX_REDUNDANCY / 2 > 0) ? FRAG_MAX_REDUNDANCY / 2 : 1)
+#define FUOTA_BENCH_LOST_WANTED     ((FUOTA_BENCH_FRAGMENTS / 10 > 0) ? FUOTA_BENCH_FRAGMENTS / 10 : 1)
+#define FUOTA_BENCH_LOST            ((FUOTA_BENCH_LOST_WANTED < FUOTA_BENCH_LOST_MAX) ? FUOTA_BENCH_LOST_WANTED : FUOTA_BENCH_LOST_MAX)
+#define FUOTA_BENCH_LOSS_PERIOD     (FUOTA_BENCH_FRAGMENTS / FUOTA_BENCH_LOST)
+
+static uint8_t lost_store[FUOTA_BENCH_LOST][FUOTA_BENCH_FRAGMENT_SIZE];
+static uint8_t fragment[FUOTA_BENCH_FRAGMENT_SIZE];
+static uint8_t parity_row[FUOTA_BENCH_FRAGMENTS];
+static uint32_t store_errors;
+
+static uint8_t pattern(uint32_t addr)
+{
+    return (uint8_t)((addr * 31) ^ (addr >> 8) ^ 0x5a);
+}
+
+// lost fragment number of a file index, -1 if it was received
+static int lost_slot(uint32_t index)
+{
+    if ((index % FUOTA_BENCH_LOSS_PERIOD) != 0 || index / FUOTA_BENCH_LOSS_PERIOD >= FUOTA_BENCH_LOST) {
+        return -1;
+    }
+
+    return index / FUOTA_BENCH_LOSS_PERIOD;
+}
+
+static int8_t store_write(uint32_t addr, uint8_t* data, uint32_t size)
+{
+    for (uint32_t i = 0; i < size; i++) {
+        uint32_t a = addr + i;
+        int slot = lost_slot(a / FUOTA_BENCH_FRAGMENT_SIZE);
+
+        if (slot >= 0) {
+            lost_store[slot][a % FUOTA_BENCH_FRAGMENT_SIZE] = data[i];
+        } else if (size > 1 && data[i] != pattern(a)) {
+            // the decoder clears the file a byte at a time, otherwise it
+            // writes the received fragments as they are
+            store_errors++;
+        }
+    }
+
+    return 0;
+}
+
+static int8_t store_read(uint32_t addr, uint8_t* data, uint32_t size)
+{
+    for (uint32_t i = 0; i < size; i++) {
+        uint32_t a = addr + i;
+        int slot = lost_slot(a / FUOTA_BENCH_FRAGMENT_SIZE);
+
+        data[i] = (slot >= 0) ? lost_store[slot][a % FUOTA_BENCH_FRAGMENT_SIZE] : pattern(a);
+    }
+
+    return 0;
+}
+
+static FragDecoderCallbacks_t store_callbacks = {
+    .FragDecoderWrite = store_write,
+    .FragDecoderRead = store_read,
+};
+
+// Parity fragment n of TS004: m / 2 of the uncoded fragments picked by a
+// PRBS23 sequence seeded from n, XORed together
+static int32_t prbs23(int32_t x)
+{
+    return (x >> 1) + (((x & 1) ^ ((x & 0x20) >> 5)) << 22);
+}
+
+static void parity_fragment(uint32_t n, uint32_t m, uint8_t* data)
+{
+    int32_t m_temp = ((m & (m - 1)) == 0) ? 1 : 0;
+    int32_t x = 1 + 1001 * (int32_t)n;
+    uint32_t coefficients = 0;
+
+    memset(parity_row, 0, m);
+
+    while (coefficients < m / 2) {
+        int32_t r = 1 << 16;
+
+        while (r >= (int32_t)m) {
+            x = prbs23(x);
+            r = x % ((int32_t)m + m_temp);
+        }
+
+        parity_row[r] = 1;
+        coefficients++;
+    }
+
+    memset(data, 0, FUOTA_BENCH_FRAGMENT_SIZE);
+
+    for (uint32_t j = 0; j < m; j++) {
+        if (parity_row[j]) {
+            for (uint32_t i = 0; i < FUOTA_BENCH_FRAGMENT_SIZE; i++) {
+                data[i] ^= pattern(j * FUOTA_BENCH_FRAGMENT_SIZE + i);
+            }
+        }
+    }
+}
+
+#ifdef PICO_LORAWAN_FUOTA_APP_DATA_SECTORS
+// RFC 8032 section 7.1, tests 1 and 2
+struct signature_vector {
+    uint8_t public_key[LORAWAN_FUOTA_ED25519_KEY_SIZE];
+    uint8_t signature[LORAWAN_FUOTA_ED25519_SIGNATURE_SIZE];
+    uint8_t message_size;
+    uint8_t message[1];
+};
+
+static const struct signature_vector signature_vectors[] = {
+    {
+        { 0xd7, 0x5a, 0x98, 0x01, 0x82, 0xb1, 0x0a, 0xb7, 0xd5, 0x4b, 0xfe, 0xd3, 0xc9, 0x64, 0x07, 0x3a,
+          0x0e, 0xe1, 0x72, 0xf3, 0xda, 0xa6, 0x23, 0x25, 0xaf, 0x02, 0x1a, 0x68, 0xf7, 0x07, 0x51, 0x1a },
+        { 0xe5, 0x56, 0x43, 0x00, 0xc3, 0x60, 0xac, 0x72, 0x90, 0x86, 0xe2, 0xcc, 0x80, 0x6e, 0x82, 0x8a,
+          0x84, 0x87, 0x7f, 0x1e, 0xb8, 0xe5, 0xd9, 0x74, 0xd8, 0x73, 0xe0, 0x65, 0x22, 0x49, 0x01, 0x55,
+          0x5f, 0xb8, 0x82, 0x15, 0x90, 0xa3, 0x3b, 0xac, 0xc6, 0x1e, 0x39, 0x70, 0x1c, 0xf9, 0xb4, 0x6b,
+          0xd2, 0x5b, 0xf5, 0xf0, 0x59, 0x5b, 0xbe, 0x24, 0x65, 0x51, 0x41, 0x43, 0x8e, 0x7a, 0x10, 0x0b },
+        0, { 0 },
+    },
+    {
+        { 0x3d, 0x40, 0x17, 0xc3, 0xe8, 0x43, 0x89, 0x5a, 0x92, 0xb7, 0x0a, 0xa7, 0x4d, 0x1b, 0x7e, 0xbc,
+          0x9c, 0x98, 0x2c, 0xcf, 0x2e, 0xc4, 0x96, 0x8c, 0xc0, 0xcd, 0x55, 0xf1, 0x2a, 0xf4, 0x66, 0x0c },
+        { 0x92, 0xa0, 0x09, 0xa9, 0xf0, 0xd4, 0xca, 0xb8, 0x72, 0x0e, 0x82, 0x0b, 0x5f, 0x64, 0x25, 0x40,
+          0xa2, 0xb2, 0x7b, 0x54, 0x16, 0x50, 0x3f, 0x8f, 0xb3, 0x76, 0x22, 0x23, 0xeb, 0xdb, 0x69, 0xda,
+          0x08, 0x5a, 0xc1, 0xe4, 0x3e, 0x15, 0x99, 0x6e, 0x45, 0x8f, 0x36, 0x13, 0xd0, 0xf1, 0x1d, 0x8c,
+          0x38, 0x7b, 0x2e, 0xae, 0xb4, 0x30, 0x2a, 0xee, 0xb0, 0x0d, 0x29, 0x16, 0x12, 0xbb, 0x0c, 0x00 },
+        1, { 0x72 },
+    },
+};
+
+static struct lorawan_fuota_ed25519 signature_check;
+
+// 0 for a good signature, -1 otherwise, the steps timed into step_result
+static int check_signature(const struct signature_vector* vector, const uint8_t* message, struct bench_result* step_result)
+{
+    int result = lorawan_fuota_ed25519_start(&signature_check, vector->public_key, vector->signature);
+
+    if (result < 0) {
+        return -1;
+    }
+
+    lorawan_fuota_ed25519_update(&signature_check, message, vector->message_size);
+
+    do {
+        struct bench_stamp start = bench_start();
+        result = lorawan_fuota_ed25519_step(&signature_check);
+        bench_result_add(step_result, bench_stop(start));
+    } while (result > 0);
+
+    return result;
+}
+
+static void signature_check_bench()
+{
+    struct bench_result step_result;
+    struct bench_result check_result;
+    uint32_t wrong = 0;
+
+    bench_result_reset(&step_result);
+    bench_result_reset(&check_result);
+
+    for (uint32_t i = 0; i < sizeof(signature_vectors) / sizeof(signature_vectors[0]); i++) {
+        const struct signature_vector* vector = &signature_vectors[i];
+        uint8_t changed[1];
+
+        struct bench_stamp start = bench_start();
+        int result = check_signature(vector, vector->message, &step_result);
+        bench_result_add(&check_result, bench_stop(start));
+
+        if (result != 0) {
+            wrong++;
+        }
+
+        // the same signature over another message
+        changed[0] = vector->message[0] ^ 0x01;
+
+        if (vector->message_size > 0 && check_signature(vector, changed, &step_result) == 0) {
+            wrong++;
+        }
+    }
+
+    bench_report("fuota", "ed25519_step", &step_result);
+    bench_report("fuota", "ed25519_check", &check_result);
+
+    printf("# fuota: ed25519 RFC 8032 known answers and a changed message, %lu wrong%s\n",
+           (unsigned long)wrong, (wrong > 0) ? ", KNOWN ANSWER MISMATCH" : "");
+}
+
+// lorawan_process() calls from the join loop of an image that never joins,
+// every 100 ms from 2 s after boot, each one feeding the watchdog as
+// lorawan_fuota_feed_watchdog() does, until it expires
+static void watchdog_check()
+{
+    const uint64_t boot_us = 2000000;
+    const uint64_t limit_us = 2 * (uint64_t)LORAWAN_FUOTA_CONFIRM_TIMEOUT_MS * 1000;
+    uint64_t now_us = boot_us;
+    uint64_t fed_us = boot_us;
+
+    while (now_us - fed_us <= (uint64_t)LORAWAN_FUOTA_WATCHDOG_MS * 1000 && now_us - boot_us < limit_us) {
+        now_us += 100000;
+
+        if (!lorawan_fuota_confirm_expired(boot_us, now_us)) {
+            fed_us = now_us;
+        }
+    }
+
+    uint32_t reset_s = (uint32_t)((now_us - boot_us) / 1000000);
+    uint32_t confirm_s = LORAWAN_FUOTA_CONFIRM_TIMEOUT_MS / 1000;
+    const char* verdict = "";
+
+    if (now_us - boot_us >= limit_us) {
+        verdict = ", NOT RESET";
+    } else if (reset_s < confirm_s) {
+        verdict = ", RESET BEFORE THE TIME TO CONFIRM";
+    }
+
+    printf("# fuota: an unconfirmed image that never joins is reset by the watchdog after %lu s, %lu s to confirm%s\n",
+           (unsigned long)reset_s, (unsigned long)confirm_s, verdict);
+}
+#endif
+
+void bench_fuota()
+{
+    struct bench_result uncoded_result;
+    struct bench_result coded_result;
+    struct bench_result solve_result;
+    uint32_t parity = 0;
+    int32_t status = FRAG_SESSION_ONGOING;
+    uint32_t mismatches = 0;
+
+    bench_result_reset(&uncoded_result);
+    bench_result_reset(&coded_result);
+    bench_result_reset(&solve_result);
+
+    store_errors = 0;
+
+    FragDecoderInit(FUOTA_BENCH_FRAGMENTS, FUOTA_BENCH_FRAGMENT_SIZE, &store_callbacks);
+
+    for (uint32_t index = 0; index < FUOTA_BENCH_FRAGMENTS; index++) {
+        if (lost_slot(index) >= 0) {
+            continue;
+        }
+
+        for (uint32_t i = 0; i < FUOTA_BENCH_FRAGMENT_SIZE; i++) {
+            fragment[i] = pattern(index * FUOTA_BENCH_FRAGMENT_SIZE + i);
+        }
+
+        struct bench_stamp start = bench_start();
+        status = FragDecoderProcess(index + 1, fragment);
+        bench_result_add(&uncoded_result, bench_stop(start));
+    }
+
+    // the decoder keeps FRAG_MAX_REDUNDANCY parity fragments at most
+    while (status == FRAG_SESSION_ONGOING && parity < FRAG_MAX_REDUNDANCY) {
+        parity++;
+        parity_fragment(parity, FUOTA_BENCH_FRAGMENTS, fragment);
+
+        struct bench_stamp start = bench_start();
+        status = FragDecoderProcess(FUOTA_BENCH_FRAGMENTS + parity, fragment);
+        struct bench_elapsed elapsed = bench_stop(start);
+
+        bench_result_add((status == FRAG_SESSION_ONGOING) ? &coded_result : &solve_result, elapsed);
+    }
+
+    for (uint32_t slot = 0; slot < FUOTA_BENCH_LOST; slot++) {
+        uint32_t addr = slot * FUOTA_BENCH_LOSS_PERIOD * FUOTA_BENCH_FRAGMENT_SIZE;
+
+        for (uint32_t i = 0; i < FUOTA_BENCH_FRAGMENT_SIZE; i++) {
+            if (lost_store[slot][i] != pattern(addr + i)) {
+                mismatches++;
+                break;
+            }
+        }
+    }
+
+    bench_report("fuota", "fragment_uncoded", &uncoded_result);
+    bench_report("fuota", "fragment_parity", &coded_result);
+    bench_report("fuota", "fragment_parity_solve", &solve_result);
+
+    printf("# fuota: %lu fragments of %lu bytes, %lu lost, %lu parity fragments, %lu recovered fragments wrong, %lu store errors%s\n",
+           (unsigned long)FUOTA_BENCH_FRAGMENTS, (unsigned long)FUOTA_BENCH_FRAGMENT_SIZE,
+           (unsigned long)FUOTA_BENCH_LOST, (unsigned long)parity, (unsigned long)mismatches,
+           (unsigned long)store_errors,
+           (status == FRAG_SESSION_ONGOING) ? ", NOT COMPLETED" : "");
+
+#ifdef PICO_LORAWAN_FUOTA_APP_DATA_SECTORS
+    signature_check_bench();
+    watchdog_check();
+#endif
+}
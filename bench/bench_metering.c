@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+/*
+ * Cost of the metering code per sample, from a table source so the ADC
+ * conversion time (2 us per sample) is not included. "step" is the whole
+ * measure task of the example: current and voltage RMS, active, apparent
+ * and reactive power and power factor. "events" is the voltage loop read
+ * through the sag / swell detector, 32 samples per half cycle.
+ * "linearized" is the current loop reading the samples through an ADC
+ * linearization table. "circuits_3" is three circuits on one voltage in
+ * the same number of conversions as the step, per conversion.
+ * "registers_update" is one 1 s window added to the demand and
+ * time-of-use registers, over an hour of windows with a three tariff
+ * schedule, the max includes closing a subinterval and a block.
+ */
+
+#include <stdio.h>
+
+#include "meter/circuits.h"
+#include "meter/events.h"
+#include "meter/linearization.h"
+#include "meter/metering.h"
+#include "meter/registers.h"
+#include "meter/source.h"
+
+#include "bench.h"
+
+#define METERING_BENCH_ITERATIONS 5
+
+#define TABLE_SIZE 256
+
+#define MAX_SAMPLES 10000
+
+struct table_source {
+    uint16_t voltage[TABLE_SIZE];
+    uint16_t current[TABLE_SIZE];
+    uint8_t input;
+    uint32_t index;
+};
+
+static struct table_source table;
+
+static double current_samples[MAX_SAMPLES];
+static double voltage_samples[MAX_SAMPLES];
+
+static struct meter_events events;
+
+static float linearization[METER_LINEARIZATION_CODES];
+
+static struct meter_circuits circuits;
+
+static void table_select(void* context, uint8_t input)
+{
+    ((struct table_source*)context)->input = input;
+}
+
+static uint16_t table_read(void* context)
+{
+    struct table_source* t = (struct table_source*)context;
+    uint32_t i = t->index++ % TABLE_SIZE;
+
+    return (t->input == METER_INPUT_CURRENT) ? t->current[i] : t->voltage[i];
+}
+
+static const struct meter_source table_source = {
+    .select = table_select,
+    .read = table_read,
+    .context = &table,
+};
+
+static void table_init()
+{
+    struct meter_synth synth;
+    struct meter_source source;
+
+    // 4 cycles per table, 60 degree lag and a 3rd harmonic on the current
+    meter_synth_init(&synth, TABLE_SIZE, 4);
+    meter_synth_add_harmonic(&synth, 1, 1000, 500, 0);
+    meter_synth_add_harmonic(&synth, 3, 0, 100, 0);
+    synth.phase = 3.14159265358979323846 / 3;
+    meter_synth_source(&synth, &source);
+
+    meter_source_select(&source, METER_INPUT_VOLTAGE);
+    for (int i = 0; i < TABLE_SIZE; i++) {
+        table.voltage[i] = meter_source_read(&source);
+    }
+
+    synth.index = 0;
+    meter_source_select(&source, METER_INPUT_CURRENT);
+    for (int i = 0; i < TABLE_SIZE; i++) {
+        table.current[i] = meter_source_read(&source);
+    }
+}
+
+static void bench_step(uint32_t num_samples)
+{
+    struct bench_result current_result;
+    struct bench_result power_result;
+    struct bench_result step_result;
+    struct bench_result voltage_result;
+    struct bench_result events_result;
+    struct bench_result linearized_result;
+    struct bench_result circuits_result;
+    struct meter_source events_source;
+    struct meter_source linearized_source = table_source;
+    const struct meter_events_config events_config = {
+        .nominal_rms = 707,
+        .sag_permille = 900,
+        .swell_permille = 1100,
+        .interruption_permille = 100,
+        .hysteresis_permille = 20,
+        .zero_hysteresis = 8,
+        .capture_pre = METER_EVENTS_CAPTURE_SIZE / 4,
+    };
+    volatile double sink = 0;
+    char name[48];
+
+    bench_result_reset(&current_result);
+    bench_result_reset(&power_result);
+    bench_result_reset(&step_result);
+    bench_result_reset(&voltage_result);
+    bench_result_reset(&events_result);
+    bench_result_reset(&linearized_result);
+    bench_result_reset(&circuits_result);
+
+    meter_events_init(&events, &events_config);
+    meter_events_source(&events, &table_source, &events_source);
+    linearized_source.linearization = linearization;
+
+    // the DC filters carry on from window to window, as on the device
+    double current_offset = ADC_COUNTS >> 1;
+    double voltage_offset = ADC_COUNTS >> 1;
+
+    for (int i = 0; i < METERING_BENCH_ITERATIONS; i++) {
+        struct bench_stamp step_start = bench_start();
+
+        struct bench_stamp start = bench_start();
+        double current_rms = meter_current_get(&table_source, num_samples, 51.61, &current_offset, current_samples);
+        bench_result_add(&current_result, bench_stop(start));
+
+        double voltage_rms = meter_voltage_get(&table_source, num_samples, 897.6, &voltage_offset, voltage_samples);
+
+        start = bench_start();
+        double active_power = meter_calculate_power(voltage_samples, current_samples, num_samples, 897.6, 51.61);
+        bench_result_add(&power_result, bench_stop(start));
+
+        double apparent_power = meter_calculate_apparent_power(voltage_rms, current_rms);
+        double reactive_power = meter_calculate_reactive_power(apparent_power, active_power);
+        sink = meter_calculate_power_factor(active_power, apparent_power) + reactive_power;
+
+        bench_result_add(&step_result, bench_stop(step_start));
+
+        start = bench_start();
+        sink = meter_voltage_get(&table_source, num_samples, 897.6, &voltage_offset, voltage_samples);
+        bench_result_add(&voltage_result, bench_stop(start));
+
+        start = bench_start();
+        sink = meter_voltage_get(&events_source, num_samples, 897.6, &voltage_offset, voltage_samples);
+        bench_result_add(&events_result, bench_stop(start));
+
+        start = bench_start();
+        sink = meter_current_get(&linearized_source, num_samples, 51.61, &current_offset, current_samples);
+        bench_result_add(&linearized_result, bench_stop(start));
+
+        start = bench_start();
+        meter_circuits_measure(&circuits, &table_source, num_samples / 2, 897.6);
+        bench_result_add(&circuits_result, bench_stop(start));
+        sink = circuits.circuit[2].active_power;
+    }
+
+    (void)sink;
+
+    snprintf(name, sizeof(name), "current_get_%lu", (unsigned long)num_samples);
+    bench_report("metering", name, &current_result);
+    snprintf(name, sizeof(name), "current_get_%lu_per_sample", (unsigned long)num_samples);
+    bench_report_per("metering", name, &current_result, num_samples);
+
+    snprintf(name, sizeof(name), "power_%lu_per_sample", (unsigned long)num_samples);
+    bench_report_per("metering", name, &power_result, num_samples);
+
+    snprintf(name, sizeof(name), "step_%lu", (unsigned long)num_samples);
+    bench_report("metering", name, &step_result);
+    snprintf(name, sizeof(name), "step_%lu_per_sample", (unsigned long)num_samples);
+    bench_report_per("metering", name, &step_result, 2 * num_samples);
+
+    snprintf(name, sizeof(name), "voltage_get_%lu_per_sample", (unsigned long)num_samples);
+    bench_report_per("metering", name, &voltage_result, num_samples);
+    snprintf(name, sizeof(name), "voltage_get_%lu_events_per_sample", (unsigned long)num_samples);
+    bench_report_per("metering", name, &events_result, num_samples);
+    snprintf(name, sizeof(name), "current_get_%lu_linearized_per_sample", (unsigned long)num_samples);
+    bench_report_per("metering", name, &linearized_result, num_samples);
+    snprintf(name, sizeof(name), "circuits_3_%lu_per_sample", (unsigned long)num_samples);
+    bench_report_per("metering", name, &circuits_result, 2 * num_samples);
+}
+
+static void bench_registers()
+{
+    static struct meter_registers registers;
+    struct bench_result result;
+    const struct meter_tou_schedule schedule = {
+        .utc_offset_min = -300,
+        .count = { 3, 1 },
+        .minute = { { 0, 7 * 60, 19 * 60 }, { 0 } },
+        .tariff = { { 0, 1, 0 }, { 2 } },
+    };
+    uint32_t time = 1704067200;     // 2024-01-01 00:00 UTC
+    volatile uint32_t sink = 0;
+
+    meter_registers_init(&registers, 900);
+    meter_registers_set_schedule(&registers, &schedule);
+    bench_result_reset(&result);
+
+    for (uint32_t i = 0; i < 3600; i++) {
+        int32_t power_mw = 1000000 + (int32_t)(i % 600) * 1000;
+
+        struct bench_stamp start = bench_start();
+        sink += meter_registers_update(&registers, time + i, power_mw, 1000);
+        bench_result_add(&result, bench_stop(start));
+    }
+
+    (void)sink;
+
+    bench_report("metering", "registers_update", &result);
+}
+
+void bench_metering()
+{
+    table_init();
+    meter_linearization_identity(linearization);
+
+    meter_circuits_init(&circuits, 3);
+    for (int i = 0; i < 3; i++) {
+        circuits.circuit[i].current_calibration = 51.61;
+    }
+
+    bench_step(1000);
+    bench_step(MAX_SAMPLES);
+
+    bench_registers();
+}
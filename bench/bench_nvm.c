@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+/*
+ * Cost of the NVM writes the MAC makes through LmHandler: updating the RAM
+ * copy of the NVM sector and EepromMcuFlush(), a 4 kB flash erase and
+ * program with interrupts disabled.
+ *
+ * The sector is loaded first and written back unchanged, so the stored
+ * LoRaWAN context survives. Few iterations, every flush is a flash erase
+ * cycle.
+ *
+ * On the host the flash is emulated in RAM, see host/board_stub.c.
+ */
+
+#include <stdio.h>
+
+#ifdef BENCH_HOST
+#include "board_stub.h"
+#else
+#include "eeprom-board.h"
+#endif
+
+#include "bench.h"
+
+#define NVM_BENCH_ITERATIONS 5
+
+// board functions with no prototype in the LoRaMac headers
+extern void EepromMcuInit();
+extern uint8_t EepromMcuFlush();
+
+// about the size of the LoRaMac NVM context groups written on every uplink
+#define NVM_UPDATE_SIZE 256
+
+void bench_nvm()
+{
+    struct bench_result update_result;
+    struct bench_result flush_result;
+    static uint8_t data[NVM_UPDATE_SIZE];
+
+    bench_result_reset(&update_result);
+    bench_result_reset(&flush_result);
+
+    EepromMcuInit();
+
+    for (int i = 0; i < NVM_BENCH_ITERATIONS; i++) {
+        struct bench_stamp start;
+
+        // read and write back the same bytes
+        EepromMcuReadBuffer(0, data, sizeof(data));
+
+        start = bench_start();
+        EepromMcuWriteBuffer(0, data, sizeof(data));
+        bench_result_add(&update_result, bench_stop(start));
+
+        start = bench_start();
+        EepromMcuFlush();
+        bench_result_add(&flush_result, bench_stop(start));
+    }
+
+    bench_report("nvm", "write_buffer_256", &update_result);
+    bench_report("nvm", "flush", &flush_result);
+}
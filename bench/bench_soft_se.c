@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+/*
+ * Per-frame cost of the soft-se crypto, issued the same way LoRaMacCrypto.c
+ * drives the secure element: one AES-CMAC over B0 plus the frame for the
+ * MIC, and one aes_set_key + aes_encrypt per 16 byte payload block.
+ *
+ * The "cold" variants flush the key schedule cache before every frame,
+ * which is what every frame cost before the cache existed.
+ *
+ * The known answers of FIPS-197 (AES-128) and RFC 4493 (AES-CMAC) are
+ * checked first, with a cold and a warm key schedule cache.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "aes.h"
+#include "cmac.h"
+
+#ifdef PICO_LORAWAN_FAST_SOFT_SE
+#include "aes-key-cache.h"
+#endif
+
+#include "bench.h"
+
+#define SOFT_SE_BENCH_ITERATIONS 100
+
+// MHDR + DevAddr + FCtrl + FCnt + FPort
+#define FRAME_HEADER_SIZE 9
+
+static const uint8_t app_s_key[16] = {
+    0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c
+};
+
+static const uint8_t nwk_s_key[16] = {
+    0x3c, 0x4f, 0xcf, 0x09, 0x88, 0x15, 0xf7, 0xab, 0xa6, 0xd2, 0xae, 0x28, 0x16, 0x15, 0x7e, 0x2b
+};
+
+static uint8_t frame[FRAME_HEADER_SIZE + 242];
+
+struct aes_known_answer {
+    uint8_t key[16];
+    uint8_t plaintext[16];
+    uint8_t ciphertext[16];
+};
+
+// FIPS-197 appendix B and C.1
+static const struct aes_known_answer aes_known_answers[] = {
+    {
+        { 0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c },
+        { 0x32, 0x43, 0xf6, 0xa8, 0x88, 0x5a, 0x30, 0x8d, 0x31, 0x31, 0x98, 0xa2, 0xe0, 0x37, 0x07, 0x34 },
+        { 0x39, 0x25, 0x84, 0x1d, 0x02, 0xdc, 0x09, 0xfb, 0xdc, 0x11, 0x85, 0x97, 0x19, 0x6a, 0x0b, 0x32 },
+    },
+    {
+        { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f },
+        { 0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff },
+        { 0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30, 0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a },
+    },
+};
+
+// RFC 4493 section 4, all with the key of app_s_key, on the first 0, 16,
+// 40 and 64 bytes of the message
+static const uint8_t cmac_message[64] = {
+    0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a,
+    0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c, 0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51,
+    0x30, 0xc8, 0x1c, 0x46, 0xa3, 0x5c, 0xe4, 0x11, 0xe5, 0xfb, 0xc1, 0x19, 0x1a, 0x0a, 0x52, 0xef,
+    0xf6, 0x9f, 0x24, 0x45, 0xdf, 0x4f, 0x9b, 0x17, 0xad, 0x2b, 0x41, 0x7b, 0xe6, 0x6c, 0x37, 0x10,
+};
+
+struct cmac_known_answer {
+    uint32_t length;
+    uint8_t mac[16];
+};
+
+static const struct cmac_known_answer cmac_known_answers[] = {
+    { 0, { 0xbb, 0x1d, 0x69, 0x29, 0xe9, 0x59, 0x37, 0x28, 0x7f, 0xa3, 0x7d, 0x12, 0x9b, 0x75, 0x67, 0x46 } },
+    { 16, { 0x07, 0x0a, 0x16, 0xb4, 0x6b, 0x4d, 0x41, 0x44, 0xf7, 0x9b, 0xdd, 0x9d, 0xd0, 0x4a, 0x28, 0x7c } },
+    { 40, { 0xdf, 0xa6, 0x67, 0x47, 0xde, 0x9a, 0xe6, 0x30, 0x30, 0xca, 0x32, 0x61, 0x14, 0x97, 0xc8, 0x27 } },
+    { 64, { 0x51, 0xf0, 0xbe, 0xbf, 0x7e, 0x3b, 0x9d, 0x92, 0xfc, 0x49, 0x74, 0x17, 0x79, 0x36, 0x3c, 0xfe } },
+};
+
+static void frame_mic(const uint8_t* key, const uint8_t* msg, uint16_t size, uint32_t* mic)
+{
+    AES_CMAC_CTX ctx;
+    uint8_t b0[16] = { 0x49 };
+    uint8_t cmac[16];
+
+    b0[15] = (uint8_t)size;
+
+    AES_CMAC_Init(&ctx);
+    AES_CMAC_SetKey(&ctx, key);
+    AES_CMAC_Update(&ctx, b0, sizeof(b0));
+    AES_CMAC_Update(&ctx, msg, size);
+    AES_CMAC_Final(cmac, &ctx);
+
+    *mic = (uint32_t)cmac[0] | ((uint32_t)cmac[1] << 8) | ((uint32_t)cmac[2] << 16) | ((uint32_t)cmac[3] << 24);
+}
+
+static void frame_payload_crypt(const uint8_t* key, uint8_t* buffer, uint16_t size, uint8_t dir)
+{
+    aes_context ctx;
+    uint8_t a_block[16] = { 0x01 };
+    uint8_t s_block[16];
+    uint8_t ctr = 1;
+
+    a_block[5] = dir;
+
+    while (size > 0) {
+        a_block[15] = ctr++;
+
+        // LoRaMacCrypto hands each block to the secure element separately,
+        // which sets the key every time
+        aes_set_key(key, 16, &ctx);
+        aes_encrypt(a_block, s_block, &ctx);
+
+        uint16_t n = (size > 16) ? 16 : size;
+
+        for (uint16_t i = 0; i < n; i++) {
+            buffer[i] ^= s_block[i];
+        }
+
+        buffer += n;
+        size -= n;
+    }
+}
+
+static void flush(int cold)
+{
+#ifdef PICO_LORAWAN_FAST_SOFT_SE
+    if (cold) {
+        AesKeyCacheFlush();
+    }
+#else
+    (void)cold;
+#endif
+}
+
+// Every vector cold and warm, the CMAC ones also with the message in
+// uneven parts; returns the number of wrong answers
+static uint32_t check_known_answers(uint32_t* checked)
+{
+    uint32_t wrong = 0;
+
+    *checked = 0;
+
+    for (int cold = 1; cold >= 0; cold--) {
+        for (size_t i = 0; i < sizeof(aes_known_answers) / sizeof(aes_known_answers[0]); i++) {
+            const struct aes_known_answer* answer = &aes_known_answers[i];
+            aes_context ctx;
+            uint8_t out[16];
+
+            flush(cold);
+            aes_set_key(answer->key, 16, &ctx);
+            aes_encrypt(answer->plaintext, out, &ctx);
+
+            wrong += (memcmp(out, answer->ciphertext, sizeof(out)) != 0);
+            (*checked)++;
+        }
+
+        for (size_t i = 0; i < sizeof(cmac_known_answers) / sizeof(cmac_known_answers[0]); i++) {
+            const struct cmac_known_answer* answer = &cmac_known_answers[i];
+
+            for (uint32_t part = 0; part <= 7; part += 7) {
+                AES_CMAC_CTX ctx;
+                uint8_t mac[16];
+                uint32_t offset = 0;
+
+                flush(cold);
+                AES_CMAC_Init(&ctx);
+                AES_CMAC_SetKey(&ctx, app_s_key);
+
+                // whole, or parts of 7, 14, 21, ... bytes
+                for (uint32_t n = part; offset < answer->length; n += part) {
+                    uint32_t length = answer->length - offset;
+
+                    if (n != 0 && n < length) {
+                        length = n;
+                    }
+
+                    AES_CMAC_Update(&ctx, cmac_message + offset, length);
+                    offset += length;
+                }
+
+                AES_CMAC_Final(mac, &ctx);
+
+                wrong += (memcmp(mac, answer->mac, sizeof(mac)) != 0);
+                (*checked)++;
+            }
+        }
+    }
+
+    return wrong;
+}
+
+static void bench_frame(uint16_t payload_size, int cold)
+{
+    struct bench_result mic_result;
+    struct bench_result encrypt_result;
+    struct bench_result decrypt_result;
+    uint16_t frame_size = FRAME_HEADER_SIZE + payload_size;
+    uint32_t mic = 0;
+    char name[32];
+
+    bench_result_reset(&mic_result);
+    bench_result_reset(&encrypt_result);
+    bench_result_reset(&decrypt_result);
+
+    for (uint16_t i = 0; i < frame_size; i++) {
+        frame[i] = (uint8_t)i;
+    }
+
+    for (int i = 0; i < SOFT_SE_BENCH_ITERATIONS; i++) {
+        struct bench_stamp start;
+
+        flush(cold);
+        start = bench_start();
+        frame_payload_crypt(app_s_key, frame + FRAME_HEADER_SIZE, payload_size, 0);
+        bench_result_add(&encrypt_result, bench_stop(start));
+
+        flush(cold);
+        start = bench_start();
+        frame_mic(nwk_s_key, frame, frame_size, &mic);
+        bench_result_add(&mic_result, bench_stop(start));
+
+        // Downlink: MIC check followed by payload decryption
+        flush(cold);
+        start = bench_start();
+        uint32_t expected = mic;
+        frame_mic(nwk_s_key, frame, frame_size, &mic);
+        if (mic == expected) {
+            frame_payload_crypt(app_s_key, frame + FRAME_HEADER_SIZE, payload_size, 1);
+        }
+        bench_result_add(&decrypt_result, bench_stop(start));
+    }
+
+    snprintf(name, sizeof(name), "mic_%u_%s", payload_size, cold ? "cold" : "warm");
+    bench_report("soft_se", name, &mic_result);
+
+    snprintf(name, sizeof(name), "encrypt_%u_%s", payload_size, cold ? "cold" : "warm");
+    bench_report("soft_se", name, &encrypt_result);
+
+    snprintf(name, sizeof(name), "decrypt_%u_%s", payload_size, cold ? "cold" : "warm");
+    bench_report("soft_se", name, &decrypt_result);
+}
+
+void bench_soft_se()
+{
+    uint32_t checked;
+    uint32_t wrong = check_known_answers(&checked);
+
+    printf("# soft_se: %lu FIPS-197 and RFC 4493 known answers, %lu wrong%s\n",
+           (unsigned long)checked, (unsigned long)wrong, wrong ? ", KNOWN ANSWER MISMATCH" : "");
+
+    bench_frame(48, 1);
+    bench_frame(48, 0);
+    bench_frame(222, 1);
+    bench_frame(222, 0);
+}
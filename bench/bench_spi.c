@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+/*
+ * SX1276 register and FIFO access over SPI, through the same driver calls
+ * the MAC uses: a register read / write is three SpiInOut() bytes framed
+ * by NSS, a FIFO load is one address byte plus the payload.
+ *
+ * On the host the radio is a register file in RAM, see host/board_stub.c.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef BENCH_HOST
+#include "board_stub.h"
+#else
+#include "pico/stdlib.h"
+#include "sx1276-board.h"
+#endif
+
+#include "bench.h"
+
+#define SPI_BENCH_ITERATIONS 100
+
+#define REG_FIFO            0x00
+#define REG_FIFO_ADDR_PTR   0x0d
+#define REG_VERSION         0x42
+
+// Radio wiring of the current_voltage_sensor example
+#ifndef BENCH_SX1276_NSS
+#define BENCH_SX1276_NSS    8
+#define BENCH_SX1276_RESET  9
+#define BENCH_SX1276_DIO0   7
+#define BENCH_SX1276_DIO1   10
+#endif
+
+static uint8_t fifo_data[255];
+
+static void radio_init()
+{
+#ifndef BENCH_HOST
+    // as lorawan_init(), without starting the MAC
+    SpiInit(&SX1276.Spi, (SpiId_t)PICO_DEFAULT_SPI,
+            PICO_DEFAULT_SPI_TX_PIN, PICO_DEFAULT_SPI_RX_PIN, PICO_DEFAULT_SPI_SCK_PIN, NC);
+
+    SX1276.Spi.Nss.pin = BENCH_SX1276_NSS;
+    SX1276.Reset.pin = BENCH_SX1276_RESET;
+    SX1276.DIO0.pin = BENCH_SX1276_DIO0;
+    SX1276.DIO1.pin = BENCH_SX1276_DIO1;
+
+    SX1276IoInit();
+#endif
+}
+
+static void bench_fifo(const char* name, uint8_t size, int write)
+{
+    struct bench_result result;
+
+    bench_result_reset(&result);
+
+    for (int i = 0; i < SPI_BENCH_ITERATIONS; i++) {
+        SX1276Write(REG_FIFO_ADDR_PTR, 0);
+
+        struct bench_stamp start = bench_start();
+        if (write) {
+            SX1276WriteBuffer(REG_FIFO, fifo_data, size);
+        } else {
+            SX1276ReadBuffer(REG_FIFO, fifo_data, size);
+        }
+        bench_result_add(&result, bench_stop(start));
+    }
+
+    char per_byte[32];
+
+    bench_report("spi", name, &result);
+
+    snprintf(per_byte, sizeof(per_byte), "%s_per_byte", name);
+    bench_report_per("spi", per_byte, &result, size);
+}
+
+void bench_spi()
+{
+    struct bench_result read_result;
+    struct bench_result write_result;
+    volatile uint8_t version = 0;
+
+    radio_init();
+
+    for (size_t i = 0; i < sizeof(fifo_data); i++) {
+        fifo_data[i] = (uint8_t)i;
+    }
+
+    bench_result_reset(&read_result);
+    bench_result_reset(&write_result);
+
+    for (int i = 0; i < SPI_BENCH_ITERATIONS; i++) {
+        struct bench_stamp start = bench_start();
+        version = SX1276Read(REG_VERSION);
+        bench_result_add(&read_result, bench_stop(start));
+
+        start = bench_start();
+        SX1276Write(REG_FIFO_ADDR_PTR, 0);
+        bench_result_add(&write_result, bench_stop(start));
+    }
+
+    (void)version;
+
+    bench_report("spi", "register_read", &read_result);
+    bench_report("spi", "register_write", &write_result);
+
+    bench_fifo("fifo_write_64", 64, 1);
+    bench_fifo("fifo_write_255", 255, 1);
+    bench_fifo("fifo_read_64", 64, 0);
+}
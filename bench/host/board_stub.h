@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#ifndef _BOARD_STUB_H_
+#define _BOARD_STUB_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+// Host stand-ins for the board functions the benchmark bodies call: the
+// SX1276 as a register file with a FIFO, and the NVM flash sector in RAM.
+
+#define SUCCESS 1
+
+void SX1276Write(uint32_t addr, uint8_t data);
+
+uint8_t SX1276Read(uint32_t addr);
+
+void SX1276WriteBuffer(uint32_t addr, uint8_t* buffer, uint8_t size);
+
+void SX1276ReadBuffer(uint32_t addr, uint8_t* buffer, uint8_t size);
+
+uint8_t EepromMcuReadBuffer(uint16_t addr, uint8_t* buffer, uint16_t size);
+
+uint8_t EepromMcuWriteBuffer(uint16_t addr, uint8_t* buffer, uint16_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ * Host stand-in for the parts of the Pico SDK DMA API used by MeterDisplay,
+ * a transfer reads its whole buffer at once and completes immediately.
+ */
+
+#ifndef _HARDWARE_DMA_H
+#define _HARDWARE_DMA_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+enum dma_channel_transfer_size {
+    DMA_SIZE_8 = 0,
+    DMA_SIZE_16 = 1,
+    DMA_SIZE_32 = 2
+};
+
+typedef struct {
+    uint32_t ctrl;
+} dma_channel_config;
+
+typedef struct {
+    volatile uint32_t ints1;
+} dma_hw_t;
+
+extern dma_hw_t* const dma_hw;
+
+// last word written by a transfer, keeps the copy from being optimized out
+extern volatile uint32_t dma_stub_sink;
+
+static inline int dma_claim_unused_channel(bool required)
+{
+    (void)required;
+
+    return 0;
+}
+
+static inline void dma_channel_unclaim(unsigned int channel)
+{
+    (void)channel;
+}
+
+static inline dma_channel_config dma_channel_get_default_config(unsigned int channel)
+{
+    dma_channel_config config = { channel };
+
+    return config;
+}
+
+static inline void channel_config_set_transfer_data_size(dma_channel_config* c, enum dma_channel_transfer_size size)
+{
+    (void)c;
+    (void)size;
+}
+
+static inline void channel_config_set_read_increment(dma_channel_config* c, bool incr)
+{
+    (void)c;
+    (void)incr;
+}
+
+static inline void channel_config_set_write_increment(dma_channel_config* c, bool incr)
+{
+    (void)c;
+    (void)incr;
+}
+
+static inline void channel_config_set_dreq(dma_channel_config* c, unsigned int dreq)
+{
+    (void)c;
+    (void)dreq;
+}
+
+static inline void dma_channel_configure(unsigned int channel, const dma_channel_config* config, volatile void* write_addr,
+                                         const volatile void* read_addr, unsigned int transfer_count, bool trigger)
+{
+    (void)channel;
+    (void)config;
+    (void)write_addr;
+    (void)read_addr;
+    (void)transfer_count;
+    (void)trigger;
+}
+
+static inline void dma_channel_set_irq1_enabled(unsigned int channel, bool enabled)
+{
+    (void)channel;
+    (void)enabled;
+}
+
+static inline void dma_channel_transfer_from_buffer_now(unsigned int channel, const volatile void* read_addr, uint32_t transfer_count)
+{
+    const volatile uint16_t* words = (const volatile uint16_t*)read_addr;
+
+    (void)channel;
+
+    for (uint32_t i = 0; i < transfer_count; i++) {
+        dma_stub_sink = words[i];
+    }
+}
+
+static inline bool dma_channel_is_busy(unsigned int channel)
+{
+    (void)channel;
+
+    return false;
+}
+
+static inline void dma_channel_abort(unsigned int channel)
+{
+    (void)channel;
+}
+
+#endif
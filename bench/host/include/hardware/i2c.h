@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ * Host stand-in for the parts of the Pico SDK I2C API used by MeterDisplay,
+ * the controller is always idle.
+ */
+
+#ifndef _HARDWARE_I2C_H
+#define _HARDWARE_I2C_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define I2C_IC_DATA_CMD_STOP_BITS       0x00000200
+#define I2C_IC_STATUS_TFE_BITS          0x00000004
+#define I2C_IC_STATUS_MST_ACTIVITY_BITS 0x00000020
+
+typedef struct {
+    volatile uint32_t enable;
+    volatile uint32_t tar;
+    volatile uint32_t data_cmd;
+    volatile uint32_t status;
+    volatile uint32_t tx_abrt_source;
+    volatile uint32_t clr_tx_abrt;
+} i2c_hw_t;
+
+typedef struct i2c_inst {
+    i2c_hw_t hw;
+} i2c_inst_t;
+
+extern i2c_inst_t i2c0_inst;
+
+#define i2c0 (&i2c0_inst)
+
+static inline i2c_hw_t* i2c_get_hw(i2c_inst_t* i2c)
+{
+    return &i2c->hw;
+}
+
+static inline unsigned int i2c_get_dreq(i2c_inst_t* i2c, bool is_tx)
+{
+    (void)i2c;
+    (void)is_tx;
+
+    return 0;
+}
+
+#endif
@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ * Host stand-in for the parts of the Pico SDK IRQ API used by MeterDisplay,
+ * interrupts never fire.
+ */
+
+#ifndef _HARDWARE_IRQ_H
+#define _HARDWARE_IRQ_H
+
+#include <stdbool.h>
+
+#define DMA_IRQ_1 12
+#define PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY 0x80
+
+typedef void (*irq_handler_t)(void);
+
+static inline void irq_add_shared_handler(unsigned int num, irq_handler_t handler, unsigned char order_priority)
+{
+    (void)num;
+    (void)handler;
+    (void)order_priority;
+}
+
+static inline void irq_remove_handler(unsigned int num, irq_handler_t handler)
+{
+    (void)num;
+    (void)handler;
+}
+
+static inline void irq_set_enabled(unsigned int num, bool enabled)
+{
+    (void)num;
+    (void)enabled;
+}
+
+#endif
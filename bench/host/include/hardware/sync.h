@@ -0,0 +1,20 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ * Host stand-in for the parts of the Pico SDK sync API used by MeterDisplay.
+ */
+
+#ifndef _HARDWARE_SYNC_H
+#define _HARDWARE_SYNC_H
+
+static inline void __sev(void)
+{
+}
+
+static inline void tight_loop_contents(void)
+{
+}
+
+#endif
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ * Runs the benchmark bodies and prints one BENCH,... line per result.
+ */
+
+#include <stdio.h>
+
+#ifndef BENCH_HOST
+#include "pico/stdlib.h"
+#include "tusb.h"
+#endif
+
+#include "bench.h"
+
+int main(void)
+{
+#ifndef BENCH_HOST
+    // initialize stdio and wait for USB CDC connect
+    stdio_init_all();
+
+    while (!tud_cdc_connected()) {
+        tight_loop_contents();
+    }
+#endif
+
+    bench_init();
+
+    printf("BENCH,group,name,iterations,min,mean,max,unit\n");
+
+    bench_soft_se();
+    bench_format();
+    bench_spi();
+    bench_nvm();
+    bench_metering();
+    bench_codec();
+    bench_display();
+    bench_fuota();
+
+    printf("BENCH,done\n");
+
+#ifndef BENCH_HOST
+    while (1) {
+        tight_loop_contents();
+    }
+#endif
+
+    return 0;
+}
@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ * Firmware update bootloader: finishes a pending swap of the application
+ * and staging slots, counts the boots of an unconfirmed image and restores
+ * the previous one after LORAWAN_FUOTA_BOOT_ATTEMPTS, then starts the
+ * application. Without a valid application it waits in BOOTSEL mode.
+ */
+
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "pico/bootrom.h"
+#include "pico/lorawan_fuota_boot.h"
+
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+#include "hardware/watchdog.h"
+#include "hardware/regs/m0plus.h"
+#include "hardware/structs/scb.h"
+
+static uint8_t sector_buffer[FLASH_SECTOR_SIZE];
+
+void lorawan_fuota_flash_erase(uint32_t offset)
+{
+    uint32_t interrupts = save_and_disable_interrupts();
+
+    flash_range_erase(offset, FLASH_SECTOR_SIZE);
+
+    restore_interrupts(interrupts);
+}
+
+void lorawan_fuota_flash_program(uint32_t offset, const uint8_t* data, uint32_t length)
+{
+    uint32_t interrupts = save_and_disable_interrupts();
+
+    flash_range_program(offset, data, length);
+
+    restore_interrupts(interrupts);
+}
+
+static const uint8_t* flash_address(uint32_t offset)
+{
+    return (const uint8_t*)(XIP_BASE + offset);
+}
+
+static void copy_sector(uint32_t to, uint32_t from)
+{
+    memcpy(sector_buffer, flash_address(from), FLASH_SECTOR_SIZE);
+
+    // repeated after a reset, already done then
+    if (memcmp(flash_address(to), sector_buffer, FLASH_SECTOR_SIZE) == 0) {
+        return;
+    }
+
+    lorawan_fuota_flash_erase(to);
+    lorawan_fuota_flash_program(to, sector_buffer, FLASH_SECTOR_SIZE);
+}
+
+// Exchanges the application and staging slots from record->sector on,
+// logging each step: the scratch sector holds the application sector until
+// the staging sector has it, so a reset repeats at most the current step
+static void swap(struct lorawan_fuota_record* record)
+{
+    while (record->sector < record->sectors) {
+        uint32_t app = LORAWAN_FUOTA_APP_OFFSET + record->sector * FLASH_SECTOR_SIZE;
+        uint32_t staging = LORAWAN_FUOTA_STAGING_OFFSET + record->sector * FLASH_SECTOR_SIZE;
+
+        if (record->step == LORAWAN_FUOTA_STEP_NONE &&
+            memcmp(flash_address(app), flash_address(staging), FLASH_SECTOR_SIZE) == 0) {
+            record->sector++;
+            continue;
+        }
+
+        if (record->step < LORAWAN_FUOTA_STEP_SCRATCH) {
+            copy_sector(LORAWAN_FUOTA_SCRATCH_OFFSET, app);
+            record->step = LORAWAN_FUOTA_STEP_SCRATCH;
+            lorawan_fuota_state_write(record);
+        }
+
+        if (record->step < LORAWAN_FUOTA_STEP_APP) {
+            copy_sector(app, staging);
+            record->step = LORAWAN_FUOTA_STEP_APP;
+            lorawan_fuota_state_write(record);
+        }
+
+        copy_sector(staging, LORAWAN_FUOTA_SCRATCH_OFFSET);
+
+        // before the scratch sector is reused for the next one
+        record->sector++;
+        record->step = LORAWAN_FUOTA_STEP_NONE;
+        lorawan_fuota_state_write(record);
+    }
+}
+
+static bool image_valid(uint32_t size, uint32_t crc)
+{
+    return size <= LORAWAN_FUOTA_SLOT_SIZE &&
+           lorawan_fuota_crc32(0, flash_address(LORAWAN_FUOTA_APP_OFFSET), size) == crc;
+}
+
+static void rollback(struct lorawan_fuota_record* record)
+{
+    if (record->state != LORAWAN_FUOTA_BOOT_ROLLBACK) {
+        record->state = LORAWAN_FUOTA_BOOT_ROLLBACK;
+        record->step = LORAWAN_FUOTA_STEP_NONE;
+        record->sector = 0;
+        lorawan_fuota_state_write(record);
+    }
+
+    swap(record);
+
+    record->state = LORAWAN_FUOTA_BOOT_NONE;
+    record->result = LORAWAN_FUOTA_RESULT_ROLLED_BACK;
+    record->boots = 0;
+    lorawan_fuota_state_write(record);
+
+    // the image that was running before the update, as it was
+    if (!image_valid(record->previous_size, record->previous_crc)) {
+        reset_usb_boot(0, 0);
+    }
+}
+
+static void install(struct lorawan_fuota_record* record)
+{
+    swap(record);
+
+    if (!image_valid(record->image_size, record->image_crc)) {
+        rollback(record);
+        return;
+    }
+
+    record->state = LORAWAN_FUOTA_BOOT_TESTING;
+    record->boots = 0;
+    lorawan_fuota_state_write(record);
+}
+
+static const uint32_t* app_vectors()
+{
+    return (const uint32_t*)(XIP_BASE + LORAWAN_FUOTA_APP_OFFSET + LORAWAN_FUOTA_VECTOR_OFFSET);
+}
+
+static bool app_present()
+{
+    const uint32_t* vectors = app_vectors();
+    uint32_t stack = vectors[0];
+    uint32_t reset = vectors[1];
+
+    return stack > SRAM_BASE && stack <= SRAM_END &&
+           reset > XIP_BASE + LORAWAN_FUOTA_APP_OFFSET &&
+           reset < XIP_BASE + LORAWAN_FUOTA_APP_OFFSET + LORAWAN_FUOTA_SLOT_SIZE;
+}
+
+static void __attribute__((noreturn)) start_app()
+{
+    const uint32_t* vectors = app_vectors();
+
+    scb_hw->vtor = (uintptr_t)vectors;
+
+    __asm volatile (
+        "msr msp, %0\n"
+        "bx %1\n"
+        :
+        : "r" (vectors[0]), "r" (vectors[1])
+    );
+
+    __builtin_unreachable();
+}
+
+int main(void)
+{
+    struct lorawan_fuota_record record;
+
+    if (lorawan_fuota_state_read(&record)) {
+        switch (record.state) {
+            case LORAWAN_FUOTA_BOOT_INSTALL:
+                install(&record);
+                break;
+
+            case LORAWAN_FUOTA_BOOT_ROLLBACK:
+                rollback(&record);
+                break;
+
+            default:
+                break;
+        }
+
+        if (record.state == LORAWAN_FUOTA_BOOT_TESTING) {
+            if (record.boots >= LORAWAN_FUOTA_BOOT_ATTEMPTS) {
+                rollback(&record);
+            } else {
+                record.boots++;
+                lorawan_fuota_state_write(&record);
+
+                // a hang before lorawan_fuota_init(...) or the confirmation
+                // resets into the next attempt
+                watchdog_enable(LORAWAN_FUOTA_WATCHDOG_MS, true);
+            }
+        }
+    }
+
+    if (!app_present()) {
+        reset_usb_boot(0, 0);
+    }
+
+    // nothing the bootloader's runtime enabled may interrupt the application
+    // before it has set up its own handlers
+    *(io_rw_32*)(PPB_BASE + M0PLUS_NVIC_ICER_OFFSET) = 0xffffffff;
+    *(io_rw_32*)(PPB_BASE + M0PLUS_NVIC_ICPR_OFFSET) = 0xffffffff;
+
+    start_app();
+}
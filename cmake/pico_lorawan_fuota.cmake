@@ -0,0 +1,66 @@
+# pico_lorawan_fuota_app(<target>)
+# pico_lorawan_fuota_bootloader(<target>)
+#
+# Link <target> for the flash layout of pico/lorawan_fuota_boot.h: an
+# application at the application slot, behind the bootloader, or the
+# bootloader itself in front of it. Both generate a copy of the SDK's
+# memmap_default.ld with the FLASH region moved, next to the build files of
+# <target>. An application linked like this runs only under
+# pico_lorawan_bootloader, load the bootloader .uf2 once, then the
+# application .uf2 or an update file, see tools/fuota.py.
+#
+# PICO_LORAWAN_FUOTA_FLASH_SIZE has to match PICO_FLASH_SIZE_BYTES of the
+# board, lorawan_fuota.c checks that the slot size agrees.
+#
+# PICO_LORAWAN_FUOTA_APP_DATA_SECTORS are kept at the end of the flash for
+# the applications' data, behind the swap scratch and state sectors, and
+# passed to pico/lorawan_fuota_boot.h through pico_lorawan and the
+# bootloader target. The slots follow from it: a bootloader installs only
+# applications built with the same value. The default covers the
+# current_voltage_sensor example, its ADC linearization, configuration and
+# billing registers, and the LoRaWAN NVM.
+
+set(PICO_LORAWAN_FUOTA_FLASH_SIZE 2097152 CACHE STRING "Flash size of the board in bytes, for the firmware update slots")
+set(PICO_LORAWAN_FUOTA_APP_DATA_SECTORS 7 CACHE STRING "Flash sectors at the end kept for application data and the LoRaWAN NVM")
+
+math(EXPR PICO_LORAWAN_FUOTA_BOOT_SIZE "32 * 1024")
+math(EXPR PICO_LORAWAN_FUOTA_RESERVED_SIZE "(3 + ${PICO_LORAWAN_FUOTA_APP_DATA_SECTORS}) * 4096")
+math(EXPR PICO_LORAWAN_FUOTA_SLOT_SIZE "((${PICO_LORAWAN_FUOTA_FLASH_SIZE} - ${PICO_LORAWAN_FUOTA_BOOT_SIZE} - ${PICO_LORAWAN_FUOTA_RESERVED_SIZE}) / 2) & ~4095")
+
+function(pico_lorawan_fuota_link TARGET OFFSET LENGTH)
+    # pico-sdk 1.x, then 2.x
+    set(MEMMAP ${PICO_SDK_PATH}/src/rp2_common/pico_standard_link/memmap_default.ld)
+
+    if (NOT EXISTS ${MEMMAP})
+        set(MEMMAP ${PICO_SDK_PATH}/src/rp2_common/pico_crt0/rp2040/memmap_default.ld)
+    endif()
+
+    if (NOT EXISTS ${MEMMAP})
+        message(FATAL_ERROR "memmap_default.ld not found in ${PICO_SDK_PATH}, cannot link ${TARGET} for firmware update")
+    endif()
+
+    math(EXPR ORIGIN "0x10000000 + ${OFFSET}")
+
+    file(READ ${MEMMAP} LINKER_SCRIPT)
+    string(REGEX REPLACE "FLASH\\(rx\\) *: *ORIGIN *= *0x10000000, *LENGTH *= *[0-9]+[kKmM]?"
+           "FLASH(rx) : ORIGIN = ${ORIGIN}, LENGTH = ${LENGTH}" FUOTA_LINKER_SCRIPT "${LINKER_SCRIPT}")
+
+    if (FUOTA_LINKER_SCRIPT STREQUAL LINKER_SCRIPT)
+        message(FATAL_ERROR "No FLASH region found in ${MEMMAP}, cannot link ${TARGET} for firmware update")
+    endif()
+
+    set(OUTPUT ${CMAKE_CURRENT_BINARY_DIR}/${TARGET}_fuota.ld)
+
+    file(WRITE ${OUTPUT} "${FUOTA_LINKER_SCRIPT}")
+    pico_set_linker_script(${TARGET} ${OUTPUT})
+endfunction()
+
+function(pico_lorawan_fuota_app TARGET)
+    pico_lorawan_fuota_link(${TARGET} ${PICO_LORAWAN_FUOTA_BOOT_SIZE} ${PICO_LORAWAN_FUOTA_SLOT_SIZE})
+    target_compile_definitions(${TARGET} PRIVATE PICO_LORAWAN_FUOTA_SLOT_SIZE=${PICO_LORAWAN_FUOTA_SLOT_SIZE})
+endfunction()
+
+function(pico_lorawan_fuota_bootloader TARGET)
+    pico_lorawan_fuota_link(${TARGET} 0 ${PICO_LORAWAN_FUOTA_BOOT_SIZE})
+    target_compile_definitions(${TARGET} PRIVATE PICO_LORAWAN_FUOTA_APP_DATA_SECTORS=${PICO_LORAWAN_FUOTA_APP_DATA_SECTORS})
+endfunction()
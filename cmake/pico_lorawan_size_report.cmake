@@ -0,0 +1,31 @@
+# pico_lorawan_add_size_report(<target>)
+#
+# After <target> links, writes <target>.size.txt next to the ELF with the
+# flash / RAM footprint per component (LoRaWAN region, MAC, radio,
+# application, ...) parsed from the linker map, and prints it to the build
+# log. Call it after pico_add_extra_outputs(<target>), which produces the
+# map file. The compiled region set is recorded in the report header so reports
+# from different configurations can be compared.
+
+find_package(Python3 COMPONENTS Interpreter)
+
+set(PICO_LORAWAN_SIZE_REPORT_SCRIPT ${CMAKE_CURRENT_LIST_DIR}/../tools/size_report.py)
+
+function(pico_lorawan_add_size_report TARGET)
+    if (NOT Python3_Interpreter_FOUND)
+        message(WARNING "python3 not found, no size report for ${TARGET}")
+        return()
+    endif()
+
+    string(REPLACE ";" "," REGIONS "${PICO_LORAWAN_REGIONS}")
+
+    add_custom_command(TARGET ${TARGET} POST_BUILD
+        COMMAND ${Python3_EXECUTABLE} ${PICO_LORAWAN_SIZE_REPORT_SCRIPT}
+            $<TARGET_FILE:${TARGET}>.map
+            --config PICO_LORAWAN_REGIONS=${REGIONS}
+            --config PICO_LORAWAN_ACTIVE_REGION=${PICO_LORAWAN_ACTIVE_REGION}
+            --config CMAKE_BUILD_TYPE=${CMAKE_BUILD_TYPE}
+            --output $<TARGET_FILE:${TARGET}>.size.txt
+        VERBATIM
+    )
+endfunction()
@@ -27,3 +27,8 @@
 // LoRaWAN Channel Mask, NULL value will use the default channel mask 
 // for the region
 #define LORAWAN_CHANNEL_MASK    NULL
+
+// Public key of the firmware update files (Ed25519), with the
+// PICO_LORAWAN_FUOTA CMake option, as tools/fuota.py keygen prints it; the
+// private key stays with tools/fuota.py pack --key
+#define LORAWAN_FUOTA_PUBLIC_KEY "8EDB512CE2F27BDDA8C2954F903A2DAAA45BC600C9BC16BFD0340F2B1DD7CEB9"
@@ -0,0 +1,212 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#include <string.h>
+
+#include "config_store.h"
+
+#include "hardware/sync.h"
+#include "pico/multicore.h"
+#include "pico/lorawan_profile.h"
+#include "meter/sector_log.h"
+
+#define SAVED_VERSION       1
+#define SAVED_SIZE          36
+#define SAVED_CRC_OFFSET    (SAVED_SIZE - 4)
+
+// the calibration record, after the configuration
+#define CALIBRATION_OFFSET  64
+
+static_assert(SAVED_SIZE <= CALIBRATION_OFFSET, "saved configuration runs into the calibration");
+static_assert(CALIBRATION_OFFSET + METER_CALIBRATION_SAVED_SIZE <= FLASH_PAGE_SIZE, "saved calibration does not fit a flash page");
+
+static void store_le16(uint8_t* p, uint16_t value)
+{
+    p[0] = value;
+    p[1] = value >> 8;
+}
+
+static void store_le32(uint8_t* p, uint32_t value)
+{
+    p[0] = value;
+    p[1] = value >> 8;
+    p[2] = value >> 16;
+    p[3] = value >> 24;
+}
+
+static uint16_t load_le16(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t load_le32(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// [0] 'C' 'F' version, [4] sequence, [8] number of samples, report
+// interval, measure period, circuits, [16] current and voltage
+// calibration, [24] current calibration of circuits 2 and 3, CRC-32 at the
+// end
+static void config_save(const struct meter_config* config, uint32_t sequence, uint8_t* buffer)
+{
+    memset(buffer, 0, SAVED_SIZE);
+
+    buffer[0] = 'C';
+    buffer[1] = 'F';
+    buffer[2] = SAVED_VERSION;
+    store_le32(buffer + 4, sequence);
+    store_le16(buffer + 8, config->num_samples);
+    store_le16(buffer + 10, config->report_interval_s);
+    store_le16(buffer + 12, config->measure_period_ms);
+    store_le16(buffer + 14, config->circuits);
+    store_le32(buffer + 16, config->current_calibration_milli);
+    store_le32(buffer + 20, config->voltage_calibration_milli);
+    store_le32(buffer + 24, config->circuit_calibration_milli[0]);
+    store_le32(buffer + 28, config->circuit_calibration_milli[1]);
+    store_le32(buffer + SAVED_CRC_OFFSET, meter_log_crc32(buffer, SAVED_CRC_OFFSET));
+}
+
+static bool config_restore(struct meter_config* config, const uint8_t* buffer, uint32_t* sequence)
+{
+    if (buffer[0] != 'C' || buffer[1] != 'F' || buffer[2] != SAVED_VERSION ||
+        load_le32(buffer + SAVED_CRC_OFFSET) != meter_log_crc32(buffer, SAVED_CRC_OFFSET)) {
+        return false;
+    }
+
+    config->num_samples = load_le16(buffer + 8);
+    config->report_interval_s = load_le16(buffer + 10);
+    config->measure_period_ms = load_le16(buffer + 12);
+    config->current_calibration_milli = load_le32(buffer + 16);
+    config->voltage_calibration_milli = load_le32(buffer + 20);
+    config->circuits = load_le16(buffer + 14);
+    config->circuit_calibration_milli[0] = load_le32(buffer + 24);
+    config->circuit_calibration_milli[1] = load_le32(buffer + 28);
+    *sequence = load_le32(buffer + 4);
+
+    return true;
+}
+
+static const uint8_t* page_address(uint32_t page)
+{
+    return (const uint8_t*)(XIP_BASE + ConfigStore::OFFSET + page * FLASH_PAGE_SIZE);
+}
+
+static bool page_blank(uint32_t page)
+{
+    const uint8_t* p = page_address(page);
+
+    for (uint32_t i = 0; i < FLASH_PAGE_SIZE; i++) {
+        if (p[i] != 0xff) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+ConfigStore::ConfigStore() :
+    next_page_(0),
+    sequence_(0),
+    saves_(0),
+    erases_(0)
+{
+}
+
+bool ConfigStore::load(struct meter_config* config, struct meter_calibration* calibration, bool* calibrated)
+{
+    struct meter_config candidate;
+    struct meter_calibration calibration_candidate;
+    uint32_t calibration_sequence = 0;
+    bool found = false;
+
+    *calibrated = false;
+
+    for (uint32_t page = 0; page < PAGES; page++) {
+        uint32_t sequence;
+
+        // the newest calibration on its own, in case a torn page has the
+        // configuration only
+        if (meter_calibration_restore(&calibration_candidate, page_address(page) + CALIBRATION_OFFSET, &sequence) == 0 &&
+            (!*calibrated || (int32_t)(sequence - calibration_sequence) > 0)) {
+            *calibration = calibration_candidate;
+            calibration_sequence = sequence;
+            *calibrated = true;
+        }
+
+        if (!config_restore(&candidate, page_address(page), &sequence)) {
+            continue;
+        }
+
+        if (!found || (int32_t)(sequence - sequence_) > 0) {
+            *config = candidate;
+            sequence_ = sequence;
+            next_page_ = (page + 1) % PAGES;
+            found = true;
+        }
+    }
+
+    return found;
+}
+
+void ConfigStore::save(const struct meter_config* config, const struct meter_calibration* calibration)
+{
+    static uint8_t page[FLASH_PAGE_SIZE];
+
+    memset(page, 0xff, sizeof(page));
+    config_save(config, ++sequence_, page);
+
+    if (calibration != NULL) {
+        meter_calibration_save(calibration, sequence_, page + CALIBRATION_OFFSET);
+    }
+
+    // left over from another firmware, start over in the next sector
+    if ((next_page_ % PAGES_PER_SECTOR) != 0 && !page_blank(next_page_)) {
+        next_page_ = (next_page_ / PAGES_PER_SECTOR + 1) * PAGES_PER_SECTOR % PAGES;
+    }
+
+    program(next_page_, page);
+
+    next_page_ = (next_page_ + 1) % PAGES;
+    saves_++;
+}
+
+void ConfigStore::program(uint32_t page, const uint8_t* data)
+{
+    LORAWAN_PROFILE_SCOPE(LORAWAN_PROFILE_FLASH);
+
+    uint32_t offset = OFFSET + page * FLASH_PAGE_SIZE;
+
+    // the SD log writer on core 1 runs from flash too, see EepromMcuFlush()
+    bool lockout = multicore_lockout_victim_is_initialized(1);
+
+    if (lockout) {
+        multicore_lockout_start_blocking();
+    }
+
+    uint32_t interrupts = save_and_disable_interrupts();
+
+    if ((page % PAGES_PER_SECTOR) == 0) {
+        flash_range_erase(offset, FLASH_SECTOR_SIZE);
+        erases_++;
+    }
+
+    flash_range_program(offset, data, FLASH_PAGE_SIZE);
+
+    restore_interrupts(interrupts);
+
+    if (lockout) {
+        multicore_lockout_end_blocking();
+    }
+}
+
+void ConfigStore::get_stats(struct stats* stats) const
+{
+    stats->saves = saves_;
+    stats->erases = erases_;
+    stats->sequence = sequence_;
+}
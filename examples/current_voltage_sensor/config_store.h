@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#ifndef _CONFIG_STORE_H_
+#define _CONFIG_STORE_H_
+
+#include <stdint.h>
+
+#include "hardware/flash.h"
+
+#include "register_store.h"
+#include "meter/calibration.h"
+#include "meter/circuits.h"
+
+// Sampling and reporting parameters, in the units of the configuration
+// downlinks on port 6
+struct meter_config {
+    uint16_t num_samples;               // per input and measure task run
+    uint32_t current_calibration_milli; // A per ADC full scale, / 1000
+    uint32_t voltage_calibration_milli; // V per ADC full scale, / 1000
+    uint16_t report_interval_s;         // readings uplink period
+    uint16_t measure_period_ms;         // measure task period
+    uint16_t circuits;                  // currents on ADC1 onwards
+    uint32_t circuit_calibration_milli[METER_CIRCUITS_MAX - 1];    // circuits 2 onwards, A per ADC full scale, / 1000
+};
+
+// The configuration and the calibration in the two flash sectors below the
+// billing registers, saved the same way: every save programs the next
+// 256-byte page with a sequence number and a CRC, a sector is only erased
+// when the pages move on to it, and the newest valid page wins on load.
+//
+// The calibration is a record of its own in every page, with its own CRC,
+// copied from page to page as it is: only the calibration command on the
+// USB console changes it, no downlink does.
+//
+// Saved on configuration downlinks and calibrations only, a sector is
+// erased every 16 of them.
+class ConfigStore {
+public:
+    static const uint32_t SECTORS = 2;
+    static const uint32_t PAGES_PER_SECTOR = FLASH_SECTOR_SIZE / FLASH_PAGE_SIZE;
+    static const uint32_t PAGES = SECTORS * PAGES_PER_SECTOR;
+    static const uint32_t OFFSET = RegisterStore::OFFSET - SECTORS * FLASH_SECTOR_SIZE;
+
+    ConfigStore();
+
+    // Restores the newest saved configuration, and the calibration saved
+    // with it if there is one. Returns false if there is no configuration,
+    // leaving config as it is, calibrated tells about the calibration.
+    bool load(struct meter_config* config, struct meter_calibration* calibration, bool* calibrated);
+
+    // calibration NULL for none
+    void save(const struct meter_config* config, const struct meter_calibration* calibration);
+
+    struct stats {
+        uint32_t saves;
+        uint32_t erases;
+        uint32_t sequence;          // of the newest page
+    };
+
+    void get_stats(struct stats* stats) const;
+
+protected:
+    void program(uint32_t page, const uint8_t* data);
+
+    uint32_t next_page_;
+    uint32_t sequence_;
+    uint32_t saves_;
+    uint32_t erases_;
+};
+
+#endif
@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+// SD card wiring for no-OS-FatFS-SD-SDIO-SPI-RPi-Pico: spi1 on GPIO 12 - 15,
+// spi0 belongs to the SX1276
+#include "hw_config.h"
+
+static spi_t spi = {
+    .hw_inst = spi1,
+    .miso_gpio = 12,
+    .mosi_gpio = 15,
+    .sck_gpio = 14,
+    .baud_rate = 12500 * 1000,
+};
+
+static sd_spi_if_t spi_if = {
+    .spi = &spi,
+    .ss_gpio = 13,
+};
+
+static sd_card_t sd_card = {
+    .type = SD_IF_SPI,
+    .spi_if_p = &spi_if,
+};
+
+size_t sd_get_num()
+{
+    return 1;
+}
+
+sd_card_t* sd_get_by_num(size_t num)
+{
+    return (num == 0) ? &sd_card : NULL;
+}
@@ -1,20 +1,42 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <math.h>
 #include "hardware/adc.h"
 #include "hardware/gpio.h"
 #include "pico/stdlib.h"
 #include "pico/lorawan.h"
+#if PICO_LORAWAN_FUOTA
+#include "pico/lorawan_fuota.h"
+#endif
+#include "pico/lorawan_log.h"
+#include "pico/lorawan_profile.h"
+#include "pico/lorawan_scheduler.h"
+#include "tusb.h"
 #include "config.h" // edit with LoRaWAN Node Region and OTAA settings 
 #include "ssd1306.h"
 #include "textRenderer/TextRenderer.h"
 #include "hardware/i2c.h"
+#include "meter_display.h"
+#include "waveform_stream.h"
+#include "register_store.h"
+#include "config_store.h"
+#if PICO_LORAWAN_SD_LOG
+#include "sd_logger.h"
+#endif
+#include "meter/calibration.h"
+#include "meter/circuits.h"
+#include "meter/events.h"
+#include "meter/fixed_format.h"
+#include "meter/linearization.h"
+#include "meter/metering.h"
+#include "meter/registers.h"
 
 using namespace pico_ssd1306;
 
-#define ADC_BITS 12
-#define ADC_COUNTS (1 << ADC_BITS)
-#define SUPPLY_VOLTAGE 3283
+static_assert(LORAWAN_REGION_IS_ENABLED(LORAWAN_REGION),
+              "LORAWAN_REGION in config.h is not compiled in, add it to the PICO_LORAWAN_REGIONS CMake option");
+
 #define SUPPLY_VOLTAGE_SENSOR 5056
 
 // pin configuration for SX1276 radio module
@@ -44,25 +66,296 @@ int receive_length = 0;
 uint8_t receive_buffer[242];
 uint8_t receive_port = 0;
 
+// metering configuration and latest results, written by the measure task
+#define MAX_SAMPLES 10000
+
+uint num_samples = MAX_SAMPLES;
+double current_calibration =  51.61;
+double voltage_calibration =  897.6;
+// DC filters of the single circuit, kept between measurements, and the
+// seeds they last started from
+double offset_current = ADC_COUNTS >> 1;
+double offset_voltage = ADC_COUNTS >> 1;
+double seed_current = ADC_COUNTS >> 1;
+double seed_voltage = ADC_COUNTS >> 1;
+int32_t phase_delay = 0;
+uint32_t power_samples = 0;     // whole cycles once calibrated
+
+// against a reference load, started with K on the USB console: the measure
+// task runs the calibration windows instead of measuring, the result sets
+// the gains in the configuration and the offsets and phase delay, and is
+// kept with the configuration
+struct meter_calibration calibration;
+bool calibrated = false;
+struct meter_calibration_solver calibration_solver;
+uint32_t calibration_windows = 0;
+
+double current_samples[MAX_SAMPLES];
+double voltage_samples[MAX_SAMPLES];
+
+// ADC nonlinearity correction of this board, written by
+// tools/adc_linearize.py to the two flash sectors below the configuration
+// and read by the measure task from SRAM, one float per code
+#define ADC_LINEARIZATION_OFFSET (ConfigStore::OFFSET - 2 * FLASH_SECTOR_SIZE)
+
+float adc_linearization[METER_LINEARIZATION_CODES];
+
+struct meter_readings {
+    double current_rms;
+    double voltage_rms;
+    double active_power;
+    double apparent_power;
+    double reactive_power;
+    double power_factor;
+};
+
+struct meter_readings readings;
+uint32_t readings_time_ms = 0;
+
+// more circuits on the same voltage: the currents on ADC1 onwards, read in
+// turn with the voltage, every circuit with its own current calibration and
+// energy, all of them in one uplink on their own port instead of the
+// readings; the readings are the totals. ADC3 is VSYS / 3 on the Pico.
+#if defined(PICO_VSYS_PIN) && PICO_VSYS_PIN == 29
+#define MAX_CIRCUITS 2
+#else
+#define MAX_CIRCUITS METER_CIRCUITS_MAX
+#endif
+
+#define CIRCUITS_PORT 7
+
+struct meter_circuits circuits;
+
+// voltage sags, swells and interruptions, detected on a continuous capture
+// of the voltage and sent on their own port ahead of the readings
+#define NOMINAL_VOLTAGE 120.0
+#define EVENT_UPLINK_PORT 4
+
+// voltage samples per second fed to the event detector, the capture runs at
+// twice this over both inputs while the ADC is not measuring or streaming
+#define EVENTS_SAMPLE_RATE 10000
+#define EVENTS_CLKDIV ((48000000 / (2 * EVENTS_SAMPLE_RATE)) - 1)
+
+struct meter_events power_events;
+struct meter_source metering_source;
+
+// the report task also sends the stage profile on this port when enabled
+// from the USB console
+#define PROFILE_UPLINK_PORT 3
+
+bool profile_uplink = false;
+
+// keep the network time within this of the DeviceTimeAns answers, uplinks
+// carry the age of their values in seconds, the receiver subtracts it from
+// the reception time
+#define TIME_SYNC_MAX_ERROR_MS 100
+
+// energy per time-of-use tariff and 15 minute demand, fed by every measure
+// task run, saved to flash and sent as a snapshot at every block end; the
+// schedule comes by downlink on the same port
+#define DEMAND_INTERVAL_S 900
+#define REGISTERS_PORT 5
+
+#define REGISTERS_COMMAND_SCHEDULE      0x01
+#define REGISTERS_COMMAND_RESET_PEAKS   0x02
+#define REGISTERS_COMMAND_SNAPSHOT      0x03
+
+struct meter_registers registers;
+RegisterStore register_store;
+bool registers_save_pending = false;
+
+// number of samples, calibrations, report interval and measure period, set
+// by downlink on their own port and kept in flash, every downlink is
+// answered with the configuration in effect
+#define CONFIG_PORT 6
+
+#define CONFIG_COMMAND_GET          0x01
+#define CONFIG_COMMAND_SET          0x02
+#define CONFIG_COMMAND_DEFAULTS     0x03
+
+#define CONFIG_NUM_SAMPLES          0x01
+#define CONFIG_CURRENT_CALIBRATION  0x02
+#define CONFIG_VOLTAGE_CALIBRATION  0x03
+#define CONFIG_REPORT_INTERVAL      0x04
+#define CONFIG_MEASURE_PERIOD       0x05
+#define CONFIG_CIRCUITS             0x06
+#define CONFIG_CIRCUIT2_CALIBRATION 0x07
+#define CONFIG_CIRCUIT3_CALIBRATION 0x08
+
+// answer status, otherwise the parameter that is out of range
+#define CONFIG_STATUS_OK            0x00
+#define CONFIG_STATUS_MALFORMED     0xff
+
+#define CONFIG_ENCODED_SIZE         24
+
+const struct meter_config default_config = {
+    .num_samples = MAX_SAMPLES,
+    .current_calibration_milli = 51610,
+    .voltage_calibration_milli = 897600,
+    .report_interval_s = 10,
+    .measure_period_ms = 1000,
+    .circuits = 1,
+    .circuit_calibration_milli = { 51610, 51610 },
+};
+
+struct meter_config active_config;
+ConfigStore config_store;
+
+#if PICO_LORAWAN_FUOTA
+// the ADC linearization, lowest, the configuration and the registers stay
+// where the bootloader keeps out
+static_assert(ADC_LINEARIZATION_OFFSET >= LORAWAN_FUOTA_APP_DATA_OFFSET, "PICO_LORAWAN_FUOTA_APP_DATA_SECTORS too small for the example");
+#endif
+bool config_save_pending = false;
+bool config_answer_pending = false;
+uint8_t config_answer[2];
+
+#if PICO_LORAWAN_SD_LOG
+// readings every measure task run and the voltage events, written to the
+// SD card by core 1, see tools/sdlog_read.py
+SdLogger sd_logger;
+
+char sd_log_device[17];
+#endif
+
 // functions used in main
 void current_voltage_init();
-double current_get(uint num_samples, double current_calibration, double offset_current, double *current_samples);
-double voltage_get(uint num_samples, double voltage_calibration, double offset_voltage, double *voltage_samples);
-double calculate_power(double *voltage_samples, double *current_samples, uint num_samples, 
-                                      double voltage_calibration, double current_calibration);
-double calculate_apparent_power(double voltage_rms, double current_rms);
-double calculate_reactive_power(double apparent_power, double active_power);
-double calculate_power_factor(double active_power, double apparent_power);
+void power_events_init();
+void events_monitor_start();
+void events_block(void* context, const uint16_t* samples, size_t pairs, uint64_t time_us, uint32_t sample_rate, bool gap);
+void log_drain();
+void sd_log(const struct meter_readings* r);
+void registers_update(const struct meter_readings* r);
+void registers_downlink(const uint8_t* data, int length);
+void registers_dump();
+void config_load();
+void config_apply(const struct meter_config* config);
+uint8_t config_check(const struct meter_config* config);
+uint8_t config_decode(struct meter_config* config, const uint8_t* data, int length);
+void config_downlink(const uint8_t* data, int length);
+struct meter_config config_defaults();
+void calibration_start(const char* args);
+void calibration_step();
+void measure();
+void single_measure(struct meter_readings* r);
+void circuits_measure(struct meter_readings* r);
+void adc_linearization_load();
+uint16_t power_events_nominal();
+uint16_t age_s(uint32_t time_ms);
+
+// scheduler tasks, lower priority value runs first
+void measure_task_fn(void* context);
+void uplink_task_fn(void* context);
+void downlink_task_fn(void* context);
+void display_task_fn(void* context);
+void report_task_fn(void* context);
+void event_task_fn(void* context);
+void registers_task_fn(void* context);
+void config_task_fn(void* context);
+void log_task_fn(void* context);
+void stream_task_fn(void* context);
+void console_task_fn(void* context);
+
+struct lorawan_task measure_task = {
+    .name = "measure",
+    .fn = measure_task_fn,
+    .priority = 2,
+    .period_us = 1000000,
+};
+
+struct lorawan_task uplink_task = {
+    .name = "uplink",
+    .fn = uplink_task_fn,
+    .priority = 1,
+    .period_us = 10000000,
+    .deadline_us = 1000000,
+};
+
+struct lorawan_task downlink_task = {
+    .name = "downlink",
+    .fn = downlink_task_fn,
+    .priority = 1,
+    .deadline_us = 100000,
+};
+
+struct lorawan_task display_task = {
+    .name = "display",
+    .fn = display_task_fn,
+    .priority = 3,
+    .period_us = 1000000,
+};
+
+// signalled by the measure task when an event was logged
+struct lorawan_task event_task = {
+    .name = "event",
+    .fn = event_task_fn,
+    .priority = 1,
+    .deadline_us = 1000000,
+};
+
+// signalled at every demand block end and by register downlinks
+struct lorawan_task registers_task = {
+    .name = "registers",
+    .fn = registers_task_fn,
+    .priority = 4,
+};
+
+// signalled by configuration downlinks
+struct lorawan_task config_task = {
+    .name = "config",
+    .fn = config_task_fn,
+    .priority = 4,
+};
+
+struct lorawan_task report_task = {
+    .name = "report",
+    .fn = report_task_fn,
+    .priority = 4,
+    .period_us = 60000000,
+};
+
+struct lorawan_task log_task = {
+    .name = "log",
+    .fn = log_task_fn,
+    .priority = 5,
+    .period_us = 20000,
+};
+
+// signalled for every captured block, one block is 2 ms at the full rate
+// and 51 ms for the event detector
+struct lorawan_task stream_task = {
+    .name = "stream",
+    .fn = stream_task_fn,
+    .priority = 1,
+    .deadline_us = 2000,
+};
+
+struct lorawan_task console_task = {
+    .name = "console",
+    .fn = console_task_fn,
+    .priority = 4,
+    .period_us = 50000,
+};
+
+// raw waveform capture, started and stopped from the USB console, see
+// tools/waveform_capture.py, and the event detector's capture in between
+WaveformStream waveform_stream(&stream_task);
 
 int main(void)
 {
     stdio_init_all(); // initialize stdio
+    config_load();
     current_voltage_init();
+    power_events_init();
+    adc_linearization_load();
     printf("Pico LoRaWAN - Current and Voltage sensor \n\n");
     
     // uncomment next line to enable debug
     lorawan_debug(true);
 
+    // write debug output as binary log records, decode with tools/log_decode.py
+    lorawan_debug_deferred(true);
+
     // Init i2c0 controller
     i2c_init(i2c0, 1000000);
     // Set up pins 4 and 5
@@ -75,17 +368,20 @@ int main(void)
 
     SSD1306 display = SSD1306(i2c0, 0x3C, Size::W128xH64);
     display.setOrientation(0);
+
+    // pico_ssd1306 initializes the panel, frames are sent by MeterDisplay
+    // which only writes what changed since the previous frame
+    MeterDisplay meter_display(i2c0, 0x3C);
     
     // Display "FREEDM SMART METER" on startup
-    display.clear();
-    drawText(&display, font_8x8, "FREEDM SMART METER", 0, 0);
-    display.sendBuffer();
+    meter_display.clear();
+    meter_display.draw_text(font_8x8, "FREEDM SMART METER", 0, 0);
+    meter_display.flush();
 
     sleep_ms(2000);  // Show message for 2 seconds
 
     // initialize the LoRaWAN stack
     printf("Initializing LoRaWAN ... ");
-    bool lorawan_connected = false;  // Flag to indicate LoRaWAN connection status
     if (lorawan_init_otaa(&sx1276_settings, LORAWAN_REGION, &otaa_settings) < 0) {
         printf("failed!!!\n");
         while (1) {
@@ -93,16 +389,23 @@ int main(void)
         }
     } else {
         printf("success!\n");
-        lorawan_connected = true;
     }
 
+#if PICO_LORAWAN_FUOTA
+    // update files over multicast, an installed image is confirmed by its
+    // first uplink and applied right after the registers are saved
+    if (lorawan_fuota_init(LORAWAN_FUOTA_PUBLIC_KEY) < 0) {
+        printf("Firmware update disabled, check the public key and that the bootloader is installed\n");
+    }
+#endif
+
     // Start the join process and wait
     printf("Joining LoRaWAN network ...");
     lorawan_join();
 
-    display.clear();
-    drawText(&display, font_8x8, "CONNECTING TO LORAWAN", 0, 0);
-    display.sendBuffer();
+    meter_display.clear();
+    meter_display.draw_text(font_8x8, "CONNECTING TO LORAWAN", 0, 0);
+    meter_display.flush();
 
     while (!lorawan_is_joined()) {
         lorawan_process_timeout_ms(1000);
@@ -111,18 +414,236 @@ int main(void)
     printf(" joined successfully!\n");
 
     // Display "CONNECTED TO LORAWAN" once connected
-    display.clear();
-    drawText(&display, font_8x8, "CONNECTED TO LORAWAN", 0, 0);
-    display.sendBuffer();
+    meter_display.clear();
+    meter_display.draw_text(font_8x8, "CONNECTED TO LORAWAN", 0, 0);
+    meter_display.flush();
 
     sleep_ms(2000);  // Show message for 2 seconds
 
-    uint num_samples = 10000;
-    double current_calibration =  51.61;
-    double voltage_calibration =  897.6;
-    double offset_current = ADC_COUNTS >> 1;
-    double offset_voltage = ADC_COUNTS >> 1;
+    // DeviceTimeReq with the first uplink, then whenever a resync is due
+    lorawan_time_sync(TIME_SYNC_MAX_ERROR_MS);
+
+    // mains powered: keep RX2 open, register commands are answered within
+    // a second instead of after the next uplink
+    lorawan_set_class(CLASS_C);
+
+#if PICO_LORAWAN_SD_LOG
+    // the header names the device by its EUI
+    sd_logger.start((otaa_settings.device_eui != NULL) ? otaa_settings.device_eui : lorawan_default_dev_eui(sd_log_device));
+#endif
+
+    meter_registers_init(&registers, DEMAND_INTERVAL_S);
+
+    if (!register_store.load(&registers)) {
+        printf("No saved registers, starting from zero\n");
+    }
+
+    lorawan_scheduler_init();
+
+    display_task.context = &meter_display;
+
+    lorawan_scheduler_add(&measure_task);
+    lorawan_scheduler_add(&uplink_task);
+    lorawan_scheduler_add(&downlink_task);
+    lorawan_scheduler_add(&display_task);
+    lorawan_scheduler_add(&report_task);
+    lorawan_scheduler_add(&event_task);
+    lorawan_scheduler_add(&registers_task);
+    lorawan_scheduler_add(&config_task);
+    lorawan_scheduler_add(&log_task);
+    lorawan_scheduler_add(&stream_task);
+    lorawan_scheduler_add(&console_task);
+
+    lorawan_scheduler_set_rx_task(&downlink_task);
+
+    events_monitor_start();
+
+    // runs the tasks in priority order, sleeps in between
+    lorawan_scheduler_run();
+
+    return 0;
+}
+
+
+void measure_task_fn(void* context)
+{
+    // the ADC is free-running for the stream, keep the last readings
+    if (waveform_stream.streaming()) {
+        return;
+    }
+
+    // the event detector gives the ADC back for the measurement, after the
+    // blocks it captured so far
+    waveform_stream.service();
+    waveform_stream.stop();
+
+    measure();
+
+    events_monitor_start();
+}
+
+// A calibration window, or the readings
+void measure()
+{
+    struct meter_readings r;
+
+    if (calibration_windows > 0) {
+        calibration_step();
+        return;
+    }
+
+    if (circuits.count > 1) {
+        circuits_measure(&r);
+    } else {
+        single_measure(&r);
+    }
+
+    if (meter_events_unsent(&power_events) > 0) {
+        lorawan_task_signal(&event_task);
+    }
+
+    readings = r;
+    readings_time_ms = to_ms_since_boot(get_absolute_time());
+
+    sd_log(&r);
+
+    registers_update(&r);
+
+    LORAWAN_LOG("Current: %0.2f A, Voltage: %0.2f V, Real Power: %0.2f W, Apparent Power: %0.2f VA, Reactive Power: %0.2f VAR, Power Factor: %0.2f\n",
+                LORAWAN_LOG_FLOAT(r.current_rms), LORAWAN_LOG_FLOAT(r.voltage_rms), LORAWAN_LOG_FLOAT(r.active_power),
+                LORAWAN_LOG_FLOAT(r.apparent_power), LORAWAN_LOG_FLOAT(r.reactive_power), LORAWAN_LOG_FLOAT(r.power_factor));
+}
+
+// One current and one voltage window, one after the other
+void single_measure(struct meter_readings* r)
+{
+    // the RMS sums are accumulated while sampling and count as acquisition
+    {
+        LORAWAN_PROFILE_SCOPE(LORAWAN_PROFILE_ACQUISITION);
+
+        r->current_rms = meter_current_get(&metering_source, num_samples, current_calibration, &offset_current, current_samples);
+        r->voltage_rms = meter_voltage_get(&metering_source, num_samples, voltage_calibration, &offset_voltage, voltage_samples);
+    }
+
+    {
+        LORAWAN_PROFILE_SCOPE(LORAWAN_PROFILE_DSP);
+
+        r->active_power =  meter_calculate_power_aligned(voltage_samples, current_samples, num_samples, phase_delay, power_samples,
+                                                         voltage_calibration, current_calibration);
+        r->apparent_power = meter_calculate_apparent_power(r->voltage_rms, r->current_rms);
+        r->active_power = meter_limit_active_power(r->active_power, r->apparent_power);
+        r->reactive_power = meter_calculate_reactive_power(r->apparent_power, r->active_power);
+        r->power_factor = meter_calculate_power_factor(r->active_power, r->apparent_power);
+    }
+}
+
+// All circuits in the ADC time of the single circuit's two windows, the
+// readings are the totals, the power factor of the total powers
+void circuits_measure(struct meter_readings* r)
+{
+    // the powers are summed while sampling too
+    {
+        LORAWAN_PROFILE_SCOPE(LORAWAN_PROFILE_ACQUISITION);
+
+        meter_circuits_measure(&circuits, &metering_source, 2 * num_samples / (circuits.count + 1), voltage_calibration);
+    }
+
+    r->voltage_rms = circuits.voltage_rms;
+    r->current_rms = 0;
+    r->active_power = 0;
+    r->apparent_power = 0;
+    r->reactive_power = 0;
+
+    for (uint8_t i = 0; i < circuits.count; i++) {
+        const struct meter_circuit* c = &circuits.circuit[i];
+
+        r->current_rms += c->current_rms;
+        r->active_power += c->active_power;
+        r->apparent_power += c->apparent_power;
+        r->reactive_power += c->reactive_power;
+
+        LORAWAN_LOG("circuit %u: Current: %0.2f A, Real Power: %0.2f W, Power Factor: %0.2f\n", i + 1,
+                    LORAWAN_LOG_FLOAT(c->current_rms), LORAWAN_LOG_FLOAT(c->active_power), LORAWAN_LOG_FLOAT(c->power_factor));
+    }
+
+    r->power_factor = meter_calculate_power_factor(r->active_power, r->apparent_power);
+}
+
+// The readings, or with more circuits all of them in one uplink, with the
+// age of the values
+void uplink_task_fn(void* context)
+{
+    uint8_t payload[METER_CIRCUITS_ENCODED_SIZE(METER_CIRCUITS_MAX) + 2];
+    int result;
+
+    static_assert(sizeof(payload) >= 50, "payload too small for the readings");
+
+    // payload and MAC frame, including the encryption and MIC
+    {
+        LORAWAN_PROFILE_SCOPE(LORAWAN_PROFILE_ENCODE);
+
+        uint16_t age = age_s(readings_time_ms);
+
+        if (circuits.count > 1) {
+            size_t length = METER_CIRCUITS_ENCODED_SIZE(circuits.count);
+
+            meter_circuits_encode(&circuits, payload);
+            memcpy(payload + length, &age, sizeof(age));
+
+            result = lorawan_send_unconfirmed(payload, length + sizeof(age), CIRCUITS_PORT);
+        } else {
+            memcpy(payload, &readings.current_rms, sizeof(double));
+            memcpy(payload + 8, &readings.voltage_rms, sizeof(double));
+            memcpy(payload + 16, &readings.active_power, sizeof(double));
+            memcpy(payload + 24, &readings.apparent_power, sizeof(double));
+            memcpy(payload + 32, &readings.reactive_power, sizeof(double));
+            memcpy(payload + 40, &readings.power_factor, sizeof(double));
+            memcpy(payload + 48, &age, sizeof(age));
+
+            // Try to send an unconfirmed uplink message
+            result = lorawan_send_unconfirmed(payload, 50, 2);
+        }
+    }
+
+    if (result < 0) {
+        LORAWAN_LOG("sending unconfirmed message ... failed!!!\n");
+    } else {
+        LORAWAN_LOG("sending unconfirmed message ... success!\n");
+
+#if PICO_LORAWAN_FUOTA
+        // joined and sending, a new image is good
+        lorawan_fuota_confirm();
+#endif
+    }
+}
+
+void downlink_task_fn(void* context)
+{
+    receive_length = lorawan_receive(receive_buffer, sizeof(receive_buffer), &receive_port);
+    if (receive_length > -1 && receive_port == REGISTERS_PORT) {
+        registers_downlink(receive_buffer, receive_length);
+    } else if (receive_length > -1 && receive_port == CONFIG_PORT) {
+        config_downlink(receive_buffer, receive_length);
+    } else if (receive_length > -1) {
+        // through the log, a printf could land inside a waveform frame;
+        // 16 bytes per record in words of 4, the last one padded with 0
+        LORAWAN_LOG("downlink: port %u, %d bytes\n", receive_port, receive_length);
+
+        for (int i = 0; i < receive_length; i += 16) {
+            uint32_t words[4] = { 0 };
+
+            for (int j = 0; j < 16 && i + j < receive_length; j++) {
+                words[j / 4] |= (uint32_t)receive_buffer[i + j] << (24 - 8 * (j % 4));
+            }
+
+            LORAWAN_LOG("downlink: %08x %08x %08x %08x\n", words[0], words[1], words[2], words[3]);
+        }
+    }
+}
 
+void display_task_fn(void* context)
+{
+    MeterDisplay* meter_display = (MeterDisplay*)context;
     char current_str[16];
     char voltage_str[16];
     char power_str[16];
@@ -130,149 +651,843 @@ int main(void)
     char reactive_power_str[16];
     char power_factor_str[16];
 
-    double current_samples[num_samples];
-    double voltage_samples[num_samples];
-    uint32_t last_message_time = 0;
-
-    while (1) {
-        lorawan_process();
-        double adc_current_rms = current_get(num_samples, current_calibration, offset_current, current_samples);
-        double adc_voltage_rms = voltage_get(num_samples, voltage_calibration, offset_voltage, voltage_samples);
-        double active_power =  calculate_power(voltage_samples, current_samples, num_samples, voltage_calibration, current_calibration);
-        double apparent_power = calculate_apparent_power(adc_voltage_rms, adc_current_rms);
-        double reactive_power = calculate_reactive_power(apparent_power, active_power);
-        double power_factor = calculate_power_factor(active_power, apparent_power);
-
-        if (lorawan_connected) {
-            printf("Current: %0.2f A, Voltage: %0.2f V, Real Power: %0.2f W, Apparent Power: %0.2f VA, Reactive Power: %0.2f VAR, Power Factor: %0.2f\n", adc_current_rms, adc_voltage_rms, active_power, apparent_power, reactive_power, power_factor);
+    // Update display with sensor values
+    meter_display->clear();
+
+    fixed_format_field(current_str, sizeof(current_str), "I: ", fixed_from_double(readings.current_rms, 2), 2, " A");
+    fixed_format_field(voltage_str, sizeof(voltage_str), "V: ", fixed_from_double(readings.voltage_rms, 2), 2, " V");
+    fixed_format_field(power_str, sizeof(power_str), "P: ", fixed_from_double(readings.active_power, 2), 2, " W");
+    fixed_format_field(apparent_power_str, sizeof(apparent_power_str), "S: ", fixed_from_double(readings.apparent_power, 2), 2, " VA");
+    fixed_format_field(reactive_power_str, sizeof(reactive_power_str), "Q: ", fixed_from_double(readings.reactive_power, 2), 2, " VAR");
+    fixed_format_field(power_factor_str, sizeof(power_factor_str), "PF: ", fixed_from_double(readings.power_factor, 2), 2, "");
+
+    meter_display->draw_text(font_8x8, current_str, 0, 0);
+    meter_display->draw_text(font_8x8, voltage_str, 0, 8);
+    meter_display->draw_text(font_8x8, power_str, 0, 16);
+    meter_display->draw_text(font_8x8, apparent_power_str, 0, 24);
+    meter_display->draw_text(font_8x8, reactive_power_str, 0, 32);
+    meter_display->draw_text(font_8x8, power_factor_str, 0, 40);
+
+    LORAWAN_PROFILE_SCOPE(LORAWAN_PROFILE_DISPLAY);
+
+    // returns immediately, if the previous frame is still being sent
+    // this one is skipped and the next run sends the latest values
+    meter_display->flush_async();
+}
+
+// Where the time goes: one record per task with the run count, total and
+// worst case run time, worst release latency and deadline misses, then one
+// per profiled stage with its cycle counts
+void report_task_fn(void* context)
+{
+    struct lorawan_scheduler_stats stats;
+    struct lorawan_profile_stats profile;
+    uint64_t elapsed_us;
+    uint64_t idle_us;
+    uint64_t xip_hits;
+    uint64_t xip_accesses;
+
+    lorawan_scheduler_get_stats(&stats);
+
+    LORAWAN_LOG("scheduler: busy %u ms, idle %u ms, sleeps %u\n",
+                (uint32_t)(stats.busy_us / 1000), (uint32_t)(stats.idle_us / 1000), stats.sleeps);
+
+    for (struct lorawan_task* task = lorawan_scheduler_tasks(); task != NULL; task = task->next) {
+        LORAWAN_LOG("task %s: runs %u, total %u ms, max %u us, latency %u us, misses %u\n",
+                    LORAWAN_LOG_STR(task->name), task->stats.runs, (uint32_t)(task->stats.run_time_us / 1000),
+                    task->stats.max_run_time_us, task->stats.max_latency_us, task->stats.deadline_misses);
+    }
+
+    lorawan_profile_get_idle(&elapsed_us, &idle_us);
+
+    LORAWAN_LOG("profile: busy %u/1000 over %u ms, idle %u ms\n",
+                lorawan_profile_busy_permille(), (uint32_t)(elapsed_us / 1000), (uint32_t)(idle_us / 1000));
+
+    // misses while sampling or in an RX window show up as jitter, build with
+    // PICO_LORAWAN_RAM_HOT_PATHS to keep those paths out of the cache
+    lorawan_profile_get_xip_cache(&xip_hits, &xip_accesses);
+
+    LORAWAN_LOG("xip cache: %u/1000 hits, %u misses of %u accesses\n",
+                (xip_accesses > 0) ? (uint32_t)((xip_hits * 1000) / xip_accesses) : 1000u,
+                (uint32_t)(xip_accesses - xip_hits), (uint32_t)xip_accesses);
+
+    struct lorawan_time_stats time_stats;
+
+    lorawan_get_time_stats(&time_stats);
+
+    LORAWAN_LOG("time: %s, %u syncs, %u requests, last %u s ago, correction %d ms, drift %d ppb\n",
+                LORAWAN_LOG_STR(time_stats.synchronized ? "network" : "uptime"), time_stats.syncs, time_stats.requests,
+                time_stats.since_sync_ms / 1000, time_stats.last_correction_ms, time_stats.drift_ppb);
+
+#if PICO_LORAWAN_FUOTA
+    struct lorawan_fuota_stats fuota_stats;
+
+    lorawan_fuota_get_stats(&fuota_stats);
+
+    LORAWAN_LOG("fuota: status %u, %u/%u fragments, %u lost, %u rewritten, write max %u us\n",
+                fuota_stats.status, fuota_stats.fragments_received, fuota_stats.fragments, fuota_stats.fragments_lost,
+                fuota_stats.journal_writes, fuota_stats.max_write_us);
+    LORAWAN_LOG("fuota: image %u, running %u%s, last result %u\n",
+                fuota_stats.image_version, fuota_stats.running_version,
+                LORAWAN_LOG_STR(fuota_stats.testing ? " (unconfirmed)" : ""), fuota_stats.last_result);
+#endif
+
+#if PICO_LORAWAN_SD_LOG
+    struct SdLogger::stats sd_stats;
+
+    sd_logger.get_stats(&sd_stats);
+
+    LORAWAN_LOG("sd log: %s, %u files, %u sectors, %u errors, %u records dropped\n",
+                LORAWAN_LOG_STR(sd_stats.mounted ? "mounted" : "no card"), sd_stats.files, sd_stats.sectors,
+                sd_stats.errors, sd_stats.dropped);
+#endif
+
+    for (int stage = 0; stage < LORAWAN_PROFILE_STAGES; stage++) {
+        lorawan_profile_get((enum lorawan_profile_stage)stage, &profile);
+
+        if (profile.count == 0) {
+            continue;
         }
 
-        uint8_t payload[48];
-        memcpy(payload, &adc_current_rms, sizeof(adc_current_rms));
-        memcpy(payload + sizeof(adc_current_rms), &adc_voltage_rms, sizeof(adc_voltage_rms));
-        memcpy(payload + sizeof(adc_current_rms) + sizeof(adc_voltage_rms), &active_power, sizeof(active_power));
-        memcpy(payload + sizeof(adc_current_rms) + sizeof(adc_voltage_rms) + sizeof(active_power), &apparent_power, sizeof(apparent_power));
-        memcpy(payload + sizeof(adc_current_rms) + sizeof(adc_voltage_rms) + sizeof(active_power) + sizeof(apparent_power), &reactive_power, sizeof(reactive_power));
-        memcpy(payload + sizeof(adc_current_rms) + sizeof(adc_voltage_rms) + sizeof(active_power) + sizeof(apparent_power) + sizeof(reactive_power), &power_factor, sizeof(power_factor));
+        LORAWAN_LOG("stage %s: runs %u, min %u, mean %u, max %u cycles, p50 < %u, p99 < %u, max %u us\n",
+                    LORAWAN_LOG_STR(lorawan_profile_stage_name((enum lorawan_profile_stage)stage)), profile.count,
+                    profile.min_cycles, lorawan_profile_mean(&profile), profile.max_cycles,
+                    lorawan_profile_percentile(&profile, 50), lorawan_profile_percentile(&profile, 99),
+                    lorawan_profile_cycles_to_us(profile.max_cycles));
+    }
 
-        uint32_t now = to_ms_since_boot(get_absolute_time());
+    if (profile_uplink) {
+        uint8_t payload[LORAWAN_PROFILE_ENCODED_MAX_SIZE];
+        int length = lorawan_profile_encode(payload, sizeof(payload));
 
-        if ((now - last_message_time) > 10000) {
-            // Try to send an unconfirmed uplink message
-            printf("sending unconfirmed message ... ");
-            if (lorawan_send_unconfirmed(payload, sizeof(payload), 2) < 0) {
-                printf("failed!!!\n");
+        // too large for the lowest datarates, skipped until ADR moves up
+        if (length > 0 && length <= lorawan_get_max_payload_size()) {
+            lorawan_send_unconfirmed(payload, length, PROFILE_UPLINK_PORT);
+        }
+    }
+}
+
+// One event per run, oldest first, the next measure task signals again
+// while any are left. An event stays unsent if the MAC cannot take it yet.
+void event_task_fn(void* context)
+{
+    struct meter_event event;
+    uint8_t payload[METER_EVENT_ENCODED_SIZE + 2];
+
+    if (meter_events_next_unsent(&power_events, &event) < 0) {
+        return;
+    }
+
+    meter_event_encode(&event, payload);
+
+    // the start of an event that waited for the MAC can be minutes old
+    uint16_t age = age_s(event.time_ms);
+    memcpy(payload + METER_EVENT_ENCODED_SIZE, &age, sizeof(age));
+
+    if (lorawan_send_unconfirmed(payload, sizeof(payload), EVENT_UPLINK_PORT) < 0) {
+        return;
+    }
+
+    meter_events_mark_sent(&power_events);
+
+    LORAWAN_LOG("event %u at %u ms: %u ms, depth %u/1000, %u half cycles\n",
+                event.type, event.time_ms, event.duration_ms, event.depth_permille, event.half_cycles);
+}
+
+// Logged events, then the frozen capture packed two samples per argument,
+// which re-arms it
+void events_dump()
+{
+    static uint16_t samples[METER_EVENTS_CAPTURE_SIZE];
+    struct meter_event event;
+    uint32_t trigger;
+
+    for (uint32_t i = 0; i < meter_events_count(&power_events); i++) {
+        meter_events_get(&power_events, i, &event);
+
+        LORAWAN_LOG("event %u: type %u at %u ms, %u ms, depth %u/1000, %u half cycles\n",
+                    i, event.type, event.time_ms, event.duration_ms, event.depth_permille, event.half_cycles);
+    }
+
+    uint32_t count = meter_events_get_capture(&power_events, samples, METER_EVENTS_CAPTURE_SIZE, &trigger);
+
+    if (count == 0) {
+        return;
+    }
+
+    LORAWAN_LOG("capture: %u samples, trigger at %u\n", count, trigger);
+
+    // a capture cut short by a gap ends in zeros
+    for (uint32_t i = 0; i < count; i += 16) {
+        uint32_t w[8];
+
+        for (uint32_t j = 0; j < 16; j++) {
+            uint32_t sample = (i + j < count) ? samples[i + j] : 0;
+
+            if ((j & 1) == 0) {
+                w[j / 2] = sample;
             } else {
-                printf("success!\n");
+                w[j / 2] |= sample << 16;
             }
-            last_message_time = now;
         }
 
-        // Update display with sensor values
-        display.clear();
-
-        sprintf(current_str, "I: %0.2f A", adc_current_rms);
-        sprintf(voltage_str, "V: %0.2f V", adc_voltage_rms);
-        sprintf(power_str, "P: %0.2f W", active_power);
-        sprintf(apparent_power_str, "S: %0.2f VA", apparent_power);
-        sprintf(reactive_power_str, "Q: %0.2f VAR", reactive_power);
-        sprintf(power_factor_str, "PF: %0.2f", power_factor);
-        
-        drawText(&display, font_8x8, current_str, 0, 0);
-        drawText(&display, font_8x8, voltage_str, 0, 8);
-        drawText(&display, font_8x8, power_str, 0, 16);
-        drawText(&display, font_8x8, apparent_power_str, 0, 24);
-        drawText(&display, font_8x8, reactive_power_str, 0, 32);
-        drawText(&display, font_8x8, power_factor_str, 0, 40);
-        display.sendBuffer();
-
-        if (lorawan_process_timeout_ms(1480) == 0 && lorawan_connected) {
-            receive_length = lorawan_receive(receive_buffer, sizeof(receive_buffer), &receive_port);
-            if (receive_length > -1) {
-                for (int i = 0; i < receive_length; i++) {
-                    printf("%02x", receive_buffer[i]);
-                }
-                printf("\n");
+        LORAWAN_LOG("capture %08x %08x %08x %08x %08x %08x %08x %08x\n",
+                    w[0], w[1], w[2], w[3], w[4], w[5], w[6], w[7]);
+    }
+
+    meter_events_release_capture(&power_events);
+}
+
+void log_task_fn(void* context)
+{
+    // records wait in the ring buffer, or are dropped and counted, while the
+    // stream owns the USB output
+    if (!waveform_stream.streaming()) {
+        log_drain();
+    }
+}
+
+void stream_task_fn(void* context)
+{
+    waveform_stream.service();
+}
+
+// Line commands from the host:
+//
+//   S            start streaming at the full ADC rate
+//   S <clkdiv>   start streaming with adc_set_clkdiv(clkdiv)
+//   Z [clkdiv]   start streaming compressed samples
+//   X            stop streaming, back to the event detector
+//   P            report the task and stage profile now
+//   D            toggle the profile uplink
+//   E            dump the event log and capture, re-arm the capture
+//   L            hand the SD log sector in progress to the writer
+//   T            send a DeviceTimeReq with the next uplink
+//   R            log the billing registers
+//   C            switch between Class A and Class C
+//   K <V> <A> <PF>  calibrate against a reference load, PF below 0 for a
+//                leading current
+void console_task_fn(void* context)
+{
+    static char line[40];
+    static size_t length = 0;
+    int c;
+
+    while ((c = getchar_timeout_us(0)) != PICO_ERROR_TIMEOUT) {
+        if (c != '\r' && c != '\n') {
+            if (length < sizeof(line) - 1) {
+                line[length++] = (char)c;
             }
+            continue;
+        }
+
+        line[length] = '\0';
+
+        if (line[0] == 'S') {
+            waveform_stream.start((float)atof(line + 1));
+        } else if (line[0] == 'Z') {
+            waveform_stream.start((float)atof(line + 1), true);
+        } else if (line[0] == 'X') {
+            events_monitor_start();
+        } else if (line[0] == 'P') {
+            lorawan_task_signal(&report_task);
+        } else if (line[0] == 'D') {
+            profile_uplink = !profile_uplink;
+        } else if (line[0] == 'E') {
+            events_dump();
+        } else if (line[0] == 'L') {
+#if PICO_LORAWAN_SD_LOG
+            sd_logger.flush();
+#endif
+        } else if (line[0] == 'T') {
+            lorawan_request_time();
+        } else if (line[0] == 'R') {
+            registers_dump();
+        } else if (line[0] == 'C') {
+            lorawan_set_class((lorawan_get_class() == CLASS_C) ? CLASS_A : CLASS_C);
+        } else if (line[0] == 'K') {
+            calibration_start(line + 1);
         }
+
+        length = 0;
     }
+}
 
-    return 0;
+// Low priority step: move whole log records to USB, never more than the
+// CDC FIFO can take without blocking
+void log_drain()
+{
+    static uint8_t chunk[256];
+
+    while (lorawan_log_pending() > 0) {
+        uint32_t available = tud_cdc_write_available();
+
+        if (available < LORAWAN_LOG_DRAIN_MIN_SIZE) {
+            break;
+        }
+
+        size_t length = lorawan_log_drain(chunk, (available < sizeof(chunk)) ? available : sizeof(chunk));
+
+        if (length == 0) {
+            break;
+        }
+
+        // raw output, no CR/LF translation
+        for (size_t i = 0; i < length; i++) {
+            putchar_raw(chunk[i]);
+        }
+    }
+}
+
+// The readings as float, then every event logged since the previous call.
+// Events are picked up from the free running log head, ones overwritten in
+// between are lost here too. Records are stamped in seconds since boot
+// until the network time is known, then a new log is started in UTC.
+void sd_log(const struct meter_readings* r)
+{
+#if PICO_LORAWAN_SD_LOG
+    static uint32_t events_logged = 0;
+    uint32_t time = readings_time_ms / 1000;
+    bool utc = (lorawan_time_from_boot_ms(readings_time_ms, &time, NULL) == 0);
+    float values[6] = {
+        (float)r->current_rms, (float)r->voltage_rms, (float)r->active_power,
+        (float)r->apparent_power, (float)r->reactive_power, (float)r->power_factor,
+    };
+
+    if (utc) {
+        sd_logger.set_time_base(METER_LOG_TIME_UNIX);
+    }
+
+    sd_logger.log_readings(time, values);
+
+    uint32_t count = meter_events_count(&power_events);
+    uint32_t first = power_events.log_head - count;
+    struct meter_event event;
+
+    if (events_logged < first) {
+        events_logged = first;
+    }
+
+    for (; events_logged != power_events.log_head; events_logged++) {
+        meter_events_get(&power_events, events_logged - first, &event);
+
+        // stamped with the start of the event
+        time = event.time_ms / 1000;
+
+        if (utc) {
+            lorawan_time_from_boot_ms(event.time_ms, &time, NULL);
+        }
+
+        sd_logger.log_event(time, &event);
+    }
+#endif
+}
+
+// Compact relative time stamp: seconds from time_ms, since boot, to now,
+// 65535 for anything older
+uint16_t age_s(uint32_t time_ms)
+{
+    uint32_t age = (to_ms_since_boot(get_absolute_time()) - time_ms) / 1000;
+
+    return (age < 0xffff) ? age : 0xffff;
+}
+
+// The readings stand for the time since the previous ones, up to two
+// measure periods: while the stream owns the ADC nothing is metered
+void registers_update(const struct meter_readings* r)
+{
+    static uint32_t previous_ms = 0;
+    uint32_t period_ms = measure_task.period_us / 1000;
+    uint32_t elapsed_ms = readings_time_ms - previous_ms;
+    uint32_t time = METER_TIME_UNKNOWN;
+
+    if (previous_ms == 0 || elapsed_ms > 2 * period_ms) {
+        elapsed_ms = period_ms;
+    }
+
+    previous_ms = readings_time_ms;
+
+    lorawan_time_from_boot_ms(readings_time_ms, &time, NULL);
+
+    // the energy of every circuit too, the registers have their total
+    if (circuits.count > 1) {
+        meter_circuits_accumulate(&circuits, elapsed_ms);
+    }
+
+    if (meter_registers_update(&registers, time, (int32_t)(r->active_power * 1000.0), elapsed_ms) & METER_REGISTERS_BLOCK_END) {
+        registers_save_pending = true;
+        lorawan_task_signal(&registers_task);
+    }
+}
+
+//   01 <schedule>  time-of-use schedule, see meter_tou_decode(...)
+//   02             new billing period, clears the peaks
+//   03             send a snapshot now
+void registers_downlink(const uint8_t* data, int length)
+{
+    struct meter_tou_schedule schedule;
+
+    if (length < 1) {
+        return;
+    }
+
+    if (data[0] == REGISTERS_COMMAND_SCHEDULE) {
+        if (meter_tou_decode(&schedule, data + 1, length - 1) < 0 ||
+            meter_registers_set_schedule(&registers, &schedule) < 0) {
+            LORAWAN_LOG("registers: invalid schedule\n");
+            return;
+        }
+
+        registers_save_pending = true;
+    } else if (data[0] == REGISTERS_COMMAND_RESET_PEAKS) {
+        meter_registers_reset_peaks(&registers);
+        registers_save_pending = true;
+    } else if (data[0] != REGISTERS_COMMAND_SNAPSHOT) {
+        return;
+    }
+
+    lorawan_task_signal(&registers_task);
+}
+
+// Saves the registers if they changed for good, then sends a snapshot; a
+// snapshot the MAC cannot take is not repeated, the next one has it all
+void registers_task_fn(void* context)
+{
+    uint8_t payload[METER_REGISTERS_ENCODED_SIZE];
+    uint32_t time = METER_TIME_UNKNOWN;
+
+    if (registers_save_pending) {
+        register_store.save(&registers);
+        registers_save_pending = false;
+
+#if PICO_LORAWAN_FUOTA
+        // nothing is lost restarting right after the save
+        if (lorawan_fuota_ready()) {
+            lorawan_fuota_apply();
+        }
+#endif
+    }
+
+    lorawan_get_time(&time, NULL);
+
+    meter_registers_encode(&registers, time, payload);
+
+    if (lorawan_send_unconfirmed(payload, sizeof(payload), REGISTERS_PORT) < 0) {
+        LORAWAN_LOG("registers: snapshot not sent\n");
+    }
+}
+
+void registers_dump()
+{
+    struct RegisterStore::stats stats;
+
+    register_store.get_stats(&stats);
+
+    LORAWAN_LOG("registers: import %u Wh (untimed %u Wh), export %u Wh, tariff %u now\n",
+                (uint32_t)(registers.import_total_uj / 3600000000ull), (uint32_t)(registers.import_untimed_uj / 3600000000ull),
+                (uint32_t)(registers.export_total_uj / 3600000000ull), registers.tou_tariff);
+
+    for (int i = 0; i < METER_TOU_TARIFFS; i++) {
+        LORAWAN_LOG("registers: tariff %u import %u Wh\n", i, (uint32_t)(registers.import_uj[i] / 3600000000ull));
+    }
+
+    LORAWAN_LOG("registers: demand block %u W, sliding %u W, peaks %u W at %u, %u W at %u\n",
+                registers.block_demand_mw / 1000, registers.sliding_demand_mw / 1000,
+                registers.block_peak.power_mw / 1000, registers.block_peak.time,
+                registers.sliding_peak.power_mw / 1000, registers.sliding_peak.time);
+
+    LORAWAN_LOG("registers: %u saves, %u erases, sequence %u\n", stats.saves, stats.erases, stats.sequence);
+}
+
+// The saved configuration, or the defaults if there is none or it is out
+// of range for this firmware, and the calibration
+void config_load()
+{
+    active_config = default_config;
+
+    if (!config_store.load(&active_config, &calibration, &calibrated) || config_check(&active_config) != CONFIG_STATUS_OK) {
+        active_config = config_defaults();
+    }
+
+    config_apply(&active_config);
+}
+
+// With the gains of the calibration, if there is one
+struct meter_config config_defaults()
+{
+    struct meter_config config = default_config;
+
+    if (calibrated) {
+        config.current_calibration_milli = (uint32_t)lround(calibration.current_gain * 1000);
+        config.voltage_calibration_milli = (uint32_t)lround(calibration.voltage_gain * 1000);
+    }
+
+    return config;
+}
+
+// CONFIG_STATUS_OK, or the first parameter out of range
+uint8_t config_check(const struct meter_config* config)
+{
+    if (config->num_samples < 100 || config->num_samples > MAX_SAMPLES) {
+        return CONFIG_NUM_SAMPLES;
+    }
+
+    if (config->current_calibration_milli < 1000 || config->current_calibration_milli > 10000000) {
+        return CONFIG_CURRENT_CALIBRATION;
+    }
+
+    if (config->voltage_calibration_milli < 1000 || config->voltage_calibration_milli > 10000000) {
+        return CONFIG_VOLTAGE_CALIBRATION;
+    }
+
+    // duty cycle and fair use at the low end, the task period in us at the
+    // high end
+    if (config->report_interval_s < 10 || config->report_interval_s > 3600) {
+        return CONFIG_REPORT_INTERVAL;
+    }
+
+    // two inputs of up to MAX_SAMPLES each fit in 200 ms, more circuits
+    // share the same number of samples
+    if (config->measure_period_ms < 200 || config->measure_period_ms > 60000) {
+        return CONFIG_MEASURE_PERIOD;
+    }
+
+    if (config->circuits < 1 || config->circuits > MAX_CIRCUITS) {
+        return CONFIG_CIRCUITS;
+    }
+
+    for (int i = 0; i < METER_CIRCUITS_MAX - 1; i++) {
+        if (config->circuit_calibration_milli[i] < 1000 || config->circuit_calibration_milli[i] > 10000000) {
+            return CONFIG_CIRCUIT2_CALIBRATION + i;
+        }
+    }
+
+    return CONFIG_STATUS_OK;
+}
+
+// The measure and uplink tasks start over with a changed period, the
+// readings continue with the next measure task run. The phase delay
+// follows the number of samples. The DC filters carry on, they start over
+// from the offsets of a new calibration only.
+void config_apply(const struct meter_config* config)
+{
+    num_samples = config->num_samples;
+    current_calibration = config->current_calibration_milli / 1000.0;
+    voltage_calibration = config->voltage_calibration_milli / 1000.0;
+
+    bool seeded = false;
+
+    if (calibrated) {
+        phase_delay = meter_calibration_phase_delay(&calibration, num_samples);
+        power_samples = meter_calibration_power_samples(&calibration, num_samples);
+
+        if (calibration.current_offset != seed_current || calibration.voltage_offset != seed_voltage) {
+            seed_current = calibration.current_offset;
+            seed_voltage = calibration.voltage_offset;
+            offset_current = seed_current;
+            offset_voltage = seed_voltage;
+            seeded = true;
+        }
+    }
+
+    // the energy of the circuits starts over when their number changes;
+    // circuit 1 is the single circuit's input, its gain and offset
+    if (circuits.count != config->circuits) {
+        meter_circuits_init(&circuits, config->circuits);
+        seeded = true;
+    }
+
+    if (seeded) {
+        circuits.voltage_offset = offset_voltage;
+        circuits.circuit[0].current_offset = offset_current;
+    }
+
+    circuits.circuit[0].current_calibration = current_calibration;
+
+    for (int i = 1; i < METER_CIRCUITS_MAX; i++) {
+        circuits.circuit[i].current_calibration = config->circuit_calibration_milli[i - 1] / 1000.0;
+    }
+
+    if (measure_task.period_us != config->measure_period_ms * 1000u) {
+        lorawan_task_set_period(&measure_task, config->measure_period_ms * 1000u);
+    }
+
+    if (uplink_task.period_us != config->report_interval_s * 1000000u) {
+        lorawan_task_set_period(&uplink_task, config->report_interval_s * 1000000u);
+    }
 }
 
+// Parameters of a set command, <id> <value> pairs, into config
+uint8_t config_decode(struct meter_config* config, const uint8_t* data, int length)
+{
+    while (length > 0) {
+        uint8_t id = data[0];
+        int size = (id == CONFIG_CURRENT_CALIBRATION || id == CONFIG_VOLTAGE_CALIBRATION ||
+                    id == CONFIG_CIRCUIT2_CALIBRATION || id == CONFIG_CIRCUIT3_CALIBRATION) ? 4 : 2;
+
+        if (id < CONFIG_NUM_SAMPLES || id > CONFIG_CIRCUIT3_CALIBRATION || length < 1 + size) {
+            return CONFIG_STATUS_MALFORMED;
+        }
+
+        uint32_t value = data[1] | (data[2] << 8);
+
+        if (size == 4) {
+            value |= (data[3] << 16) | ((uint32_t)data[4] << 24);
+        }
+
+        if (id == CONFIG_NUM_SAMPLES) {
+            config->num_samples = value;
+        } else if (id == CONFIG_CURRENT_CALIBRATION) {
+            config->current_calibration_milli = value;
+        } else if (id == CONFIG_VOLTAGE_CALIBRATION) {
+            config->voltage_calibration_milli = value;
+        } else if (id == CONFIG_REPORT_INTERVAL) {
+            config->report_interval_s = value;
+        } else if (id == CONFIG_MEASURE_PERIOD) {
+            config->measure_period_ms = value;
+        } else if (id == CONFIG_CIRCUITS) {
+            config->circuits = value;
+        } else {
+            config->circuit_calibration_milli[id - CONFIG_CIRCUIT2_CALIBRATION] = value;
+        }
+
+        data += 1 + size;
+        length -= 1 + size;
+    }
+
+    return config_check(config);
+}
+
+//   01                   send the configuration
+//   02 <id> <value> ...  set parameters, all of them or none
+//   03                   back to the defaults
+//
+// Values are little-endian: 01 number of samples (2 bytes), 02 and 03
+// current and voltage calibration in 1/1000 (4 bytes), 04 report interval
+// in s (2 bytes), 05 measure period in ms (2 bytes), 06 number of circuits
+// (2 bytes), 07 and 08 current calibration of circuits 2 and 3 in 1/1000
+// (4 bytes)
+void config_downlink(const uint8_t* data, int length)
+{
+    struct meter_config config = active_config;
+    uint8_t status = CONFIG_STATUS_OK;
+
+    if (length < 1) {
+        return;
+    }
+
+    if (data[0] == CONFIG_COMMAND_SET) {
+        status = config_decode(&config, data + 1, length - 1);
+    } else if (data[0] == CONFIG_COMMAND_DEFAULTS) {
+        config = config_defaults();
+    } else if (data[0] != CONFIG_COMMAND_GET) {
+        status = CONFIG_STATUS_MALFORMED;
+    }
+
+    if (status == CONFIG_STATUS_OK && data[0] != CONFIG_COMMAND_GET) {
+        active_config = config;
+        config_apply(&active_config);
+        meter_events_set_nominal(&power_events, power_events_nominal());
+        config_save_pending = true;
+    }
+
+    config_answer[0] = data[0];
+    config_answer[1] = status;
+    config_answer_pending = true;
+
+    lorawan_task_signal(&config_task);
+}
+
+// Saves a changed configuration, then answers with the command, the
+// status and the configuration in effect, in the order and units of the
+// set command without the ids; an answer the MAC cannot take is dropped
+void config_task_fn(void* context)
+{
+    uint8_t payload[2 + CONFIG_ENCODED_SIZE];
+
+    if (config_save_pending) {
+        config_store.save(&active_config, calibrated ? &calibration : NULL);
+        config_save_pending = false;
+    }
+
+    // a calibration is saved without an answer
+    if (!config_answer_pending) {
+        return;
+    }
+
+    config_answer_pending = false;
+
+    payload[0] = config_answer[0];
+    payload[1] = config_answer[1];
+    memcpy(payload + 2, &active_config.num_samples, 2);
+    memcpy(payload + 4, &active_config.current_calibration_milli, 4);
+    memcpy(payload + 8, &active_config.voltage_calibration_milli, 4);
+    memcpy(payload + 12, &active_config.report_interval_s, 2);
+    memcpy(payload + 14, &active_config.measure_period_ms, 2);
+    memcpy(payload + 16, &active_config.circuits, 2);
+    memcpy(payload + 18, &active_config.circuit_calibration_milli[0], 4);
+    memcpy(payload + 22, &active_config.circuit_calibration_milli[1], 4);
+
+    if (lorawan_send_unconfirmed(payload, sizeof(payload), CONFIG_PORT) < 0) {
+        LORAWAN_LOG("config: answer not sent\n");
+        return;
+    }
+
+    LORAWAN_LOG("config: command %u, status %u, %u samples, calibration %u %u, report %u s, measure %u ms, %u circuits\n",
+                payload[0], payload[1], active_config.num_samples, active_config.current_calibration_milli,
+                active_config.voltage_calibration_milli, active_config.report_interval_s, active_config.measure_period_ms,
+                active_config.circuits);
+}
+
+// K <V> <A> <PF>: the reference load, from the next measure task run on
+void calibration_start(const char* args)
+{
+    struct meter_calibration_reference reference;
+    char* end;
+
+    reference.voltage_rms = strtod(args, &end);
+    reference.current_rms = strtod(end, &end);
+    reference.power_factor = strtod(end, &end);
+
+    if (!(reference.voltage_rms > 0 && reference.current_rms > 0 && fabs(reference.power_factor) <= 1)) {
+        LORAWAN_LOG("calibration: K <V> <A> <PF>, PF below 0 for a leading current\n");
+        return;
+    }
+
+    meter_calibration_start(&calibration_solver, &reference, num_samples);
+    calibration_windows = 1 + METER_CALIBRATION_WINDOWS;
+}
+
+// One calibration window, measured like the readings with unity gains. A
+// calibration that cannot be solved changes nothing.
+void calibration_step()
+{
+    struct meter_calibration result;
+    double seed_current = meter_calibration_seed(&calibration_solver, METER_INPUT_CURRENT);
+    double seed_voltage = meter_calibration_seed(&calibration_solver, METER_INPUT_VOLTAGE);
+    double filter_current = seed_current;
+    double filter_voltage = seed_voltage;
+
+    // the number of samples it was started with, a downlink may change it
+    meter_current_get(&metering_source, calibration_solver.num_samples, 1.0, &filter_current, current_samples);
+    meter_voltage_get(&metering_source, calibration_solver.num_samples, 1.0, &filter_voltage, voltage_samples);
+    meter_calibration_add_window(&calibration_solver, voltage_samples, current_samples, seed_voltage, seed_current);
+
+    if (--calibration_windows > 0) {
+        return;
+    }
+
+    int status = meter_calibration_solve(&calibration_solver, &result);
+
+    if (status < 0) {
+        LORAWAN_LOG("calibration: failed, error %d\n", status);
+        return;
+    }
+
+    calibration = result;
+    calibrated = true;
+
+    active_config.current_calibration_milli = (uint32_t)lround(result.current_gain * 1000);
+    active_config.voltage_calibration_milli = (uint32_t)lround(result.voltage_gain * 1000);
+
+    config_apply(&active_config);
+    meter_events_set_nominal(&power_events, power_events_nominal());
+
+    config_save_pending = true;
+    lorawan_task_signal(&config_task);
+
+    LORAWAN_LOG("calibration: gains %u %u /1000, offsets %0.2f %0.2f, %0.2f samples per cycle, phase delay %d samples\n",
+                active_config.voltage_calibration_milli, active_config.current_calibration_milli,
+                LORAWAN_LOG_FLOAT(result.voltage_offset), LORAWAN_LOG_FLOAT(result.current_offset),
+                LORAWAN_LOG_FLOAT(result.cycle_samples), result.phase_delay);
+}
 
 void current_voltage_init()
 {
+    metering_source = meter_source_adc;
+
     adc_init();
     adc_gpio_init(27); // Use Pin 27 for ADC1
     adc_gpio_init(26); // Use Pin 26 for ADC0
+    adc_gpio_init(28); // ADC2, circuit 2
+#if MAX_CIRCUITS > 2
+    adc_gpio_init(29); // ADC3, circuit 3
+#endif
 }
 
-double current_get(uint num_samples, double current_calibration, double offset_current, double *current_samples)
+// Thresholds from IEC 61000-4-30: sag below 90 %, swell above 110 %,
+// interruption below 10 % of nominal, 2 % hysteresis
+void power_events_init()
 {
-    adc_select_input(1);
-    double sample_current = 0;
-    double sum_current = 0;
-    for (uint sample = 0; sample < num_samples; sample++) {
-        sample_current = adc_read();
-        offset_current += ((sample_current - offset_current) / 4096);
-        double filtered_current = sample_current - offset_current;
+    struct meter_events_config config = {
+        .nominal_rms = power_events_nominal(),
+        .sag_permille = 900,
+        .swell_permille = 1100,
+        .interruption_permille = 100,
+        .hysteresis_permille = 20,
+        .zero_hysteresis = 8,
+        .capture_pre = METER_EVENTS_CAPTURE_SIZE / 4,
+    };
 
-        current_samples[sample] = filtered_current;  // Store the sample
+    meter_events_init(&power_events, &config);
 
-        double sqrt_current = filtered_current * filtered_current;
-        sum_current += sqrt_current;
-    }
-    double current_ratio = current_calibration * ((SUPPLY_VOLTAGE / 1000.0) / ADC_COUNTS);
-    double current_rms = current_ratio * sqrt(sum_current / num_samples);
-    return current_rms;
-} 
+    waveform_stream.set_block_handler(events_block, &power_events);
+}
 
-double voltage_get(uint num_samples, double voltage_calibration, double offset_voltage, double *voltage_samples) {
-    adc_select_input(0);
-    double sample_voltage;
-    double sum_voltage = 0;
-    for (uint sample = 0; sample < num_samples; sample++) {
-        sample_voltage = adc_read();
-        offset_voltage += ((sample_voltage - offset_voltage) / 4096);
-        double filtered_voltage = sample_voltage - offset_voltage;
+// The voltage and current capture without USB output, for the event detector
+void events_monitor_start()
+{
+    waveform_stream.start(EVENTS_CLKDIV, false, false);
+}
 
-        voltage_samples[sample] = filtered_voltage;  // Store the sample
+// Every block's voltage samples at EVENTS_SAMPLE_RATE, also while streaming
+// at a higher rate, timed from the block's capture time
+void events_block(void* context, const uint16_t* samples, size_t pairs, uint64_t time_us, uint32_t sample_rate, bool gap)
+{
+    struct meter_events* events = (struct meter_events*)context;
+    uint32_t step = (sample_rate / 2 + EVENTS_SAMPLE_RATE / 2) / EVENTS_SAMPLE_RATE;
+    static size_t next = 0;
 
-        double sqrt_voltage = filtered_voltage * filtered_voltage;
-        sum_voltage += sqrt_voltage;
+    if (step == 0) {
+        step = 1;
     }
-    double voltage_ratio = voltage_calibration * ((SUPPLY_VOLTAGE / 1000.0) / ADC_COUNTS);
-    double voltage_rms = voltage_ratio * sqrt(sum_voltage / num_samples);
-    return voltage_rms;
-}
 
-//Active Power Is calculated by taking the average of instantaneous power values over time. This automatically accounts for any phase difference between voltage and current.
-//For each sample, multiply instantaneous voltage by instantaneous current. Take the average of all these products
+    if (gap) {
+        meter_events_gap(events);
+        next = 0;
+    }
 
-double calculate_power(double *voltage_samples, double *current_samples, uint num_samples, 
-                       double voltage_calibration, double current_calibration) {
-    double sum_power = 0;
-    double voltage_ratio = voltage_calibration * ((SUPPLY_VOLTAGE / 1000.0) / ADC_COUNTS);
-    double current_ratio = current_calibration * ((SUPPLY_VOLTAGE / 1000.0) / ADC_COUNTS);
+    // time_us is that of the last pair, two samples per pair
+    if (next < pairs) {
+        meter_events_clock(events, time_us - (uint64_t)(pairs - 1 - next) * 2000000 / sample_rate, sample_rate / 2 / step);
+    }
 
-    for (uint sample = 0; sample < num_samples; sample++) {
-        double calibrated_voltage = voltage_samples[sample] * voltage_ratio;
-        double calibrated_current = current_samples[sample] * current_ratio;
-        sum_power += calibrated_voltage * calibrated_current;
+    for (; next < pairs; next += step) {
+        meter_events_sample(events, samples[2 * next]);
     }
-    
-    return sum_power / num_samples;
-}
 
-double calculate_apparent_power(double voltage_rms, double current_rms) {
-    return voltage_rms * current_rms;
+    next -= pairs;
 }
 
-double calculate_reactive_power(double apparent_power, double active_power) {
-    return sqrt(pow(apparent_power, 2) - pow(active_power, 2));
+// Without a table the measure task reads the ADC codes as they are
+void adc_linearization_load()
+{
+    uint32_t ramp_samples;
+
+    if (meter_linearization_restore(adc_linearization, (const uint8_t*)(XIP_BASE + ADC_LINEARIZATION_OFFSET), &ramp_samples) < 0) {
+        printf("ADC linearization: none\n");
+        return;
+    }
+
+    metering_source.linearization = adc_linearization;
+    printf("ADC linearization: from %u ramp samples\n", (unsigned)ramp_samples);
 }
 
-double calculate_power_factor(double active_power, double apparent_power) {
-    return active_power / apparent_power;
-}
\ No newline at end of file
+// NOMINAL_VOLTAGE in ADC counts at the voltage calibration
+uint16_t power_events_nominal()
+{
+    double voltage_ratio = voltage_calibration * ((SUPPLY_VOLTAGE / 1000.0) / ADC_COUNTS);
+    double nominal = NOMINAL_VOLTAGE / voltage_ratio;
+
+    return (nominal < ADC_COUNTS) ? (uint16_t)nominal : ADC_COUNTS;
+}
@@ -0,0 +1,294 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#include <string.h>
+
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+
+#include "meter_display.h"
+
+#define SSD1306_CONTROL_COMMAND     0x00
+#define SSD1306_CONTROL_DATA        0x40
+#define SSD1306_COLUMNADDR          0x21
+#define SSD1306_PAGEADDR            0x22
+
+// Unchanged columns between two changed runs are resent rather than
+// starting a new span when the gap is shorter than the cost of the address
+// commands and the extra I2C transaction
+#define SPAN_MERGE_GAP              10
+
+// Every span but the last one of a page is followed by a gap of more than
+// SPAN_MERGE_GAP columns, which bounds the spans per page
+#define MAX_SPANS                   (MeterDisplay::PAGES * (MeterDisplay::WIDTH / (SPAN_MERGE_GAP + 2) + 1))
+
+// Display that owns the DMA completion interrupt
+static MeterDisplay* dma_irq_display = NULL;
+
+MeterDisplay::MeterDisplay(i2c_inst_t* i2c, uint8_t address) :
+    i2c_(i2c),
+    address_(address),
+    full_(true),
+    in_flight_(false),
+    tx_length_(0)
+{
+    memset(frame_, 0, sizeof(frame_));
+    memset(sent_, 0, sizeof(sent_));
+    memset(&stats_, 0, sizeof(stats_));
+
+    dma_channel_ = dma_claim_unused_channel(true);
+
+    dma_channel_config config = dma_channel_get_default_config(dma_channel_);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_16);
+    channel_config_set_read_increment(&config, true);
+    channel_config_set_write_increment(&config, false);
+    channel_config_set_dreq(&config, i2c_get_dreq(i2c_, true));
+    dma_channel_configure(dma_channel_, &config, &i2c_get_hw(i2c_)->data_cmd, tx_, 0, false);
+
+    dma_irq_display = this;
+    dma_channel_set_irq1_enabled(dma_channel_, true);
+    irq_add_shared_handler(DMA_IRQ_1, dma_irq_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(DMA_IRQ_1, true);
+}
+
+MeterDisplay::~MeterDisplay()
+{
+    while (busy()) {
+        tight_loop_contents();
+    }
+
+    dma_channel_set_irq1_enabled(dma_channel_, false);
+    irq_remove_handler(DMA_IRQ_1, dma_irq_handler);
+    dma_channel_unclaim(dma_channel_);
+    dma_irq_display = NULL;
+}
+
+void MeterDisplay::dma_irq_handler()
+{
+    MeterDisplay* display = dma_irq_display;
+
+    if (display == NULL || !(dma_hw->ints1 & (1u << display->dma_channel_))) {
+        return;
+    }
+
+    dma_hw->ints1 = 1u << display->dma_channel_;
+
+    // the last words may still be in the I2C FIFO, busy() checks the bus,
+    // this wakes anyone waiting in WFE to do so
+    __sev();
+}
+
+void MeterDisplay::clear()
+{
+    memset(frame_, 0, sizeof(frame_));
+}
+
+void MeterDisplay::set_pixel(uint8_t x, uint8_t y, bool on)
+{
+    if (x >= WIDTH || y >= PAGES * 8) {
+        return;
+    }
+
+    if (on) {
+        frame_[y >> 3][x] |= (1 << (y & 7));
+    } else {
+        frame_[y >> 3][x] &= ~(1 << (y & 7));
+    }
+}
+
+void MeterDisplay::draw_text(const unsigned char* font, const char* text, uint8_t x, uint8_t y)
+{
+    // pico_ssd1306 fonts: width, height, then the glyphs from ' ' on, each
+    // column stored top to bottom with the least significant bit first
+    const uint8_t font_width = font[0];
+    const uint8_t font_height = font[1];
+    const uint16_t glyph_size = (font_width * font_height) / 8;
+
+    for (; *text != '\0'; text++, x += font_width) {
+        if ((uint8_t)*text < 32) {
+            continue;
+        }
+
+        const unsigned char* glyph = font + 2 + ((uint8_t)*text - 32) * glyph_size;
+
+        if (font_height == 8 && (y & 7) == 0 && y < PAGES * 8) {
+            uint8_t* column = &frame_[y >> 3][x];
+
+            for (uint8_t i = 0; i < font_width && (x + i) < WIDTH; i++) {
+                column[i] |= glyph[i];
+            }
+            continue;
+        }
+
+        uint8_t bit = 0;
+
+        for (uint8_t gx = 0; gx < font_width; gx++) {
+            for (uint8_t gy = 0; gy < font_height; gy++) {
+                if ((*glyph >> bit) & 1) {
+                    set_pixel(x + gx, y + gy, true);
+                }
+
+                if (++bit == 8) {
+                    bit = 0;
+                    glyph++;
+                }
+            }
+        }
+    }
+}
+
+void MeterDisplay::invalidate()
+{
+    full_ = true;
+}
+
+size_t MeterDisplay::collect_spans(struct span* spans, size_t max_spans)
+{
+    size_t count = 0;
+
+    for (uint8_t page = 0; page < PAGES; page++) {
+        const uint8_t* now = frame_[page];
+        uint8_t* before = sent_[page];
+        int first = -1;
+        int last = -1;
+
+        for (int column = 0; column < WIDTH; column++) {
+            if (!full_ && now[column] == before[column]) {
+                continue;
+            }
+
+            if (first >= 0 && (column - last) > SPAN_MERGE_GAP && count < max_spans) {
+                spans[count++] = { page, (uint8_t)first, (uint8_t)last };
+                first = -1;
+            }
+
+            if (first < 0) {
+                first = column;
+            }
+            last = column;
+        }
+
+        if (first >= 0 && count < max_spans) {
+            spans[count++] = { page, (uint8_t)first, (uint8_t)last };
+        }
+
+        memcpy(before, now, WIDTH);
+    }
+
+    full_ = false;
+
+    return count;
+}
+
+void MeterDisplay::queue_span(const struct span& span)
+{
+    const uint8_t commands[] = {
+        SSD1306_CONTROL_COMMAND,
+        SSD1306_COLUMNADDR, span.first, span.last,
+        SSD1306_PAGEADDR, span.page, span.page
+    };
+    const uint8_t* data = &sent_[span.page][span.first];
+    size_t length = span.last - span.first + 1;
+    uint16_t* tx = tx_ + tx_length_;
+
+    // a STOP ends each transaction, the controller issues a new START for
+    // the next word in the FIFO
+    for (size_t i = 0; i < sizeof(commands); i++) {
+        *tx++ = commands[i];
+    }
+    tx[-1] |= I2C_IC_DATA_CMD_STOP_BITS;
+
+    *tx++ = SSD1306_CONTROL_DATA;
+    for (size_t i = 0; i < length; i++) {
+        *tx++ = data[i];
+    }
+    tx[-1] |= I2C_IC_DATA_CMD_STOP_BITS;
+
+    tx_length_ = tx - tx_;
+
+    stats_.spans++;
+    stats_.bytes += sizeof(commands) + 1 + length;
+}
+
+bool MeterDisplay::busy()
+{
+    if (!in_flight_) {
+        return false;
+    }
+
+    i2c_hw_t* hw = i2c_get_hw(i2c_);
+
+    if (hw->tx_abrt_source) {
+        // the controller flushed its FIFO, drop the rest of the frame and
+        // resend everything next time since the panel state is unknown
+        dma_channel_abort(dma_channel_);
+        (void)hw->clr_tx_abrt;
+        stats_.aborts++;
+        full_ = true;
+        in_flight_ = false;
+        return false;
+    }
+
+    if (dma_channel_is_busy(dma_channel_) ||
+        !(hw->status & I2C_IC_STATUS_TFE_BITS) ||
+        (hw->status & I2C_IC_STATUS_MST_ACTIVITY_BITS)) {
+        return true;
+    }
+
+    in_flight_ = false;
+
+    return false;
+}
+
+bool MeterDisplay::flush_async()
+{
+    if (busy()) {
+        stats_.busy++;
+        return false;
+    }
+
+    struct span spans[MAX_SPANS];
+    size_t count = collect_spans(spans, MAX_SPANS);
+
+    stats_.flushes++;
+
+    if (count == 0) {
+        return true;
+    }
+
+    tx_length_ = 0;
+    for (size_t i = 0; i < count; i++) {
+        queue_span(spans[i]);
+    }
+
+    // target address can only change with the controller disabled
+    i2c_hw_t* hw = i2c_get_hw(i2c_);
+    hw->enable = 0;
+    hw->tar = address_;
+    hw->enable = 1;
+
+    in_flight_ = true;
+    dma_channel_transfer_from_buffer_now(dma_channel_, tx_, tx_length_);
+
+    return true;
+}
+
+size_t MeterDisplay::flush()
+{
+    uint32_t bytes = stats_.bytes;
+
+    while (!flush_async()) {
+        tight_loop_contents();
+    }
+
+    while (busy()) {
+        tight_loop_contents();
+    }
+
+    return stats_.bytes - bytes;
+}
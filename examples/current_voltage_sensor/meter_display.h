@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#ifndef _METER_DISPLAY_H_
+#define _METER_DISPLAY_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "hardware/i2c.h"
+
+// Frame layer on top of an SSD1306 that pico_ssd1306 has initialized.
+//
+// Drawing goes to a local frame, flush() compares it with the frame last
+// sent to the panel and only writes the changed column spans of each page,
+// using the controller's page / column address window. Text in 8 pixel high
+// fonts at page aligned rows is copied glyph column by glyph column, which
+// is the controller's native byte layout.
+//
+// The spans are queued as I2C data / command words and sent by DMA, so a
+// flush returns as soon as the transfer is started. Only one frame is in
+// flight at a time, its completion is signalled with an event (SEV) that
+// wakes WFE based waits such as lorawan_process_timeout_ms().
+class MeterDisplay {
+public:
+    static const uint8_t WIDTH = 128;
+    static const uint8_t PAGES = 8;
+
+    MeterDisplay(i2c_inst_t* i2c, uint8_t address);
+
+    ~MeterDisplay();
+
+    void clear();
+
+    void set_pixel(uint8_t x, uint8_t y, bool on);
+
+    void draw_text(const unsigned char* font, const char* text, uint8_t x, uint8_t y);
+
+    // Send the next full frame, e.g. after the panel was written elsewhere
+    void invalidate();
+
+    // Start writing the changed spans to the panel. Returns false without
+    // consuming the frame if the previous one is still in flight.
+    bool flush_async();
+
+    // Write the changed spans and wait for completion, returns the number of
+    // bytes sent
+    size_t flush();
+
+    // True while a frame is being transferred
+    bool busy();
+
+    struct stats {
+        uint32_t flushes;
+        uint32_t spans;
+        uint32_t bytes;
+        uint32_t busy;      // flush_async() calls rejected while in flight
+        uint32_t aborts;    // transfers aborted by the I2C controller, e.g. NACK
+    };
+
+    const struct stats& get_stats() const { return stats_; }
+
+protected:
+    struct span {
+        uint8_t page;
+        uint8_t first;
+        uint8_t last;
+    };
+
+    // Collect the changed spans and mark them as sent, returns the span count
+    size_t collect_spans(struct span* spans, size_t max_spans);
+
+    // Append a span to the DMA transfer as one command and one data transaction
+    void queue_span(const struct span& span);
+
+    static void dma_irq_handler();
+
+    i2c_inst_t* i2c_;
+    uint8_t address_;
+    bool full_;
+    uint8_t frame_[PAGES][WIDTH];
+    uint8_t sent_[PAGES][WIDTH];
+    struct stats stats_;
+
+    int dma_channel_;
+    volatile bool in_flight_;
+    size_t tx_length_;
+
+    // IC_DATA_CMD words: command transaction (7) and data transaction
+    // (1 + WIDTH) per page in the worst case
+    uint16_t tx_[PAGES * (7 + 1 + WIDTH)];
+};
+
+#endif
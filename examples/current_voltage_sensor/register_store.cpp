@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#include <string.h>
+
+#include "register_store.h"
+
+#include "hardware/sync.h"
+#include "pico/multicore.h"
+#include "pico/lorawan_profile.h"
+
+static_assert(METER_REGISTERS_SAVED_SIZE <= FLASH_PAGE_SIZE, "saved registers do not fit a flash page");
+
+static const uint8_t* page_address(uint32_t page)
+{
+    return (const uint8_t*)(XIP_BASE + RegisterStore::OFFSET + page * FLASH_PAGE_SIZE);
+}
+
+static bool page_blank(uint32_t page)
+{
+    const uint8_t* p = page_address(page);
+
+    for (uint32_t i = 0; i < FLASH_PAGE_SIZE; i++) {
+        if (p[i] != 0xff) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+RegisterStore::RegisterStore() :
+    next_page_(0),
+    sequence_(0),
+    saves_(0),
+    erases_(0)
+{
+}
+
+bool RegisterStore::load(struct meter_registers* registers)
+{
+    static struct meter_registers candidate;
+    bool found = false;
+
+    for (uint32_t page = 0; page < PAGES; page++) {
+        uint32_t sequence;
+
+        candidate.interval_s = registers->interval_s;
+
+        if (meter_registers_restore(&candidate, page_address(page), &sequence) < 0) {
+            continue;
+        }
+
+        if (!found || (int32_t)(sequence - sequence_) > 0) {
+            *registers = candidate;
+            sequence_ = sequence;
+            next_page_ = (page + 1) % PAGES;
+            found = true;
+        }
+    }
+
+    return found;
+}
+
+void RegisterStore::save(const struct meter_registers* registers)
+{
+    static uint8_t page[FLASH_PAGE_SIZE];
+
+    memset(page, 0xff, sizeof(page));
+    meter_registers_save(registers, ++sequence_, page);
+
+    // left over from another firmware, start over in the next sector
+    if ((next_page_ % PAGES_PER_SECTOR) != 0 && !page_blank(next_page_)) {
+        next_page_ = (next_page_ / PAGES_PER_SECTOR + 1) * PAGES_PER_SECTOR % PAGES;
+    }
+
+    program(next_page_, page);
+
+    next_page_ = (next_page_ + 1) % PAGES;
+    saves_++;
+}
+
+void RegisterStore::program(uint32_t page, const uint8_t* data)
+{
+    LORAWAN_PROFILE_SCOPE(LORAWAN_PROFILE_FLASH);
+
+    uint32_t offset = OFFSET + page * FLASH_PAGE_SIZE;
+
+    // the SD log writer on core 1 runs from flash too, see EepromMcuFlush()
+    bool lockout = multicore_lockout_victim_is_initialized(1);
+
+    if (lockout) {
+        multicore_lockout_start_blocking();
+    }
+
+    uint32_t interrupts = save_and_disable_interrupts();
+
+    if ((page % PAGES_PER_SECTOR) == 0) {
+        flash_range_erase(offset, FLASH_SECTOR_SIZE);
+        erases_++;
+    }
+
+    flash_range_program(offset, data, FLASH_PAGE_SIZE);
+
+    restore_interrupts(interrupts);
+
+    if (lockout) {
+        multicore_lockout_end_blocking();
+    }
+}
+
+void RegisterStore::get_stats(struct stats* stats) const
+{
+    stats->saves = saves_;
+    stats->erases = erases_;
+    stats->sequence = sequence_;
+}
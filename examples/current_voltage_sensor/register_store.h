@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#ifndef _REGISTER_STORE_H_
+#define _REGISTER_STORE_H_
+
+#include <stdint.h>
+
+#include "hardware/flash.h"
+#include "meter/registers.h"
+
+// Billing registers in the two flash sectors below the LoRaWAN NVM sector.
+//
+// Every save programs the next 256-byte page with meter_registers_save(...),
+// which carries a sequence number and a CRC, and a sector is only erased
+// when the pages move on to it, while the other one still holds the latest
+// state. The newest valid page wins on load, a save torn by a reset leaves
+// the previous one.
+//
+// Saved at every demand block end, 96 pages a day: each sector is erased 3
+// times a day, some 90 years of its 100k erase cycles.
+class RegisterStore {
+public:
+    static const uint32_t SECTORS = 2;
+    static const uint32_t PAGES_PER_SECTOR = FLASH_SECTOR_SIZE / FLASH_PAGE_SIZE;
+    static const uint32_t PAGES = SECTORS * PAGES_PER_SECTOR;
+    static const uint32_t OFFSET = PICO_FLASH_SIZE_BYTES - (SECTORS + 1) * FLASH_SECTOR_SIZE;
+
+    RegisterStore();
+
+    // Restores the newest saved state, returns false if there is none
+    bool load(struct meter_registers* registers);
+
+    void save(const struct meter_registers* registers);
+
+    struct stats {
+        uint32_t saves;
+        uint32_t erases;
+        uint32_t sequence;          // of the newest page
+    };
+
+    void get_stats(struct stats* stats) const;
+
+protected:
+    void program(uint32_t page, const uint8_t* data);
+
+    uint32_t next_page_;
+    uint32_t sequence_;
+    uint32_t saves_;
+    uint32_t erases_;
+};
+
+#endif
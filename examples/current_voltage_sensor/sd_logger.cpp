@@ -0,0 +1,266 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sd_logger.h"
+
+#include "pico/multicore.h"
+#include "pico/stdlib.h"
+#include "ff.h"
+
+// the file system state and the open log belong to core 1
+static FATFS fatfs;
+static FIL file;
+static uint32_t file_number = 0;
+
+static SdLogger* core1_logger = NULL;
+
+SdLogger::SdLogger() :
+    device_(""),
+    time_base_(METER_LOG_TIME_UPTIME),
+    restart_(false),
+    sectors_(0),
+    errors_(0),
+    files_(0),
+    mounted_(false)
+{
+    memset(&writer_, 0, sizeof(writer_));
+
+    queue_init(&free_, sizeof(uint8_t*), SECTORS);
+    queue_init(&full_, sizeof(uint8_t*), SECTORS);
+
+    for (size_t i = 0; i < SECTORS; i++) {
+        uint8_t* sector = buffers_[i];
+
+        queue_add_blocking(&free_, &sector);
+    }
+}
+
+void SdLogger::start(const char* device)
+{
+    device_ = device;
+
+    meter_log_start(&writer_, get_sector, put_sector, this, time_base_,
+                    to_ms_since_boot(get_absolute_time()) / 1000, device_);
+
+    core1_logger = this;
+    multicore_launch_core1(core1_entry);
+}
+
+uint8_t* SdLogger::get_sector(void* context)
+{
+    SdLogger* logger = (SdLogger*)context;
+    uint8_t* sector;
+
+    return queue_try_remove(&logger->free_, &sector) ? sector : NULL;
+}
+
+void SdLogger::put_sector(void* context, uint8_t* sector)
+{
+    SdLogger* logger = (SdLogger*)context;
+
+    // never full, there are only SECTORS buffers
+    queue_try_add(&logger->full_, &sector);
+}
+
+void SdLogger::restart_if_needed(uint32_t time)
+{
+    if (!restart_) {
+        return;
+    }
+
+    // the sector in progress belongs to the ended file, core 1 still writes
+    // it there after a time base change or discards it after an error
+    meter_log_flush(&writer_);
+
+    uint32_t dropped = writer_.dropped_total;
+
+    restart_ = false;
+
+    if (meter_log_start(&writer_, get_sector, put_sector, this, time_base_, time, device_) < 0) {
+        restart_ = true;
+    }
+
+    writer_.dropped_total = dropped;
+}
+
+void SdLogger::append(uint8_t type, uint32_t time, const void* payload, uint8_t length)
+{
+    restart_if_needed(time);
+
+    meter_log_append(&writer_, type, time, payload, length);
+}
+
+void SdLogger::log_readings(uint32_t time, const float values[6])
+{
+    append(METER_LOG_RECORD_MEASUREMENT, time, values, 6 * sizeof(float));
+}
+
+void SdLogger::log_event(uint32_t time, const struct meter_event* event)
+{
+    uint8_t payload[METER_EVENT_ENCODED_SIZE];
+
+    meter_event_encode(event, payload);
+
+    append(METER_LOG_RECORD_EVENT, time, payload, sizeof(payload));
+}
+
+void SdLogger::flush()
+{
+    meter_log_flush(&writer_);
+}
+
+void SdLogger::set_time_base(uint8_t time_base)
+{
+    if (time_base != time_base_) {
+        time_base_ = time_base;
+        restart_ = true;
+    }
+}
+
+void SdLogger::get_stats(struct stats* stats) const
+{
+    stats->sectors = sectors_;
+    stats->errors = errors_;
+    stats->files = files_;
+    stats->dropped = writer_.dropped_total;
+    stats->mounted = mounted_;
+}
+
+void SdLogger::core1_entry()
+{
+    // lets core 0 pause this core while it writes the internal flash
+    multicore_lockout_victim_init();
+
+    core1_logger->writer_loop();
+}
+
+bool SdLogger::open_file()
+{
+    char name[16];
+
+    if (!mounted_) {
+        if (f_mount(&fatfs, "0:", 1) != FR_OK) {
+            return false;
+        }
+
+        mounted_ = true;
+    }
+
+    // the next number after the files already on the card
+    while (file_number < 100000) {
+        snprintf(name, sizeof(name), "LOG%05u.MLG", (unsigned)file_number++);
+
+        FRESULT result = f_open(&file, name, FA_WRITE | FA_CREATE_NEW);
+
+        if (result == FR_OK) {
+            files_++;
+            return true;
+        }
+
+        if (result != FR_EXIST) {
+            break;
+        }
+    }
+
+    f_unmount("0:");
+    mounted_ = false;
+
+    return false;
+}
+
+void SdLogger::close_file()
+{
+    f_close(&file);
+    f_unmount("0:");
+    mounted_ = false;
+}
+
+void SdLogger::writer_loop()
+{
+    bool open = false;
+    bool wait_header = false;
+    uint32_t file_sectors = 0;
+    uint32_t unsynced = 0;
+    uint32_t next_mount_ms = 0;
+    uint8_t* sector;
+
+    while (true) {
+        uint32_t now_ms = to_ms_since_boot(get_absolute_time());
+
+        // after an error the sectors of the ended log are dropped, the
+        // next file starts with the new header
+        while (wait_header && queue_try_peek(&full_, &sector)) {
+            if (sector[2] == METER_LOG_SECTOR_HEADER) {
+                wait_header = false;
+                break;
+            }
+
+            queue_remove_blocking(&full_, &sector);
+            queue_add_blocking(&free_, &sector);
+        }
+
+        // a new log while the file is open goes to the next file, the card
+        // stays mounted
+        if (open && file_sectors > 0 && queue_try_peek(&full_, &sector) &&
+            sector[2] == METER_LOG_SECTOR_HEADER) {
+            f_close(&file);
+            open = false;
+            file_sectors = 0;
+            unsynced = 0;
+        }
+
+        if (!open && !wait_header && (int32_t)(now_ms - next_mount_ms) >= 0) {
+            open = open_file();
+
+            if (!open) {
+                next_mount_ms = now_ms + MOUNT_RETRY_MS;
+            }
+        }
+
+        if (!open || !queue_try_remove(&full_, &sector)) {
+            if (open && unsynced > 0) {
+                f_sync(&file);
+                unsynced = 0;
+            }
+
+            sleep_ms(10);
+            continue;
+        }
+
+        meter_log_seal(sector);
+
+        UINT written = 0;
+        FRESULT result = f_write(&file, sector, METER_LOG_SECTOR_SIZE, &written);
+
+        queue_add_blocking(&free_, &sector);
+
+        if (result == FR_OK && written == METER_LOG_SECTOR_SIZE) {
+            sectors_++;
+            file_sectors++;
+
+            if (++unsynced >= SYNC_SECTORS) {
+                result = f_sync(&file);
+                unsynced = 0;
+            }
+        }
+
+        if (result != FR_OK || written != METER_LOG_SECTOR_SIZE) {
+            errors_++;
+            close_file();
+            open = false;
+            file_sectors = 0;
+            unsynced = 0;
+            next_mount_ms = now_ms + MOUNT_RETRY_MS;
+
+            wait_header = true;
+            restart_ = true;
+        }
+    }
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#ifndef _SD_LOGGER_H_
+#define _SD_LOGGER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "pico/util/queue.h"
+#include "meter/events.h"
+#include "meter/sector_log.h"
+
+// Measurement and event log on an SD card, format in
+// meter/include/meter/sector_log.h, read with tools/sdlog_read.py.
+//
+// Records are packed into 512-byte sector buffers on core 0, full sectors
+// are queued to a writer loop on core 1 which owns the card: it seals each
+// sector with its CRC and appends it to LOGnnnnn.MLG with one sector-sized
+// f_write at a sector-aligned offset, so FatFs passes it straight to the
+// card without a read-modify-write of a partial sector. Core 0 only copies
+// records and moves buffer pointers through two queues, it never waits on
+// the card: with every buffer queued (card missing, slow or being mounted)
+// records are dropped and the count is written with the next one that
+// fits.
+//
+// A card error or removal ends the file. Core 1 mounts again every few
+// seconds, core 0 then starts a new log in the next file with a new header.
+// A header queued while a file is open, for a new time base, also starts
+// the next file.
+class SdLogger {
+public:
+    static const size_t SECTORS = 8;
+    static const uint32_t SYNC_SECTORS = 8;         // f_sync after this many
+    static const uint32_t MOUNT_RETRY_MS = 5000;
+
+    SdLogger();
+
+    // Launches the writer on core 1 and starts the first log, device is
+    // stored in the header, e.g. the device EUI
+    void start(const char* device);
+
+    // Append without blocking, time in seconds of the time base
+    void log_readings(uint32_t time, const float values[6]);
+
+    void log_event(uint32_t time, const struct meter_event* event);
+
+    // Hand over the sector being filled, it is written within a few ms
+    void flush();
+
+    // Starts a new log in the next file if time_base differs from the one
+    // in use, e.g. METER_LOG_TIME_UNIX once the network time is known. Takes
+    // effect with the next record, which has to be in the new time base.
+    void set_time_base(uint8_t time_base);
+
+    struct stats {
+        uint32_t sectors;       // written to the card
+        uint32_t errors;        // card errors, each one ends a file
+        uint32_t files;
+        uint32_t dropped;       // records without a free buffer
+        bool mounted;
+    };
+
+    void get_stats(struct stats* stats) const;
+
+protected:
+    static uint8_t* get_sector(void* context);
+
+    static void put_sector(void* context, uint8_t* sector);
+
+    static void core1_entry();
+
+    void append(uint8_t type, uint32_t time, const void* payload, uint8_t length);
+
+    void restart_if_needed(uint32_t time);
+
+    // core 1
+    void writer_loop();
+
+    bool open_file();
+
+    void close_file();
+
+    const char* device_;
+    uint8_t time_base_;
+    struct meter_log_writer writer_;
+
+    queue_t free_;              // empty buffers, to core 0
+    queue_t full_;              // filled buffers, to core 1
+
+    // set by core 1 when a file ended, or by set_time_base(...), core 0
+    // starts a new log
+    volatile bool restart_;
+
+    volatile uint32_t sectors_;
+    volatile uint32_t errors_;
+    volatile uint32_t files_;
+    volatile bool mounted_;
+
+    uint8_t buffers_[SECTORS][METER_LOG_SECTOR_SIZE] __attribute__((aligned(4)));
+};
+
+#endif
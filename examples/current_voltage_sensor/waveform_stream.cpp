@@ -0,0 +1,322 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#include <string.h>
+
+#include "waveform_stream.h"
+
+#include "pico/stdio_usb.h"
+#include "hardware/adc.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+#include "tusb.h"
+
+// ADC conversions take 96 cycles of the 48 MHz ADC clock
+#define ADC_CLOCK_HZ        48000000
+#define ADC_CYCLES_MIN      96
+
+static WaveformStream* dma_irq_stream = NULL;
+
+WaveformStream::WaveformStream(struct lorawan_task* task) :
+    task_(task),
+    active_(false),
+    sample_rate_(0),
+    compress_(false),
+    usb_(false),
+    handler_(NULL),
+    handler_context_(NULL),
+    head_(0),
+    tail_(0),
+    next_block_(0),
+    sequence_(0),
+    gap_(false),
+    frame_length_(0),
+    frame_sent_(0)
+{
+    memset(&stats_, 0, sizeof(stats_));
+
+    dma_channel_[0] = dma_claim_unused_channel(true);
+    dma_channel_[1] = dma_claim_unused_channel(true);
+
+    dma_irq_stream = this;
+    dma_channel_set_irq0_enabled(dma_channel_[0], true);
+    dma_channel_set_irq0_enabled(dma_channel_[1], true);
+    irq_add_shared_handler(DMA_IRQ_0, dma_irq_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(DMA_IRQ_0, true);
+}
+
+WaveformStream::~WaveformStream()
+{
+    stop();
+
+    dma_channel_set_irq0_enabled(dma_channel_[0], false);
+    dma_channel_set_irq0_enabled(dma_channel_[1], false);
+    irq_remove_handler(DMA_IRQ_0, dma_irq_handler);
+    dma_channel_unclaim(dma_channel_[0]);
+    dma_channel_unclaim(dma_channel_[1]);
+    dma_irq_stream = NULL;
+}
+
+void WaveformStream::set_block_handler(block_handler handler, void* context)
+{
+    handler_ = handler;
+    handler_context_ = context;
+}
+
+void WaveformStream::dma_irq_handler()
+{
+    WaveformStream* stream = dma_irq_stream;
+
+    if (stream == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < 2; i++) {
+        uint32_t mask = 1u << stream->dma_channel_[i];
+
+        if (dma_hw->ints0 & mask) {
+            dma_hw->ints0 = mask;
+            stream->block_done(i);
+        }
+    }
+}
+
+void WaveformStream::block_done(int channel)
+{
+    uint64_t time = time_us_64();
+    int block = dma_block_[channel];
+
+    stats_.blocks++;
+
+    if (block >= 0) {
+        block_sequence_[block] = sequence_;
+        block_time_[block] = time;
+        block_gap_[block] = gap_;
+        gap_ = false;
+        head_ = head_ + 1;
+    } else {
+        stats_.dropped++;
+        gap_ = true;
+    }
+
+    sequence_++;
+
+    // the chained channel is filling the next block, hand this one the block
+    // after that, or the scratch block if the consumer is a whole ring behind
+    volatile void* write;
+
+    if (next_block_ - tail_ < BLOCKS) {
+        dma_block_[channel] = next_block_ % BLOCKS;
+        write = blocks_[next_block_ % BLOCKS];
+        next_block_++;
+    } else {
+        dma_block_[channel] = -1;
+        write = scratch_;
+    }
+
+    dma_channel_set_write_addr(dma_channel_[channel], write, false);
+
+    if (task_ != NULL) {
+        lorawan_task_signal(task_);
+    }
+}
+
+void WaveformStream::start(float clkdiv, bool compress, bool usb)
+{
+    stop();
+
+    compress_ = compress;
+    usb_ = usb;
+    head_ = 0;
+    tail_ = 0;
+    next_block_ = 2;
+    sequence_ = 0;
+    gap_ = false;
+    frame_length_ = 0;
+    frame_sent_ = 0;
+    dma_block_[0] = 0;
+    dma_block_[1] = 1;
+
+    uint32_t cycles = (uint32_t)clkdiv + 1;
+    sample_rate_ = ADC_CLOCK_HZ / ((cycles < ADC_CYCLES_MIN) ? ADC_CYCLES_MIN : cycles);
+
+    // voltage first, then alternate with current
+    adc_select_input(0);
+    adc_set_round_robin(0x03);
+    adc_fifo_setup(true, true, 1, false, false);
+    adc_set_clkdiv(clkdiv);
+
+    for (int i = 0; i < 2; i++) {
+        dma_channel_config config = dma_channel_get_default_config(dma_channel_[i]);
+        channel_config_set_transfer_data_size(&config, DMA_SIZE_16);
+        channel_config_set_read_increment(&config, false);
+        channel_config_set_write_increment(&config, true);
+        channel_config_set_dreq(&config, DREQ_ADC);
+        channel_config_set_chain_to(&config, dma_channel_[i ^ 1]);
+
+        dma_channel_configure(dma_channel_[i], &config, blocks_[i], &adc_hw->fifo, BLOCK_SAMPLES, false);
+    }
+
+    active_ = true;
+
+    dma_channel_start(dma_channel_[0]);
+    adc_run(true);
+}
+
+void WaveformStream::stop()
+{
+    if (!active_) {
+        return;
+    }
+
+    adc_run(false);
+
+    // break the chain first, so aborting one channel cannot start the other
+    for (int i = 0; i < 2; i++) {
+        hw_clear_bits(&dma_hw->ch[dma_channel_[i]].al1_ctrl, DMA_CH0_CTRL_TRIG_EN_BITS);
+    }
+
+    dma_channel_abort(dma_channel_[0]);
+    dma_channel_abort(dma_channel_[1]);
+    dma_hw->ints0 = (1u << dma_channel_[0]) | (1u << dma_channel_[1]);
+
+    // leave the ADC as adc_read() expects it
+    adc_set_round_robin(0);
+    adc_fifo_setup(false, false, 0, false, false);
+    adc_fifo_drain();
+    adc_set_clkdiv(0);
+
+    active_ = false;
+}
+
+size_t WaveformStream::pack_frame(uint32_t block)
+{
+    const uint16_t* samples = blocks_[block];
+    uint8_t* p = frame_;
+    uint16_t pairs = BLOCK_SAMPLES / 2;
+    uint16_t length = pairs * 3;
+    uint8_t checksum = 0;
+
+    if (compress_) {
+        length = meter_wave_encode(samples, pairs, 2, p + HEADER_SIZE);
+        length += meter_wave_encode(samples + 1, pairs, 2, p + HEADER_SIZE + length);
+
+        for (size_t i = 0; i < length; i++) {
+            checksum ^= p[HEADER_SIZE + i];
+        }
+    }
+
+    p[0] = 'W';
+    p[1] = 'F';
+    p[2] = VERSION;
+    p[3] = (block_gap_[block] ? 0x01 : 0x00) | (compress_ ? 0x02 : 0x00);
+    memcpy(p + 4, &block_sequence_[block], 4);
+    uint32_t time = (uint32_t)block_time_[block];
+
+    memcpy(p + 8, &time, 4);
+    memcpy(p + 12, &sample_rate_, 4);
+    memcpy(p + 16, &pairs, 2);
+    memcpy(p + 18, &length, 2);
+
+    for (size_t i = 2; i < HEADER_SIZE; i++) {
+        checksum ^= p[i];
+    }
+
+    p += HEADER_SIZE;
+
+    if (compress_) {
+        p += length;
+        *p++ = checksum;
+
+        return p - frame_;
+    }
+
+    for (uint16_t i = 0; i < pairs; i++) {
+        uint16_t v = samples[2 * i] & 0x0fff;
+        uint16_t c = samples[2 * i + 1] & 0x0fff;
+        uint8_t b0 = (uint8_t)v;
+        uint8_t b1 = (uint8_t)((v >> 8) | (c << 4));
+        uint8_t b2 = (uint8_t)(c >> 4);
+
+        p[0] = b0;
+        p[1] = b1;
+        p[2] = b2;
+        p += 3;
+
+        checksum ^= b0 ^ b1 ^ b2;
+    }
+
+    *p++ = checksum;
+
+    return p - frame_;
+}
+
+void WaveformStream::handle_block(uint32_t block)
+{
+    if (handler_ != NULL) {
+        bool gap = block_sequence_[block] == 0 || block_gap_[block];
+
+        handler_(handler_context_, blocks_[block], BLOCK_SAMPLES / 2, block_time_[block], sample_rate_, gap);
+    }
+}
+
+void WaveformStream::service()
+{
+    if (!active_) {
+        return;
+    }
+
+    // nobody listening, release the blocks instead of letting the ring fill
+    if (!usb_ || !tud_cdc_connected()) {
+        for (; tail_ != head_; tail_ = tail_ + 1) {
+            handle_block(tail_ % BLOCKS);
+        }
+
+        frame_sent_ = frame_length_;
+        return;
+    }
+
+    while (1) {
+        if (frame_sent_ == frame_length_) {
+            if (tail_ == head_) {
+                break;
+            }
+
+            handle_block(tail_ % BLOCKS);
+
+            // the frame is a copy, so the block goes back to the DMA now
+            frame_length_ = pack_frame(tail_ % BLOCKS);
+            frame_sent_ = 0;
+            tail_ = tail_ + 1;
+        }
+
+        uint32_t available = tud_cdc_write_available();
+
+        if (available == 0) {
+            break;
+        }
+
+        size_t length = frame_length_ - frame_sent_;
+
+        if (length > available) {
+            length = available;
+        }
+
+        // through the stdio driver, which holds the USB mutex, it does not
+        // block when given no more than the FIFO has room for
+        stdio_usb.out_chars((const char*)frame_ + frame_sent_, length);
+
+        frame_sent_ += length;
+        stats_.bytes += length;
+
+        if (frame_sent_ == frame_length_) {
+            stats_.frames++;
+        }
+    }
+}
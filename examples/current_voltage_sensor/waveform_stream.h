@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#ifndef _WAVEFORM_STREAM_H_
+#define _WAVEFORM_STREAM_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "pico/lorawan_scheduler.h"
+#include "meter/wave_codec.h"
+
+// Raw voltage / current waveform streaming over USB CDC.
+//
+// The ADC free-runs in round robin over inputs 0 (voltage) and 1 (current)
+// and two chained DMA channels fill a ring of sample blocks, so capture
+// never waits for the CPU. Each completed block signals a scheduler task
+// that packs it into a frame and writes as much as the CDC FIFO takes.
+// When the ring is full the DMA writes to a scratch block instead and the
+// block is counted as dropped; the frame sequence numbers show the gap.
+// Compressed frames carry each input as one meter_wave_encode(...) block,
+// about a third of the packed size for mains waveforms, which lets the
+// full rate fit through USB full speed.
+//
+// A block handler sees every completed block first, whether or not the
+// blocks go to USB, so the capture can also run without a host to feed
+// on-device consumers such as the voltage event detector.
+//
+// Frame, little-endian, decoded by tools/waveform_capture.py:
+//
+//   [0]  'W' 'F'
+//   [2]  version
+//   [3]  flags, bit 0: blocks were dropped before this one,
+//        bit 1: compressed
+//   [4]  block sequence number, counts dropped blocks too
+//   [8]  time_us_32() when the last sample of the block was written
+//   [12] sample rate in Hz, both inputs together
+//   [16] number of voltage / current pairs
+//   [18] payload length in bytes
+//   [20] payload, pairs of 12-bit voltage v and current i packed into 3
+//        bytes: v[7:0], i[3:0] << 4 | v[11:8], i[11:4]
+//        compressed: the encoded voltage block, then the current block
+//   [..] XOR of bytes 2 up to here
+class WaveformStream {
+public:
+    static const size_t BLOCK_SAMPLES = 1024;   // 512 pairs, 2 ms at full rate
+    static const size_t BLOCKS = 8;
+    static const size_t HEADER_SIZE = 20;
+    static const size_t FRAME_SIZE = HEADER_SIZE + 2 * METER_WAVE_ENCODED_MAX_SIZE(BLOCK_SAMPLES / 2) + 1;
+    static const uint8_t VERSION = 2;             // 1: no compression, bytes 18-19 reserved
+
+    // Called from service() for every completed block, pairs of voltage and
+    // current samples. time_us is time_us_64() when the last pair was
+    // written, service() may run well after that. gap is set when the block
+    // does not follow on from the previous one: the first block after
+    // start() or blocks were dropped.
+    typedef void (*block_handler)(void* context, const uint16_t* samples, size_t pairs, uint64_t time_us, uint32_t sample_rate, bool gap);
+
+    // task is signalled for every completed block and should call service()
+    WaveformStream(struct lorawan_task* task);
+
+    ~WaveformStream();
+
+    void set_block_handler(block_handler handler, void* context);
+
+    // Start capturing, clkdiv as for adc_set_clkdiv(), 0 for the full
+    // 500 ksps. Takes over the ADC until stop(). Without usb the blocks only
+    // go to the block handler.
+    void start(float clkdiv, bool compress = false, bool usb = true);
+
+    void stop();
+
+    bool active() const { return active_; }
+
+    // Capturing and writing the frames to USB
+    bool streaming() const { return active_ && usb_; }
+
+    // Hand completed blocks to the block handler and write them to USB
+    // without blocking
+    void service();
+
+    struct stats {
+        uint32_t blocks;        // captured, dropped included
+        uint32_t dropped;       // ring full, CDC could not keep up
+        uint32_t frames;        // completely written to USB
+        uint64_t bytes;
+    };
+
+    const struct stats& get_stats() const { return stats_; }
+
+protected:
+    static void dma_irq_handler();
+
+    void block_done(int channel);
+
+    void handle_block(uint32_t block);
+
+    size_t pack_frame(uint32_t block);
+
+    struct lorawan_task* task_;
+    volatile bool active_;
+    uint32_t sample_rate_;
+    bool compress_;
+    bool usb_;
+
+    block_handler handler_;
+    void* handler_context_;
+
+    int dma_channel_[2];
+    int dma_block_[2];          // ring block each channel writes, -1 for scratch
+
+    // free running block counters: written by the IRQ, consumed by service()
+    volatile uint32_t head_;
+    volatile uint32_t tail_;
+    uint32_t next_block_;
+    uint32_t sequence_;
+    bool gap_;
+
+    uint16_t blocks_[BLOCKS][BLOCK_SAMPLES];
+    uint16_t scratch_[BLOCK_SAMPLES];
+    uint32_t block_sequence_[BLOCKS];
+    uint64_t block_time_[BLOCKS];
+    bool block_gap_[BLOCKS];
+
+    uint8_t frame_[FRAME_SIZE];
+    size_t frame_length_;
+    size_t frame_sent_;
+
+    struct stats stats_;
+};
+
+#endif
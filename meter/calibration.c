@@ -0,0 +1,328 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "meter/calibration.h"
+#include "meter/metering.h"
+#include "meter/sector_log.h"
+#include "meter/source.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define SAVED_VERSION       1
+#define SAVED_CRC_OFFSET    (METER_CALIBRATION_SAVED_SIZE - 4)
+
+// DC filter of meter_current_get(...) and meter_voltage_get(...)
+#define FILTER_SHIFT        4096
+
+// RMS below this many ADC counts is no signal
+#define MIN_RMS_COUNTS      8.0
+
+// same limits as the calibration factors of the configuration downlinks
+#define MIN_GAIN            1.0
+#define MAX_GAIN            10000.0
+
+static void store_le32(uint8_t* p, uint32_t value)
+{
+    p[0] = value;
+    p[1] = value >> 8;
+    p[2] = value >> 16;
+    p[3] = value >> 24;
+}
+
+static uint32_t load_le32(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void store_double(uint8_t* p, double value)
+{
+    uint64_t bits;
+
+    memcpy(&bits, &value, sizeof(bits));
+    store_le32(p, (uint32_t)bits);
+    store_le32(p + 4, (uint32_t)(bits >> 32));
+}
+
+static double load_double(const uint8_t* p)
+{
+    uint64_t bits = load_le32(p) | ((uint64_t)load_le32(p + 4) << 32);
+    double value;
+
+    memcpy(&value, &bits, sizeof(value));
+
+    return value;
+}
+
+// Mean of the raw samples behind count filtered ones: the filter keeps
+// offset += (x - offset) / 4096 and stores x - offset, so x is the offset
+// before the sample plus 4096 / 4095 of the stored value
+static double raw_mean(const double* samples, uint32_t count, double seed)
+{
+    double offset = seed;
+    double sum = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        sum += offset + samples[i] * FILTER_SHIFT / (FILTER_SHIFT - 1);
+        offset += samples[i] / (FILTER_SHIFT - 1);
+    }
+
+    return sum / count;
+}
+
+static double mean_square(const double* samples, uint32_t count)
+{
+    double sum = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        sum += samples[i] * samples[i];
+    }
+
+    return sum / count;
+}
+
+// Samples per cycle from the zero crossings, a crossing counts once the
+// signal is past hysteresis on the other side, 0 with fewer than two
+static double cycle_samples(const double* samples, uint32_t count, double hysteresis)
+{
+    double first = 0;
+    double last = 0;
+    double position = 0;
+    uint32_t crossings = 0;
+    int state = 0;
+
+    for (uint32_t i = 1; i < count; i++) {
+        double a = samples[i - 1];
+        double b = samples[i];
+
+        if ((a < 0) != (b < 0)) {
+            position = (i - 1) + a / (a - b);
+        }
+
+        if ((b > hysteresis && state <= 0) || (b < -hysteresis && state >= 0)) {
+            // the first one is only where the signal was found
+            if (state != 0) {
+                if (crossings == 0) {
+                    first = position;
+                }
+                last = position;
+                crossings++;
+            }
+
+            state = (b > 0) ? 1 : -1;
+        }
+    }
+
+    return (crossings >= 2) ? 2 * (last - first) / (crossings - 1) : 0;
+}
+
+void meter_calibration_start(struct meter_calibration_solver* solver, const struct meter_calibration_reference* reference,
+                             uint32_t num_samples)
+{
+    memset(solver, 0, sizeof(*solver));
+
+    solver->reference = *reference;
+    solver->num_samples = num_samples;
+    solver->voltage_offset = ADC_COUNTS >> 1;
+    solver->current_offset = ADC_COUNTS >> 1;
+}
+
+double meter_calibration_seed(const struct meter_calibration_solver* solver, uint8_t input)
+{
+    return (input == METER_INPUT_CURRENT) ? solver->current_offset : solver->voltage_offset;
+}
+
+void meter_calibration_add_window(struct meter_calibration_solver* solver, const double* voltage_samples,
+                                  const double* current_samples, double voltage_seed, double current_seed)
+{
+    uint32_t n = solver->num_samples;
+    double voltage_ms = mean_square(voltage_samples, n);
+    double period = cycle_samples(voltage_samples, n, sqrt(voltage_ms) / 4);
+    uint32_t whole = n;
+
+    // offsets and the DFT over whole cycles, a part cycle biases both
+    if (period > 0 && period <= n) {
+        whole = (uint32_t)(floor(n / period) * period + 0.5);
+    }
+
+    // the seeds do not change the raw mean, the settling window counts
+    double weight = 1.0 / (solver->windows + 1);
+
+    solver->voltage_offset += (raw_mean(voltage_samples, whole, voltage_seed) - solver->voltage_offset) * weight;
+    solver->current_offset += (raw_mean(current_samples, whole, current_seed) - solver->current_offset) * weight;
+
+    if (solver->windows++ == 0) {
+        return;
+    }
+
+    solver->voltage_ms += voltage_ms;
+    solver->current_ms += mean_square(current_samples, n);
+
+    if (period == 0 || period > n) {
+        return;
+    }
+
+    // fundamental of both inputs, rotating the phasor instead of a sin and
+    // a cos per sample
+    double step_re = cos(2 * M_PI / period);
+    double step_im = -sin(2 * M_PI / period);
+    double z_re = 1;
+    double z_im = 0;
+    double v_re = 0;
+    double v_im = 0;
+    double i_re = 0;
+    double i_im = 0;
+
+    for (uint32_t k = 0; k < whole; k++) {
+        v_re += voltage_samples[k] * z_re;
+        v_im += voltage_samples[k] * z_im;
+        i_re += current_samples[k] * z_re;
+        i_im += current_samples[k] * z_im;
+
+        double re = z_re * step_re - z_im * step_im;
+        z_im = z_re * step_im + z_im * step_re;
+        z_re = re;
+    }
+
+    // angle the current lags the voltage by, less the reference angle
+    double lag = atan2(v_im * i_re - v_re * i_im, v_re * i_re + v_im * i_im);
+    double reference = acos(fmin(fabs(solver->reference.power_factor), 1.0));
+
+    if (solver->reference.power_factor < 0) {
+        reference = -reference;
+    }
+
+    solver->delay_cos += cos(lag - reference);
+    solver->delay_sin += sin(lag - reference);
+    solver->cycle_samples += period;
+    solver->cycles++;
+}
+
+int meter_calibration_solve(const struct meter_calibration_solver* solver, struct meter_calibration* calibration)
+{
+    double scale = (SUPPLY_VOLTAGE / 1000.0) / ADC_COUNTS;
+
+    if (solver->windows < 2) {
+        return METER_CALIBRATION_ERROR_WINDOWS;
+    }
+
+    double voltage_rms = sqrt(solver->voltage_ms / (solver->windows - 1));
+    double current_rms = sqrt(solver->current_ms / (solver->windows - 1));
+
+    if (voltage_rms < MIN_RMS_COUNTS || current_rms < MIN_RMS_COUNTS) {
+        return METER_CALIBRATION_ERROR_SIGNAL;
+    }
+
+    if (solver->cycles == 0) {
+        return METER_CALIBRATION_ERROR_CYCLE;
+    }
+
+    double voltage_gain = solver->reference.voltage_rms / (voltage_rms * scale);
+    double current_gain = solver->reference.current_rms / (current_rms * scale);
+
+    if (!(voltage_gain >= MIN_GAIN && voltage_gain <= MAX_GAIN && current_gain >= MIN_GAIN && current_gain <= MAX_GAIN)) {
+        return METER_CALIBRATION_ERROR_RANGE;
+    }
+
+    double period = solver->cycle_samples / solver->cycles;
+    double error = atan2(solver->delay_sin, solver->delay_cos);
+
+    calibration->voltage_gain = voltage_gain;
+    calibration->current_gain = current_gain;
+    calibration->voltage_offset = solver->voltage_offset;
+    calibration->current_offset = solver->current_offset;
+    calibration->cycle_samples = period;
+    calibration->phase_delay = (int32_t)lround(error / (2 * M_PI) * period);
+    calibration->num_samples = solver->num_samples;
+
+    return 0;
+}
+
+int32_t meter_calibration_phase_delay(const struct meter_calibration* calibration, uint32_t num_samples)
+{
+    double period = calibration->cycle_samples;
+    double delay = calibration->phase_delay + ((double)num_samples - calibration->num_samples);
+
+    if (period <= 0) {
+        return 0;
+    }
+
+    // the shortest way round, the fewest samples left out
+    return (int32_t)lround(delay - period * round(delay / period));
+}
+
+// A window that is not whole cycles adds part of the power's ripple at
+// twice the fundamental to the mean, the shift alone makes it so
+uint32_t meter_calibration_power_samples(const struct meter_calibration* calibration, uint32_t num_samples)
+{
+    int32_t delay = meter_calibration_phase_delay(calibration, num_samples);
+    uint32_t shift = (delay < 0) ? -delay : delay;
+    double period = calibration->cycle_samples;
+
+    if (shift >= num_samples) {
+        return 0;
+    }
+
+    uint32_t pairs = num_samples - shift;
+
+    // the period is an estimate, within 1% of a cycle counts as whole
+    double cycles = (period > 0) ? floor(pairs / period + 0.01) : 0;
+
+    if (cycles < 1) {
+        return pairs;
+    }
+
+    uint32_t power_samples = (uint32_t)lround(cycles * period);
+
+    return (power_samples < pairs) ? power_samples : pairs;
+}
+
+// [0] 'C' 'L' version, [4] sequence, [8] voltage and current gain, [24]
+// voltage and current offset, [40] cycle samples, [48] phase delay,
+// [52] number of samples, CRC-32 at the end
+void meter_calibration_save(const struct meter_calibration* calibration, uint32_t sequence, uint8_t* buffer)
+{
+    memset(buffer, 0, METER_CALIBRATION_SAVED_SIZE);
+
+    buffer[0] = 'C';
+    buffer[1] = 'L';
+    buffer[2] = SAVED_VERSION;
+    store_le32(buffer + 4, sequence);
+
+    store_double(buffer + 8, calibration->voltage_gain);
+    store_double(buffer + 16, calibration->current_gain);
+    store_double(buffer + 24, calibration->voltage_offset);
+    store_double(buffer + 32, calibration->current_offset);
+    store_double(buffer + 40, calibration->cycle_samples);
+    store_le32(buffer + 48, (uint32_t)calibration->phase_delay);
+    store_le32(buffer + 52, calibration->num_samples);
+
+    store_le32(buffer + SAVED_CRC_OFFSET, meter_log_crc32(buffer, SAVED_CRC_OFFSET));
+}
+
+int meter_calibration_restore(struct meter_calibration* calibration, const uint8_t* buffer, uint32_t* sequence)
+{
+    if (buffer[0] != 'C' || buffer[1] != 'L' || buffer[2] != SAVED_VERSION ||
+        load_le32(buffer + SAVED_CRC_OFFSET) != meter_log_crc32(buffer, SAVED_CRC_OFFSET)) {
+        return -1;
+    }
+
+    calibration->voltage_gain = load_double(buffer + 8);
+    calibration->current_gain = load_double(buffer + 16);
+    calibration->voltage_offset = load_double(buffer + 24);
+    calibration->current_offset = load_double(buffer + 32);
+    calibration->cycle_samples = load_double(buffer + 40);
+    calibration->phase_delay = (int32_t)load_le32(buffer + 48);
+    calibration->num_samples = load_le32(buffer + 52);
+    *sequence = load_le32(buffer + 4);
+
+    return 0;
+}
@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "meter/circuits.h"
+#include "meter/linearization.h"
+#include "meter/metering.h"
+
+#define UJ_PER_WH           3600000000ull
+
+static void store_le16(uint8_t* p, uint16_t value)
+{
+    p[0] = value;
+    p[1] = value >> 8;
+}
+
+static void store_le32(uint8_t* p, uint32_t value)
+{
+    p[0] = value;
+    p[1] = value >> 8;
+    p[2] = value >> 16;
+    p[3] = value >> 24;
+}
+
+static uint32_t saturate_u32(uint64_t value)
+{
+    return (value < UINT32_MAX) ? (uint32_t)value : UINT32_MAX;
+}
+
+// rounded and clamped to min..max, 0 for NaN
+static int32_t quantize(double value, double min, double max)
+{
+    if (isnan(value)) {
+        return 0;
+    }
+
+    value = floor(value + 0.5);
+
+    return (int32_t)((value < min) ? min : (value > max) ? max : value);
+}
+
+void meter_circuits_init(struct meter_circuits* circuits, uint8_t count)
+{
+    memset(circuits, 0, sizeof(*circuits));
+
+    circuits->count = (count < METER_CIRCUITS_MAX) ? count : METER_CIRCUITS_MAX;
+    circuits->voltage_offset = ADC_COUNTS >> 1;
+
+    for (uint8_t i = 0; i < METER_CIRCUITS_MAX; i++) {
+        circuits->circuit[i].input = METER_INPUT_CURRENT + i;
+        circuits->circuit[i].current_offset = ADC_COUNTS >> 1;
+    }
+}
+
+// The DC filters and sums stay in locals, no sample is kept. A current is
+// multiplied with the voltage interpolated to when it was read, between the
+// voltage of its row and the next one, its product is added one row late.
+void METER_RAM_FUNC(meter_circuits_measure)(struct meter_circuits* circuits, const struct meter_source* source, uint32_t num_rows,
+                                            double voltage_calibration)
+{
+    const float* linearization = source->linearization;
+    uint8_t count = circuits->count;
+    double offset_voltage = circuits->voltage_offset;
+    double offset_current[METER_CIRCUITS_MAX];
+    double previous_voltage = 0;
+    double previous_current[METER_CIRCUITS_MAX];
+    double weight[METER_CIRCUITS_MAX];
+    double sum_voltage = 0;
+    double sum_current[METER_CIRCUITS_MAX];
+    double sum_power[METER_CIRCUITS_MAX];
+
+    if (num_rows < 2) {
+        return;
+    }
+
+    for (uint8_t i = 0; i < count; i++) {
+        offset_current[i] = circuits->circuit[i].current_offset;
+        previous_current[i] = 0;
+        weight[i] = (i + 1.0) / (count + 1);
+        sum_current[i] = 0;
+        sum_power[i] = 0;
+    }
+
+    for (uint32_t row = 0; row < num_rows; row++) {
+        meter_source_select(source, METER_INPUT_VOLTAGE);
+        uint16_t code = meter_source_read(source);
+        double sample_voltage = (linearization != NULL) ? linearization[code & (METER_LINEARIZATION_CODES - 1)] : code;
+        offset_voltage += ((sample_voltage - offset_voltage) / 4096);
+        double filtered_voltage = sample_voltage - offset_voltage;
+
+        sum_voltage += filtered_voltage * filtered_voltage;
+
+        // nothing to add for the first row, the previous currents are 0
+        for (uint8_t i = 0; i < count; i++) {
+            sum_power[i] += (previous_voltage + (filtered_voltage - previous_voltage) * weight[i]) * previous_current[i];
+        }
+
+        previous_voltage = filtered_voltage;
+
+        for (uint8_t i = 0; i < count; i++) {
+            meter_source_select(source, circuits->circuit[i].input);
+            code = meter_source_read(source);
+            double sample_current = (linearization != NULL) ? linearization[code & (METER_LINEARIZATION_CODES - 1)] : code;
+            offset_current[i] += ((sample_current - offset_current[i]) / 4096);
+            double filtered_current = sample_current - offset_current[i];
+
+            sum_current[i] += filtered_current * filtered_current;
+            previous_current[i] = filtered_current;
+        }
+    }
+
+    // the next measurement goes on from the settled DC filters
+    circuits->voltage_offset = offset_voltage;
+
+    for (uint8_t i = 0; i < count; i++) {
+        circuits->circuit[i].current_offset = offset_current[i];
+    }
+
+    double voltage_ratio = voltage_calibration * ((SUPPLY_VOLTAGE / 1000.0) / ADC_COUNTS);
+
+    circuits->voltage_rms = voltage_ratio * sqrt(sum_voltage / num_rows);
+
+    for (uint8_t i = 0; i < count; i++) {
+        struct meter_circuit* c = &circuits->circuit[i];
+        double current_ratio = c->current_calibration * ((SUPPLY_VOLTAGE / 1000.0) / ADC_COUNTS);
+
+        c->current_rms = current_ratio * sqrt(sum_current[i] / num_rows);
+        c->active_power = voltage_ratio * current_ratio * (sum_power[i] / (num_rows - 1));
+        c->apparent_power = meter_calculate_apparent_power(circuits->voltage_rms, c->current_rms);
+        c->active_power = meter_limit_active_power(c->active_power, c->apparent_power);
+        c->reactive_power = meter_calculate_reactive_power(c->apparent_power, c->active_power);
+        c->power_factor = meter_calculate_power_factor(c->active_power, c->apparent_power);
+    }
+}
+
+void meter_circuits_accumulate(struct meter_circuits* circuits, uint32_t elapsed_ms)
+{
+    for (uint8_t i = 0; i < circuits->count; i++) {
+        struct meter_circuit* c = &circuits->circuit[i];
+        int32_t power_mw = quantize(c->active_power * 1000.0, -INT32_MAX, INT32_MAX);
+
+        if (power_mw < 0) {
+            c->export_uj += (uint64_t)(-(int64_t)power_mw) * elapsed_ms;
+        } else {
+            c->import_uj += (uint64_t)power_mw * elapsed_ms;
+        }
+    }
+}
+
+void meter_circuits_encode(const struct meter_circuits* circuits, uint8_t* buffer)
+{
+    uint8_t* p = buffer;
+
+    *p++ = METER_CIRCUITS_ENCODING_VERSION;
+    *p++ = circuits->count;
+    store_le16(p, quantize(circuits->voltage_rms * 100, 0, UINT16_MAX));
+    p += 2;
+
+    for (uint8_t i = 0; i < circuits->count; i++) {
+        const struct meter_circuit* c = &circuits->circuit[i];
+
+        store_le16(p, quantize(c->current_rms * 100, 0, UINT16_MAX));
+        store_le32(p + 2, (uint32_t)quantize(c->active_power * 10, -INT32_MAX, INT32_MAX));
+        store_le16(p + 6, (uint16_t)quantize(c->power_factor * 1000, -1000, 1000));
+        store_le32(p + 8, saturate_u32(c->import_uj / UJ_PER_WH));
+        store_le32(p + 12, saturate_u32(c->export_uj / UJ_PER_WH));
+        p += 16;
+    }
+}
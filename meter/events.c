@@ -0,0 +1,400 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#include <string.h>
+
+#include "meter/events.h"
+#include "meter/metering.h"
+
+#define LOG_MASK        (METER_EVENTS_LOG_SIZE - 1)
+#define CAPTURE_MASK    (METER_EVENTS_CAPTURE_SIZE - 1)
+
+#if (METER_EVENTS_LOG_SIZE & LOG_MASK) != 0 || (METER_EVENTS_CAPTURE_SIZE & CAPTURE_MASK) != 0
+#error "METER_EVENTS_LOG_SIZE and METER_EVENTS_CAPTURE_SIZE must be powers of 2"
+#endif
+
+static uint32_t threshold_ms(uint16_t nominal_rms, uint32_t permille)
+{
+    uint32_t rms = ((uint32_t)nominal_rms * permille) / 1000;
+
+    return rms * rms;
+}
+
+static uint32_t isqrt(uint32_t value)
+{
+    uint32_t root = 0;
+    uint32_t bit = 1u << 30;
+
+    while (bit > value) {
+        bit >>= 2;
+    }
+
+    while (bit != 0) {
+        if (value >= root + bit) {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+
+    return root;
+}
+
+void meter_events_init(struct meter_events* events, const struct meter_events_config* config)
+{
+    memset(events, 0, sizeof(*events));
+
+    events->config = *config;
+
+    // the trigger sample itself is kept too
+    if (events->config.capture_pre > METER_EVENTS_CAPTURE_SIZE - 1) {
+        events->config.capture_pre = METER_EVENTS_CAPTURE_SIZE - 1;
+    }
+
+    meter_events_set_nominal(events, config->nominal_rms);
+
+    events->offset_q16 = (ADC_COUNTS / 2) << 16;
+}
+
+void meter_events_set_nominal(struct meter_events* events, uint16_t nominal_rms)
+{
+    const struct meter_events_config* config = &events->config;
+
+    events->config.nominal_rms = nominal_rms;
+
+    events->sag_ms = threshold_ms(nominal_rms, config->sag_permille);
+    events->sag_end_ms = threshold_ms(nominal_rms, config->sag_permille + config->hysteresis_permille);
+    events->swell_ms = threshold_ms(nominal_rms, config->swell_permille);
+    events->swell_end_ms = threshold_ms(nominal_rms, config->swell_permille - config->hysteresis_permille);
+    events->interruption_ms = threshold_ms(nominal_rms, config->interruption_permille);
+}
+
+static void log_push(struct meter_events* events, const struct meter_event* event)
+{
+    events->log[events->log_head++ & LOG_MASK] = *event;
+
+    // the oldest unsent record is overwritten
+    if ((events->log_head - events->log_sent) > METER_EVENTS_LOG_SIZE) {
+        events->log_sent = events->log_head - METER_EVENTS_LOG_SIZE;
+        events->log_dropped++;
+    }
+}
+
+// Time of the latest sample fed, in ms
+static uint32_t sample_time_ms(const struct meter_events* events)
+{
+    uint64_t time_us = events->clock_us;
+
+    if (events->clock_rate != 0) {
+        time_us += (uint64_t)(events->sample_index - 1 - events->clock_index) * 1000000 / events->clock_rate;
+    }
+
+    return (uint32_t)(time_us / 1000);
+}
+
+static void event_start(struct meter_events* events, uint8_t type, uint32_t ms)
+{
+    events->event.type = type;
+    events->event.time_ms = sample_time_ms(events);
+    events->event.half_cycles = 0;
+    events->extreme_ms = ms;
+
+    if (!events->capture_frozen && !events->capture_triggered) {
+        events->capture_triggered = true;
+        // the sample that closed the half cycle, already in the ring
+        events->capture_trigger = events->capture_index - 1;
+        events->capture_post = METER_EVENTS_CAPTURE_SIZE - events->config.capture_pre - 1;
+
+        if (events->capture_post == 0) {
+            events->capture_frozen = true;
+        }
+    }
+}
+
+static void event_end(struct meter_events* events)
+{
+    struct meter_event* event = &events->event;
+    uint32_t depth = 0;
+
+    event->duration_ms = sample_time_ms(events) - event->time_ms;
+
+    if (events->config.nominal_rms != 0) {
+        depth = (isqrt(events->extreme_ms) * 1000) / events->config.nominal_rms;
+    }
+
+    event->depth_permille = (depth > 0xffff) ? 0xffff : depth;
+
+    log_push(events, event);
+
+    event->type = 0;
+}
+
+// One cycle RMS, refreshed every half cycle
+static void evaluate(struct meter_events* events, uint32_t ms)
+{
+    struct meter_event* event = &events->event;
+
+    if (event->type != 0 && event->half_cycles < 0xffff) {
+        event->half_cycles++;
+    }
+
+    if (event->type == METER_EVENT_SAG || event->type == METER_EVENT_INTERRUPTION) {
+        if (ms >= events->sag_end_ms) {
+            event_end(events);
+        } else {
+            if (ms < events->extreme_ms) {
+                events->extreme_ms = ms;
+            }
+
+            if (ms < events->interruption_ms) {
+                event->type = METER_EVENT_INTERRUPTION;
+            }
+        }
+    } else if (event->type == METER_EVENT_SWELL) {
+        if (ms <= events->swell_end_ms) {
+            event_end(events);
+        } else if (ms > events->extreme_ms) {
+            events->extreme_ms = ms;
+        }
+    }
+
+    // a swell ending in a sag, or the other way around, starts the next
+    // event on the same half cycle
+    if (event->type == 0) {
+        if (ms < events->interruption_ms) {
+            event_start(events, METER_EVENT_INTERRUPTION, ms);
+        } else if (ms < events->sag_ms) {
+            event_start(events, METER_EVENT_SAG, ms);
+        } else if (ms > events->swell_ms) {
+            event_start(events, METER_EVENT_SWELL, ms);
+        }
+    }
+}
+
+static void half_cycle_end(struct meter_events* events, bool aligned_end)
+{
+    uint32_t samples = events->half_samples;
+
+    // only half cycles between two crossings tell the period
+    if (events->half_aligned && aligned_end) {
+        if (events->avg_half_samples_q4 == 0) {
+            events->avg_half_samples_q4 = samples << 4;
+        } else {
+            events->avg_half_samples_q4 += (int32_t)((samples << 4) - events->avg_half_samples_q4) / 8;
+        }
+    }
+
+    if (events->prev_half_samples != 0) {
+        uint64_t sum = events->prev_half_sum + events->half_sum;
+        uint32_t count = events->prev_half_samples + samples;
+
+        evaluate(events, (uint32_t)(sum / count));
+    }
+
+    events->prev_half_sum = events->half_sum;
+    events->prev_half_samples = samples;
+    events->half_sum = 0;
+    events->half_samples = 0;
+    events->half_aligned = aligned_end;
+}
+
+void meter_events_clock(struct meter_events* events, uint64_t time_us, uint32_t sample_rate)
+{
+    events->clock_us = time_us;
+    events->clock_index = events->sample_index;
+    events->clock_rate = sample_rate;
+}
+
+void METER_RAM_FUNC(meter_events_sample)(struct meter_events* events, uint16_t sample)
+{
+    events->sample_index++;
+
+    if (!events->capture_frozen) {
+        events->capture[events->capture_index++ & CAPTURE_MASK] = sample;
+
+        if (events->capture_triggered && --events->capture_post == 0) {
+            events->capture_frozen = true;
+        }
+    }
+
+    // same offset filter as the metering loops, in 16.16 fixed point
+    events->offset_q16 += (((int32_t)sample << 16) - events->offset_q16) >> 12;
+
+    int32_t value = (int32_t)sample - (events->offset_q16 >> 16);
+    int8_t polarity = events->polarity;
+
+    if (value > (int32_t)events->config.zero_hysteresis) {
+        polarity = 1;
+    } else if (value < -(int32_t)events->config.zero_hysteresis) {
+        polarity = -1;
+    }
+
+    if (polarity != events->polarity) {
+        if (events->polarity == 0) {
+            // the first partial half cycle is dropped
+            events->half_sum = 0;
+            events->half_samples = 0;
+            events->half_aligned = true;
+        } else {
+            half_cycle_end(events, true);
+        }
+
+        events->polarity = polarity;
+    } else if (events->half_samples >= UINT16_MAX ||
+               (events->avg_half_samples_q4 != 0 && (events->half_samples << 4) >= 2 * events->avg_half_samples_q4)) {
+        // no crossing where one was due
+        half_cycle_end(events, false);
+    }
+
+    events->half_sum += (uint32_t)(value * value);
+    events->half_samples++;
+}
+
+void meter_events_gap(struct meter_events* events)
+{
+    events->polarity = 0;
+    events->half_aligned = false;
+    events->half_sum = 0;
+    events->half_samples = 0;
+    events->prev_half_sum = 0;
+    events->prev_half_samples = 0;
+
+    // the capture only ever holds contiguous samples: one in progress ends
+    // at the gap, an armed one starts over after it
+    if (events->capture_triggered) {
+        events->capture_frozen = true;
+    } else {
+        events->capture_start = events->capture_index;
+    }
+}
+
+static void events_source_select(void* context, uint8_t input)
+{
+    struct meter_events* events = (struct meter_events*)context;
+
+    events->input = input;
+    meter_events_gap(events);
+
+    meter_source_select(events->inner, input);
+}
+
+static uint16_t METER_RAM_FUNC(events_source_read)(void* context)
+{
+    struct meter_events* events = (struct meter_events*)context;
+    uint16_t sample = meter_source_read(events->inner);
+
+    if (events->input == METER_INPUT_VOLTAGE) {
+        meter_events_sample(events, sample);
+    }
+
+    return sample;
+}
+
+void meter_events_source(struct meter_events* events, const struct meter_source* inner, struct meter_source* source)
+{
+    events->inner = inner;
+    events->input = METER_INPUT_VOLTAGE;
+
+    source->select = events_source_select;
+    source->read = events_source_read;
+    source->context = events;
+    source->linearization = inner->linearization;
+}
+
+uint32_t meter_events_unsent(const struct meter_events* events)
+{
+    return events->log_head - events->log_sent;
+}
+
+int meter_events_next_unsent(const struct meter_events* events, struct meter_event* event)
+{
+    if (events->log_head == events->log_sent) {
+        return -1;
+    }
+
+    *event = events->log[events->log_sent & LOG_MASK];
+
+    return 0;
+}
+
+void meter_events_mark_sent(struct meter_events* events)
+{
+    if (events->log_sent != events->log_head) {
+        events->log_sent++;
+    }
+}
+
+uint32_t meter_events_count(const struct meter_events* events)
+{
+    return (events->log_head < METER_EVENTS_LOG_SIZE) ? events->log_head : METER_EVENTS_LOG_SIZE;
+}
+
+int meter_events_get(const struct meter_events* events, uint32_t index, struct meter_event* event)
+{
+    uint32_t count = meter_events_count(events);
+
+    if (index >= count) {
+        return -1;
+    }
+
+    *event = events->log[(events->log_head - count + index) & LOG_MASK];
+
+    return 0;
+}
+
+uint32_t meter_events_get_capture(const struct meter_events* events, uint16_t* samples, uint32_t max_samples, uint32_t* trigger)
+{
+    if (!events->capture_frozen) {
+        return 0;
+    }
+
+    uint32_t count = events->capture_index - events->capture_start;
+
+    if (count > METER_EVENTS_CAPTURE_SIZE) {
+        count = METER_EVENTS_CAPTURE_SIZE;
+    }
+
+    uint32_t first = events->capture_index - count;
+
+    if (count > max_samples) {
+        count = max_samples;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        samples[i] = events->capture[(first + i) & CAPTURE_MASK];
+    }
+
+    *trigger = events->capture_trigger - first;
+
+    return count;
+}
+
+void meter_events_release_capture(struct meter_events* events)
+{
+    events->capture_frozen = false;
+    events->capture_triggered = false;
+}
+
+void meter_event_encode(const struct meter_event* event, uint8_t* buffer)
+{
+    uint8_t* p = buffer;
+
+    *p++ = event->type;
+
+    for (int i = 0; i < 4; i++) {
+        *p++ = event->time_ms >> (8 * i);
+    }
+
+    for (int i = 0; i < 4; i++) {
+        *p++ = event->duration_ms >> (8 * i);
+    }
+
+    *p++ = event->depth_permille & 0xff;
+    *p++ = event->depth_permille >> 8;
+}
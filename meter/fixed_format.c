@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#include "meter/fixed_format.h"
+
+static const double fixed_scale[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+
+size_t fixed_format(char* buffer, int32_t value, uint8_t decimals)
+{
+    char digits[10];
+    size_t count = 0;
+    size_t length = 0;
+    uint32_t magnitude;
+
+    // as many decimals as an int32_t has digits after the first
+    if (decimals > 9) {
+        decimals = 9;
+    }
+
+    if (value < 0) {
+        buffer[length++] = '-';
+        magnitude = -(uint32_t)value;
+    } else {
+        magnitude = value;
+    }
+
+    // least significant digit first, at least one digit before the point
+    do {
+        digits[count++] = '0' + (magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0 || count <= decimals);
+
+    while (count > 0) {
+        if (count == decimals) {
+            buffer[length++] = '.';
+        }
+        buffer[length++] = digits[--count];
+    }
+
+    return length;
+}
+
+size_t fixed_format_field(char* buffer, size_t buffer_len, const char* prefix, int32_t value, uint8_t decimals, const char* unit)
+{
+    char number[FIXED_FORMAT_MAX_DIGITS];
+    size_t number_length = fixed_format(number, value, decimals);
+    size_t length = 0;
+
+    if (buffer_len == 0) {
+        return 0;
+    }
+
+    for (; prefix != NULL && *prefix != '\0' && length < buffer_len - 1; prefix++) {
+        buffer[length++] = *prefix;
+    }
+
+    for (size_t i = 0; i < number_length && length < buffer_len - 1; i++) {
+        buffer[length++] = number[i];
+    }
+
+    for (; unit != NULL && *unit != '\0' && length < buffer_len - 1; unit++) {
+        buffer[length++] = *unit;
+    }
+
+    buffer[length] = '\0';
+
+    return length;
+}
+
+int32_t fixed_from_double(double value, uint8_t decimals)
+{
+    double scaled = value * fixed_scale[decimals < 9 ? decimals : 9];
+
+    if (scaled >= 2147483647.0) {
+        return INT32_MAX;
+    } else if (scaled <= -2147483648.0) {
+        return INT32_MIN;
+    } else if (scaled != scaled) {
+        // NaN, e.g. a power factor with no load
+        return 0;
+    }
+
+    return (int32_t)(scaled < 0 ? scaled - 0.5 : scaled + 0.5);
+}
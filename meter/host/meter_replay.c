@@ -0,0 +1,621 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ * Replays recorded or synthesized ADC waveforms through the metering code
+ * of the current_voltage_sensor example and reports the computed values,
+ * the throughput and differences against golden outputs.
+ *
+ *   meter_replay                          run the synthesized cases, also
+ *                                         calibrated against 120,5,1 and
+ *                                         on 2 and 3 circuits
+ *   meter_replay capture.mtr ...          replay traces, one result per window
+ *   meter_replay --golden golden.csv      compare with golden outputs
+ *   meter_replay --update-golden golden.csv
+ *   meter_replay --calibrate 120,5,1      calibrate on the first windows
+ *   meter_replay --linearization adc.bin  correct the ADC codes
+ *   meter_replay --circuits 3             circuits on one voltage
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "meter/calibration.h"
+#include "meter/circuits.h"
+#include "meter/linearization.h"
+#include "meter/metering.h"
+#include "meter/source.h"
+#include "meter/trace.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define MAX_SAMPLES     100000
+#define MAX_GOLDEN      64
+
+// example defaults
+static uint32_t num_samples = 10000;
+static double current_calibration = 51.61;
+static double voltage_calibration = 897.6;
+static double sample_rate = 25000;
+static double frequency = 60;
+static double tolerance = 1e-6;
+
+// --calibrate: solved on the first windows of every case or trace, then
+// applied like the example does
+static struct meter_calibration_reference reference;
+static struct meter_calibration calibration;
+static int calibrate = 0;
+static int calibrated = 0;
+
+// the synthesized cases are also calibrated against this load when neither
+// --calibrate nor --circuits is given, for the golden outputs
+static const struct meter_calibration_reference golden_reference = { 120, 5, 1 };
+
+// --linearization: corrected ADC codes, built by tools/adc_linearize.py
+static float linearization_table[METER_LINEARIZATION_CODES];
+static const float* linearization = NULL;
+
+// --circuits: that many currents read in turn with the voltage, over the
+// ADC time of one voltage and one current window like the example, the DC
+// filters kept from window to window of a case or trace like the device
+static int num_circuits = 0;
+static struct meter_circuits circuits;
+
+static double current_samples[MAX_SAMPLES];
+static double voltage_samples[MAX_SAMPLES];
+
+struct result {
+    char name[64];                  // the longest names end in 11 characters of %d
+    double current_rms;
+    double voltage_rms;
+    double active_power;
+    double apparent_power;
+    double reactive_power;
+    double power_factor;
+};
+
+static struct result golden[MAX_GOLDEN];
+static int num_golden = 0;
+
+static double elapsed_s = 0;
+static uint64_t samples_processed = 0;
+
+static double now_s()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// DC filters of the single circuit, kept between measurements like the
+// example's
+static double offset_current;
+static double offset_voltage;
+
+// The single circuit of a new case or trace
+static void single_start()
+{
+    offset_current = calibrated ? calibration.current_offset : ADC_COUNTS >> 1;
+    offset_voltage = calibrated ? calibration.voltage_offset : ADC_COUNTS >> 1;
+}
+
+// The measure step of the example, unchanged apart from the source
+static void measure(const struct meter_source* source, struct result* r)
+{
+    double gain_current = calibrated ? calibration.current_gain : current_calibration;
+    double gain_voltage = calibrated ? calibration.voltage_gain : voltage_calibration;
+    int32_t phase_delay = calibrated ? meter_calibration_phase_delay(&calibration, num_samples) : 0;
+    uint32_t power_samples = calibrated ? meter_calibration_power_samples(&calibration, num_samples) : 0;
+    double start = now_s();
+
+    r->current_rms = meter_current_get(source, num_samples, gain_current, &offset_current, current_samples);
+    r->voltage_rms = meter_voltage_get(source, num_samples, gain_voltage, &offset_voltage, voltage_samples);
+    r->active_power = meter_calculate_power_aligned(voltage_samples, current_samples, num_samples, phase_delay, power_samples,
+                                                    gain_voltage, gain_current);
+    r->apparent_power = meter_calculate_apparent_power(r->voltage_rms, r->current_rms);
+    r->active_power = meter_limit_active_power(r->active_power, r->apparent_power);
+    r->reactive_power = meter_calculate_reactive_power(r->apparent_power, r->active_power);
+    r->power_factor = meter_calculate_power_factor(r->active_power, r->apparent_power);
+
+    elapsed_s += now_s() - start;
+    samples_processed += 2 * num_samples;
+}
+
+// Windows of the example's calibration command, the coefficients go to
+// stderr; without a solution the case is measured uncalibrated
+static void calibrate_source(const struct meter_source* source, const char* name)
+{
+    struct meter_calibration_solver solver;
+
+    calibrated = 0;
+
+    meter_calibration_start(&solver, &reference, num_samples);
+
+    for (int window = 0; window <= METER_CALIBRATION_WINDOWS; window++) {
+        double seed_current = meter_calibration_seed(&solver, METER_INPUT_CURRENT);
+        double seed_voltage = meter_calibration_seed(&solver, METER_INPUT_VOLTAGE);
+        double filter_current = seed_current;
+        double filter_voltage = seed_voltage;
+
+        meter_current_get(source, num_samples, 1.0, &filter_current, current_samples);
+        meter_voltage_get(source, num_samples, 1.0, &filter_voltage, voltage_samples);
+        meter_calibration_add_window(&solver, voltage_samples, current_samples, seed_voltage, seed_current);
+    }
+
+    int status = meter_calibration_solve(&solver, &calibration);
+
+    if (status < 0) {
+        fprintf(stderr, "%s: calibration failed (%d)\n", name, status);
+        return;
+    }
+
+    fprintf(stderr, "%s: gains %.4f V %.4f A, offsets %.2f %.2f, %.2f samples per cycle, phase delay %d samples\n",
+            name, calibration.voltage_gain, calibration.current_gain, calibration.voltage_offset,
+            calibration.current_offset, calibration.cycle_samples, calibration.phase_delay);
+
+    calibrated = 1;
+}
+
+static void print_result(const struct result* r)
+{
+    printf("%s,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g\n", r->name, r->current_rms, r->voltage_rms,
+           r->active_power, r->apparent_power, r->reactive_power, r->power_factor);
+}
+
+static int check_golden(const struct result* r);
+
+// Printed, written to the golden file being updated and compared, returns
+// 1 for a regression
+static int report(const struct result* r, FILE* update)
+{
+    print_result(r);
+    if (update != NULL) {
+        fprintf(update, "%s,%.17g,%.17g,%.17g,%.17g,%.17g,%.17g\n", r->name, r->current_rms, r->voltage_rms,
+                r->active_power, r->apparent_power, r->reactive_power, r->power_factor);
+    }
+
+    return check_golden(r);
+}
+
+// The circuits of a new case or trace, all with the gains of the single
+// circuit
+static void circuits_start()
+{
+    meter_circuits_init(&circuits, num_circuits);
+
+    if (calibrated) {
+        circuits.voltage_offset = calibration.voltage_offset;
+        circuits.circuit[0].current_offset = calibration.current_offset;
+    }
+
+    for (int i = 0; i < num_circuits; i++) {
+        circuits.circuit[i].current_calibration = calibrated ? calibration.current_gain : current_calibration;
+    }
+}
+
+// One result per circuit, name/c1 onwards, none without a name
+static int measure_circuits(const struct meter_source* source, const char* name, FILE* update)
+{
+    int regressions = 0;
+    double start = now_s();
+    uint32_t num_rows = 2 * num_samples / (num_circuits + 1);
+
+    meter_circuits_measure(&circuits, source, num_rows, calibrated ? calibration.voltage_gain : voltage_calibration);
+
+    elapsed_s += now_s() - start;
+    samples_processed += num_rows * (num_circuits + 1);
+
+    for (int i = 0; name != NULL && i < num_circuits; i++) {
+        const struct meter_circuit* c = &circuits.circuit[i];
+        struct result r = {
+            .current_rms = c->current_rms,
+            .voltage_rms = circuits.voltage_rms,
+            .active_power = c->active_power,
+            .apparent_power = c->apparent_power,
+            .reactive_power = c->reactive_power,
+            .power_factor = c->power_factor,
+        };
+
+        snprintf(r.name, sizeof(r.name), "%.48s/c%d", name, i + 1);
+        regressions += report(&r, update);
+    }
+
+    return regressions;
+}
+
+static int load_golden(const char* path)
+{
+    FILE* f = fopen(path, "r");
+    char line[256];
+
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), f) != NULL && num_golden < MAX_GOLDEN) {
+        struct result* r = &golden[num_golden];
+
+        if (line[0] == '#' || strncmp(line, "case,", 5) == 0) {
+            continue;
+        }
+
+        if (sscanf(line, "%63[^,],%lf,%lf,%lf,%lf,%lf,%lf", r->name, &r->current_rms, &r->voltage_rms,
+                   &r->active_power, &r->apparent_power, &r->reactive_power, &r->power_factor) == 7) {
+            num_golden++;
+        }
+    }
+
+    fclose(f);
+
+    return 0;
+}
+
+static int load_linearization(const char* path)
+{
+    static uint8_t buffer[METER_LINEARIZATION_SAVED_SIZE];
+    FILE* f = fopen(path, "rb");
+    uint32_t ramp_samples;
+
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    size_t size = fread(buffer, 1, sizeof(buffer), f);
+    fclose(f);
+
+    if (size != sizeof(buffer) || meter_linearization_restore(linearization_table, buffer, &ramp_samples) < 0) {
+        fprintf(stderr, "%s: not an ADC linearization\n", path);
+        return -1;
+    }
+
+    fprintf(stderr, "%s: ADC linearization from %u ramp samples\n", path, ramp_samples);
+    linearization = linearization_table;
+
+    return 0;
+}
+
+static int differs(double expected, double actual)
+{
+    if (isnan(expected) || isnan(actual)) {
+        return isnan(expected) != isnan(actual);
+    }
+
+    return fabs(actual - expected) > tolerance * fmax(1.0, fabs(expected));
+}
+
+// Returns 1 for a regression, 0 for a match or no golden value
+static int check_golden(const struct result* r)
+{
+    static const char* fields[] = {
+        "current_rms", "voltage_rms", "active_power", "apparent_power", "reactive_power", "power_factor"
+    };
+
+    for (int i = 0; i < num_golden; i++) {
+        if (strcmp(golden[i].name, r->name) != 0) {
+            continue;
+        }
+
+        const double* expected = &golden[i].current_rms;
+        const double* actual = &r->current_rms;
+        int regressions = 0;
+
+        for (int j = 0; j < 6; j++) {
+            if (differs(expected[j], actual[j])) {
+                fprintf(stderr, "REGRESSION %s %s: expected %.9g, got %.9g\n", r->name, fields[j], expected[j], actual[j]);
+                regressions = 1;
+            }
+        }
+
+        return regressions;
+    }
+
+    if (num_golden > 0) {
+        fprintf(stderr, "no golden output for %s\n", r->name);
+    }
+
+    return 0;
+}
+
+static void synth_case(struct meter_synth* synth, const char* name)
+{
+    meter_synth_init(synth, sample_rate, frequency);
+
+    if (strcmp(name, "sine") == 0) {
+        meter_synth_add_harmonic(synth, 1, 1000, 500, 0);
+    } else if (strcmp(name, "harmonics") == 0) {
+        meter_synth_add_harmonic(synth, 1, 1000, 500, 0);
+        meter_synth_add_harmonic(synth, 3, 50, 150, 0);
+        meter_synth_add_harmonic(synth, 5, 20, 80, M_PI / 4);
+    } else if (strcmp(name, "dc_offset") == 0) {
+        meter_synth_add_harmonic(synth, 1, 1000, 500, 0);
+        synth->voltage_dc = 1800;
+        synth->current_dc = 2400;
+    } else if (strcmp(name, "phase_60") == 0) {
+        meter_synth_add_harmonic(synth, 1, 1000, 500, 0);
+        synth->phase = M_PI / 3;
+    } else if (strcmp(name, "no_load") == 0) {
+        meter_synth_add_harmonic(synth, 1, 1000, 0, 0);
+    }
+}
+
+static const char* synth_cases[] = { "sine", "harmonics", "dc_offset", "phase_60", "no_load" };
+
+// Every case once, calibrated ones as case/cal<V>_<I>_<PF>, circuits as
+// case/circuits<N>/c1 onwards, each after a window that settles the DC
+// filters
+static int run_synth_cases(FILE* update)
+{
+    int regressions = 0;
+
+    for (size_t i = 0; i < sizeof(synth_cases) / sizeof(synth_cases[0]); i++) {
+        struct meter_synth synth;
+        struct meter_source source;
+        struct result r;
+
+        synth_case(&synth, synth_cases[i]);
+        meter_synth_source(&synth, &source);
+        source.linearization = linearization;
+
+        if (calibrate) {
+            calibrate_source(&source, synth_cases[i]);
+            snprintf(r.name, sizeof(r.name), "%s/cal%g_%g_%g", synth_cases[i], reference.voltage_rms,
+                     reference.current_rms, reference.power_factor);
+        } else {
+            snprintf(r.name, sizeof(r.name), "%s", synth_cases[i]);
+        }
+
+        if (num_circuits > 0) {
+            size_t length = strlen(r.name);
+
+            snprintf(r.name + length, sizeof(r.name) - length, "/circuits%d", num_circuits);
+
+            circuits_start();
+            measure_circuits(&source, NULL, NULL);
+            regressions += measure_circuits(&source, r.name, update);
+            continue;
+        }
+
+        single_start();
+        measure(&source, &r);
+        measure(&source, &r);
+
+        regressions += report(&r, update);
+    }
+
+    return regressions;
+}
+
+// As asked for, or without --calibrate and --circuits as they are,
+// calibrated against golden_reference, and on 2 and 3 circuits
+static int run_synth(FILE* update)
+{
+    if (calibrate || num_circuits > 0) {
+        return run_synth_cases(update);
+    }
+
+    int regressions = run_synth_cases(update);
+
+    reference = golden_reference;
+    calibrate = 1;
+    regressions += run_synth_cases(update);
+    calibrate = 0;
+    calibrated = 0;
+
+    for (num_circuits = 2; num_circuits <= METER_CIRCUITS_MAX; num_circuits++) {
+        regressions += run_synth_cases(update);
+    }
+
+    num_circuits = 0;
+
+    return regressions;
+}
+
+static int run_trace(const char* path, FILE* update)
+{
+    FILE* f = fopen(path, "rb");
+    struct meter_trace trace;
+    struct meter_source source;
+    const char* base = strrchr(path, '/');
+    int regressions = 0;
+    uint8_t* data;
+    long size;
+
+    if (f == NULL) {
+        perror(path);
+        return 1;
+    }
+
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    data = malloc(size > 0 ? size : 1);
+    if (data == NULL || fread(data, 1, size, f) != (size_t)size) {
+        fprintf(stderr, "%s: read failed\n", path);
+        fclose(f);
+        free(data);
+        return 1;
+    }
+    fclose(f);
+
+    if (meter_trace_open(&trace, data, size) < 0) {
+        fprintf(stderr, "%s: not a trace\n", path);
+        free(data);
+        return 1;
+    }
+
+    base = (base != NULL) ? base + 1 : path;
+    meter_trace_source(&trace, &source);
+    source.linearization = linearization;
+
+    if (calibrate && meter_trace_remaining(&trace) >= 2 * num_samples * (METER_CALIBRATION_WINDOWS + 1)) {
+        calibrate_source(&source, base);
+    } else if (calibrate) {
+        fprintf(stderr, "%s: too short to calibrate\n", path);
+        calibrated = 0;
+    }
+
+    if (num_circuits > 0) {
+        circuits_start();
+    } else {
+        single_start();
+    }
+
+    // one measurement per window of 2 * num_samples rows, like the device
+    for (int window = 0; meter_trace_remaining(&trace) >= 2 * num_samples; window++) {
+        struct result r;
+
+        snprintf(r.name, sizeof(r.name), "%.40s#%d", base, window);
+
+        if (num_circuits > 0) {
+            regressions += measure_circuits(&source, r.name, update);
+            continue;
+        }
+
+        measure(&source, &r);
+
+        regressions += report(&r, update);
+    }
+
+    if (trace.rows_lost > 0) {
+        fprintf(stderr, "%s: %u rows lost in the recording\n", path, trace.rows_lost);
+    }
+
+    free(data);
+
+    return regressions;
+}
+
+static void usage()
+{
+    fprintf(stderr,
+            "usage: meter_replay [options] [trace.mtr ...]\n"
+            "  --samples N                samples per input and measurement (10000)\n"
+            "  --current-calibration X    (51.61)\n"
+            "  --voltage-calibration X    (897.6)\n"
+            "  --rate HZ                  synthesized sample rate (25000)\n"
+            "  --frequency HZ             synthesized fundamental (60)\n"
+            "  --golden FILE              compare with golden outputs\n"
+            "  --update-golden FILE       write the outputs as the new golden file\n"
+            "  --tolerance X              relative tolerance (1e-6)\n"
+            "  --calibrate V,I,PF         calibrate against a reference load on the first\n"
+            "                             windows, PF below 0 for a leading current\n"
+            "  --linearization FILE       ADC corrections from tools/adc_linearize.py\n"
+            "  --circuits N               N currents on ADC1 onwards with the voltage, read in\n"
+            "                             turn, every current from the synthesized one\n"
+            "without traces the synthesized cases are run\n");
+}
+
+int main(int argc, char** argv)
+{
+    const char* update_path = NULL;
+    FILE* update = NULL;
+    int traces = 0;
+    int regressions = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+        if (arg[0] != '-') {
+            continue;
+        }
+
+        if (value == NULL) {
+            usage();
+            return 2;
+        } else if (strcmp(arg, "--samples") == 0) {
+            num_samples = strtoul(value, NULL, 0);
+        } else if (strcmp(arg, "--current-calibration") == 0) {
+            current_calibration = atof(value);
+        } else if (strcmp(arg, "--voltage-calibration") == 0) {
+            voltage_calibration = atof(value);
+        } else if (strcmp(arg, "--rate") == 0) {
+            sample_rate = atof(value);
+        } else if (strcmp(arg, "--frequency") == 0) {
+            frequency = atof(value);
+        } else if (strcmp(arg, "--golden") == 0) {
+            if (load_golden(value) < 0) {
+                return 2;
+            }
+        } else if (strcmp(arg, "--update-golden") == 0) {
+            update_path = value;
+        } else if (strcmp(arg, "--tolerance") == 0) {
+            tolerance = atof(value);
+        } else if (strcmp(arg, "--calibrate") == 0) {
+            if (sscanf(value, "%lf,%lf,%lf", &reference.voltage_rms, &reference.current_rms, &reference.power_factor) != 3) {
+                usage();
+                return 2;
+            }
+            calibrate = 1;
+        } else if (strcmp(arg, "--circuits") == 0) {
+            num_circuits = atoi(value);
+            if (num_circuits < 1 || num_circuits > METER_CIRCUITS_MAX) {
+                fprintf(stderr, "--circuits must be 1..%d\n", METER_CIRCUITS_MAX);
+                return 2;
+            }
+        } else if (strcmp(arg, "--linearization") == 0) {
+            if (load_linearization(value) < 0) {
+                return 2;
+            }
+        } else {
+            usage();
+            return 2;
+        }
+
+        argv[++i] = NULL;
+    }
+
+    if (num_samples == 0 || num_samples > MAX_SAMPLES) {
+        fprintf(stderr, "--samples must be 1..%d\n", MAX_SAMPLES);
+        return 2;
+    }
+
+    if (update_path != NULL) {
+        update = fopen(update_path, "w");
+        if (update == NULL) {
+            perror(update_path);
+            return 2;
+        }
+        fprintf(update, "case,current_rms,voltage_rms,active_power,apparent_power,reactive_power,power_factor\n");
+    }
+
+    printf("case,current_rms,voltage_rms,active_power,apparent_power,reactive_power,power_factor\n");
+
+    for (int i = 1; i < argc; i++) {
+        if (argv[i] != NULL && argv[i][0] != '-') {
+            regressions += run_trace(argv[i], update);
+            traces++;
+        }
+    }
+
+    if (traces == 0) {
+        regressions += run_synth(update);
+    }
+
+    if (update != NULL) {
+        fclose(update);
+    }
+
+    if (elapsed_s > 0) {
+        fprintf(stderr, "throughput: %.0f samples/s (%llu samples in %.3f s)\n",
+                samples_processed / elapsed_s, (unsigned long long)samples_processed, elapsed_s);
+    }
+
+    if (regressions > 0) {
+        fprintf(stderr, "%d regressions\n", regressions);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,207 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ * Writes waveform stream frames of compressed blocks, as the
+ * current_voltage_sensor example sends them, and the samples they hold in
+ * the CSV format of tools/waveform_capture.py, so the tool's decoder can
+ * be checked against meter_wave_encode(...):
+ *
+ *   wave_frames frames.wf expected.csv
+ *   python3 tools/waveform_capture.py frames.wf decoded.csv
+ *   cmp expected.csv decoded.csv
+ *
+ * The blocks cover every predictor order, the escape and verbatim blocks.
+ * Each one is also decoded with meter_wave_decode(...), a difference exits
+ * with status 1.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "meter/wave_codec.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// as examples/current_voltage_sensor/waveform_stream.h
+#define FRAME_VERSION   2
+#define FRAME_COMPRESSED 0x02
+#define HEADER_SIZE     20
+#define PAIRS           512
+#define SAMPLE_RATE     500000
+
+#define KINDS           8
+#define BLOCKS          (3 * KINDS)
+
+static uint32_t lcg_state = 1;
+
+static uint32_t lcg()
+{
+    lcg_state = lcg_state * 1664525 + 1013904223;
+
+    return lcg_state >> 8;
+}
+
+static uint16_t clamp(double value)
+{
+    if (value < 0) {
+        return 0;
+    } else if (value > 4095) {
+        return 4095;
+    }
+
+    return (uint16_t)lround(value);
+}
+
+// One input of a block, the phase moves on with the block number
+static void fill(uint16_t* samples, size_t stride, int kind, int block)
+{
+    for (size_t i = 0; i < PAIRS; i++) {
+        double t = (double)(block * PAIRS + i) / (SAMPLE_RATE / 2);
+        double noise = (double)(lcg() % 5) - 2;
+        double wave = sin(2 * M_PI * 60 * t);
+        uint16_t sample;
+
+        switch (kind) {
+        case 0:     // mains with ADC noise
+            sample = clamp(2048 + 1400 * wave + noise);
+            break;
+        case 1:     // harmonics
+            sample = clamp(2048 + 1200 * wave + 300 * sin(2 * M_PI * 180 * t) + 150 * sin(2 * M_PI * 300 * t) + noise);
+            break;
+        case 2:     // no signal
+            sample = 2048;
+            break;
+        case 3:     // full scale noise, stored verbatim
+            sample = lcg() & 0x0fff;
+            break;
+        case 4:     // steps of full scale, escaped residuals
+            sample = ((i / 7) & 1) ? 4095 : 0;
+            break;
+        case 5:     // ramp, wrapping around
+            sample = (block * PAIRS + i * 9) & 0x0fff;
+            break;
+        case 6:     // clipped
+            sample = clamp(2048 + 3000 * sin(2 * M_PI * 1000 * t));
+            break;
+        default:    // fast sine, high order predictors
+            sample = clamp(2048 + 2000 * sin(2 * M_PI * 5000 * t) + noise);
+            break;
+        }
+
+        samples[i * stride] = sample;
+    }
+}
+
+static void put_u16(uint8_t* p, uint16_t value)
+{
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+}
+
+static void put_u32(uint8_t* p, uint32_t value)
+{
+    put_u16(p, (uint16_t)value);
+    put_u16(p + 2, (uint16_t)(value >> 16));
+}
+
+// WaveformStream::pack_frame(...) of a compressed block
+static size_t pack_frame(const uint16_t* samples, uint32_t sequence, uint32_t time_us, uint8_t* frame)
+{
+    uint8_t* payload = frame + HEADER_SIZE;
+    uint8_t checksum = 0;
+    size_t length;
+
+    length = meter_wave_encode(samples, PAIRS, 2, payload);
+    length += meter_wave_encode(samples + 1, PAIRS, 2, payload + length);
+
+    frame[0] = 'W';
+    frame[1] = 'F';
+    frame[2] = FRAME_VERSION;
+    frame[3] = FRAME_COMPRESSED;
+    put_u32(frame + 4, sequence);
+    put_u32(frame + 8, time_us);
+    put_u32(frame + 12, SAMPLE_RATE);
+    put_u16(frame + 16, PAIRS);
+    put_u16(frame + 18, (uint16_t)length);
+
+    for (size_t i = 2; i < HEADER_SIZE + length; i++) {
+        checksum ^= frame[i];
+    }
+
+    frame[HEADER_SIZE + length] = checksum;
+
+    return HEADER_SIZE + length + 1;
+}
+
+// Both inputs back through meter_wave_decode(...)
+static int check_decode(const uint16_t* samples, const uint8_t* frame, size_t length)
+{
+    uint16_t decoded[2 * PAIRS];
+    const uint8_t* payload = frame + HEADER_SIZE;
+    size_t size = length - HEADER_SIZE - 1;
+    int used = meter_wave_decode(payload, size, decoded, PAIRS, 2);
+
+    if (used < 0 || meter_wave_decode(payload + used, size - used, decoded + 1, PAIRS, 2) < 0) {
+        return -1;
+    }
+
+    return memcmp(samples, decoded, sizeof(decoded)) == 0 ? 0 : -1;
+}
+
+int main(int argc, char** argv)
+{
+    static uint8_t frame[HEADER_SIZE + 2 * METER_WAVE_ENCODED_MAX_SIZE(PAIRS) + 1];
+    uint16_t samples[2 * PAIRS];
+    size_t encoded = 0;
+    int failures = 0;
+
+    if (argc != 3) {
+        fprintf(stderr, "usage: wave_frames frames.wf expected.csv\n");
+        return 2;
+    }
+
+    FILE* frames = fopen(argv[1], "wb");
+    FILE* csv = fopen(argv[2], "w");
+
+    if (frames == NULL || csv == NULL) {
+        fprintf(stderr, "cannot create %s or %s\n", argv[1], argv[2]);
+        return 2;
+    }
+
+    fprintf(csv, "time_us,voltage,current\n");
+
+    for (int block = 0; block < BLOCKS; block++) {
+        // time_us_32() of the last sample, 2 samples per pair
+        uint32_t first_us = block * PAIRS * 2000000u / SAMPLE_RATE;
+        uint32_t time_us = first_us + (PAIRS - 1) * 2000000u / SAMPLE_RATE;
+
+        fill(samples, 2, block % KINDS, block);
+        fill(samples + 1, 2, (block + 3) % KINDS, block);
+
+        size_t length = pack_frame(samples, block, time_us, frame);
+
+        if (check_decode(samples, frame, length) < 0) {
+            fprintf(stderr, "block %d: meter_wave_decode differs\n", block);
+            failures++;
+        }
+
+        fwrite(frame, 1, length, frames);
+        encoded += length - HEADER_SIZE - 1;
+
+        for (size_t i = 0; i < PAIRS; i++) {
+            fprintf(csv, "%.1f,%d,%d\n", first_us + i * (2e6 / SAMPLE_RATE), samples[2 * i], samples[2 * i + 1]);
+        }
+    }
+
+    fclose(frames);
+    fclose(csv);
+
+    printf("%d blocks, %.2f bits per sample\n", BLOCKS, encoded * 8.0 / (BLOCKS * 2 * PAIRS));
+
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#ifndef _METER_CALIBRATION_H_
+#define _METER_CALIBRATION_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Gain, offset and phase calibration against a reference load.
+//
+// The meter is connected to a linear load of known RMS voltage, current and
+// power factor and measures a few windows with unity gains, exactly as the
+// measure step does: meter_current_get(...) then meter_voltage_get(...),
+// seeded with meter_calibration_seed(...). From the filtered samples of each
+// window the solver takes
+//
+// - the offsets: the raw mean of each input, reconstructed from the
+//   filtered samples and the seed; used to seed the DC filters, the first
+//   window only settles them
+// - the gains: reference RMS over measured RMS
+// - the phase delay: the angle between the fundamentals of the voltage and
+//   current samples, by a single bin DFT over whole cycles, less the
+//   reference angle, in samples of the fundamental period
+//
+// Applied in the measure step at no cost per sample: the gains are the
+// calibration factors, the offsets the DC filter seeds, and the phase delay
+// shifts the current samples against the voltage samples in
+// meter_calculate_power_aligned(...).
+//
+// The two inputs are sampled one after the other, so the phase delay
+// includes the num_samples periods between the two captures, see
+// meter_calibration_phase_delay(...).
+
+#define METER_CALIBRATION_WINDOWS       8       // after the settling window
+
+// Size of meter_calibration_save(...), with a sequence number and a CRC-32
+#define METER_CALIBRATION_SAVED_SIZE    64
+
+// meter_calibration_solve(...) errors
+#define METER_CALIBRATION_ERROR_WINDOWS     -1  // not enough windows
+#define METER_CALIBRATION_ERROR_SIGNAL      -2  // no voltage or current
+#define METER_CALIBRATION_ERROR_CYCLE       -3  // window shorter than a cycle
+#define METER_CALIBRATION_ERROR_RANGE       -4  // gains out of range
+
+struct meter_calibration_reference {
+    double voltage_rms;         // V
+    double current_rms;         // A
+    double power_factor;        // 0 to 1 lagging (inductive), 0 to -1 leading
+};
+
+struct meter_calibration {
+    double voltage_gain;        // V at ADC full scale, the voltage calibration
+    double current_gain;        // A at ADC full scale, the current calibration
+    double voltage_offset;      // ADC counts, DC filter seed
+    double current_offset;
+    double cycle_samples;       // fundamental period in samples
+    int32_t phase_delay;        // samples, at num_samples
+    uint32_t num_samples;       // per input, of the calibration windows
+};
+
+struct meter_calibration_solver {
+    struct meter_calibration_reference reference;
+    uint32_t num_samples;
+    uint32_t windows;           // added, the settling one included
+
+    double voltage_offset;
+    double current_offset;
+
+    // sums over the windows after the settling one
+    double voltage_ms;          // mean squares, ADC counts^2
+    double current_ms;
+    double cycle_samples;
+    uint32_t cycles;            // windows with a fundamental period
+    double delay_cos;           // unit phasors of the phase error
+    double delay_sin;
+};
+
+void meter_calibration_start(struct meter_calibration_solver* solver, const struct meter_calibration_reference* reference,
+                             uint32_t num_samples);
+
+// DC filter seed for the next window, METER_INPUT_VOLTAGE or
+// METER_INPUT_CURRENT
+double meter_calibration_seed(const struct meter_calibration_solver* solver, uint8_t input);
+
+// Adds a window measured with the seeds of meter_calibration_seed(...)
+void meter_calibration_add_window(struct meter_calibration_solver* solver, const double* voltage_samples,
+                                  const double* current_samples, double voltage_seed, double current_seed);
+
+// Returns 0 and the calibration, or a METER_CALIBRATION_ERROR_...
+int meter_calibration_solve(const struct meter_calibration_solver* solver, struct meter_calibration* calibration);
+
+// Phase delay for another number of samples per input, the time between
+// the two captures changes with it
+int32_t meter_calibration_phase_delay(const struct meter_calibration* calibration, uint32_t num_samples);
+
+// Pairs of samples left after the phase delay for num_samples, cut to
+// whole cycles of the fundamental, for meter_calculate_power_aligned(...);
+// all of them when they are less than a cycle
+uint32_t meter_calibration_power_samples(const struct meter_calibration* calibration, uint32_t num_samples);
+
+// [0] 'C' 'L' version, [4] sequence, values, CRC-32 at the end
+void meter_calibration_save(const struct meter_calibration* calibration, uint32_t sequence, uint8_t* buffer);
+
+// Returns 0 and the sequence number, or -1 if buffer holds no calibration
+int meter_calibration_restore(struct meter_calibration* calibration, const uint8_t* buffer, uint32_t* sequence);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#ifndef _METER_CIRCUITS_H_
+#define _METER_CIRCUITS_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "meter/source.h"
+
+// Several circuits on one voltage: the voltage input and the current input
+// of every circuit are read in turn, one row of samples after the other,
+// so all of them cover the same cycles and nothing needs to be kept for
+// the power. Every circuit has its own gain, DC filter and sums, and its
+// own energy.
+//
+// The current of circuit n is read n sample periods after the voltage,
+// each is multiplied with the voltage interpolated to that time, so the
+// reads only need to be evenly spaced. There is no phase calibration.
+
+#define METER_CIRCUITS_MAX  3       // ADC1 to ADC3, the voltage on ADC0
+
+struct meter_circuit {
+    uint8_t input;                  // ADC input of the current
+    double current_calibration;     // A at ADC full scale
+    double current_offset;          // DC filter, ADC counts, kept between measurements
+
+    // last meter_circuits_measure(...)
+    double current_rms;
+    double active_power;
+    double apparent_power;
+    double reactive_power;
+    double power_factor;
+
+    // since meter_circuits_init(...), active power only
+    uint64_t import_uj;
+    uint64_t export_uj;
+};
+
+struct meter_circuits {
+    uint8_t count;
+    double voltage_offset;          // DC filter, ADC counts, kept between measurements
+    double voltage_rms;             // last meter_circuits_measure(...)
+    struct meter_circuit circuit[METER_CIRCUITS_MAX];
+};
+
+// count circuits on ADC1 onwards, mid-scale offsets, no energy yet; gains
+// and offsets are set in the structure
+void meter_circuits_init(struct meter_circuits* circuits, uint8_t count);
+
+// num_rows of the voltage and every current, at least 2, the voltage at
+// voltage_calibration (V at ADC full scale). The DC filters start from the
+// offsets in the structure and leave them where they settled.
+void meter_circuits_measure(struct meter_circuits* circuits, const struct meter_source* source, uint32_t num_rows,
+                            double voltage_calibration);
+
+// Adds the active power of the last measurement over elapsed_ms
+void meter_circuits_accumulate(struct meter_circuits* circuits, uint32_t elapsed_ms);
+
+// Size of meter_circuits_encode(...) for count circuits
+#define METER_CIRCUITS_ENCODED_SIZE(count) (4 + 16 * (count))
+#define METER_CIRCUITS_ENCODING_VERSION 1
+
+// Combined uplink, little-endian, saturating:
+//   [0]  format version, METER_CIRCUITS_ENCODING_VERSION
+//   [1]  number of circuits
+//   [2]  voltage RMS in 10 mV (2 bytes)
+//   [4]  one record of 16 bytes per circuit:
+//        [0]  current RMS in 10 mA (2 bytes)
+//        [2]  active power in 0.1 W, signed, negative for export
+//        [6]  power factor in 1/1000, signed (2 bytes)
+//        [8]  imported energy in Wh
+//        [12] exported energy in Wh
+void meter_circuits_encode(const struct meter_circuits* circuits, uint8_t* buffer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
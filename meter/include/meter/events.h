@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#ifndef _METER_EVENTS_H_
+#define _METER_EVENTS_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "meter/source.h"
+
+// Voltage sag / swell / interruption detection.
+//
+// Voltage samples are fed one at a time, half cycles are delimited by the
+// zero crossings of the offset-removed signal. After every half cycle the
+// RMS over the last full cycle (the two latest half cycles) is compared
+// against thresholds relative to the nominal RMS, in integer arithmetic:
+// the per-sample cost is an offset update, a square and a sign check.
+//
+// - sag: below sag_permille of nominal
+// - interruption: below interruption_permille, a sag that goes this deep
+//   is reported as an interruption
+// - swell: above swell_permille
+//
+// An event ends when the RMS is back within the thresholds by
+// hysteresis_permille. Every event is kept in a small log of records, and
+// the first one to trigger while the capture is armed freezes a window of
+// raw samples around the trigger until meter_events_release_capture(...).
+// The window never spans a gap: a gap after the trigger ends it early, and
+// one shortly before leaves fewer samples ahead of the trigger.
+//
+// Without zero crossings (an interruption, or no voltage) a half cycle is
+// closed after twice the average half cycle length seen so far.
+//
+// Event times are those of the samples that start and end them, counted
+// from the sample clock of meter_events_clock(...), not from when the
+// samples are processed.
+
+#define METER_EVENT_SAG             1
+#define METER_EVENT_SWELL           2
+#define METER_EVENT_INTERRUPTION    3
+
+#define METER_EVENTS_LOG_SIZE       16      // power of 2
+#define METER_EVENTS_CAPTURE_SIZE   512     // samples, power of 2
+
+// Size of meter_event_encode(...)
+#define METER_EVENT_ENCODED_SIZE    11
+
+struct meter_event {
+    uint32_t time_ms;               // start, from the sample clock
+    uint32_t duration_ms;
+    uint16_t depth_permille;        // lowest (sag, interruption) or highest (swell) RMS
+    uint16_t half_cycles;           // saturating
+    uint8_t type;
+};
+
+struct meter_events_config {
+    uint16_t nominal_rms;           // ADC counts, offset removed
+    uint16_t sag_permille;          // e.g. 900
+    uint16_t swell_permille;        // e.g. 1100
+    uint16_t interruption_permille; // e.g. 100
+    uint16_t hysteresis_permille;   // e.g. 20
+    uint16_t zero_hysteresis;       // ADC counts around zero ignored for crossings
+    uint16_t capture_pre;           // samples kept before the trigger, at most METER_EVENTS_CAPTURE_SIZE - 1
+};
+
+struct meter_events {
+    struct meter_events_config config;
+
+    // thresholds on the mean square over one cycle, counts^2
+    uint32_t sag_ms;
+    uint32_t sag_end_ms;
+    uint32_t swell_ms;
+    uint32_t swell_end_ms;
+    uint32_t interruption_ms;
+
+    // sample clock, see meter_events_clock(...)
+    uint64_t clock_us;              // time of sample clock_index
+    uint32_t clock_index;
+    uint32_t clock_rate;            // samples per second, 0 without a clock
+    uint32_t sample_index;          // samples fed, free running
+
+    // sample state
+    int32_t offset_q16;
+    int8_t polarity;                // 0 until the first excursion past zero_hysteresis
+    bool half_aligned;              // the half cycle in progress started at a crossing
+    uint64_t half_sum;
+    uint32_t half_samples;
+    uint64_t prev_half_sum;
+    uint32_t prev_half_samples;
+    uint32_t avg_half_samples_q4;   // 0 until a whole half cycle was seen
+
+    // current event, type 0 for none
+    struct meter_event event;
+    uint32_t extreme_ms;
+
+    // event log, free running indices
+    struct meter_event log[METER_EVENTS_LOG_SIZE];
+    uint32_t log_head;
+    uint32_t log_sent;
+    uint32_t log_dropped;
+
+    // capture ring
+    uint16_t capture[METER_EVENTS_CAPTURE_SIZE];
+    uint32_t capture_index;         // free running
+    uint32_t capture_start;         // capture_index after the last gap
+    uint16_t capture_post;          // samples still to take after the trigger
+    uint32_t capture_trigger;       // capture_index of the trigger sample
+    bool capture_frozen;
+    bool capture_triggered;
+
+    // wrapped source
+    const struct meter_source* inner;
+    uint8_t input;
+};
+
+void meter_events_init(struct meter_events* events, const struct meter_events_config* config);
+
+// New nominal RMS, e.g. after a calibration change, the thresholds follow,
+// the log and the capture are kept
+void meter_events_set_nominal(struct meter_events* events, uint16_t nominal_rms);
+
+// The next sample fed was taken at time_us, e.g. the first one of a DMA
+// block, the ones after it follow at sample_rate per second. Set it for
+// every block, the event times are counted from it; without a clock they
+// are 0.
+void meter_events_clock(struct meter_events* events, uint64_t time_us, uint32_t sample_rate);
+
+// Feeds one raw voltage sample (ADC counts)
+void meter_events_sample(struct meter_events* events, uint16_t sample);
+
+// The samples stop being contiguous, e.g. the ADC moves to another input:
+// drops the half cycle in progress, an ongoing event continues. A capture
+// collecting samples after its trigger is frozen as it is, an armed one
+// drops the samples before the gap.
+void meter_events_gap(struct meter_events* events);
+
+// Wraps a source: reads of the voltage input are fed to the engine, a
+// switch to another input is a gap
+void meter_events_source(struct meter_events* events, const struct meter_source* inner, struct meter_source* source);
+
+// Logged events not yet returned by meter_events_next_unsent(...)
+uint32_t meter_events_unsent(const struct meter_events* events);
+
+// Copies the oldest unsent event, returns 0 or -1 if there is none. Call
+// meter_events_mark_sent(...) once it was handed over.
+int meter_events_next_unsent(const struct meter_events* events, struct meter_event* event);
+
+void meter_events_mark_sent(struct meter_events* events);
+
+// Logged events still held, newest last, index 0 is the oldest
+uint32_t meter_events_count(const struct meter_events* events);
+
+int meter_events_get(const struct meter_events* events, uint32_t index, struct meter_event* event);
+
+// The frozen capture in time order, returns the number of samples copied
+// and the position of the trigger in them, below the number of samples, 0
+// if nothing is frozen
+uint32_t meter_events_get_capture(const struct meter_events* events, uint16_t* samples, uint32_t max_samples, uint32_t* trigger);
+
+// Re-arms the capture for the next event
+void meter_events_release_capture(struct meter_events* events);
+
+// type (1 byte), start time in ms (4 bytes), duration in ms (4 bytes),
+// depth in 1/1000 of nominal (2 bytes), little-endian
+void meter_event_encode(const struct meter_event* event, uint8_t* buffer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#ifndef _METER_FIXED_FORMAT_H_
+#define _METER_FIXED_FORMAT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Text rendering of scaled fixed-point integers, a value of 123456 with 2
+// decimals is 1234.56. Uses integer arithmetic only, so it replaces
+// printf("%0.2f") without pulling in soft-float formatting.
+
+// Largest formatted number: sign, 10 digits, decimal point
+#define FIXED_FORMAT_MAX_DIGITS 12
+
+// Write value / 10^decimals with exactly `decimals` decimals, no terminator.
+// More than 9 decimals are taken as 9, like fixed_from_double.
+// Returns the number of characters written, at most FIXED_FORMAT_MAX_DIGITS.
+size_t fixed_format(char* buffer, int32_t value, uint8_t decimals);
+
+// Write "<prefix><value><unit>" NUL terminated, truncated to buffer_len.
+// Returns the string length.
+size_t fixed_format_field(char* buffer, size_t buffer_len, const char* prefix, int32_t value, uint8_t decimals, const char* unit);
+
+// Scale and round a floating point value, saturating at the int32_t range.
+// More than 9 decimals are taken as 9.
+int32_t fixed_from_double(double value, uint8_t decimals);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#ifndef _METER_LINEARIZATION_H_
+#define _METER_LINEARIZATION_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+// ADC nonlinearity correction, a corrected value for every 12-bit code.
+//
+// The RP2040 ADC has codes noticeably wider or narrower than the others
+// (DNL), mostly around 512, 1536, 2560 and 3584, and their sum bends the
+// transfer curve (INL). Both go straight into the sums of squares and of
+// products, averaging more samples does not take them out. The correction
+// of every code is measured per board from a slow ramp over the whole input
+// range, see tools/adc_linearize.py: every code is hit in proportion to its
+// width, the widths give where each code really is, and the straight line
+// through them is left to the gain and offset calibration.
+//
+// Saved as one signed byte per code, in 1/8 ADC counts, and expanded into a
+// table of floats, code + correction, that the sample loops of
+// meter_current_get(...) and meter_voltage_get(...) read instead of the
+// code: struct meter_source linearization. One table load per sample.
+
+#define METER_LINEARIZATION_CODES       4096
+#define METER_LINEARIZATION_STEPS       8       // corrections per ADC count
+
+// Size of meter_linearization_restore(...) buffers
+#define METER_LINEARIZATION_SAVED_SIZE  (8 + METER_LINEARIZATION_CODES + 4)
+
+// Fills table with the codes themselves
+void meter_linearization_identity(float* table);
+
+// [0] 'A' 'L' version, [4] number of ramp samples, [8] corrections, CRC-32
+// at the end. Returns 0 and fills table, or -1 if buffer holds no
+// corrections, leaving table as it is.
+int meter_linearization_restore(float* table, const uint8_t* buffer, uint32_t* ramp_samples);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
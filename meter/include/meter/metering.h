@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#ifndef _METER_METERING_H_
+#define _METER_METERING_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "meter/source.h"
+
+#define ADC_BITS 12
+#define ADC_COUNTS (1 << ADC_BITS)
+
+// ADC reference in mV
+#ifndef SUPPLY_VOLTAGE
+#define SUPPLY_VOLTAGE 3283
+#endif
+
+// RMS of num_samples current samples read from input 1 of source, after
+// removing the DC offset with a slow IIR that starts from *offset_current
+// and leaves it where it ended, so the next window carries on with the
+// settled filter. The filtered samples are stored in current_samples for
+// meter_calculate_power.
+double meter_current_get(const struct meter_source* source, uint32_t num_samples, double current_calibration, double* offset_current, double* current_samples);
+
+// Same for the voltage on input 0
+double meter_voltage_get(const struct meter_source* source, uint32_t num_samples, double voltage_calibration, double* offset_voltage, double* voltage_samples);
+
+// Active power, the mean of the instantaneous power over the stored samples
+double meter_calculate_power(const double* voltage_samples, const double* current_samples, uint32_t num_samples,
+                             double voltage_calibration, double current_calibration);
+
+// Same, with current sample n paired with voltage sample n - phase_delay,
+// see meter/calibration.h; the samples left without a partner are left out.
+// Only the first power_samples pairs are averaged if there are more, 0 for
+// all of them: meter_calibration_power_samples(...) cuts them to whole
+// cycles.
+double meter_calculate_power_aligned(const double* voltage_samples, const double* current_samples, uint32_t num_samples,
+                                     int32_t phase_delay, uint32_t power_samples, double voltage_calibration,
+                                     double current_calibration);
+
+double meter_calculate_apparent_power(double voltage_rms, double current_rms);
+
+// Active power limited to +/- the apparent power: the power and the RMS
+// values are averaged over different samples, not whole cycles, and can
+// disagree by a little at a power factor close to 1
+double meter_limit_active_power(double active_power, double apparent_power);
+
+double meter_calculate_reactive_power(double apparent_power, double active_power);
+
+double meter_calculate_power_factor(double active_power, double apparent_power);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#ifndef _METER_REGISTERS_H_
+#define _METER_REGISTERS_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Billing registers: energy per time-of-use tariff and demand.
+//
+// Each metering window adds its average active power times its length to
+// the registers, in integer arithmetic, energy in uJ (mW x ms).
+//
+// - energy: imported energy per tariff of the time-of-use schedule, and in
+//   total; exported energy in total
+// - block demand: average imported power over fixed intervals aligned to
+//   the clock (e.g. :00, :15, :30, :45), with the peak and its end time
+// - sliding demand: average over the last interval, moved forward every
+//   subinterval (interval / METER_DEMAND_SUBINTERVALS) with a ring of the
+//   subinterval energies and a running sum, with the peak and its end time
+//
+// An update costs a few additions, closing a subinterval one ring slot, and
+// the tariff is looked up again only when the schedule switches or the day
+// changes, so the work per window does not depend on the interval or the
+// schedule size. A window counts in the subinterval its end falls in.
+//
+// Times are seconds since 1970 UTC. Until the time is known updates take
+// METER_TIME_UNKNOWN: the energy goes to the total and the untimed register
+// only, demand starts with the first known time. Peaks are only taken from
+// complete intervals, the first one after a start, a reboot or a gap longer
+// than an interval does not count.
+
+#define METER_TIME_UNKNOWN          0
+
+#define METER_TOU_TARIFFS           4
+#define METER_TOU_SWITCHES          8       // per day profile
+#define METER_TOU_WEEKDAY           0
+#define METER_TOU_WEEKEND           1       // Saturday and Sunday
+
+#define METER_DEMAND_SUBINTERVALS   15
+
+// Time-of-use schedule: two day profiles, each a list of switch points in
+// local minutes of the day, the first one at minute 0, with the tariff
+// from that minute on
+struct meter_tou_schedule {
+    int16_t utc_offset_min;         // local time - UTC
+    uint8_t count[2];
+    uint16_t minute[2][METER_TOU_SWITCHES];
+    uint8_t tariff[2][METER_TOU_SWITCHES];
+};
+
+// Size of meter_tou_encode(...) at most
+#define METER_TOU_ENCODED_MAX_SIZE  (2 + 2 * 2 * METER_TOU_SWITCHES)
+
+struct meter_demand_peak {
+    uint32_t power_mw;
+    uint32_t time;                  // end of the interval, 0 for none
+};
+
+struct meter_registers {
+    struct meter_tou_schedule schedule;
+    uint32_t interval_s;            // multiple of METER_DEMAND_SUBINTERVALS
+
+    // persisted, see meter_registers_save(...)
+    uint64_t import_uj[METER_TOU_TARIFFS];
+    uint64_t import_total_uj;
+    uint64_t import_untimed_uj;     // while the time was unknown
+    uint64_t export_total_uj;
+    struct meter_demand_peak block_peak;
+    struct meter_demand_peak sliding_peak;
+
+    // tariff in effect from tou_from until tou_next
+    uint8_t tou_tariff;
+    uint32_t tou_from;
+    uint32_t tou_next;
+
+    // subinterval in progress, 0 before the first known time
+    uint32_t sub_start;
+    uint64_t sub_uj;
+
+    // ring of the closed subintervals of the sliding interval
+    uint64_t ring_uj[METER_DEMAND_SUBINTERVALS];
+    uint64_t ring_sum_uj;
+    uint8_t ring_index;
+    uint8_t ring_count;             // valid slots, sliding demand once full
+
+    // block in progress
+    uint64_t block_uj;
+    uint8_t block_subs;             // subintervals closed in it
+
+    uint32_t block_demand_mw;       // of the last complete block
+    uint32_t sliding_demand_mw;
+};
+
+// meter_registers_update(...) results
+#define METER_REGISTERS_SUBINTERVAL_END 0x01
+#define METER_REGISTERS_BLOCK_END       0x02
+
+// Clears every register, interval_s is the demand interval, e.g. 900; the
+// schedule starts with tariff 0 all day
+void meter_registers_init(struct meter_registers* registers, uint32_t interval_s);
+
+// One metering window ending at time, of elapsed_ms with power_mw average
+// active power, negative when exporting. Returns METER_REGISTERS_* flags
+// for the intervals it closed.
+uint32_t meter_registers_update(struct meter_registers* registers, uint32_t time, int32_t power_mw, uint32_t elapsed_ms);
+
+// Starts a new billing period: clears both peaks
+void meter_registers_reset_peaks(struct meter_registers* registers);
+
+// Replaces the schedule, returns 0 or -1 if it is invalid: UTC offset in
+// whole quarter hours up to 14 hours, counts from 1 to METER_TOU_SWITCHES,
+// minutes rising from 0 and below 1440, tariffs below METER_TOU_TARIFFS
+int meter_registers_set_schedule(struct meter_registers* registers, const struct meter_tou_schedule* schedule);
+
+// Tariff in effect at time
+uint8_t meter_tou_tariff(const struct meter_tou_schedule* schedule, uint32_t time);
+
+// Schedule downlink, little-endian:
+//   [0]  UTC offset, signed, 15 minute units
+//   [1]  weekday switch points << 4 | weekend switch points
+//   [2]  weekday then weekend switch points, 2 bytes each:
+//        tariff << 12 | minute of the day
+// Returns the size, or -1 if the buffer is too small
+int meter_tou_encode(const struct meter_tou_schedule* schedule, uint8_t* buffer, size_t buffer_len);
+
+// Returns 0, or -1 if the buffer does not hold a valid schedule
+int meter_tou_decode(struct meter_tou_schedule* schedule, const uint8_t* buffer, size_t length);
+
+// Size of meter_registers_encode(...)
+#define METER_REGISTERS_ENCODED_SIZE (29 + 4 * METER_TOU_TARIFFS)
+#define METER_REGISTERS_ENCODING_VERSION 1
+
+// Register snapshot uplink, little-endian, energy in Wh, demand in W,
+// saturating:
+//   [0]  format version, METER_REGISTERS_ENCODING_VERSION
+//   [1]  time of the snapshot, seconds since 1970 UTC, 0 if unknown
+//   [5]  imported energy, total
+//   [9]  exported energy, total
+//   [13] last block demand (2 bytes)
+//   [15] sliding demand (2 bytes)
+//   [17] peak block demand (2 bytes), [19] its end time
+//   [23] peak sliding demand (2 bytes), [25] its end time
+//   [29] imported energy per tariff, METER_TOU_TARIFFS x 4 bytes
+void meter_registers_encode(const struct meter_registers* registers, uint32_t time, uint8_t* buffer);
+
+// Size of meter_registers_save(...), with a sequence number and a CRC-32
+#define METER_REGISTERS_SAVED_SIZE  (8 + 8 * (METER_TOU_TARIFFS + 3) + 16 + METER_TOU_ENCODED_MAX_SIZE + 4)
+
+// Persistent state: energy registers, peaks and schedule. Demand intervals
+// in progress are not saved, the first one after a restore is incomplete.
+void meter_registers_save(const struct meter_registers* registers, uint32_t sequence, uint8_t* buffer);
+
+// Restores a saved state, returns 0 and its sequence number, or -1 if the
+// buffer does not hold one (erased, torn write, other version)
+int meter_registers_restore(struct meter_registers* registers, const uint8_t* buffer, uint32_t* sequence);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#ifndef _METER_SECTOR_LOG_H_
+#define _METER_SECTOR_LOG_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Append-only measurement log made of 512-byte sectors, little-endian.
+// Sector n of the file is at offset n * 512, so whole-sector appends never
+// make the file system read back a partial sector.
+//
+// sector
+//   [0]   'M' 'L'
+//   [2]   type: METER_LOG_SECTOR_HEADER / _DATA / _INDEX
+//   [3]   version
+//   [4]   sequence, the sector number in the file
+//   [8]   time of the first record / entry
+//   [12]  payload length
+//   [14]  records (data) or entries (index)
+//   [16]  payload, up to METER_LOG_PAYLOAD_SIZE bytes, zero padded
+//   [508] CRC-32 (IEEE) of bytes 0..507
+//
+// header sector (sector 0) payload
+//   [0]   time base: METER_LOG_TIME_UPTIME (seconds since boot) or
+//         METER_LOG_TIME_UNIX (seconds since 1970 UTC)
+//   [1]   data sectors per index sector
+//   [2]   reserved
+//   [4]   time when the log was started
+//   [8]   device identification, NUL terminated, up to 32 bytes
+//
+// data sector payload: records
+//   [0]   type: METER_LOG_RECORD_*
+//   [1]   payload length
+//   [2]   time
+//   [6]   payload
+//
+// index sector payload, after every METER_LOG_INDEX_INTERVAL data sectors:
+// one entry per data sector since the previous index
+//   [0]   sequence
+//   [4]   time of the first record
+
+#define METER_LOG_SECTOR_SIZE       512
+#define METER_LOG_HEADER_SIZE       16
+#define METER_LOG_PAYLOAD_SIZE      (METER_LOG_SECTOR_SIZE - METER_LOG_HEADER_SIZE - 4)
+#define METER_LOG_VERSION           1
+
+#define METER_LOG_SECTOR_HEADER     0
+#define METER_LOG_SECTOR_DATA       1
+#define METER_LOG_SECTOR_INDEX      2
+
+#define METER_LOG_TIME_UPTIME       0
+#define METER_LOG_TIME_UNIX         1
+
+#define METER_LOG_INDEX_INTERVAL    60
+#define METER_LOG_INDEX_ENTRY_SIZE  8
+
+#define METER_LOG_RECORD_HEADER_SIZE 6
+#define METER_LOG_RECORD_MAX_PAYLOAD 255
+
+// 6 x float: current and voltage RMS, active, apparent and reactive power,
+// power factor
+#define METER_LOG_RECORD_MEASUREMENT 1
+// meter_event_encode(...) of a voltage event
+#define METER_LOG_RECORD_EVENT      2
+// uint32 number of records dropped before this one for lack of buffers
+#define METER_LOG_RECORD_DROPPED    255
+
+// Sector buffers are handed in and out through callbacks: get returns an
+// empty sector or NULL when none is free, put takes a filled one, still
+// without its CRC, see meter_log_seal(...). Both must not block.
+struct meter_log_writer {
+    uint8_t* (*get_sector)(void* context);
+    void (*put_sector)(void* context, uint8_t* sector);
+    void* context;
+
+    uint32_t sequence;              // of the next sector
+    uint8_t* sector;                // data sector being filled, NULL if none
+    uint32_t dropped;               // records not yet reported in the log
+    uint32_t dropped_total;
+
+    uint32_t index_time[METER_LOG_INDEX_INTERVAL];
+    uint32_t index_sequence[METER_LOG_INDEX_INTERVAL];
+    uint8_t index_entries;
+};
+
+// Starts a new log with its header sector, returns 0 or -1 if no sector
+// buffer is free
+int meter_log_start(struct meter_log_writer* writer, uint8_t* (*get_sector)(void* context),
+                    void (*put_sector)(void* context, uint8_t* sector), void* context,
+                    uint8_t time_base, uint32_t time, const char* device);
+
+// Appends a record, returns 0 or -1 if it was dropped for lack of a sector
+// buffer, which is noted in the log with the next record that fits
+int meter_log_append(struct meter_log_writer* writer, uint8_t type, uint32_t time, const void* payload, uint8_t length);
+
+// Hands over the data sector being filled, e.g. before a power down
+void meter_log_flush(struct meter_log_writer* writer);
+
+// Fills in the CRC, called by whoever writes the sector out
+void meter_log_seal(uint8_t* sector);
+
+// Checks the magic, version and CRC of a sector
+bool meter_log_check(const uint8_t* sector);
+
+uint32_t meter_log_crc32(const uint8_t* data, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#ifndef _METER_SOURCE_H_
+#define _METER_SOURCE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Sample loops and the ADC source are linked into SRAM with the
+// PICO_LORAWAN_RAM_HOT_PATHS build option, see pico/lorawan_ram.h
+#if defined(PICO_LORAWAN_RAM_HOT_PATHS)
+#include "pico/platform.h"
+#define METER_RAM_FUNC(name) __not_in_flash_func(name)
+#else
+#define METER_RAM_FUNC(name) name
+#endif
+
+// Where the metering code gets its samples from, shaped like the ADC:
+// select an input, then read one 12-bit sample at a time. Every read is
+// the next sample period, whichever input is selected.
+//
+// - meter_source_adc: the RP2040 ADC, adc_select_input / adc_read
+// - meter_synth: synthesized voltage / current waveforms
+// - meter_trace: replay of a recorded trace, see meter/trace.h
+//
+// The metering code reads the samples through linearization, corrected
+// values by code, if there is one, see meter/linearization.h.
+struct meter_source {
+    void (*select)(void* context, uint8_t input);
+    uint16_t (*read)(void* context);
+    void* context;
+    const float* linearization;     // METER_LINEARIZATION_CODES, NULL for none
+};
+
+static inline void meter_source_select(const struct meter_source* source, uint8_t input)
+{
+    source->select(source->context, input);
+}
+
+static inline uint16_t meter_source_read(const struct meter_source* source)
+{
+    return source->read(source->context);
+}
+
+#define METER_INPUT_VOLTAGE 0
+#define METER_INPUT_CURRENT 1
+
+// RP2040 builds only
+extern const struct meter_source meter_source_adc;
+
+// Synthesized waveforms, in ADC counts: dc + sum of harmonics, the current
+// lagging the voltage by phase (radians) at the fundamental. Every input
+// but the voltage reads the current.
+#define METER_SYNTH_MAX_HARMONICS 8
+
+struct meter_synth_harmonic {
+    uint8_t order;          // 1 for the fundamental
+    double voltage_amplitude;
+    double current_amplitude;
+    double current_phase;   // extra lag of this harmonic, radians
+};
+
+struct meter_synth {
+    double sample_rate;     // Hz
+    double frequency;       // fundamental, Hz
+    double voltage_dc;
+    double current_dc;
+    double phase;           // current lag at the fundamental, radians
+    uint8_t num_harmonics;
+    struct meter_synth_harmonic harmonics[METER_SYNTH_MAX_HARMONICS];
+
+    // state
+    uint8_t input;
+    uint64_t index;
+};
+
+void meter_synth_init(struct meter_synth* synth, double sample_rate, double frequency);
+
+int meter_synth_add_harmonic(struct meter_synth* synth, uint8_t order, double voltage_amplitude, double current_amplitude, double current_phase);
+
+void meter_synth_source(struct meter_synth* synth, struct meter_source* source);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
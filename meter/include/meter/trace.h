@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#ifndef _METER_TRACE_H_
+#define _METER_TRACE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "meter/source.h"
+
+// ADC trace, little-endian:
+//
+// header (16 bytes)
+//   [0]  'M' 'T' 'R' 'C'
+//   [4]  version
+//   [5]  channels per row, channel n is ADC input n
+//   [6]  bits per sample, 12
+//   [7]  reserved
+//   [8]  rows per second
+//   [12] reserved
+//
+// blocks, until the end of the file
+//   [0]  index of the first row since the start of the recording, a jump
+//        from the previous block means rows were lost
+//   [4]  time_us_32() of the first row on the recording device
+//   [8]  number of rows
+//   [10] reserved
+//   [12] rows * channels samples, 12 bits each packed two into 3 bytes:
+//        s0[7:0], s1[3:0] << 4 | s0[11:8], s1[11:4], padded to a whole byte
+//
+// Two channels per row is the same packing as the waveform stream frames,
+// tools/waveform_capture.py writes traces directly.
+
+#define METER_TRACE_VERSION         1
+#define METER_TRACE_HEADER_SIZE     16
+#define METER_TRACE_BLOCK_HEADER_SIZE 12
+#define METER_TRACE_MAX_CHANNELS    4
+
+// Size of the packed samples of a block
+#define METER_TRACE_PACKED_SIZE(samples) (((samples) * 3 + 1) / 2)
+
+struct meter_trace {
+    const uint8_t* data;
+    size_t size;
+    uint8_t channels;
+    uint32_t sample_rate;
+
+    // replay position
+    size_t block;               // offset of the current block
+    uint32_t block_rows;
+    uint32_t row;               // within the current block
+    uint8_t input;
+
+    uint32_t rows_read;
+    uint32_t rows_lost;         // skipped by jumps in the row index
+    uint32_t next_row_index;
+    bool ended;
+};
+
+// Checks the header and prepares replay of a trace held in memory,
+// returns 0 on success, -1 for an invalid trace
+int meter_trace_open(struct meter_trace* trace, const uint8_t* data, size_t size);
+
+// Rows left to replay
+uint32_t meter_trace_remaining(const struct meter_trace* trace);
+
+// Replay as a sample source: every read returns the selected channel of the
+// next row, like the ADC where every read is the next sample period. After
+// the last row, reads return mid-scale and ended is set.
+void meter_trace_source(struct meter_trace* trace, struct meter_source* source);
+
+// Writing, e.g. from a capture: header into 16 bytes, then per block its
+// header and the samples packed into METER_TRACE_PACKED_SIZE(rows * channels)
+void meter_trace_write_header(uint8_t* header, uint8_t channels, uint32_t sample_rate);
+
+void meter_trace_write_block_header(uint8_t* header, uint32_t row_index, uint32_t time_us, uint16_t rows);
+
+void meter_trace_pack(uint8_t* packed, const uint16_t* samples, size_t count);
+
+static inline uint16_t meter_trace_unpack(const uint8_t* packed, size_t index)
+{
+    const uint8_t* p = packed + (index * 3) / 2;
+
+    if (index & 1) {
+        return (p[0] >> 4) | ((uint16_t)p[1] << 4);
+    }
+
+    return p[0] | ((uint16_t)(p[1] & 0x0f) << 8);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
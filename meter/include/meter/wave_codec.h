@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#ifndef _METER_WAVE_CODEC_H_
+#define _METER_WAVE_CODEC_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Lossless codec for blocks of 12-bit ADC samples of one input.
+//
+// Each sample is predicted from the previous ones with a fixed polynomial
+// predictor of order 0 to 3, the order with the smallest residuals is
+// picked per block. Residuals are zigzag mapped to unsigned values and
+// Rice coded with one parameter k per block. Blocks that would not get
+// smaller are stored as packed 12-bit samples instead, so the encoded size
+// never exceeds METER_WAVE_ENCODED_MAX_SIZE(count).
+//
+// Block, bits MSB first:
+//
+//   [0]  order << 4 | k, k = METER_WAVE_VERBATIM for packed samples
+//   [1]  the first order samples, 12 bits each
+//        residuals: (zz >> k) zero bits, a one bit, the low k bits of zz;
+//        zz >> k of METER_WAVE_ESCAPE or more is written as
+//        METER_WAVE_ESCAPE zero bits and zz in 16 bits
+//        zero padding to a whole byte
+//
+// verbatim: the samples, 12 bits each, zero padded to a whole byte.
+//
+// The sample count is not stored, the container knows it.
+
+#define METER_WAVE_VERBATIM         15
+#define METER_WAVE_ESCAPE           16
+#define METER_WAVE_MAX_ORDER        3
+
+#define METER_WAVE_ENCODED_MAX_SIZE(count) (1 + ((count) * 12 + 7) / 8)
+
+// Encodes count samples, every stride-th entry of samples starting with
+// the first, into out which holds METER_WAVE_ENCODED_MAX_SIZE(count)
+// bytes. Bits above the low 12 are ignored. Returns the encoded size.
+size_t meter_wave_encode(const uint16_t* samples, size_t count, size_t stride, uint8_t* out);
+
+// Decodes count samples into every stride-th entry of samples, returns the
+// number of bytes used from in, or -1 if they do not form a valid block
+int meter_wave_decode(const uint8_t* in, size_t size, uint16_t* samples, size_t count, size_t stride);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#include "meter/linearization.h"
+#include "meter/sector_log.h"
+
+#define SAVED_VERSION       1
+#define SAVED_CRC_OFFSET    (METER_LINEARIZATION_SAVED_SIZE - 4)
+
+static uint32_t load_le32(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+void meter_linearization_identity(float* table)
+{
+    for (uint32_t code = 0; code < METER_LINEARIZATION_CODES; code++) {
+        table[code] = code;
+    }
+}
+
+int meter_linearization_restore(float* table, const uint8_t* buffer, uint32_t* ramp_samples)
+{
+    if (buffer[0] != 'A' || buffer[1] != 'L' || buffer[2] != SAVED_VERSION ||
+        load_le32(buffer + SAVED_CRC_OFFSET) != meter_log_crc32(buffer, SAVED_CRC_OFFSET)) {
+        return -1;
+    }
+
+    const int8_t* corrections = (const int8_t*)(buffer + 8);
+
+    for (uint32_t code = 0; code < METER_LINEARIZATION_CODES; code++) {
+        table[code] = code + corrections[code] / (float)METER_LINEARIZATION_STEPS;
+    }
+
+    *ramp_samples = load_le32(buffer + 4);
+
+    return 0;
+}
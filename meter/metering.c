@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#include <math.h>
+
+#include "meter/linearization.h"
+#include "meter/metering.h"
+
+double METER_RAM_FUNC(meter_current_get)(const struct meter_source* source, uint32_t num_samples, double current_calibration, double* offset, double* current_samples)
+{
+    const float* linearization = source->linearization;
+    meter_source_select(source, METER_INPUT_CURRENT);
+    double offset_current = *offset;
+    double sample_current = 0;
+    double sum_current = 0;
+    for (uint32_t sample = 0; sample < num_samples; sample++) {
+        uint16_t code = meter_source_read(source);
+        sample_current = (linearization != NULL) ? linearization[code & (METER_LINEARIZATION_CODES - 1)] : code;
+        offset_current += ((sample_current - offset_current) / 4096);
+        double filtered_current = sample_current - offset_current;
+
+        current_samples[sample] = filtered_current;  // Store the sample
+
+        double sqrt_current = filtered_current * filtered_current;
+        sum_current += sqrt_current;
+    }
+    *offset = offset_current;
+    double current_ratio = current_calibration * ((SUPPLY_VOLTAGE / 1000.0) / ADC_COUNTS);
+    double current_rms = current_ratio * sqrt(sum_current / num_samples);
+    return current_rms;
+}
+
+double METER_RAM_FUNC(meter_voltage_get)(const struct meter_source* source, uint32_t num_samples, double voltage_calibration, double* offset, double* voltage_samples)
+{
+    const float* linearization = source->linearization;
+    meter_source_select(source, METER_INPUT_VOLTAGE);
+    double offset_voltage = *offset;
+    double sample_voltage;
+    double sum_voltage = 0;
+    for (uint32_t sample = 0; sample < num_samples; sample++) {
+        uint16_t code = meter_source_read(source);
+        sample_voltage = (linearization != NULL) ? linearization[code & (METER_LINEARIZATION_CODES - 1)] : code;
+        offset_voltage += ((sample_voltage - offset_voltage) / 4096);
+        double filtered_voltage = sample_voltage - offset_voltage;
+
+        voltage_samples[sample] = filtered_voltage;  // Store the sample
+
+        double sqrt_voltage = filtered_voltage * filtered_voltage;
+        sum_voltage += sqrt_voltage;
+    }
+    *offset = offset_voltage;
+    double voltage_ratio = voltage_calibration * ((SUPPLY_VOLTAGE / 1000.0) / ADC_COUNTS);
+    double voltage_rms = voltage_ratio * sqrt(sum_voltage / num_samples);
+    return voltage_rms;
+}
+
+//Active Power Is calculated by taking the average of instantaneous power values over time. This automatically accounts for any phase difference between voltage and current.
+//For each sample, multiply instantaneous voltage by instantaneous current. Take the average of all these products
+
+double METER_RAM_FUNC(meter_calculate_power)(const double* voltage_samples, const double* current_samples, uint32_t num_samples,
+                             double voltage_calibration, double current_calibration)
+{
+    return meter_calculate_power_aligned(voltage_samples, current_samples, num_samples, 0, 0, voltage_calibration, current_calibration);
+}
+
+// The phase correction is where the loop starts in each array, the loop
+// itself is the same
+double METER_RAM_FUNC(meter_calculate_power_aligned)(const double* voltage_samples, const double* current_samples, uint32_t num_samples,
+                                     int32_t phase_delay, uint32_t power_samples, double voltage_calibration,
+                                     double current_calibration)
+{
+    double sum_power = 0;
+    double voltage_ratio = voltage_calibration * ((SUPPLY_VOLTAGE / 1000.0) / ADC_COUNTS);
+    double current_ratio = current_calibration * ((SUPPLY_VOLTAGE / 1000.0) / ADC_COUNTS);
+    uint32_t shift = (phase_delay < 0) ? -phase_delay : phase_delay;
+
+    if (shift >= num_samples) {
+        return 0;
+    }
+
+    if (phase_delay > 0) {
+        current_samples += shift;
+    } else {
+        voltage_samples += shift;
+    }
+
+    num_samples -= shift;
+
+    if (power_samples > 0 && power_samples < num_samples) {
+        num_samples = power_samples;
+    }
+
+    for (uint32_t sample = 0; sample < num_samples; sample++) {
+        double calibrated_voltage = voltage_samples[sample] * voltage_ratio;
+        double calibrated_current = current_samples[sample] * current_ratio;
+        sum_power += calibrated_voltage * calibrated_current;
+    }
+
+    return sum_power / num_samples;
+}
+
+double meter_calculate_apparent_power(double voltage_rms, double current_rms)
+{
+    return voltage_rms * current_rms;
+}
+
+double meter_limit_active_power(double active_power, double apparent_power)
+{
+    if (active_power > apparent_power) {
+        return apparent_power;
+    }
+
+    if (active_power < -apparent_power) {
+        return -apparent_power;
+    }
+
+    return active_power;
+}
+
+double meter_calculate_reactive_power(double apparent_power, double active_power)
+{
+    return sqrt(pow(apparent_power, 2) - pow(active_power, 2));
+}
+
+double meter_calculate_power_factor(double active_power, double apparent_power)
+{
+    return active_power / apparent_power;
+}
@@ -0,0 +1,435 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#include <string.h>
+
+#include "meter/registers.h"
+#include "meter/sector_log.h"
+
+#define SECONDS_PER_DAY     86400
+#define MINUTES_PER_DAY     1440
+#define UJ_PER_WH           3600000000ull
+
+#define SAVED_VERSION       1
+#define SAVED_CRC_OFFSET    (METER_REGISTERS_SAVED_SIZE - 4)
+
+static void store_le16(uint8_t* p, uint16_t value)
+{
+    p[0] = value;
+    p[1] = value >> 8;
+}
+
+static void store_le32(uint8_t* p, uint32_t value)
+{
+    p[0] = value;
+    p[1] = value >> 8;
+    p[2] = value >> 16;
+    p[3] = value >> 24;
+}
+
+static void store_le64(uint8_t* p, uint64_t value)
+{
+    store_le32(p, (uint32_t)value);
+    store_le32(p + 4, (uint32_t)(value >> 32));
+}
+
+static uint16_t load_le16(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t load_le32(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t load_le64(const uint8_t* p)
+{
+    return load_le32(p) | ((uint64_t)load_le32(p + 4) << 32);
+}
+
+static uint32_t saturate_u32(uint64_t value)
+{
+    return (value < UINT32_MAX) ? (uint32_t)value : UINT32_MAX;
+}
+
+static uint16_t saturate_u16(uint32_t value)
+{
+    return (value < UINT16_MAX) ? (uint16_t)value : UINT16_MAX;
+}
+
+static bool schedule_valid(const struct meter_tou_schedule* schedule)
+{
+    if ((schedule->utc_offset_min % 15) != 0 ||
+        schedule->utc_offset_min < -14 * 60 || schedule->utc_offset_min > 14 * 60) {
+        return false;
+    }
+
+    for (int profile = 0; profile < 2; profile++) {
+        uint8_t count = schedule->count[profile];
+
+        if (count < 1 || count > METER_TOU_SWITCHES || schedule->minute[profile][0] != 0) {
+            return false;
+        }
+
+        for (int i = 0; i < count; i++) {
+            if (schedule->tariff[profile][i] >= METER_TOU_TARIFFS || schedule->minute[profile][i] >= MINUTES_PER_DAY) {
+                return false;
+            }
+
+            if (i > 0 && schedule->minute[profile][i] <= schedule->minute[profile][i - 1]) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+// The tariff at time and when it ends: the next switch point or midnight,
+// where the profile may change
+static uint8_t tou_lookup(const struct meter_tou_schedule* schedule, uint32_t time, uint32_t* next)
+{
+    int32_t offset_s = schedule->utc_offset_min * 60;
+    uint32_t local = time + offset_s;
+    uint32_t day = local / SECONDS_PER_DAY;
+    uint32_t minute = (local % SECONDS_PER_DAY) / 60;
+
+    // 1970-01-01 was a Thursday, weekday 4 counting from Sunday
+    uint32_t weekday = (day + 4) % 7;
+    int profile = (weekday == 0 || weekday == 6) ? METER_TOU_WEEKEND : METER_TOU_WEEKDAY;
+    uint32_t next_minute = MINUTES_PER_DAY;
+    uint8_t tariff = 0;
+
+    for (int i = 0; i < schedule->count[profile]; i++) {
+        if (schedule->minute[profile][i] > minute) {
+            next_minute = schedule->minute[profile][i];
+            break;
+        }
+
+        tariff = schedule->tariff[profile][i];
+    }
+
+    *next = day * SECONDS_PER_DAY + next_minute * 60 - offset_s;
+
+    return tariff;
+}
+
+uint8_t meter_tou_tariff(const struct meter_tou_schedule* schedule, uint32_t time)
+{
+    uint32_t next;
+
+    return tou_lookup(schedule, time, &next);
+}
+
+void meter_registers_init(struct meter_registers* registers, uint32_t interval_s)
+{
+    memset(registers, 0, sizeof(*registers));
+
+    interval_s -= interval_s % METER_DEMAND_SUBINTERVALS;
+
+    registers->interval_s = (interval_s > 0) ? interval_s : METER_DEMAND_SUBINTERVALS;
+    registers->schedule.count[METER_TOU_WEEKDAY] = 1;
+    registers->schedule.count[METER_TOU_WEEKEND] = 1;
+}
+
+static void demand_restart(struct meter_registers* registers, uint32_t time)
+{
+    uint32_t sub_s = registers->interval_s / METER_DEMAND_SUBINTERVALS;
+
+    registers->sub_start = time - (time % sub_s);
+    registers->sub_uj = 0;
+
+    memset(registers->ring_uj, 0, sizeof(registers->ring_uj));
+    registers->ring_sum_uj = 0;
+    registers->ring_index = 0;
+    registers->ring_count = 0;
+
+    // the block in progress misses its start, it is not a peak candidate
+    registers->block_uj = 0;
+    registers->block_subs = 0;
+}
+
+static void peak_update(struct meter_demand_peak* peak, uint32_t power_mw, uint32_t time)
+{
+    if (peak->time == 0 || power_mw > peak->power_mw) {
+        peak->power_mw = power_mw;
+        peak->time = time;
+    }
+}
+
+static uint32_t subinterval_close(struct meter_registers* registers)
+{
+    uint32_t sub_s = registers->interval_s / METER_DEMAND_SUBINTERVALS;
+    uint32_t interval_ms = registers->interval_s * 1000;
+    uint32_t end = registers->sub_start + sub_s;
+    uint32_t result = METER_REGISTERS_SUBINTERVAL_END;
+    uint8_t index = registers->ring_index;
+
+    // running sum over the ring, the oldest slot makes room for the newest
+    registers->ring_sum_uj += registers->sub_uj - registers->ring_uj[index];
+    registers->ring_uj[index] = registers->sub_uj;
+    registers->ring_index = (index + 1 < METER_DEMAND_SUBINTERVALS) ? index + 1 : 0;
+
+    if (registers->ring_count < METER_DEMAND_SUBINTERVALS) {
+        registers->ring_count++;
+    }
+
+    if (registers->ring_count == METER_DEMAND_SUBINTERVALS) {
+        registers->sliding_demand_mw = saturate_u32(registers->ring_sum_uj / interval_ms);
+        peak_update(&registers->sliding_peak, registers->sliding_demand_mw, end);
+    }
+
+    registers->block_uj += registers->sub_uj;
+    registers->block_subs++;
+
+    if ((end % registers->interval_s) == 0) {
+        if (registers->block_subs == METER_DEMAND_SUBINTERVALS) {
+            registers->block_demand_mw = saturate_u32(registers->block_uj / interval_ms);
+            peak_update(&registers->block_peak, registers->block_demand_mw, end);
+        }
+
+        registers->block_uj = 0;
+        registers->block_subs = 0;
+        result |= METER_REGISTERS_BLOCK_END;
+    }
+
+    registers->sub_start = end;
+    registers->sub_uj = 0;
+
+    return result;
+}
+
+uint32_t meter_registers_update(struct meter_registers* registers, uint32_t time, int32_t power_mw, uint32_t elapsed_ms)
+{
+    uint32_t sub_s = registers->interval_s / METER_DEMAND_SUBINTERVALS;
+    uint32_t result = 0;
+    uint64_t import_uj = 0;
+
+    if (power_mw < 0) {
+        registers->export_total_uj += (uint64_t)(-(int64_t)power_mw) * elapsed_ms;
+    } else {
+        import_uj = (uint64_t)power_mw * elapsed_ms;
+    }
+
+    registers->import_total_uj += import_uj;
+
+    if (time == METER_TIME_UNKNOWN) {
+        registers->import_untimed_uj += import_uj;
+        return 0;
+    }
+
+    // also after the clock was set back
+    if (time >= registers->tou_next || time < registers->tou_from) {
+        registers->tou_tariff = tou_lookup(&registers->schedule, time, &registers->tou_next);
+        registers->tou_from = time;
+    }
+
+    registers->import_uj[registers->tou_tariff] += import_uj;
+
+    if (registers->sub_start == 0) {
+        demand_restart(registers, time);
+    } else if (time < registers->sub_start) {
+        // the clock was set back, a little counts in the subinterval in
+        // progress
+        if ((registers->sub_start - time) > sub_s) {
+            demand_restart(registers, time);
+        }
+    } else if ((time - registers->sub_start) >= registers->interval_s + sub_s) {
+        // nothing measured for longer than an interval
+        demand_restart(registers, time);
+    } else {
+        // at most METER_DEMAND_SUBINTERVALS closes, usually none or one
+        while ((time - registers->sub_start) >= sub_s) {
+            result |= subinterval_close(registers);
+        }
+    }
+
+    registers->sub_uj += import_uj;
+
+    return result;
+}
+
+void meter_registers_reset_peaks(struct meter_registers* registers)
+{
+    memset(&registers->block_peak, 0, sizeof(registers->block_peak));
+    memset(&registers->sliding_peak, 0, sizeof(registers->sliding_peak));
+}
+
+int meter_registers_set_schedule(struct meter_registers* registers, const struct meter_tou_schedule* schedule)
+{
+    if (!schedule_valid(schedule)) {
+        return -1;
+    }
+
+    registers->schedule = *schedule;
+
+    // looked up again with the next update
+    registers->tou_from = 0;
+    registers->tou_next = 0;
+
+    return 0;
+}
+
+int meter_tou_encode(const struct meter_tou_schedule* schedule, uint8_t* buffer, size_t buffer_len)
+{
+    size_t size = 2 + 2 * (schedule->count[0] + schedule->count[1]);
+    uint8_t* p = buffer;
+
+    if (buffer_len < size) {
+        return -1;
+    }
+
+    *p++ = (uint8_t)(int8_t)(schedule->utc_offset_min / 15);
+    *p++ = (schedule->count[METER_TOU_WEEKDAY] << 4) | schedule->count[METER_TOU_WEEKEND];
+
+    for (int profile = 0; profile < 2; profile++) {
+        for (int i = 0; i < schedule->count[profile]; i++) {
+            store_le16(p, (schedule->tariff[profile][i] << 12) | schedule->minute[profile][i]);
+            p += 2;
+        }
+    }
+
+    return size;
+}
+
+int meter_tou_decode(struct meter_tou_schedule* schedule, const uint8_t* buffer, size_t length)
+{
+    struct meter_tou_schedule decoded;
+    const uint8_t* p = buffer + 2;
+
+    if (length < 2) {
+        return -1;
+    }
+
+    memset(&decoded, 0, sizeof(decoded));
+
+    decoded.utc_offset_min = (int8_t)buffer[0] * 15;
+    decoded.count[METER_TOU_WEEKDAY] = buffer[1] >> 4;
+    decoded.count[METER_TOU_WEEKEND] = buffer[1] & 0x0f;
+
+    if (decoded.count[0] > METER_TOU_SWITCHES || decoded.count[1] > METER_TOU_SWITCHES ||
+        length != 2 + 2 * (size_t)(decoded.count[0] + decoded.count[1])) {
+        return -1;
+    }
+
+    for (int profile = 0; profile < 2; profile++) {
+        for (int i = 0; i < decoded.count[profile]; i++) {
+            uint16_t value = load_le16(p);
+
+            decoded.tariff[profile][i] = value >> 12;
+            decoded.minute[profile][i] = value & 0x0fff;
+            p += 2;
+        }
+    }
+
+    if (!schedule_valid(&decoded)) {
+        return -1;
+    }
+
+    *schedule = decoded;
+
+    return 0;
+}
+
+void meter_registers_encode(const struct meter_registers* registers, uint32_t time, uint8_t* buffer)
+{
+    uint8_t* p = buffer;
+
+    *p++ = METER_REGISTERS_ENCODING_VERSION;
+    store_le32(p, time);
+    store_le32(p + 4, saturate_u32(registers->import_total_uj / UJ_PER_WH));
+    store_le32(p + 8, saturate_u32(registers->export_total_uj / UJ_PER_WH));
+    store_le16(p + 12, saturate_u16(registers->block_demand_mw / 1000));
+    store_le16(p + 14, saturate_u16(registers->sliding_demand_mw / 1000));
+    store_le16(p + 16, saturate_u16(registers->block_peak.power_mw / 1000));
+    store_le32(p + 18, registers->block_peak.time);
+    store_le16(p + 22, saturate_u16(registers->sliding_peak.power_mw / 1000));
+    store_le32(p + 24, registers->sliding_peak.time);
+    p += 28;
+
+    for (int i = 0; i < METER_TOU_TARIFFS; i++) {
+        store_le32(p, saturate_u32(registers->import_uj[i] / UJ_PER_WH));
+        p += 4;
+    }
+}
+
+// [0] 'R' 'G' version, [4] sequence, [8] energy registers, [64] peaks,
+// [80] schedule as meter_tou_encode(...), zero padded, CRC-32 at the end
+void meter_registers_save(const struct meter_registers* registers, uint32_t sequence, uint8_t* buffer)
+{
+    uint8_t* p = buffer + 8;
+
+    memset(buffer, 0, METER_REGISTERS_SAVED_SIZE);
+
+    buffer[0] = 'R';
+    buffer[1] = 'G';
+    buffer[2] = SAVED_VERSION;
+    store_le32(buffer + 4, sequence);
+
+    for (int i = 0; i < METER_TOU_TARIFFS; i++) {
+        store_le64(p, registers->import_uj[i]);
+        p += 8;
+    }
+
+    store_le64(p, registers->import_total_uj);
+    store_le64(p + 8, registers->import_untimed_uj);
+    store_le64(p + 16, registers->export_total_uj);
+    p += 24;
+
+    store_le32(p, registers->block_peak.power_mw);
+    store_le32(p + 4, registers->block_peak.time);
+    store_le32(p + 8, registers->sliding_peak.power_mw);
+    store_le32(p + 12, registers->sliding_peak.time);
+    p += 16;
+
+    meter_tou_encode(&registers->schedule, p, METER_TOU_ENCODED_MAX_SIZE);
+
+    store_le32(buffer + SAVED_CRC_OFFSET, meter_log_crc32(buffer, SAVED_CRC_OFFSET));
+}
+
+int meter_registers_restore(struct meter_registers* registers, const uint8_t* buffer, uint32_t* sequence)
+{
+    const uint8_t* p = buffer + 8;
+    struct meter_tou_schedule schedule;
+
+    if (buffer[0] != 'R' || buffer[1] != 'G' || buffer[2] != SAVED_VERSION ||
+        load_le32(buffer + SAVED_CRC_OFFSET) != meter_log_crc32(buffer, SAVED_CRC_OFFSET)) {
+        return -1;
+    }
+
+    const uint8_t* encoded = p + 8 * (METER_TOU_TARIFFS + 3) + 16;
+    uint8_t counts = encoded[1];
+    size_t encoded_size = 2 + 2 * ((counts >> 4) + (counts & 0x0f));
+
+    if (encoded_size > METER_TOU_ENCODED_MAX_SIZE || meter_tou_decode(&schedule, encoded, encoded_size) < 0) {
+        return -1;
+    }
+
+    meter_registers_init(registers, registers->interval_s);
+
+    for (int i = 0; i < METER_TOU_TARIFFS; i++) {
+        registers->import_uj[i] = load_le64(p);
+        p += 8;
+    }
+
+    registers->import_total_uj = load_le64(p);
+    registers->import_untimed_uj = load_le64(p + 8);
+    registers->export_total_uj = load_le64(p + 16);
+    p += 24;
+
+    registers->block_peak.power_mw = load_le32(p);
+    registers->block_peak.time = load_le32(p + 4);
+    registers->sliding_peak.power_mw = load_le32(p + 8);
+    registers->sliding_peak.time = load_le32(p + 12);
+
+    registers->schedule = schedule;
+
+    *sequence = load_le32(buffer + 4);
+
+    return 0;
+}
@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#include <string.h>
+
+#include "meter/sector_log.h"
+
+#define CRC_OFFSET          (METER_LOG_SECTOR_SIZE - 4)
+#define DEVICE_MAX_SIZE     32
+
+static void store_le16(uint8_t* p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void store_le32(uint8_t* p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static uint16_t load_le16(const uint8_t* p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t load_le32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+uint32_t meter_log_crc32(const uint8_t* data, size_t length)
+{
+    // nibble table, small enough to stay in the cache next to the caller
+    static const uint32_t table[16] = {
+        0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+        0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+    };
+    uint32_t crc = 0xffffffff;
+
+    for (size_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ table[crc & 0x0f];
+        crc = (crc >> 4) ^ table[crc & 0x0f];
+    }
+
+    return ~crc;
+}
+
+void meter_log_seal(uint8_t* sector)
+{
+    store_le32(sector + CRC_OFFSET, meter_log_crc32(sector, CRC_OFFSET));
+}
+
+bool meter_log_check(const uint8_t* sector)
+{
+    return sector[0] == 'M' && sector[1] == 'L' && sector[3] == METER_LOG_VERSION &&
+           load_le16(sector + 12) <= METER_LOG_PAYLOAD_SIZE &&
+           load_le32(sector + CRC_OFFSET) == meter_log_crc32(sector, CRC_OFFSET);
+}
+
+static void sector_init(uint8_t* sector, uint8_t type, uint32_t sequence, uint32_t time)
+{
+    memset(sector, 0, METER_LOG_SECTOR_SIZE);
+
+    sector[0] = 'M';
+    sector[1] = 'L';
+    sector[2] = type;
+    sector[3] = METER_LOG_VERSION;
+    store_le32(sector + 4, sequence);
+    store_le32(sector + 8, time);
+}
+
+int meter_log_start(struct meter_log_writer* writer, uint8_t* (*get_sector)(void* context),
+                    void (*put_sector)(void* context, uint8_t* sector), void* context,
+                    uint8_t time_base, uint32_t time, const char* device)
+{
+    memset(writer, 0, sizeof(*writer));
+
+    writer->get_sector = get_sector;
+    writer->put_sector = put_sector;
+    writer->context = context;
+
+    uint8_t* sector = get_sector(context);
+
+    if (sector == NULL) {
+        return -1;
+    }
+
+    sector_init(sector, METER_LOG_SECTOR_HEADER, writer->sequence++, time);
+
+    uint8_t* payload = sector + METER_LOG_HEADER_SIZE;
+    size_t device_length = (device != NULL) ? strlen(device) : 0;
+
+    if (device_length > DEVICE_MAX_SIZE - 1) {
+        device_length = DEVICE_MAX_SIZE - 1;
+    }
+
+    payload[0] = time_base;
+    payload[1] = METER_LOG_INDEX_INTERVAL;
+    store_le32(payload + 4, time);
+    if (device_length > 0) {
+        memcpy(payload + 8, device, device_length);
+    }
+
+    store_le16(sector + 12, 8 + DEVICE_MAX_SIZE);
+
+    put_sector(context, sector);
+
+    return 0;
+}
+
+static void sector_close(struct meter_log_writer* writer)
+{
+    uint8_t* sector = writer->sector;
+
+    writer->index_sequence[writer->index_entries] = load_le32(sector + 4);
+    writer->index_time[writer->index_entries] = load_le32(sector + 8);
+    writer->index_entries++;
+
+    writer->put_sector(writer->context, sector);
+    writer->sector = NULL;
+}
+
+// The index of the previous interval goes out before the next data sector,
+// so index sectors sit at fixed positions in the file
+static int sector_open(struct meter_log_writer* writer, uint32_t time)
+{
+    if (writer->index_entries == METER_LOG_INDEX_INTERVAL) {
+        uint8_t* index = writer->get_sector(writer->context);
+
+        if (index == NULL) {
+            return -1;
+        }
+
+        sector_init(index, METER_LOG_SECTOR_INDEX, writer->sequence++, writer->index_time[0]);
+
+        uint8_t* entry = index + METER_LOG_HEADER_SIZE;
+
+        for (uint8_t i = 0; i < writer->index_entries; i++) {
+            store_le32(entry, writer->index_sequence[i]);
+            store_le32(entry + 4, writer->index_time[i]);
+            entry += METER_LOG_INDEX_ENTRY_SIZE;
+        }
+
+        store_le16(index + 12, writer->index_entries * METER_LOG_INDEX_ENTRY_SIZE);
+        store_le16(index + 14, writer->index_entries);
+
+        writer->put_sector(writer->context, index);
+        writer->index_entries = 0;
+    }
+
+    uint8_t* sector = writer->get_sector(writer->context);
+
+    if (sector == NULL) {
+        return -1;
+    }
+
+    sector_init(sector, METER_LOG_SECTOR_DATA, writer->sequence++, time);
+    writer->sector = sector;
+
+    return 0;
+}
+
+static void record_write(uint8_t* sector, uint8_t type, uint32_t time, const void* payload, uint8_t length)
+{
+    uint16_t used = load_le16(sector + 12);
+    uint8_t* record = sector + METER_LOG_HEADER_SIZE + used;
+
+    record[0] = type;
+    record[1] = length;
+    store_le32(record + 2, time);
+    memcpy(record + METER_LOG_RECORD_HEADER_SIZE, payload, length);
+
+    store_le16(sector + 12, used + METER_LOG_RECORD_HEADER_SIZE + length);
+    store_le16(sector + 14, load_le16(sector + 14) + 1);
+}
+
+int meter_log_append(struct meter_log_writer* writer, uint8_t type, uint32_t time, const void* payload, uint8_t length)
+{
+    size_t needed = METER_LOG_RECORD_HEADER_SIZE + length;
+
+    if (writer->dropped > 0) {
+        needed += METER_LOG_RECORD_HEADER_SIZE + 4;
+    }
+
+    if (writer->sector != NULL && load_le16(writer->sector + 12) + needed > METER_LOG_PAYLOAD_SIZE) {
+        sector_close(writer);
+    }
+
+    if (writer->sector == NULL && sector_open(writer, time) < 0) {
+        writer->dropped++;
+        writer->dropped_total++;
+        return -1;
+    }
+
+    if (writer->dropped > 0) {
+        uint8_t dropped[4];
+
+        store_le32(dropped, writer->dropped);
+        record_write(writer->sector, METER_LOG_RECORD_DROPPED, time, dropped, sizeof(dropped));
+        writer->dropped = 0;
+    }
+
+    record_write(writer->sector, type, time, payload, length);
+
+    return 0;
+}
+
+void meter_log_flush(struct meter_log_writer* writer)
+{
+    if (writer->sector != NULL) {
+        sector_close(writer);
+    }
+}
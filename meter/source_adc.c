@@ -0,0 +1,30 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#include "meter/source.h"
+
+#include "hardware/adc.h"
+
+static void METER_RAM_FUNC(adc_source_select)(void* context, uint8_t input)
+{
+    (void)context;
+
+    adc_select_input(input);
+}
+
+static uint16_t METER_RAM_FUNC(adc_source_read)(void* context)
+{
+    (void)context;
+
+    return adc_read();
+}
+
+const struct meter_source meter_source_adc = {
+    .select = adc_source_select,
+    .read = adc_source_read,
+    .context = NULL,
+};
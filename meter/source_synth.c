@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "meter/metering.h"
+#include "meter/source.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+void meter_synth_init(struct meter_synth* synth, double sample_rate, double frequency)
+{
+    memset(synth, 0, sizeof(*synth));
+
+    synth->sample_rate = sample_rate;
+    synth->frequency = frequency;
+    synth->voltage_dc = ADC_COUNTS / 2;
+    synth->current_dc = ADC_COUNTS / 2;
+}
+
+int meter_synth_add_harmonic(struct meter_synth* synth, uint8_t order, double voltage_amplitude, double current_amplitude, double current_phase)
+{
+    if (synth->num_harmonics >= METER_SYNTH_MAX_HARMONICS || order == 0) {
+        return -1;
+    }
+
+    struct meter_synth_harmonic* harmonic = &synth->harmonics[synth->num_harmonics++];
+
+    harmonic->order = order;
+    harmonic->voltage_amplitude = voltage_amplitude;
+    harmonic->current_amplitude = current_amplitude;
+    harmonic->current_phase = current_phase;
+
+    return 0;
+}
+
+static void synth_select(void* context, uint8_t input)
+{
+    struct meter_synth* synth = (struct meter_synth*)context;
+
+    synth->input = input;
+}
+
+static uint16_t synth_read(void* context)
+{
+    struct meter_synth* synth = (struct meter_synth*)context;
+    double angle = 2 * M_PI * synth->frequency * (double)synth->index++ / synth->sample_rate;
+    double value;
+
+    if (synth->input != METER_INPUT_VOLTAGE) {
+        value = synth->current_dc;
+
+        for (uint8_t i = 0; i < synth->num_harmonics; i++) {
+            const struct meter_synth_harmonic* h = &synth->harmonics[i];
+
+            value += h->current_amplitude * sin(h->order * (angle - synth->phase) - h->current_phase);
+        }
+    } else {
+        value = synth->voltage_dc;
+
+        for (uint8_t i = 0; i < synth->num_harmonics; i++) {
+            const struct meter_synth_harmonic* h = &synth->harmonics[i];
+
+            value += h->voltage_amplitude * sin(h->order * angle);
+        }
+    }
+
+    // quantize and clip like the ADC
+    value = floor(value + 0.5);
+
+    if (value < 0) {
+        return 0;
+    } else if (value > ADC_COUNTS - 1) {
+        return ADC_COUNTS - 1;
+    }
+
+    return (uint16_t)value;
+}
+
+void meter_synth_source(struct meter_synth* synth, struct meter_source* source)
+{
+    synth->input = 0;
+    synth->index = 0;
+
+    source->select = synth_select;
+    source->read = synth_read;
+    source->context = synth;
+    source->linearization = NULL;
+}
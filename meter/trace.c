@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#include <string.h>
+
+#include "meter/metering.h"
+#include "meter/trace.h"
+
+static uint32_t load_le32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t load_le16(const uint8_t* p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static void store_le32(uint8_t* p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static size_t block_size(const struct meter_trace* trace, uint32_t rows)
+{
+    return METER_TRACE_BLOCK_HEADER_SIZE + METER_TRACE_PACKED_SIZE(rows * trace->channels);
+}
+
+// Moves to the block at offset, skipping empty and truncated blocks.
+// Returns false at the end of the trace.
+static bool enter_block(struct meter_trace* trace, size_t offset)
+{
+    while (offset + METER_TRACE_BLOCK_HEADER_SIZE <= trace->size) {
+        const uint8_t* header = trace->data + offset;
+        uint32_t row_index = load_le32(header);
+        uint16_t rows = load_le16(header + 8);
+
+        if (offset + block_size(trace, rows) > trace->size) {
+            break;
+        }
+
+        if (row_index > trace->next_row_index) {
+            trace->rows_lost += row_index - trace->next_row_index;
+        }
+        trace->next_row_index = row_index + rows;
+
+        if (rows > 0) {
+            trace->block = offset;
+            trace->block_rows = rows;
+            trace->row = 0;
+            return true;
+        }
+
+        offset += block_size(trace, rows);
+    }
+
+    trace->ended = true;
+    trace->block_rows = 0;
+    trace->row = 0;
+
+    return false;
+}
+
+int meter_trace_open(struct meter_trace* trace, const uint8_t* data, size_t size)
+{
+    memset(trace, 0, sizeof(*trace));
+
+    if (size < METER_TRACE_HEADER_SIZE || memcmp(data, "MTRC", 4) != 0 ||
+        data[4] != METER_TRACE_VERSION || data[6] != 12 ||
+        data[5] == 0 || data[5] > METER_TRACE_MAX_CHANNELS) {
+        return -1;
+    }
+
+    trace->data = data;
+    trace->size = size;
+    trace->channels = data[5];
+    trace->sample_rate = load_le32(data + 8);
+
+    enter_block(trace, METER_TRACE_HEADER_SIZE);
+
+    return 0;
+}
+
+uint32_t meter_trace_remaining(const struct meter_trace* trace)
+{
+    uint32_t remaining = 0;
+
+    if (trace->ended) {
+        return 0;
+    }
+
+    remaining = trace->block_rows - trace->row;
+
+    for (size_t offset = trace->block + block_size(trace, trace->block_rows);
+         offset + METER_TRACE_BLOCK_HEADER_SIZE <= trace->size; ) {
+        uint16_t rows = load_le16(trace->data + offset + 8);
+
+        if (offset + block_size(trace, rows) > trace->size) {
+            break;
+        }
+
+        remaining += rows;
+        offset += block_size(trace, rows);
+    }
+
+    return remaining;
+}
+
+static void trace_select(void* context, uint8_t input)
+{
+    struct meter_trace* trace = (struct meter_trace*)context;
+
+    trace->input = input;
+}
+
+static uint16_t trace_read(void* context)
+{
+    struct meter_trace* trace = (struct meter_trace*)context;
+
+    if (trace->ended || trace->input >= trace->channels) {
+        return ADC_COUNTS / 2;
+    }
+
+    const uint8_t* packed = trace->data + trace->block + METER_TRACE_BLOCK_HEADER_SIZE;
+    uint16_t sample = meter_trace_unpack(packed, trace->row * trace->channels + trace->input);
+
+    trace->rows_read++;
+
+    if (++trace->row == trace->block_rows) {
+        enter_block(trace, trace->block + block_size(trace, trace->block_rows));
+    }
+
+    return sample;
+}
+
+void meter_trace_source(struct meter_trace* trace, struct meter_source* source)
+{
+    source->select = trace_select;
+    source->read = trace_read;
+    source->context = trace;
+    source->linearization = NULL;
+}
+
+void meter_trace_write_header(uint8_t* header, uint8_t channels, uint32_t sample_rate)
+{
+    memset(header, 0, METER_TRACE_HEADER_SIZE);
+    memcpy(header, "MTRC", 4);
+    header[4] = METER_TRACE_VERSION;
+    header[5] = channels;
+    header[6] = 12;
+    store_le32(header + 8, sample_rate);
+}
+
+void meter_trace_write_block_header(uint8_t* header, uint32_t row_index, uint32_t time_us, uint16_t rows)
+{
+    store_le32(header, row_index);
+    store_le32(header + 4, time_us);
+    header[8] = (uint8_t)rows;
+    header[9] = (uint8_t)(rows >> 8);
+    header[10] = 0;
+    header[11] = 0;
+}
+
+void meter_trace_pack(uint8_t* packed, const uint16_t* samples, size_t count)
+{
+    size_t i;
+
+    for (i = 0; i + 1 < count; i += 2) {
+        uint16_t s0 = samples[i] & 0x0fff;
+        uint16_t s1 = samples[i + 1] & 0x0fff;
+
+        *packed++ = (uint8_t)s0;
+        *packed++ = (uint8_t)((s0 >> 8) | (s1 << 4));
+        *packed++ = (uint8_t)(s1 >> 4);
+    }
+
+    if (i < count) {
+        uint16_t s0 = samples[i] & 0x0fff;
+
+        *packed++ = (uint8_t)s0;
+        *packed++ = (uint8_t)(s0 >> 8);
+    }
+}
@@ -0,0 +1,272 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#include "meter/source.h"
+#include "meter/wave_codec.h"
+
+#define SAMPLE_MASK     0x0fff
+#define MID_SCALE       2048
+#define MAX_K           13
+
+// prediction = c1 * x[i-1] + c2 * x[i-2] + c3 * x[i-3] + c0, one multiply
+// per term is a single cycle on the M0+, cheaper than a branch per sample
+static const int32_t predictors[METER_WAVE_MAX_ORDER + 1][4] = {
+    { 0, 0, 0, MID_SCALE },
+    { 1, 0, 0, 0 },
+    { 2, -1, 0, 0 },
+    { 3, -3, 1, 0 },
+};
+
+struct bit_writer {
+    uint8_t* p;
+    uint32_t acc;
+    uint32_t bits;
+};
+
+// n up to 24, value without bits above n
+static inline void put_bits(struct bit_writer* w, uint32_t value, uint32_t n)
+{
+    w->acc = (w->acc << n) | value;
+    w->bits += n;
+
+    while (w->bits >= 8) {
+        w->bits -= 8;
+        *w->p++ = (uint8_t)(w->acc >> w->bits);
+    }
+}
+
+static inline void flush_bits(struct bit_writer* w)
+{
+    if (w->bits > 0) {
+        *w->p++ = (uint8_t)(w->acc << (8 - w->bits));
+        w->bits = 0;
+    }
+}
+
+static inline uint32_t abs32(int32_t v)
+{
+    int32_t sign = v >> 31;
+
+    return (uint32_t)((v ^ sign) - sign);
+}
+
+static size_t encode_verbatim(const uint16_t* samples, size_t count, size_t stride, uint8_t* out)
+{
+    struct bit_writer w = { out + 1, 0, 0 };
+
+    out[0] = METER_WAVE_VERBATIM;
+
+    for (size_t i = 0; i < count; i++) {
+        put_bits(&w, samples[i * stride] & SAMPLE_MASK, 12);
+    }
+
+    flush_bits(&w);
+
+    return w.p - out;
+}
+
+size_t METER_RAM_FUNC(meter_wave_encode)(const uint16_t* samples, size_t count, size_t stride, uint8_t* out)
+{
+    size_t max_size = METER_WAVE_ENCODED_MAX_SIZE(count);
+
+    if (count <= METER_WAVE_MAX_ORDER) {
+        return encode_verbatim(samples, count, stride, out);
+    }
+
+    // absolute residuals of every order over the same samples: the order n
+    // residual is the difference of the order n - 1 residuals
+    uint32_t sums[METER_WAVE_MAX_ORDER + 1] = { 0 };
+    int32_t x1 = samples[2 * stride] & SAMPLE_MASK;
+    int32_t d1 = x1 - (samples[stride] & SAMPLE_MASK);
+    int32_t d2 = d1 - ((samples[stride] & SAMPLE_MASK) - (samples[0] & SAMPLE_MASK));
+
+    for (size_t i = METER_WAVE_MAX_ORDER; i < count; i++) {
+        int32_t x = samples[i * stride] & SAMPLE_MASK;
+        int32_t e1 = x - x1;
+        int32_t e2 = e1 - d1;
+        int32_t e3 = e2 - d2;
+
+        sums[0] += abs32(x - MID_SCALE);
+        sums[1] += abs32(e1);
+        sums[2] += abs32(e2);
+        sums[3] += abs32(e3);
+
+        x1 = x;
+        d1 = e1;
+        d2 = e2;
+    }
+
+    uint32_t order = 0;
+
+    for (uint32_t o = 1; o <= METER_WAVE_MAX_ORDER; o++) {
+        if (sums[o] < sums[order]) {
+            order = o;
+        }
+    }
+
+    // 2^k close to the mean absolute residual
+    uint32_t n = count - METER_WAVE_MAX_ORDER;
+    uint32_t k = 0;
+
+    while (k < MAX_K && (n << (k + 1)) <= sums[order]) {
+        k++;
+    }
+
+    // a sample takes at most 32 bits, stop before that could overflow out
+    const uint8_t* limit = out + max_size - 5;
+    const int32_t* c = predictors[order];
+    uint32_t mask = (1u << k) - 1;
+    struct bit_writer w = { out + 1, 0, 0 };
+    int32_t x2 = 0;
+    int32_t x3 = 0;
+
+    out[0] = (uint8_t)(order << 4 | k);
+    x1 = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        int32_t x = samples[i * stride] & SAMPLE_MASK;
+
+        if (w.p > limit) {
+            return encode_verbatim(samples, count, stride, out);
+        }
+
+        if (i < order) {
+            put_bits(&w, x, 12);
+        } else {
+            int32_t e = x - (c[0] * x1 + c[1] * x2 + c[2] * x3 + c[3]);
+            uint32_t zz = ((uint32_t)e << 1) ^ (uint32_t)(e >> 31);
+            uint32_t q = zz >> k;
+
+            if (q >= METER_WAVE_ESCAPE) {
+                put_bits(&w, 0, METER_WAVE_ESCAPE);
+                put_bits(&w, zz, 16);
+            } else if (q + 1 + k <= 24) {
+                put_bits(&w, (1u << k) | (zz & mask), q + 1 + k);
+            } else {
+                put_bits(&w, 0, q);
+                put_bits(&w, (1u << k) | (zz & mask), k + 1);
+            }
+        }
+
+        x3 = x2;
+        x2 = x1;
+        x1 = x;
+    }
+
+    flush_bits(&w);
+
+    return w.p - out;
+}
+
+struct bit_reader {
+    const uint8_t* p;
+    const uint8_t* end;
+    uint32_t acc;
+    uint32_t bits;
+};
+
+// n up to 24, -1 past the end of the input
+static int32_t get_bits(struct bit_reader* r, uint32_t n)
+{
+    while (r->bits < n) {
+        if (r->p == r->end) {
+            return -1;
+        }
+
+        r->acc = (r->acc << 8) | *r->p++;
+        r->bits += 8;
+    }
+
+    r->bits -= n;
+
+    return (int32_t)((r->acc >> r->bits) & ((1u << n) - 1));
+}
+
+int meter_wave_decode(const uint8_t* in, size_t size, uint16_t* samples, size_t count, size_t stride)
+{
+    struct bit_reader r = { in + 1, in + size, 0, 0 };
+
+    if (size < 1) {
+        return -1;
+    }
+
+    uint32_t order = in[0] >> 4;
+    uint32_t k = in[0] & 0x0f;
+
+    if (k == METER_WAVE_VERBATIM) {
+        for (size_t i = 0; i < count; i++) {
+            int32_t x = get_bits(&r, 12);
+
+            if (x < 0) {
+                return -1;
+            }
+
+            samples[i * stride] = (uint16_t)x;
+        }
+
+        return r.p - in;
+    }
+
+    if (order > METER_WAVE_MAX_ORDER || k > MAX_K) {
+        return -1;
+    }
+
+    const int32_t* c = predictors[order];
+    int32_t x1 = 0;
+    int32_t x2 = 0;
+    int32_t x3 = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        int32_t x;
+
+        if (i < order) {
+            x = get_bits(&r, 12);
+        } else {
+            uint32_t q = 0;
+            int32_t bit = 0;
+            int32_t zz;
+
+            while (q < METER_WAVE_ESCAPE && (bit = get_bits(&r, 1)) == 0) {
+                q++;
+            }
+
+            if (bit < 0) {
+                return -1;
+            }
+
+            if (q == METER_WAVE_ESCAPE) {
+                zz = get_bits(&r, 16);
+            } else {
+                zz = (k > 0) ? get_bits(&r, k) : 0;
+
+                if (zz >= 0) {
+                    zz |= (int32_t)(q << k);
+                }
+            }
+
+            if (zz < 0) {
+                return -1;
+            }
+
+            int32_t e = (zz >> 1) ^ -(zz & 1);
+
+            x = c[0] * x1 + c[1] * x2 + c[2] * x3 + c[3] + e;
+        }
+
+        if (x < 0 || x > SAMPLE_MASK) {
+            return -1;
+        }
+
+        samples[i * stride] = (uint16_t)x;
+
+        x3 = x2;
+        x2 = x1;
+        x1 = x;
+    }
+
+    return r.p - in;
+}
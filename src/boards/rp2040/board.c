@@ -9,8 +9,10 @@
 #include <string.h>
 
 #include "pico.h"
+#include "pico/lorawan_profile.h"
 #include "pico/unique_id.h"
 #include "hardware/sync.h"
+#include "hardware/timer.h"
 
 #include "board.h"
 
@@ -24,7 +26,14 @@ void BoardInitPeriph( void )
 
 void BoardLowPowerHandler( void )
 {
-    __wfi();
+    uint32_t start = time_us_32();
+
+    // WFE rather than WFI: also returns on __sev() from a task signal or a
+    // DMA completion, and stays set if the event arrived just before
+    __wfe();
+
+    // everything outside of here counts as busy in the profile
+    lorawan_profile_idle(time_us_32() - start);
 }
 
 uint8_t BoardGetBatteryLevel( void )
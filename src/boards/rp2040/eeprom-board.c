@@ -8,7 +8,9 @@
 #include <string.h>
 
 #include "pico/stdlib.h"
+#include "pico/multicore.h"
 #include "hardware/flash.h"
+#include "pico/lorawan_profile.h"
 
 #include "utilities.h"
 #include "eeprom-board.h"
@@ -40,12 +42,28 @@ uint8_t EepromMcuWriteBuffer( uint16_t addr, uint8_t *buffer, uint16_t size )
 
 uint8_t EepromMcuFlush()
 {
+    LORAWAN_PROFILE_SCOPE(LORAWAN_PROFILE_FLASH);
+
     uint32_t mask;
 
+    // code on the other core runs from flash too, e.g. the SD log writer,
+    // hold it in RAM until the flash is back
+    bool lockout = multicore_lockout_victim_is_initialized(1);
+
+    if (lockout) {
+        multicore_lockout_start_blocking();
+    }
+
     BoardCriticalSectionBegin(&mask);
 
     flash_range_erase(EEPROM_OFFSET, sizeof(eeprom_write_cache));
     flash_range_program(EEPROM_OFFSET, eeprom_write_cache, sizeof(eeprom_write_cache));
 
     BoardCriticalSectionEnd(&mask);
+
+    if (lockout) {
+        multicore_lockout_end_blocking();
+    }
+
+    return SUCCESS;
 }
@@ -6,6 +6,7 @@
  */
 
 #include "hardware/gpio.h"
+#include "pico/lorawan_ram.h"
 
 #include "gpio-board.h"
 
@@ -51,12 +52,12 @@ void GpioMcuInit( Gpio_t *obj, PinNames pin, PinModes mode, PinConfigs config, P
     }
 }
 
-void GpioMcuWrite( Gpio_t *obj, uint32_t value )
+void LORAWAN_RAM_FUNC(GpioMcuWrite)( Gpio_t *obj, uint32_t value )
 {
     gpio_put(obj->pin, value);
 }
 
-uint32_t GpioMcuRead( Gpio_t *obj )
+uint32_t LORAWAN_RAM_FUNC(GpioMcuRead)( Gpio_t *obj )
 {
     return gpio_get(obj->pin);
 }
@@ -8,12 +8,35 @@
 #include "pico/time.h"
 #include "pico/stdlib.h"
 
+#include "pico/lorawan_ram.h"
+
 #include "rtc-board.h"
 
 static alarm_pool_t* rtc_alarm_pool = NULL;
 static absolute_time_t rtc_timer_context;
 static alarm_id_t last_rtc_alarm_id = -1;
 
+/*
+ * SysTime keeps the offset from the calendar time, the time since boot here,
+ * to the network time in the backup registers: SysTimeSet(...) writes it when
+ * a DeviceTimeAns or AppTimeAns arrives, SysTimeGet(...) adds it back.
+ *
+ * The offset is kept in RAM, with the frequency error of the crystal measured
+ * from the correction at each synchronization: between two of them the
+ * offset is extended by that error, so the clock keeps running at network
+ * rate instead of drifting by up to 30 ppm (2.6 s a day).
+ */
+#define RTC_DRIFT_MIN_INTERVAL_MS   (60 * 60 * 1000)
+#define RTC_DRIFT_MAX_STEP_MS       500
+#define RTC_DRIFT_MAX_PPB           200000
+
+static bool rtc_synchronized = false;
+static int64_t rtc_offset_ms = 0;       // at rtc_sync_us
+static uint64_t rtc_sync_us = 0;
+static int32_t rtc_drift_ppb = 0;       // positive when the crystal is slow
+static uint32_t rtc_syncs = 0;
+static int32_t rtc_last_correction_ms = 0;
+
 void RtcInit( void )
 {
     rtc_alarm_pool = alarm_pool_create(2, 16);
@@ -30,13 +53,22 @@ uint32_t RtcGetCalendarTime( uint16_t *milliseconds )
     return (now / 1000);
 }
 
+static int64_t rtc_offset_at(uint64_t now_us)
+{
+    int64_t elapsed_ms = (now_us - rtc_sync_us) / 1000;
+
+    return rtc_offset_ms + (elapsed_ms * rtc_drift_ppb) / 1000000000;
+}
+
 void RtcBkupRead( uint32_t *data0, uint32_t *data1 )
 {
-    *data0 = 0;
-    *data1 = 0;
+    int64_t offset_ms = rtc_offset_at(to_us_since_boot(get_absolute_time()));
+
+    *data0 = offset_ms / 1000;
+    *data1 = offset_ms % 1000;
 }
 
-uint32_t RtcGetTimerElapsedTime( void )
+uint32_t LORAWAN_RAM_FUNC(RtcGetTimerElapsedTime)( void )
 {
     int64_t delta = absolute_time_diff_us(rtc_timer_context, get_absolute_time());
 
@@ -64,7 +96,7 @@ uint32_t RtcGetMinimumTimeout( void )
     return 1;
 }
 
-static int64_t alarm_callback(alarm_id_t id, void *user_data) {
+static int64_t LORAWAN_RAM_FUNC(alarm_callback)(alarm_id_t id, void *user_data) {
     TimerIrqHandler( );
 
     return 0;
@@ -91,7 +123,7 @@ uint32_t RtcMs2Tick( TimerTime_t milliseconds )
     return milliseconds * 1000;
 }
 
-uint32_t RtcGetTimerValue( void )
+uint32_t LORAWAN_RAM_FUNC(RtcGetTimerValue)( void )
 {
     uint64_t now = to_us_since_boot(get_absolute_time());
 
@@ -105,6 +137,45 @@ TimerTime_t RtcTick2Ms( uint32_t tick )
 
 void RtcBkupWrite( uint32_t data0, uint32_t data1 )
 {
+    uint64_t now_us = to_us_since_boot(get_absolute_time());
+    int64_t offset_ms = (int64_t)data0 * 1000 + data1;
+
+    if (rtc_synchronized) {
+        int64_t correction_ms = offset_ms - rtc_offset_at(now_us);
+        int64_t elapsed_ms = (now_us - rtc_sync_us) / 1000;
+
+        // half of the remaining error per synchronization, the network time
+        // has some 10 ms of jitter; whole second AppTimeAns steps and other
+        // large ones are not drift
+        if (elapsed_ms >= RTC_DRIFT_MIN_INTERVAL_MS &&
+            correction_ms >= -RTC_DRIFT_MAX_STEP_MS && correction_ms <= RTC_DRIFT_MAX_STEP_MS) {
+            int64_t drift_ppb = rtc_drift_ppb + (correction_ms * 1000000000 / elapsed_ms) / 2;
+
+            if (drift_ppb > RTC_DRIFT_MAX_PPB) {
+                drift_ppb = RTC_DRIFT_MAX_PPB;
+            } else if (drift_ppb < -RTC_DRIFT_MAX_PPB) {
+                drift_ppb = -RTC_DRIFT_MAX_PPB;
+            }
+
+            rtc_drift_ppb = drift_ppb;
+        }
+
+        rtc_last_correction_ms = (int32_t)correction_ms;
+    }
+
+    rtc_offset_ms = offset_ms;
+    rtc_sync_us = now_us;
+    rtc_synchronized = true;
+    rtc_syncs++;
+}
+
+void RtcBoardGetSyncState( bool *synchronized, uint32_t *syncs, uint32_t *sinceSyncMs, int32_t *lastCorrectionMs, int32_t *driftPpb )
+{
+    *synchronized = rtc_synchronized;
+    *syncs = rtc_syncs;
+    *sinceSyncMs = (to_us_since_boot(get_absolute_time()) - rtc_sync_us) / 1000;
+    *lastCorrectionMs = rtc_last_correction_ms;
+    *driftPpb = rtc_drift_ppb;
 }
 
 void RtcProcess( void )
@@ -7,6 +7,7 @@
 
 #include "pico/stdlib.h"
 #include "hardware/spi.h"
+#include "pico/lorawan_ram.h"
 
 #include "spi-board.h"
 
@@ -21,12 +22,22 @@ void SpiInit( Spi_t *obj, SpiId_t spiId, PinNames mosi, PinNames miso, PinNames
     obj->SpiId = spiId;
 }
 
-uint16_t SpiInOut( Spi_t *obj, uint16_t outData )
+uint16_t LORAWAN_RAM_FUNC(SpiInOut)( Spi_t *obj, uint16_t outData )
 {
-    const uint8_t outDataB = (outData & 0xff);
-    uint8_t inDataB = 0x00;
+    spi_inst_t* spi = (obj->SpiId == 0) ? spi0 : spi1;
+    spi_hw_t* hw = spi_get_hw(spi);
 
-    spi_write_read_blocking((obj->SpiId == 0) ? spi0 : spi1, &outDataB, &inDataB, 1);
+    // one byte at a time with both FIFOs empty in between, the same as
+    // spi_write_read_blocking() for a length of 1 but without leaving SRAM
+    while (!spi_is_writable(spi)) {
+        tight_loop_contents();
+    }
 
-    return inDataB;
+    hw->dr = outData & 0xff;
+
+    while (!spi_is_readable(spi)) {
+        tight_loop_contents();
+    }
+
+    return (uint8_t)hw->dr;
 }
@@ -28,12 +28,23 @@
 #include <stddef.h>
 
 #include "hardware/gpio.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+
+#include "pico/lorawan_ram.h"
 
 #include "delay.h"
 #include "sx1276-board.h"
 
 #include "radio/radio.h"
 
+static void SX1276BoardSetTxConfig( RadioModems_t modem, int8_t power, uint32_t fdev,
+                                    uint32_t bandwidth, uint32_t datarate,
+                                    uint8_t coderate, uint16_t preambleLen,
+                                    bool fixLen, bool crcOn, bool freqHopOn,
+                                    uint8_t hopPeriod, bool iqInverted, uint32_t timeout );
+static void SX1276BoardSend( uint8_t *buffer, uint8_t size );
+
 const struct Radio_s Radio =
 {
     SX1276Init,
@@ -43,10 +54,10 @@ const struct Radio_s Radio =
     SX1276IsChannelFree,
     SX1276Random,
     SX1276SetRxConfig,
-    SX1276SetTxConfig,
+    SX1276BoardSetTxConfig,
     SX1276CheckRfFrequency,
     SX1276GetTimeOnAir,
-    SX1276Send,
+    SX1276BoardSend,
     SX1276SetSleep,
     SX1276SetStby,
     SX1276SetRx,
@@ -67,7 +78,97 @@ const struct Radio_s Radio =
 
 static DioIrqHandler** irq_handlers;
 
-void dio_gpio_callback(uint gpio, uint32_t events)
+/*!
+ * Receive time accounting, the driver switches the antenna for every
+ * operating mode change and puts it in low power when the radio sleeps
+ */
+static uint8_t radio_op_mode = 0;
+static uint64_t radio_op_mode_start_us = 0;
+static uint64_t radio_rx_time_us = 0;
+
+/*!
+ * Time on air of every frame sent, from the TX configuration it is sent
+ * with; the operating mode stays TX until the next change, which can be
+ * long after TX done
+ */
+static struct
+{
+    RadioModems_t modem;
+    uint32_t bandwidth;
+    uint32_t datarate;
+    uint8_t coderate;
+    uint16_t preambleLen;
+    bool fixLen;
+    bool crcOn;
+} radio_tx_config;
+static uint64_t radio_tx_air_time_ms = 0;
+
+static void LORAWAN_RAM_FUNC(SX1276BoardAccountOpMode)( uint8_t opMode )
+{
+    uint64_t now = time_us_64();
+
+    if( ( radio_op_mode == RFLR_OPMODE_RECEIVER ) || ( radio_op_mode == RFLR_OPMODE_RECEIVER_SINGLE ) )
+    {
+        radio_rx_time_us += now - radio_op_mode_start_us;
+    }
+
+    radio_op_mode = opMode;
+    radio_op_mode_start_us = now;
+}
+
+static void SX1276BoardSetTxConfig( RadioModems_t modem, int8_t power, uint32_t fdev,
+                                    uint32_t bandwidth, uint32_t datarate,
+                                    uint8_t coderate, uint16_t preambleLen,
+                                    bool fixLen, bool crcOn, bool freqHopOn,
+                                    uint8_t hopPeriod, bool iqInverted, uint32_t timeout )
+{
+    radio_tx_config.modem = modem;
+    radio_tx_config.bandwidth = bandwidth;
+    radio_tx_config.datarate = datarate;
+    radio_tx_config.coderate = coderate;
+    radio_tx_config.preambleLen = preambleLen;
+    radio_tx_config.fixLen = fixLen;
+    radio_tx_config.crcOn = crcOn;
+
+    SX1276SetTxConfig( modem, power, fdev, bandwidth, datarate, coderate, preambleLen,
+                       fixLen, crcOn, freqHopOn, hopPeriod, iqInverted, timeout );
+}
+
+static void SX1276BoardSend( uint8_t *buffer, uint8_t size )
+{
+    uint32_t air_time_ms = SX1276GetTimeOnAir( radio_tx_config.modem, radio_tx_config.bandwidth,
+                                               radio_tx_config.datarate, radio_tx_config.coderate,
+                                               radio_tx_config.preambleLen, radio_tx_config.fixLen,
+                                               size, radio_tx_config.crcOn );
+
+    // the MAC sends from its timer callbacks too
+    uint32_t mask = save_and_disable_interrupts();
+    radio_tx_air_time_ms += air_time_ms;
+    restore_interrupts(mask);
+
+    SX1276Send( buffer, size );
+}
+
+uint64_t SX1276BoardGetTxAirTimeMs( void )
+{
+    uint32_t mask = save_and_disable_interrupts();
+    uint64_t time_ms = radio_tx_air_time_ms;
+    restore_interrupts(mask);
+
+    return time_ms;
+}
+
+uint64_t SX1276BoardGetRxTimeUs( void )
+{
+    // updated from the DIO interrupt handlers
+    uint32_t mask = save_and_disable_interrupts();
+    uint64_t time_us = radio_rx_time_us;
+    restore_interrupts(mask);
+
+    return time_us;
+}
+
+void LORAWAN_RAM_FUNC(dio_gpio_callback)(uint gpio, uint32_t events)
 {
     if (gpio == SX1276.DIO0.pin) {
         irq_handlers[0](NULL);
@@ -78,6 +179,10 @@ void dio_gpio_callback(uint gpio, uint32_t events)
 
 void SX1276SetAntSwLowPower( bool status )
 {
+    if( status )
+    {
+        SX1276BoardAccountOpMode( RFLR_OPMODE_SLEEP );
+    }
 }
 
 bool SX1276CheckRfFrequency( uint32_t frequency )
@@ -94,8 +199,12 @@ uint32_t SX1276GetDio1PinState( void )
     return GpioRead(&SX1276.DIO1);
 }
 
-void SX1276SetAntSw( uint8_t opMode )
+void LORAWAN_RAM_FUNC(SX1276SetAntSw)( uint8_t opMode )
 {
+    if( opMode != radio_op_mode )
+    {
+        SX1276BoardAccountOpMode( opMode );
+    }
 }
 
 void SX1276Reset( void )
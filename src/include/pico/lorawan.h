@@ -17,6 +17,82 @@ extern "C" {
 
 #include "LoRaMac.h"
 
+// Regions compiled into the stack, selected with the PICO_LORAWAN_REGIONS
+// CMake option. Use LORAWAN_REGION_IS_ENABLED(region) in a static assertion
+// to catch an application region that is not compiled in at build time.
+#ifdef REGION_AS923
+#define LORAWAN_REGION_AS923_ENABLED 1
+#else
+#define LORAWAN_REGION_AS923_ENABLED 0
+#endif
+
+#ifdef REGION_AU915
+#define LORAWAN_REGION_AU915_ENABLED 1
+#else
+#define LORAWAN_REGION_AU915_ENABLED 0
+#endif
+
+#ifdef REGION_CN470
+#define LORAWAN_REGION_CN470_ENABLED 1
+#else
+#define LORAWAN_REGION_CN470_ENABLED 0
+#endif
+
+#ifdef REGION_CN779
+#define LORAWAN_REGION_CN779_ENABLED 1
+#else
+#define LORAWAN_REGION_CN779_ENABLED 0
+#endif
+
+#ifdef REGION_EU433
+#define LORAWAN_REGION_EU433_ENABLED 1
+#else
+#define LORAWAN_REGION_EU433_ENABLED 0
+#endif
+
+#ifdef REGION_EU868
+#define LORAWAN_REGION_EU868_ENABLED 1
+#else
+#define LORAWAN_REGION_EU868_ENABLED 0
+#endif
+
+#ifdef REGION_IN865
+#define LORAWAN_REGION_IN865_ENABLED 1
+#else
+#define LORAWAN_REGION_IN865_ENABLED 0
+#endif
+
+#ifdef REGION_KR920
+#define LORAWAN_REGION_KR920_ENABLED 1
+#else
+#define LORAWAN_REGION_KR920_ENABLED 0
+#endif
+
+#ifdef REGION_RU864
+#define LORAWAN_REGION_RU864_ENABLED 1
+#else
+#define LORAWAN_REGION_RU864_ENABLED 0
+#endif
+
+#ifdef REGION_US915
+#define LORAWAN_REGION_US915_ENABLED 1
+#else
+#define LORAWAN_REGION_US915_ENABLED 0
+#endif
+
+#define LORAWAN_REGION_IS_ENABLED(region) ( \
+    (((region) == LORAMAC_REGION_AS923) && LORAWAN_REGION_AS923_ENABLED) || \
+    (((region) == LORAMAC_REGION_AU915) && LORAWAN_REGION_AU915_ENABLED) || \
+    (((region) == LORAMAC_REGION_CN470) && LORAWAN_REGION_CN470_ENABLED) || \
+    (((region) == LORAMAC_REGION_CN779) && LORAWAN_REGION_CN779_ENABLED) || \
+    (((region) == LORAMAC_REGION_EU433) && LORAWAN_REGION_EU433_ENABLED) || \
+    (((region) == LORAMAC_REGION_EU868) && LORAWAN_REGION_EU868_ENABLED) || \
+    (((region) == LORAMAC_REGION_IN865) && LORAWAN_REGION_IN865_ENABLED) || \
+    (((region) == LORAMAC_REGION_KR920) && LORAWAN_REGION_KR920_ENABLED) || \
+    (((region) == LORAMAC_REGION_RU864) && LORAWAN_REGION_RU864_ENABLED) || \
+    (((region) == LORAMAC_REGION_US915) && LORAWAN_REGION_US915_ENABLED) \
+)
+
 struct lorawan_sx1276_settings {
     struct {
         spi_inst_t* inst;
@@ -44,6 +120,60 @@ struct lorawan_otaa_settings {
     const char* channel_mask;
 };
 
+// Number of datarates with separate time-on-air accounting
+#define LORAWAN_STATS_DATARATES         16
+
+// Number of downlink RSSI / SNR samples kept
+#define LORAWAN_STATS_HISTORY_SIZE      8
+
+// Size of the buffer lorawan_stats_encode(...) needs at most
+#define LORAWAN_STATS_ENCODED_MAX_SIZE  (16 + 3 * LORAWAN_STATS_DATARATES)
+
+struct lorawan_stats {
+    uint32_t uplinks;               // uplinks accepted by the MAC
+    uint32_t uplink_failures;       // rejected requests and failed transmissions
+    uint32_t uplinks_unacked;       // confirmed uplinks without ACK
+    uint32_t downlinks;
+    uint32_t join_attempts;
+    uint32_t join_failures;
+
+    uint32_t duty_cycle_blocked;    // requests rejected by duty cycle restriction
+    uint32_t duty_cycle_wait_ms;    // time the MAC asked to wait, overlapping waits once
+
+    uint32_t time_on_air_ms[LORAWAN_STATS_DATARATES]; // time on air of the frames sent, per datarate
+    uint32_t rx_time_ms;            // measured time with the receiver on
+
+    int16_t last_rssi;              // dBm
+    int8_t last_snr;                // dB
+    int8_t last_tx_datarate;
+    int8_t last_tx_power;
+
+    int16_t rssi_avg_x16;           // rolling average, 1/16 dBm
+    int16_t snr_avg_x16;            // rolling average, 1/16 dB
+
+    // most recent downlinks, history_head is the next slot to be written
+    int16_t rssi_history[LORAWAN_STATS_HISTORY_SIZE];
+    int8_t snr_history[LORAWAN_STATS_HISTORY_SIZE];
+    uint8_t history_head;
+    uint8_t history_count;
+};
+
+// Network time: the MAC and the Clock Synchronization package set the GPS
+// time, which has no leap seconds, lorawan_get_time(...) returns UTC by
+// subtracting this many seconds (18 since 2017-01-01)
+#ifndef LORAWAN_TIME_LEAP_SECONDS
+#define LORAWAN_TIME_LEAP_SECONDS       18
+#endif
+
+struct lorawan_time_stats {
+    bool synchronized;
+    uint32_t syncs;                 // time answers applied
+    uint32_t since_sync_ms;         // since the last one
+    int32_t last_correction_ms;     // step of the last one, after drift compensation
+    int32_t drift_ppb;              // crystal frequency error compensated between syncs
+    uint32_t requests;              // DeviceTimeReq commands queued
+};
+
 const char* lorawan_default_dev_eui(char* dev_eui);
 
 int lorawan_init(const struct lorawan_sx1276_settings* sx1276_settings, LoRaMacRegion_t region);
@@ -62,12 +192,58 @@ int lorawan_process_timeout_ms(uint32_t timeout_ms);
 
 int lorawan_send_unconfirmed(const void* data, uint8_t data_len, uint8_t app_port);
 
+int lorawan_send(const void* data, uint8_t data_len, uint8_t app_port);
+
 int lorawan_receive(void* data, uint8_t data_len, uint8_t* app_port);
 
+int lorawan_set_adr(bool enabled);
+
+int lorawan_get_adr();
+
+int lorawan_set_datarate(int8_t datarate);
+
+int lorawan_get_datarate();
+
+int lorawan_set_tx_power(int8_t tx_power);
+
+int lorawan_get_tx_power();
+
+void lorawan_set_confirmed(bool confirmed);
+
+int lorawan_get_confirmed();
+
+void lorawan_set_duty_cycle(bool enabled);
+
+int lorawan_get_duty_cycle();
+
+int lorawan_set_class(DeviceClass_t device_class);
+
+int lorawan_get_class();
+
+int lorawan_get_max_payload_size();
+
 void lorawan_debug(bool debug);
 
+void lorawan_debug_deferred(bool deferred);
+
+int lorawan_get_stats(struct lorawan_stats* stats);
+
+void lorawan_reset_stats();
+
+int lorawan_stats_encode(const struct lorawan_stats* stats, uint8_t* buffer, uint8_t buffer_len);
+
 int lorawan_erase_nvm();
 
+int lorawan_request_time();
+
+void lorawan_time_sync(uint32_t max_error_ms);
+
+int lorawan_get_time(uint32_t* seconds, uint16_t* milliseconds);
+
+int lorawan_time_from_boot_ms(uint32_t boot_ms, uint32_t* seconds, uint16_t* milliseconds);
+
+int lorawan_get_time_stats(struct lorawan_time_stats* stats);
+
 #ifdef __cplusplus
 }
 #endif
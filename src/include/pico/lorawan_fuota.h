@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#ifndef _PICO_LORAWAN_FUOTA_H_
+#define _PICO_LORAWAN_FUOTA_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "pico/lorawan_fuota_boot.h"
+
+// Firmware update over the air, built with the PICO_LORAWAN_FUOTA CMake
+// option.
+//
+// The LoRaWAN Remote Multicast Setup (port 200) and Fragmented Data Block
+// Transport (port 201) packages receive an update file, the FragDecoder
+// recovers lost fragments from the redundant ones. Its file is the staging
+// slot: a received fragment is programmed straight into the erased flash,
+// the few fragments the decoder writes a second time while solving go to a
+// journal at the end of the slot. The decoder's own RAM is bounded by
+// FRAG_MAX_NB, FRAG_MAX_SIZE and FRAG_MAX_REDUNDANCY, see the
+// PICO_LORAWAN_FUOTA_* CMake variables.
+//
+// Once the file is complete a low priority task checks its Ed25519
+// signature under the public key, see pico/lorawan_fuota_ed25519.h, moves
+// the image to the start of the slot, one sector per
+// run, with the journal applied, and takes its CRC. lorawan_fuota_apply()
+// then hands it to the bootloader, see pico/lorawan_fuota_boot.h.
+//
+// Update file, little-endian, built by tools/fuota.py:
+//   [0]  magic, LORAWAN_FUOTA_FILE_MAGIC
+//   [4]  format version, LORAWAN_FUOTA_FILE_VERSION
+//   [5]  reserved, 0 (3 bytes)
+//   [8]  image size
+//   [12] image version
+//   [16] Ed25519 signature of bytes 0 to 15 and the image
+//   [80] image, the .bin of an application linked for the application slot
+
+#define LORAWAN_FUOTA_FILE_MAGIC        0x57464c50  // "PLFW"
+#define LORAWAN_FUOTA_FILE_VERSION      1
+#define LORAWAN_FUOTA_FILE_HEADER_SIZE  80
+
+#define LORAWAN_FUOTA_KEY_SIZE          32
+
+// An unconfirmed image is restarted after this long, counting as a failed boot
+#define LORAWAN_FUOTA_CONFIRM_TIMEOUT_MS (30 * 60 * 1000)
+
+// Whether an unconfirmed image that started at boot_us ran out of time to
+// confirm at now_us, joined or not: its watchdog is no longer fed
+static inline bool lorawan_fuota_confirm_expired(uint64_t boot_us, uint64_t now_us)
+{
+    return now_us - boot_us > (uint64_t)LORAWAN_FUOTA_CONFIRM_TIMEOUT_MS * 1000;
+}
+
+#define LORAWAN_FUOTA_TASK_PRIORITY     250
+
+enum lorawan_fuota_status {
+    LORAWAN_FUOTA_IDLE = 0,
+    LORAWAN_FUOTA_RECEIVING,            // fragmentation session in progress
+    LORAWAN_FUOTA_VERIFYING,            // file complete, checking and moving the image
+    LORAWAN_FUOTA_READY,                // image staged, see lorawan_fuota_apply()
+    LORAWAN_FUOTA_FAILED,               // too many fragments lost, bad file or key
+};
+
+struct lorawan_fuota_stats {
+    enum lorawan_fuota_status status;
+
+    // session
+    uint16_t fragments;             // in the file
+    uint16_t fragments_received;
+    uint16_t fragments_lost;
+    uint8_t fragment_size;
+    uint32_t file_size;
+    uint32_t image_version;         // of the received image, once checked
+    uint32_t journal_writes;        // fragments rewritten by the decoder
+
+    // fragment store, per write and in total since boot
+    uint32_t max_write_us;
+    uint32_t flash_programs;        // pages
+    uint32_t flash_erases;          // sectors
+
+    uint32_t sessions;
+    uint32_t failures;
+
+    // running image, from the bootloader state
+    bool testing;                   // not confirmed yet
+    uint8_t boots;                  // of it while unconfirmed
+    uint8_t last_result;            // enum lorawan_fuota_boot_result
+    uint32_t running_version;       // 0 if not installed over the air
+};
+
+// Registers the multicast setup and fragmentation packages, call after
+// lorawan_init_*(...). public_key is the Ed25519 key the files are signed
+// for, in hex. Adds the update task to the scheduler, applications without it call
+// lorawan_fuota_process() every second. Returns 0, or -1 for a bad key or
+// an image not linked for the application slot.
+int lorawan_fuota_init(const char* public_key);
+
+// One step of the background work: checking and moving a received image,
+// erasing the staging slot for the next session, feeding the watchdog of
+// an unconfirmed image. Returns 1 if there is more to do right away.
+int lorawan_fuota_process();
+
+// 1 if an image is staged and lorawan_fuota_apply() will install it
+int lorawan_fuota_ready();
+
+// Hands the staged image to the bootloader and restarts, returns -1 if
+// there is none. Pick a moment that loses no data, e.g. right after saving.
+int lorawan_fuota_apply();
+
+// Marks the running image good, e.g. once it has joined and sent an uplink;
+// without it the bootloader restores the previous image. Returns 0, also
+// when there is nothing to confirm.
+int lorawan_fuota_confirm();
+
+int lorawan_fuota_get_stats(struct lorawan_fuota_stats* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
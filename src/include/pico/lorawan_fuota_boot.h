@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#ifndef _PICO_LORAWAN_FUOTA_BOOT_H_
+#define _PICO_LORAWAN_FUOTA_BOOT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "hardware/flash.h"
+
+// Flash layout and swap state shared by the firmware update code of the
+// library (pico/lorawan_fuota.h) and pico_lorawan_bootloader.
+//
+//   0                              boot2 and the bootloader
+//   LORAWAN_FUOTA_APP_OFFSET       application slot, the running image
+//   LORAWAN_FUOTA_STAGING_OFFSET   staging slot, same size: the update file
+//                                  while it is received, the image to
+//                                  install, after the swap the previous one
+//   LORAWAN_FUOTA_SCRATCH_OFFSET   one sector, swap scratch
+//   LORAWAN_FUOTA_STATE_OFFSET     two sectors, swap state log
+//   LORAWAN_FUOTA_APP_DATA_OFFSET  PICO_LORAWAN_FUOTA_APP_DATA_SECTORS,
+//                                  the application's own data, the
+//                                  LoRaWAN NVM sector last
+//
+// Applications are linked at LORAWAN_FUOTA_APP_OFFSET with their own boot2
+// in front, unused, the vector table follows at
+// LORAWAN_FUOTA_VECTOR_OFFSET. See cmake/pico_lorawan_fuota.cmake, which
+// sets PICO_LORAWAN_FUOTA_APP_DATA_SECTORS for the bootloader and the
+// applications alike: a different value moves the slots.
+//
+// The bootloader swaps the two slots sector by sector through the scratch
+// sector, logging every step, so a reset at any point resumes the swap
+// instead of leaving half an image. The previous image ends up in the
+// staging slot and is swapped back when the new one is not confirmed
+// within LORAWAN_FUOTA_BOOT_ATTEMPTS boots.
+
+#ifndef PICO_LORAWAN_FUOTA_APP_DATA_SECTORS
+#error "PICO_LORAWAN_FUOTA_APP_DATA_SECTORS is set by cmake/pico_lorawan_fuota.cmake for pico_lorawan and the bootloader"
+#endif
+
+#define LORAWAN_FUOTA_BOOT_SIZE         (32 * 1024)
+#define LORAWAN_FUOTA_RESERVED_SIZE     ((3 + PICO_LORAWAN_FUOTA_APP_DATA_SECTORS) * FLASH_SECTOR_SIZE)
+
+#define LORAWAN_FUOTA_SLOT_SIZE         (((PICO_FLASH_SIZE_BYTES - LORAWAN_FUOTA_BOOT_SIZE - LORAWAN_FUOTA_RESERVED_SIZE) / 2) & ~(FLASH_SECTOR_SIZE - 1))
+#define LORAWAN_FUOTA_SLOT_SECTORS      (LORAWAN_FUOTA_SLOT_SIZE / FLASH_SECTOR_SIZE)
+
+#define LORAWAN_FUOTA_APP_OFFSET        LORAWAN_FUOTA_BOOT_SIZE
+#define LORAWAN_FUOTA_STAGING_OFFSET    (LORAWAN_FUOTA_APP_OFFSET + LORAWAN_FUOTA_SLOT_SIZE)
+#define LORAWAN_FUOTA_SCRATCH_OFFSET    (PICO_FLASH_SIZE_BYTES - LORAWAN_FUOTA_RESERVED_SIZE)
+#define LORAWAN_FUOTA_STATE_OFFSET      (LORAWAN_FUOTA_SCRATCH_OFFSET + FLASH_SECTOR_SIZE)
+#define LORAWAN_FUOTA_STATE_SECTORS     2
+#define LORAWAN_FUOTA_APP_DATA_OFFSET   (LORAWAN_FUOTA_STATE_OFFSET + LORAWAN_FUOTA_STATE_SECTORS * FLASH_SECTOR_SIZE)
+
+#define LORAWAN_FUOTA_VECTOR_OFFSET     0x100
+
+// Boots of an unconfirmed image before the previous one is restored, and
+// the watchdog the bootloader starts for them
+#define LORAWAN_FUOTA_BOOT_ATTEMPTS     3
+#define LORAWAN_FUOTA_WATCHDOG_MS       8000
+
+enum lorawan_fuota_boot_state {
+    LORAWAN_FUOTA_BOOT_NONE = 0,        // running a confirmed image
+    LORAWAN_FUOTA_BOOT_INSTALL,         // swapping the staged image in
+    LORAWAN_FUOTA_BOOT_TESTING,         // new image running, not confirmed yet
+    LORAWAN_FUOTA_BOOT_ROLLBACK,        // swapping the previous image back
+};
+
+// Outcome of the last update, kept until the next one
+enum lorawan_fuota_boot_result {
+    LORAWAN_FUOTA_RESULT_NONE = 0,
+    LORAWAN_FUOTA_RESULT_INSTALLED,     // confirmed by the new image
+    LORAWAN_FUOTA_RESULT_ROLLED_BACK,   // not confirmed in time, or corrupted
+};
+
+// Last step completed for the sector being swapped
+#define LORAWAN_FUOTA_STEP_NONE         0
+#define LORAWAN_FUOTA_STEP_SCRATCH      1   // application sector copied to scratch
+#define LORAWAN_FUOTA_STEP_APP          2   // staging sector copied to the application slot
+
+#define LORAWAN_FUOTA_RECORD_MAGIC      0x53554650  // "PFUS"
+#define LORAWAN_FUOTA_RECORD_SIZE       64
+
+// One entry of the state log, the newest valid one is the current state
+struct lorawan_fuota_record {
+    uint32_t magic;
+    uint32_t sequence;
+    uint8_t state;                  // enum lorawan_fuota_boot_state
+    uint8_t result;                 // enum lorawan_fuota_boot_result
+    uint8_t step;                   // LORAWAN_FUOTA_STEP_*
+    uint8_t boots;                  // of the unconfirmed image
+    uint16_t sector;                // being swapped
+    uint16_t sectors;               // to swap, covering both images
+    uint32_t image_size;            // of the image in the application slot once swapped
+    uint32_t image_crc;
+    uint32_t image_version;
+    uint32_t previous_size;         // of the image it replaces
+    uint32_t previous_crc;
+    uint32_t previous_version;
+    uint8_t reserved[20];
+    uint32_t crc;                   // CRC-32 of the bytes before
+};
+
+// CRC-32 (IEEE 802.3) of length bytes, continuing from crc, 0 to start
+uint32_t lorawan_fuota_crc32(uint32_t crc, const void* data, uint32_t length);
+
+// Newest valid record of the state log, false if there is none: a device
+// that never installed an update
+bool lorawan_fuota_state_read(struct lorawan_fuota_record* record);
+
+// Appends the record with the next sequence number and its CRC, erasing
+// the other sector of the log when the records move on to it
+void lorawan_fuota_state_write(struct lorawan_fuota_record* record);
+
+// Flash access of lorawan_fuota_state_write(...), implemented by the
+// library with the multicore lockout and by the bootloader directly:
+// erases the sector at offset, programs whole pages
+void lorawan_fuota_flash_erase(uint32_t offset);
+void lorawan_fuota_flash_program(uint32_t offset, const uint8_t* data, uint32_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#ifndef _PICO_LORAWAN_FUOTA_ED25519_H_
+#define _PICO_LORAWAN_FUOTA_ED25519_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Ed25519 signature check (RFC 8032) of the firmware update files, see
+// pico/lorawan_fuota.h. The device holds the public key only, the private
+// key stays with tools/fuota.py.
+//
+// The check runs in steps, so a low priority task can spread it over
+// several runs: the message goes through SHA-512 in pieces of any size,
+// then every step takes LORAWAN_FUOTA_ED25519_STEP_BITS of the 256 bits of
+// the double scalar multiplication. Only public data goes in, the steps
+// are not constant time.
+
+#define LORAWAN_FUOTA_ED25519_KEY_SIZE          32
+#define LORAWAN_FUOTA_ED25519_SIGNATURE_SIZE    64
+
+#define LORAWAN_FUOTA_ED25519_STEP_BITS         8
+
+typedef int64_t lorawan_fuota_gf[16];
+
+struct lorawan_fuota_sha512 {
+    uint64_t state[8];
+    uint64_t length;                // bytes
+    uint8_t buffer[128];
+};
+
+struct lorawan_fuota_ed25519 {
+    struct lorawan_fuota_sha512 hash;
+    uint8_t r[32];
+    uint8_t s[32];
+    uint8_t h[32];
+    // points in extended coordinates: -A, B - A, and [s]B - [h]A so far
+    lorawan_fuota_gf minus_a[4];
+    lorawan_fuota_gf base_minus_a[4];
+    lorawan_fuota_gf sum[4];
+    int bit;                        // next bit of the multiplication, 256 before the first step
+};
+
+// Starts the check of signature under public_key: -1 if the key is not a
+// curve point or the signature is malformed, then the check has failed
+// already
+int lorawan_fuota_ed25519_start(struct lorawan_fuota_ed25519* ctx,
+                                const uint8_t public_key[LORAWAN_FUOTA_ED25519_KEY_SIZE],
+                                const uint8_t signature[LORAWAN_FUOTA_ED25519_SIGNATURE_SIZE]);
+
+// The signed message, in pieces of any size
+void lorawan_fuota_ed25519_update(struct lorawan_fuota_ed25519* ctx, const uint8_t* data, size_t size);
+
+// After the whole message: 1 while there are steps left, then 0 for a good
+// signature or -1
+int lorawan_fuota_ed25519_step(struct lorawan_fuota_ed25519* ctx);
+
+void lorawan_fuota_sha512_init(struct lorawan_fuota_sha512* ctx);
+void lorawan_fuota_sha512_update(struct lorawan_fuota_sha512* ctx, const uint8_t* data, size_t size);
+void lorawan_fuota_sha512_final(struct lorawan_fuota_sha512* ctx, uint8_t digest[64]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#ifndef _PICO_LORAWAN_LOG_H_
+#define _PICO_LORAWAN_LOG_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Deferred binary logging.
+//
+// LORAWAN_LOG(fmt, ...) stores the address of the format string, a
+// microsecond timestamp and up to 8 raw 32-bit arguments in a RAM ring
+// buffer, without formatting anything. lorawan_log_drain(...) copies whole
+// records out in a framed binary chunk for the application to write to USB
+// from a low priority step, and tools/log_decode.py renders the text on the
+// host using the format strings from the firmware ELF.
+//
+// - fmt must be a string literal, it is resolved from the ELF
+// - every conversion in fmt consumes one 32-bit argument: integers as is,
+//   floats through LORAWAN_LOG_FLOAT(x), %s for string literals only,
+//   through LORAWAN_LOG_STR(s)
+// - at most LORAWAN_LOG_MAX_ARGS arguments, more do not compile
+// - records that do not fit are dropped and counted, writers never block
+
+#ifndef LORAWAN_LOG_BUFFER_SIZE
+#define LORAWAN_LOG_BUFFER_SIZE     2048    // bytes, power of 2
+#endif
+
+#define LORAWAN_LOG_MAX_ARGS        8
+
+// Drained chunk: sync (2 bytes), records length (2 bytes, little-endian),
+// records, XOR of the record bytes (1 byte)
+#define LORAWAN_LOG_SYNC_0          0xa5
+#define LORAWAN_LOG_SYNC_1          0x5a
+#define LORAWAN_LOG_CHUNK_OVERHEAD  5
+
+// Smallest drain buffer that always fits the largest record
+#define LORAWAN_LOG_DRAIN_MIN_SIZE  (LORAWAN_LOG_CHUNK_OVERHEAD + 4 * (2 + LORAWAN_LOG_MAX_ARGS))
+
+void lorawan_log_write(const char* fmt, uint32_t nargs, const uint32_t* args);
+
+size_t lorawan_log_drain(uint8_t* buffer, size_t buffer_len);
+
+size_t lorawan_log_pending();
+
+uint32_t lorawan_log_dropped();
+
+static inline uint32_t LORAWAN_LOG_FLOAT(float f)
+{
+    uint32_t bits;
+
+    memcpy(&bits, &f, sizeof(bits));
+
+    return bits;
+}
+
+// The address only, the decoder reads the string from the ELF
+static inline uint32_t LORAWAN_LOG_STR(const char* s)
+{
+    return (uint32_t)(uintptr_t)s;
+}
+
+static inline void lorawan_log_write0(const char* fmt)
+{
+    lorawan_log_write(fmt, 0, NULL);
+}
+
+static inline void lorawan_log_write1(const char* fmt, uint32_t a0)
+{
+    const uint32_t args[] = { a0 };
+    lorawan_log_write(fmt, 1, args);
+}
+
+static inline void lorawan_log_write2(const char* fmt, uint32_t a0, uint32_t a1)
+{
+    const uint32_t args[] = { a0, a1 };
+    lorawan_log_write(fmt, 2, args);
+}
+
+static inline void lorawan_log_write3(const char* fmt, uint32_t a0, uint32_t a1, uint32_t a2)
+{
+    const uint32_t args[] = { a0, a1, a2 };
+    lorawan_log_write(fmt, 3, args);
+}
+
+static inline void lorawan_log_write4(const char* fmt, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3)
+{
+    const uint32_t args[] = { a0, a1, a2, a3 };
+    lorawan_log_write(fmt, 4, args);
+}
+
+static inline void lorawan_log_write5(const char* fmt, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4)
+{
+    const uint32_t args[] = { a0, a1, a2, a3, a4 };
+    lorawan_log_write(fmt, 5, args);
+}
+
+static inline void lorawan_log_write6(const char* fmt, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5)
+{
+    const uint32_t args[] = { a0, a1, a2, a3, a4, a5 };
+    lorawan_log_write(fmt, 6, args);
+}
+
+static inline void lorawan_log_write7(const char* fmt, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5, uint32_t a6)
+{
+    const uint32_t args[] = { a0, a1, a2, a3, a4, a5, a6 };
+    lorawan_log_write(fmt, 7, args);
+}
+
+static inline void lorawan_log_write8(const char* fmt, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5, uint32_t a6, uint32_t a7)
+{
+    const uint32_t args[] = { a0, a1, a2, a3, a4, a5, a6, a7 };
+    lorawan_log_write(fmt, 8, args);
+}
+
+// 9 to 16 arguments count as too many
+#define LORAWAN_LOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, N, ...) N
+#define LORAWAN_LOG_NARGS(...) \
+    LORAWAN_LOG_NARGS_(0, ##__VA_ARGS__, _too_many, _too_many, _too_many, _too_many, _too_many, _too_many, \
+                       _too_many, _too_many, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+
+#ifdef __cplusplus
+#define lorawan_log_write_too_many(...) \
+    do { static_assert(false, "LORAWAN_LOG takes at most 8 arguments"); } while (0)
+#else
+#define lorawan_log_write_too_many(...) \
+    do { _Static_assert(0, "LORAWAN_LOG takes at most 8 arguments"); } while (0)
+#endif
+
+#define LORAWAN_LOG_CONCAT_(a, b) a##b
+#define LORAWAN_LOG_CONCAT(a, b) LORAWAN_LOG_CONCAT_(a, b)
+
+#define LORAWAN_LOG(fmt, ...) \
+    LORAWAN_LOG_CONCAT(lorawan_log_write, LORAWAN_LOG_NARGS(__VA_ARGS__))(fmt, ##__VA_ARGS__)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
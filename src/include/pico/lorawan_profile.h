@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#ifndef _PICO_LORAWAN_PROFILE_H_
+#define _PICO_LORAWAN_PROFILE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+// Per-stage cycle profiling.
+//
+// A stage is timed with LORAWAN_PROFILE_SCOPE(stage) at the top of a block,
+// or with lorawan_profile_begin() / lorawan_profile_end(...) around it. The
+// processor cycles are read from SysTick, stages longer than one SysTick
+// wrap (~134 ms at 125 MHz) are converted from the microsecond timer. Each
+// stage keeps min / max / total cycles and a log2 histogram.
+//
+// The time spent in BoardLowPowerHandler() is counted as idle, everything
+// else as busy. The XIP cache hit and access counters are collected along,
+// see pico/lorawan_ram.h for keeping the hot paths out of flash.
+//
+// The library times LORAWAN_PROFILE_MAC (lorawan_process()),
+// LORAWAN_PROFILE_FLASH (NVM flash erase and program) and
+// LORAWAN_PROFILE_FUOTA (pico/lorawan_fuota.h), the other stages are for
+// the application. Stages must be timed from thread context.
+//
+// Build with LORAWAN_PROFILE=0 (the PICO_LORAWAN_PROFILE CMake option) to
+// compile the timers out.
+
+#ifndef LORAWAN_PROFILE
+#define LORAWAN_PROFILE             1
+#endif
+
+enum lorawan_profile_stage {
+    LORAWAN_PROFILE_ACQUISITION,    // ADC sampling
+    LORAWAN_PROFILE_DSP,            // RMS, power and derived values
+    LORAWAN_PROFILE_ENCODE,         // uplink payload and MAC frame
+    LORAWAN_PROFILE_MAC,            // lorawan_process()
+    LORAWAN_PROFILE_DISPLAY,        // display frame flush
+    LORAWAN_PROFILE_FLASH,          // flash erase and program
+    LORAWAN_PROFILE_FUOTA,          // update fragment store and image checks
+    LORAWAN_PROFILE_STAGES
+};
+
+// Bucket 0 counts runs under 2^8 cycles, bucket i runs from 2^(7 + i) to
+// 2^(8 + i) cycles, the last bucket everything from 2^26 cycles on
+#define LORAWAN_PROFILE_BUCKETS     20
+
+struct lorawan_profile_stats {
+    uint32_t count;
+    uint32_t min_cycles;
+    uint32_t max_cycles;
+    uint64_t total_cycles;
+    uint32_t histogram[LORAWAN_PROFILE_BUCKETS];
+};
+
+struct lorawan_profile_timer {
+    uint32_t cycles;                // SysTick, counts down
+    uint32_t us;
+};
+
+struct lorawan_profile_scope {
+    enum lorawan_profile_stage stage;
+    struct lorawan_profile_timer start;
+};
+
+// Largest lorawan_profile_encode(...) payload
+#define LORAWAN_PROFILE_ENCODED_MAX_SIZE (4 + 6 * LORAWAN_PROFILE_STAGES)
+
+#if LORAWAN_PROFILE
+
+#include "hardware/structs/systick.h"
+#include "hardware/timer.h"
+
+static inline struct lorawan_profile_timer lorawan_profile_begin()
+{
+    struct lorawan_profile_timer timer;
+
+    timer.us = time_us_32();
+    timer.cycles = systick_hw->cvr;
+
+    return timer;
+}
+
+void lorawan_profile_end(enum lorawan_profile_stage stage, struct lorawan_profile_timer start);
+
+#else
+
+static inline struct lorawan_profile_timer lorawan_profile_begin()
+{
+    struct lorawan_profile_timer timer = { 0, 0 };
+
+    return timer;
+}
+
+static inline void lorawan_profile_end(enum lorawan_profile_stage stage, struct lorawan_profile_timer start)
+{
+    (void)stage;
+    (void)start;
+}
+
+#endif
+
+static inline void lorawan_profile_scope_end(struct lorawan_profile_scope* scope)
+{
+    lorawan_profile_end(scope->stage, scope->start);
+}
+
+#define LORAWAN_PROFILE_CONCAT_(a, b) a##b
+#define LORAWAN_PROFILE_CONCAT(a, b) LORAWAN_PROFILE_CONCAT_(a, b)
+
+// Times the rest of the enclosing block
+#define LORAWAN_PROFILE_SCOPE(stage) \
+    struct lorawan_profile_scope LORAWAN_PROFILE_CONCAT(profile_scope_, __LINE__) \
+        __attribute__((cleanup(lorawan_profile_scope_end))) = { (stage), lorawan_profile_begin() }
+
+// Starts SysTick as a free running cycle counter, called from
+// lorawan_init(...), call earlier to profile stages before that
+void lorawan_profile_init();
+
+// Counted by BoardLowPowerHandler()
+void lorawan_profile_idle(uint32_t us);
+
+void lorawan_profile_get(enum lorawan_profile_stage stage, struct lorawan_profile_stats* stats);
+
+// Name of the stage, a string literal that can be used in LORAWAN_LOG records
+const char* lorawan_profile_stage_name(enum lorawan_profile_stage stage);
+
+// Mean of the stage in cycles, 0 if it never ran
+uint32_t lorawan_profile_mean(const struct lorawan_profile_stats* stats);
+
+// Upper bound in cycles of the histogram bucket holding the given percentile
+// (1 to 100), UINT32_MAX for the last bucket, 0 if the stage never ran
+uint32_t lorawan_profile_percentile(const struct lorawan_profile_stats* stats, uint8_t percentile);
+
+// Microseconds since the last reset, and the part spent in BoardLowPowerHandler()
+void lorawan_profile_get_idle(uint64_t* elapsed_us, uint64_t* idle_us);
+
+// Busy time since the last reset in 1/1000
+uint16_t lorawan_profile_busy_permille();
+
+// XIP cache hits and accesses since the last reset, the hardware counters
+// saturate at 32 bits and are folded into these on every sleep
+void lorawan_profile_get_xip_cache(uint64_t* hits, uint64_t* accesses);
+
+uint32_t lorawan_profile_cycles_to_us(uint32_t cycles);
+
+void lorawan_profile_reset();
+
+// Compact diagnostic payload, see API.md. Returns the payload length, -1 if
+// buffer is too small.
+int lorawan_profile_encode(uint8_t* buffer, uint8_t buffer_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
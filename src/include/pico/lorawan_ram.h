@@ -0,0 +1,27 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#ifndef _PICO_LORAWAN_RAM_H_
+#define _PICO_LORAWAN_RAM_H_
+
+// SRAM-resident hot paths.
+//
+// Code runs from flash through the 16 KB XIP cache, a miss stalls the core
+// until the line is fetched over QSPI. With the PICO_LORAWAN_RAM_HOT_PATHS
+// CMake option, functions defined as LORAWAN_RAM_FUNC(name) are linked into
+// SRAM and copied there at boot: the radio interrupt dispatch and SPI byte
+// transfer, the timer callbacks and the producers called from interrupts.
+// Without the option they stay in flash.
+
+#if defined(PICO_LORAWAN_RAM_HOT_PATHS)
+#include "pico/platform.h"
+#define LORAWAN_RAM_FUNC(name) __not_in_flash_func(name)
+#else
+#define LORAWAN_RAM_FUNC(name) name
+#endif
+
+#endif
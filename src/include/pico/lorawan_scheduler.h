@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#ifndef _PICO_LORAWAN_SCHEDULER_H_
+#define _PICO_LORAWAN_SCHEDULER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Cooperative run-to-completion scheduler.
+//
+// Tasks are periodic (period_us > 0), event triggered through
+// lorawan_task_signal(...), or both. Of the ready tasks the one with the
+// lowest priority value runs next, ties go to the earliest deadline. Tasks
+// never block, a long job has to be split into steps.
+//
+// The LoRaMac event processing is a built-in task with priority
+// LORAWAN_TASK_PRIORITY_MAC, signalled whenever the MAC requests
+// processing. When nothing is ready the scheduler sleeps in
+// BoardLowPowerHandler() until the next periodic release or interrupt.
+
+#define LORAWAN_TASK_PRIORITY_MAC   0   // reserved for the MAC task
+
+typedef void (*lorawan_task_fn)(void* context);
+
+struct lorawan_task_stats {
+    uint32_t runs;
+    uint32_t deadline_misses;       // finished after the deadline, or release skipped
+    uint64_t run_time_us;           // total
+    uint32_t max_run_time_us;
+    uint32_t max_latency_us;        // release to start
+};
+
+struct lorawan_task {
+    // set by the application before lorawan_scheduler_add(...)
+    const char* name;               // string literal, also used in LORAWAN_LOG records
+    lorawan_task_fn fn;
+    void* context;
+    uint8_t priority;               // 1 highest, 255 lowest
+    uint32_t period_us;             // 0 for event triggered only
+    uint32_t deadline_us;           // relative to the release, 0 for the period
+
+    // scheduler state
+    uint64_t release_us;
+    volatile uint64_t signal_us;
+    volatile bool pending;
+    struct lorawan_task_stats stats;
+    struct lorawan_task* next;
+};
+
+struct lorawan_scheduler_stats {
+    uint64_t busy_us;               // running tasks, including the MAC
+    uint64_t idle_us;               // in BoardLowPowerHandler
+    uint32_t sleeps;
+};
+
+// Registers the built-in MAC task, call after lorawan_init_*(...)
+void lorawan_scheduler_init();
+
+// task must stay valid for the life of the scheduler, periodic tasks are
+// first released one period after being added
+int lorawan_scheduler_add(struct lorawan_task* task);
+
+// Marks an event triggered task ready, safe from interrupt context
+void lorawan_task_signal(struct lorawan_task* task);
+
+// Changes the period of a task that was added, the next periodic release
+// is one new period from now, 0 leaves it event triggered only
+void lorawan_task_set_period(struct lorawan_task* task, uint32_t period_us);
+
+// Runs the highest priority ready task, or sleeps until the next release
+// or interrupt when none is ready. Returns 1 if a task ran.
+int lorawan_scheduler_run_once();
+
+void lorawan_scheduler_run();
+
+// Task to signal when a downlink is received, NULL for none
+void lorawan_scheduler_set_rx_task(struct lorawan_task* task);
+
+// First registered task, walk the list with task->next, the MAC task included
+struct lorawan_task* lorawan_scheduler_tasks();
+
+void lorawan_scheduler_get_stats(struct lorawan_scheduler_stats* stats);
+
+void lorawan_scheduler_reset_stats();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
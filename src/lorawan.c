@@ -28,6 +28,8 @@
 #include <string.h>
 
 #include "pico/lorawan.h"
+#include "pico/lorawan_log.h"
+#include "pico/lorawan_profile.h"
 #include "pico/time.h"
 
 #include "board.h"
@@ -36,11 +38,15 @@
 
 #include "../../periodic-uplink-lpp/firmwareVersion.h"
 #include "Commissioning.h"
+#include "Region.h"
 #include "RegionCommon.h"
 #include "LmHandler.h"
+#include "LoRaMacTest.h"
 #include "LmhpCompliance.h"
+#include "LmhpClockSync.h"
 #include "LmHandlerMsgDisplay.h"
 #include "NvmDataMgmt.h"
+#include "systime.h"
 
 /*!
  * LoRaWAN default end-device class
@@ -181,8 +187,81 @@ static LmHandlerAppData_t AppRxData =
 
 static bool Debug = false;
 
+/*!
+ * Write debug output from the MAC callbacks as deferred binary log records
+ * instead of formatting it in the callbacks
+ */
+static bool DebugDeferred = false;
+
+/*!
+ * Indicates if LmHandlerInit has run, before that link parameters are only
+ * stored in LmHandlerParams and applied by LmHandlerInit
+ */
+static bool IsInitialized = false;
+
+/*!
+ * Link statistics, updated from the LmHandler callbacks
+ */
+static struct lorawan_stats Stats;
+
+/*!
+ * Radio time on air / RX time already attributed to Stats
+ */
+static uint64_t StatsTxAirTimeMs = 0;
+static uint64_t StatsRxTimeUs = 0;
+
+/*!
+ * End of the latest duty cycle wait in ms since boot, a request rejected
+ * again within it only adds what reaches beyond
+ */
+static uint32_t StatsDutyCycleEndMs = 0;
+
+/*!
+ * Format version of lorawan_stats_encode
+ */
+#define LORAWAN_STATS_ENCODING_VERSION              1
+
+/*!
+ * Bounds of the resynchronization interval of lorawan_time_sync, and the
+ * wait for an answer before a DeviceTimeReq is sent again
+ */
+#define LORAWAN_TIME_SYNC_MIN_INTERVAL_MS           ( 60 * 60 * 1000 )
+#define LORAWAN_TIME_SYNC_MAX_INTERVAL_MS           ( 24 * 60 * 60 * 1000 )
+#define LORAWAN_TIME_SYNC_RETRY_MS                  ( 10 * 60 * 1000 )
+
+/*!
+ * Automatic time synchronization, 0 when disabled
+ */
+static uint32_t TimeSyncMaxErrorMs = 0;
+static uint32_t TimeSyncIntervalMs = LORAWAN_TIME_SYNC_MIN_INTERVAL_MS;
+
+/*!
+ * DeviceTimeReq queued and not answered yet, and when, in ms since boot
+ */
+static bool TimeRequestPending = false;
+static uint32_t TimeRequestMs = 0;
+static uint32_t TimeRequests = 0;
+
+/*!
+ * End-device class asked for with lorawan_set_class(), requested once
+ * joined and whenever the MAC is idle while it differs
+ */
+static DeviceClass_t RequestedClass = LORAWAN_DEFAULT_CLASS;
+static bool ClassChangePending = false;
+
 extern void EepromMcuInit();
 extern uint8_t EepromMcuFlush();
+extern uint64_t SX1276BoardGetTxAirTimeMs( void );
+extern uint64_t SX1276BoardGetRxTimeUs( void );
+extern void lorawan_scheduler_notify_mac( void );
+extern void lorawan_scheduler_notify_rx( void );
+extern void RtcBoardGetSyncState( bool *synchronized, uint32_t *syncs, uint32_t *sinceSyncMs, int32_t *lastCorrectionMs, int32_t *driftPpb );
+#ifdef PICO_LORAWAN_FUOTA
+extern void lorawan_fuota_feed_watchdog( void );
+#endif
+
+static void TimeSyncProcess( void );
+static void ClassProcess( void );
 
 const char* lorawan_default_dev_eui(char* dev_eui)
 {
@@ -201,6 +280,13 @@ const char* lorawan_default_dev_eui(char* dev_eui)
 
 int lorawan_init(const struct lorawan_sx1276_settings* sx1276_settings, LoRaMacRegion_t region)
 {
+    // region not in PICO_LORAWAN_REGIONS
+    if (!RegionIsActive(region)) {
+        return -1;
+    }
+
+    lorawan_profile_init();
+
     EepromMcuInit();
 
     RtcInit();
@@ -232,6 +318,8 @@ int lorawan_init(const struct lorawan_sx1276_settings* sx1276_settings, LoRaMacR
         return -1;
     }
 
+    IsInitialized = true;
+
     // Set system maximum tolerated rx error in milliseconds
     LmHandlerSetSystemMaxRxError( 20 );
 
@@ -239,6 +327,10 @@ int lorawan_init(const struct lorawan_sx1276_settings* sx1276_settings, LoRaMacR
     // initialized and activated.
     LmHandlerPackageRegister( PACKAGE_ID_COMPLIANCE, &LmhpComplianceParams );
 
+    // Application Layer Clock Synchronization on port 202, the network can
+    // correct the clock and force a resynchronization through it
+    LmHandlerPackageRegister( PACKAGE_ID_CLOCK_SYNC, NULL );
+
     return 0;
 }
 
@@ -272,11 +364,21 @@ int lorawan_is_joined()
 
 int lorawan_process()
 {
+    LORAWAN_PROFILE_SCOPE(LORAWAN_PROFILE_MAC);
+
     int sleep = 0;
 
+#ifdef PICO_LORAWAN_FUOTA
+    // an unconfirmed update runs under the bootloader's watchdog, also
+    // while joining, until its time to confirm is up
+    lorawan_fuota_feed_watchdog( );
+#endif
+
     // Processes the LoRaMac events
     LmHandlerProcess( );
 
+    ClassProcess( );
+
     CRITICAL_SECTION_BEGIN( );
     if( IsMacProcessPending == 1 )
     {
@@ -320,6 +422,8 @@ int lorawan_send_unconfirmed(const void* data, uint8_t data_len, uint8_t app_por
     appData.BufferSize = data_len;
     appData.Buffer = (uint8_t*)data;
 
+    TimeSyncProcess();
+
     if (LmHandlerSend(&appData, LORAMAC_HANDLER_UNCONFIRMED_MSG) != LORAMAC_HANDLER_SUCCESS) {
         return -1;
     }
@@ -327,6 +431,23 @@ int lorawan_send_unconfirmed(const void* data, uint8_t data_len, uint8_t app_por
     return 0;
 }
 
+int lorawan_send(const void* data, uint8_t data_len, uint8_t app_port)
+{
+    LmHandlerAppData_t appData;
+
+    appData.Port = app_port;
+    appData.BufferSize = data_len;
+    appData.Buffer = (uint8_t*)data;
+
+    TimeSyncProcess();
+
+    if (LmHandlerSend(&appData, LmHandlerParams.IsTxConfirmed) != LORAMAC_HANDLER_SUCCESS) {
+        return -1;
+    }
+
+    return 0;
+}
+
 int lorawan_receive(void* data, uint8_t data_len, uint8_t* app_port)
 {
     *app_port = AppRxData.Port;
@@ -346,11 +467,273 @@ int lorawan_receive(void* data, uint8_t data_len, uint8_t* app_port)
     return receive_length;
 }
 
+int lorawan_set_adr(bool enabled)
+{
+    if (IsInitialized) {
+        MibRequestConfirm_t mibReq;
+
+        mibReq.Type = MIB_ADR;
+        mibReq.Param.AdrEnable = enabled;
+        if (LoRaMacMibSetRequestConfirm( &mibReq ) != LORAMAC_STATUS_OK) {
+            return -1;
+        }
+    }
+
+    LmHandlerParams.AdrEnable = enabled;
+
+    return 0;
+}
+
+int lorawan_get_adr()
+{
+    if (IsInitialized) {
+        MibRequestConfirm_t mibReq;
+
+        mibReq.Type = MIB_ADR;
+        if (LoRaMacMibGetRequestConfirm( &mibReq ) != LORAMAC_STATUS_OK) {
+            return -1;
+        }
+
+        return mibReq.Param.AdrEnable ? 1 : 0;
+    }
+
+    return LmHandlerParams.AdrEnable ? 1 : 0;
+}
+
+int lorawan_set_datarate(int8_t datarate)
+{
+    if (IsInitialized) {
+        MibRequestConfirm_t mibReq;
+
+        mibReq.Type = MIB_CHANNELS_DATARATE;
+        mibReq.Param.ChannelsDatarate = datarate;
+        if (LoRaMacMibSetRequestConfirm( &mibReq ) != LORAMAC_STATUS_OK) {
+            return -1;
+        }
+    }
+
+    // LmHandlerSend requests this datarate on every uplink when ADR is off
+    LmHandlerParams.TxDatarate = datarate;
+
+    return 0;
+}
+
+int lorawan_get_datarate()
+{
+    if (IsInitialized) {
+        MibRequestConfirm_t mibReq;
+
+        mibReq.Type = MIB_CHANNELS_DATARATE;
+        if (LoRaMacMibGetRequestConfirm( &mibReq ) != LORAMAC_STATUS_OK) {
+            return -1;
+        }
+
+        return mibReq.Param.ChannelsDatarate;
+    }
+
+    return LmHandlerParams.TxDatarate;
+}
+
+int lorawan_set_tx_power(int8_t tx_power)
+{
+    MibRequestConfirm_t mibReq;
+
+    if (!IsInitialized) {
+        return -1;
+    }
+
+    mibReq.Type = MIB_CHANNELS_TX_POWER;
+    mibReq.Param.ChannelsTxPower = tx_power;
+    if (LoRaMacMibSetRequestConfirm( &mibReq ) != LORAMAC_STATUS_OK) {
+        return -1;
+    }
+
+    return 0;
+}
+
+int lorawan_get_tx_power()
+{
+    MibRequestConfirm_t mibReq;
+
+    if (!IsInitialized) {
+        return -1;
+    }
+
+    mibReq.Type = MIB_CHANNELS_TX_POWER;
+    if (LoRaMacMibGetRequestConfirm( &mibReq ) != LORAMAC_STATUS_OK) {
+        return -1;
+    }
+
+    return mibReq.Param.ChannelsTxPower;
+}
+
+void lorawan_set_confirmed(bool confirmed)
+{
+    LmHandlerParams.IsTxConfirmed = confirmed ? LORAMAC_HANDLER_CONFIRMED_MSG : LORAMAC_HANDLER_UNCONFIRMED_MSG;
+}
+
+int lorawan_get_confirmed()
+{
+    return (LmHandlerParams.IsTxConfirmed == LORAMAC_HANDLER_CONFIRMED_MSG) ? 1 : 0;
+}
+
+void lorawan_set_duty_cycle(bool enabled)
+{
+    if (IsInitialized) {
+        LoRaMacTestSetDutyCycleOn( enabled );
+    }
+
+    LmHandlerParams.DutyCycleEnabled = enabled;
+}
+
+int lorawan_get_duty_cycle()
+{
+    return LmHandlerParams.DutyCycleEnabled ? 1 : 0;
+}
+
+int lorawan_set_class(DeviceClass_t device_class)
+{
+    // Class B needs beacon acquisition and ping slots, not supported
+    if (device_class != CLASS_A && device_class != CLASS_C) {
+        return -1;
+    }
+
+    RequestedClass = device_class;
+    ClassChangePending = true;
+
+    ClassProcess();
+
+    return 0;
+}
+
+int lorawan_get_class()
+{
+    MibRequestConfirm_t mibReq;
+
+    if (!IsInitialized) {
+        return RequestedClass;
+    }
+
+    mibReq.Type = MIB_DEVICE_CLASS;
+    if (LoRaMacMibGetRequestConfirm( &mibReq ) != LORAMAC_STATUS_OK) {
+        return -1;
+    }
+
+    return mibReq.Param.Class;
+}
+
+int lorawan_get_max_payload_size()
+{
+    LoRaMacTxInfo_t txInfo;
+
+    if (!IsInitialized) {
+        return -1;
+    }
+
+    // Fills txInfo even when pending MAC commands do not fit the current datarate
+    LoRaMacQueryTxPossible( 0, &txInfo );
+
+    if (txInfo.MaxPossibleApplicationDataSize > LORAWAN_APP_DATA_BUFFER_MAX_SIZE) {
+        return LORAWAN_APP_DATA_BUFFER_MAX_SIZE;
+    }
+
+    return txInfo.MaxPossibleApplicationDataSize;
+}
+
 void lorawan_debug(bool debug)
 {
     Debug = debug;
 }
 
+void lorawan_debug_deferred(bool deferred)
+{
+    DebugDeferred = deferred;
+}
+
+int lorawan_get_stats(struct lorawan_stats* stats)
+{
+    CRITICAL_SECTION_BEGIN( );
+    memcpy(stats, &Stats, sizeof(Stats));
+    stats->rx_time_ms = (SX1276BoardGetRxTimeUs() - StatsRxTimeUs) / 1000;
+    CRITICAL_SECTION_END( );
+
+    return 0;
+}
+
+void lorawan_reset_stats()
+{
+    CRITICAL_SECTION_BEGIN( );
+    memset(&Stats, 0, sizeof(Stats));
+    StatsTxAirTimeMs = SX1276BoardGetTxAirTimeMs();
+    StatsRxTimeUs = SX1276BoardGetRxTimeUs();
+    StatsDutyCycleEndMs = 0;
+    CRITICAL_SECTION_END( );
+}
+
+static uint8_t* PutU16Saturated(uint8_t* p, uint32_t value)
+{
+    if (value > 0xffff) {
+        value = 0xffff;
+    }
+
+    *p++ = value & 0xff;
+    *p++ = value >> 8;
+
+    return p;
+}
+
+static uint8_t RssiToU8(int16_t rssi)
+{
+    // RSSI is reported as its magnitude, -255..0 dBm
+    if (rssi > 0) {
+        return 0;
+    } else if (rssi < -255) {
+        return 255;
+    }
+
+    return -rssi;
+}
+
+int lorawan_stats_encode(const struct lorawan_stats* stats, uint8_t* buffer, uint8_t buffer_len)
+{
+    uint8_t datarates = 0;
+
+    for (int i = 0; i < LORAWAN_STATS_DATARATES; i++) {
+        if (stats->time_on_air_ms[i] != 0) {
+            datarates++;
+        }
+    }
+
+    if (buffer_len < (16 + 3 * datarates)) {
+        return -1;
+    }
+
+    uint8_t* p = buffer;
+
+    *p++ = LORAWAN_STATS_ENCODING_VERSION;
+    p = PutU16Saturated(p, stats->uplinks);
+    p = PutU16Saturated(p, stats->uplink_failures);
+    p = PutU16Saturated(p, stats->downlinks);
+    *p++ = (stats->join_attempts > 0xff) ? 0xff : stats->join_attempts;
+    p = PutU16Saturated(p, stats->duty_cycle_wait_ms / 1000);
+    *p++ = RssiToU8(stats->last_rssi);
+    *p++ = (uint8_t)stats->last_snr;
+    *p++ = RssiToU8(stats->rssi_avg_x16 / 16);
+    *p++ = (uint8_t)(int8_t)(stats->snr_avg_x16 / 16);
+    *p++ = (uint8_t)stats->last_tx_datarate;
+    *p++ = datarates;
+
+    // one (datarate, seconds on air) pair per datarate used
+    for (int i = 0; i < LORAWAN_STATS_DATARATES; i++) {
+        if (stats->time_on_air_ms[i] != 0) {
+            *p++ = i;
+            p = PutU16Saturated(p, (stats->time_on_air_ms[i] + 999) / 1000);
+        }
+    }
+
+    return p - buffer;
+}
+
 int lorawan_erase_nvm()
 {
     if (!NvmDataMgmtFactoryReset()) {
@@ -362,15 +745,195 @@ int lorawan_erase_nvm()
     return 0;
 }
 
+int lorawan_request_time()
+{
+    if (LmHandlerDeviceTimeReq() != LORAMAC_HANDLER_SUCCESS) {
+        return -1;
+    }
+
+    TimeRequestPending = true;
+    TimeRequestMs = to_ms_since_boot(get_absolute_time());
+    TimeRequests++;
+
+    return 0;
+}
+
+void lorawan_time_sync(uint32_t max_error_ms)
+{
+    TimeSyncMaxErrorMs = max_error_ms;
+}
+
+int lorawan_get_time(uint32_t* seconds, uint16_t* milliseconds)
+{
+    return lorawan_time_from_boot_ms(to_ms_since_boot(get_absolute_time()), seconds, milliseconds);
+}
+
+int lorawan_time_from_boot_ms(uint32_t boot_ms, uint32_t* seconds, uint16_t* milliseconds)
+{
+    struct lorawan_time_stats stats;
+
+    lorawan_get_time_stats(&stats);
+
+    if (!stats.synchronized) {
+        return -1;
+    }
+
+    // the network time now, back by the age of boot_ms and the leap seconds
+    uint32_t age_ms = to_ms_since_boot(get_absolute_time()) - boot_ms;
+    SysTime_t age = { .Seconds = age_ms / 1000 + LORAWAN_TIME_LEAP_SECONDS, .SubSeconds = age_ms % 1000 };
+    SysTime_t time = SysTimeSub(SysTimeGet(), age);
+
+    *seconds = time.Seconds;
+
+    if (milliseconds != NULL) {
+        *milliseconds = time.SubSeconds;
+    }
+
+    return 0;
+}
+
+int lorawan_get_time_stats(struct lorawan_time_stats* stats)
+{
+    RtcBoardGetSyncState(&stats->synchronized, &stats->syncs, &stats->since_sync_ms,
+                         &stats->last_correction_ms, &stats->drift_ppb);
+    stats->requests = TimeRequests;
+
+    return 0;
+}
+
+/*!
+ * Queues a DeviceTimeReq with the uplink about to be sent when the clock is
+ * due for a resynchronization, or the previous request went unanswered
+ */
+static void TimeSyncProcess( void )
+{
+    struct lorawan_time_stats stats;
+    uint32_t now = to_ms_since_boot(get_absolute_time());
+
+    if( ( TimeSyncMaxErrorMs == 0 ) || ( lorawan_is_joined( ) == 0 ) )
+    {
+        return;
+    }
+
+    lorawan_get_time_stats( &stats );
+
+    if( TimeRequestPending == true )
+    {
+        if( ( now - TimeRequestMs ) < LORAWAN_TIME_SYNC_RETRY_MS )
+        {
+            return;
+        }
+    }
+    else if( ( stats.synchronized == true ) && ( stats.since_sync_ms < TimeSyncIntervalMs ) )
+    {
+        return;
+    }
+
+    lorawan_request_time( );
+}
+
+/*!
+ * Requests the class asked for with lorawan_set_class() while the MAC is
+ * idle, LmHandlerRequestClass() refuses while it is busy. Switching to
+ * Class C opens RX2 continuously right away, switching back to Class A
+ * puts the radio to sleep until the next uplink.
+ */
+static void ClassProcess( void )
+{
+    if( ( ClassChangePending == false ) || ( lorawan_is_joined( ) == 0 ) || ( LmHandlerIsBusy( ) == true ) )
+    {
+        return;
+    }
+
+    // OnClassChange() may set it again
+    ClassChangePending = false;
+
+    if( lorawan_get_class( ) == RequestedClass )
+    {
+        return;
+    }
+
+    if( ( LmHandlerRequestClass( RequestedClass ) != LORAMAC_HANDLER_SUCCESS ) && ( Debug == true ) )
+    {
+        if( DebugDeferred == true )
+        {
+            LORAWAN_LOG( "Class: %c refused\n", "ABC"[RequestedClass] );
+        }
+        else
+        {
+            printf( "\n###### ===== CLASS %c REFUSED ==== ######\n\n", "ABC"[RequestedClass] );
+        }
+    }
+}
+
+/*!
+ * Adapts the resynchronization interval to the error the drift compensated
+ * clock built up since the previous answer: longer while it stays within
+ * TimeSyncMaxErrorMs, shorter when it did not, at most doubling or halving
+ */
+static void TimeSyncUpdate( bool isSynchronized, int32_t timeCorrection )
+{
+    static uint32_t lastSyncs = 0;
+    struct lorawan_time_stats stats;
+
+    TimeRequestPending = false;
+
+    lorawan_get_time_stats( &stats );
+
+    // answers without a clock step, e.g. AppTimeAns with no correction
+    if( stats.syncs != lastSyncs )
+    {
+        uint32_t error = ( stats.last_correction_ms < 0 ) ? -stats.last_correction_ms : stats.last_correction_ms;
+
+        if( ( lastSyncs == 0 ) || ( error > TimeSyncMaxErrorMs ) )
+        {
+            TimeSyncIntervalMs /= 2;
+        }
+        else if( error < ( TimeSyncMaxErrorMs / 2 ) )
+        {
+            TimeSyncIntervalMs *= 2;
+        }
+
+        if( TimeSyncIntervalMs < LORAWAN_TIME_SYNC_MIN_INTERVAL_MS )
+        {
+            TimeSyncIntervalMs = LORAWAN_TIME_SYNC_MIN_INTERVAL_MS;
+        }
+        else if( TimeSyncIntervalMs > LORAWAN_TIME_SYNC_MAX_INTERVAL_MS )
+        {
+            TimeSyncIntervalMs = LORAWAN_TIME_SYNC_MAX_INTERVAL_MS;
+        }
+
+        lastSyncs = stats.syncs;
+    }
+
+    if (Debug) {
+        if (DebugDeferred) {
+            LORAWAN_LOG("Time: sync %u, correction %d ms (%d s), drift %d ppb, next in %u s\n",
+                        stats.syncs, stats.last_correction_ms, timeCorrection, stats.drift_ppb,
+                        TimeSyncIntervalMs / 1000);
+        } else {
+            printf("\n###### ===== TIME SYNC %s ==== ######\n", isSynchronized ? "OK" : "PENDING");
+            printf("Correction  : %d ms\n", (int)stats.last_correction_ms);
+            printf("Drift       : %d ppb\n\n", (int)stats.drift_ppb);
+        }
+    }
+}
+
 static void OnMacProcessNotify( void )
 {
     IsMacProcessPending = 1;
+
+    lorawan_scheduler_notify_mac();
 }
 
 static void OnNvmDataChange( LmHandlerNvmContextStates_t state, uint16_t size )
 {
     if (Debug) {
-        DisplayNvmDataChange( state, size );
+        if (DebugDeferred) {
+            LORAWAN_LOG("NVM: %s %u bytes\n", LORAWAN_LOG_STR((state == LORAMAC_HANDLER_NVM_STORE) ? "stored" : "restored"), size);
+        } else {
+            DisplayNvmDataChange( state, size );
+        }
     }
 
     EepromMcuFlush();
@@ -556,24 +1119,89 @@ static void OnNetworkParametersChange( CommissioningParams_t* params )
     }
 }
 
+// Counts the rejected request and the part of its wait not counted yet,
+// so retrying while blocked does not add the same wait again
+static void StatsDutyCycleBlocked( TimerTime_t nextTxIn )
+{
+    uint32_t now = to_ms_since_boot(get_absolute_time());
+    uint32_t end = now + nextTxIn;
+    int32_t counted = (int32_t)(StatsDutyCycleEndMs - now);
+
+    Stats.duty_cycle_blocked++;
+
+    if ((int32_t)(end - StatsDutyCycleEndMs) > 0) {
+        Stats.duty_cycle_wait_ms += (counted > 0) ? nextTxIn - counted : nextTxIn;
+        StatsDutyCycleEndMs = end;
+    }
+}
+
+// Charges the time on air of the frames sent since the last call, the
+// join requests or an uplink with its retransmissions, to the datarate
+// the MAC reports for them
+static void StatsChargeTimeOnAir( int8_t datarate )
+{
+    uint64_t airTimeMs = SX1276BoardGetTxAirTimeMs();
+
+    if (datarate >= 0 && datarate < LORAWAN_STATS_DATARATES) {
+        Stats.time_on_air_ms[datarate] += airTimeMs - StatsTxAirTimeMs;
+    }
+    StatsTxAirTimeMs = airTimeMs;
+}
+
 static void OnMacMcpsRequest( LoRaMacStatus_t status, McpsReq_t *mcpsReq, TimerTime_t nextTxIn )
 {
+    if (status == LORAMAC_STATUS_OK) {
+        Stats.uplinks++;
+    } else {
+        Stats.uplink_failures++;
+
+        if (status == LORAMAC_STATUS_DUTYCYCLE_RESTRICTED) {
+            StatsDutyCycleBlocked( nextTxIn );
+        }
+    }
+
     if (Debug) {
-        DisplayMacMcpsRequestUpdate( status, mcpsReq, nextTxIn );
+        if (DebugDeferred) {
+            LORAWAN_LOG("MCPS-Request: type %u status %u next TX in %u ms\n", mcpsReq->Type, status, nextTxIn);
+        } else {
+            DisplayMacMcpsRequestUpdate( status, mcpsReq, nextTxIn );
+        }
     }
 }
 
 static void OnMacMlmeRequest( LoRaMacStatus_t status, MlmeReq_t *mlmeReq, TimerTime_t nextTxIn )
 {
+    if (mlmeReq->Type == MLME_JOIN) {
+        Stats.join_attempts++;
+
+        if (status == LORAMAC_STATUS_DUTYCYCLE_RESTRICTED) {
+            StatsDutyCycleBlocked( nextTxIn );
+        }
+    }
+
     if (Debug) {
-        DisplayMacMlmeRequestUpdate( status, mlmeReq, nextTxIn );
+        if (DebugDeferred) {
+            LORAWAN_LOG("MLME-Request: type %u status %u next TX in %u ms\n", mlmeReq->Type, status, nextTxIn);
+        } else {
+            DisplayMacMlmeRequestUpdate( status, mlmeReq, nextTxIn );
+        }
     }
 }
 
 static void OnJoinRequest( LmHandlerJoinParams_t* params )
 {
     if (Debug) {
-        DisplayJoinRequestUpdate( params );
+        if (DebugDeferred) {
+            LORAWAN_LOG("Join: status %d DR %d\n", params->Status, params->Datarate);
+        } else {
+            DisplayJoinRequestUpdate( params );
+        }
+    }
+
+    StatsChargeTimeOnAir( params->Datarate );
+
+    if (params->Status == LORAMAC_HANDLER_ERROR) {
+        Stats.join_failures++;
     }
 
     if( params->Status == LORAMAC_HANDLER_ERROR )
@@ -582,42 +1210,106 @@ static void OnJoinRequest( LmHandlerJoinParams_t* params )
     }
     else
     {
-        LmHandlerRequestClass( LORAWAN_DEFAULT_CLASS );
+        // requested from lorawan_process() once the MAC is idle
+        ClassChangePending = true;
     }
 }
 
 static void OnTxData( LmHandlerTxParams_t* params )
 {
+    StatsChargeTimeOnAir( params->Datarate );
+
+    Stats.last_tx_datarate = params->Datarate;
+    Stats.last_tx_power = params->TxPower;
+
+    if (params->Status != LORAMAC_EVENT_INFO_STATUS_OK) {
+        Stats.uplink_failures++;
+    } else if (params->MsgType == LORAMAC_HANDLER_CONFIRMED_MSG && !params->AckReceived) {
+        Stats.uplinks_unacked++;
+    }
+
     if (Debug) {
-        DisplayTxUpdate( params );
+        if (DebugDeferred) {
+            LORAWAN_LOG("TX: status %u confirmed %u ack %u DR %d power %d channel %u fcnt %u port %u\n",
+                        params->Status, params->MsgType, params->AckReceived, params->Datarate,
+                        params->TxPower, params->Channel, params->UplinkCounter, params->AppData.Port);
+        } else {
+            DisplayTxUpdate( params );
+        }
     }
 }
 
 static void OnRxData( LmHandlerAppData_t* appData, LmHandlerRxParams_t* params )
 {
     if (Debug) {
-        DisplayRxUpdate( appData, params );
+        if (DebugDeferred) {
+            LORAWAN_LOG("RX: status %u DR %d RSSI %d SNR %d slot %d fcnt %u port %u size %u\n",
+                        params->Status, params->Datarate, params->Rssi, params->Snr,
+                        params->RxSlot, params->DownlinkCounter, appData->Port, appData->BufferSize);
+        } else {
+            DisplayRxUpdate( appData, params );
+        }
+    }
+
+    Stats.downlinks++;
+    Stats.last_rssi = params->Rssi;
+    Stats.last_snr = params->Snr;
+
+    // exponential moving average with a weight of 1/8, seeded by the first sample
+    if (Stats.history_count == 0) {
+        Stats.rssi_avg_x16 = params->Rssi * 16;
+        Stats.snr_avg_x16 = params->Snr * 16;
+    } else {
+        Stats.rssi_avg_x16 += (params->Rssi * 16 - Stats.rssi_avg_x16) / 8;
+        Stats.snr_avg_x16 += (params->Snr * 16 - Stats.snr_avg_x16) / 8;
+    }
+
+    Stats.rssi_history[Stats.history_head] = params->Rssi;
+    Stats.snr_history[Stats.history_head] = params->Snr;
+    Stats.history_head = (Stats.history_head + 1) % LORAWAN_STATS_HISTORY_SIZE;
+    if (Stats.history_count < LORAWAN_STATS_HISTORY_SIZE) {
+        Stats.history_count++;
     }
 
     memcpy(AppRxData.Buffer, appData->Buffer, appData->BufferSize);
     AppRxData.BufferSize = appData->BufferSize;
     AppRxData.Port = appData->Port;
+
+    if (AppRxData.Port != 0) {
+        lorawan_scheduler_notify_rx();
+    }
 }
 
 static void OnClassChange( DeviceClass_t deviceClass )
 {
     if (Debug) {
-        DisplayClassUpdate( deviceClass );
+        if (DebugDeferred) {
+            LORAWAN_LOG("Class: %c\n", "ABC"[deviceClass]);
+        } else {
+            DisplayClassUpdate( deviceClass );
+        }
     }
 
+    // A multicast session of the remote multicast setup package ends in
+    // Class A, return to Class C if the application runs in it
+    if( ( deviceClass == CLASS_A ) && ( RequestedClass == CLASS_C ) )
+    {
+        ClassChangePending = true;
+    }
+
+    // Class A and C need no uplink, the network server knows the class from
+    // the device profile and a Class C device listens on RX2 right away.
     // Inform the server as soon as possible that the end-device has switched to ClassB
-    LmHandlerAppData_t appData =
+    if( deviceClass == CLASS_B )
     {
-        .Buffer = NULL,
-        .BufferSize = 0,
-        .Port = 0,
-    };
-    LmHandlerSend( &appData, LORAMAC_HANDLER_UNCONFIRMED_MSG );
+        LmHandlerAppData_t appData =
+        {
+            .Buffer = NULL,
+            .BufferSize = 0,
+            .Port = 0,
+        };
+        LmHandlerSend( &appData, LORAMAC_HANDLER_UNCONFIRMED_MSG );
+    }
 }
 
 static void OnBeaconStatusChange( LoRaMacHandlerBeaconParams_t* params )
@@ -640,19 +1332,23 @@ static void OnBeaconStatusChange( LoRaMacHandlerBeaconParams_t* params )
     }
 
     if (Debug) {
-        DisplayBeaconUpdate( params );
+        if (DebugDeferred) {
+            LORAWAN_LOG("Beacon: state %u\n", params->State);
+        } else {
+            DisplayBeaconUpdate( params );
+        }
     }
 }
 
 #if( LMH_SYS_TIME_UPDATE_NEW_API == 1 )
 static void OnSysTimeUpdate( bool isSynchronized, int32_t timeCorrection )
 {
-
+    TimeSyncUpdate( isSynchronized, timeCorrection );
 }
 #else
 static void OnSysTimeUpdate( void )
 {
-
+    TimeSyncUpdate( true, 0 );
 }
 #endif
 
@@ -0,0 +1,719 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "pico/lorawan_fuota.h"
+#include "pico/lorawan_fuota_ed25519.h"
+#include "pico/lorawan_profile.h"
+#include "pico/lorawan_scheduler.h"
+#include "pico/multicore.h"
+
+#include "hardware/flash.h"
+#include "hardware/regs/addressmap.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+#include "hardware/watchdog.h"
+#include "hardware/structs/watchdog.h"
+
+#include "LmHandler.h"
+#include "LmhpRemoteMcastSetup.h"
+#include "LmhpFragmentation.h"
+#include "FragDecoder.h"
+
+#if (FRAG_DECODER_FILE_HANDLING_NEW_API != 1)
+#error "PICO_LORAWAN_FUOTA needs the FragDecoder file handling callbacks"
+#endif
+
+#if defined(PICO_LORAWAN_FUOTA_SLOT_SIZE) && (PICO_LORAWAN_FUOTA_SLOT_SIZE != LORAWAN_FUOTA_SLOT_SIZE)
+#error "PICO_LORAWAN_FUOTA_FLASH_SIZE does not match PICO_FLASH_SIZE_BYTES, the application is linked for another slot"
+#endif
+
+// Fragments the decoder writes a second time: the missing ones, first with
+// a combination of redundant fragments, then with the solved data. The
+// journal holds the second writes, the end of the staging slot is reserved
+// for it.
+#define JOURNAL_ENTRIES     FRAG_MAX_REDUNDANCY
+#define JOURNAL_SIZE        ((JOURNAL_ENTRIES * FRAG_MAX_SIZE + FLASH_SECTOR_SIZE - 1) & ~(FLASH_SECTOR_SIZE - 1))
+#define JOURNAL_OFFSET      (LORAWAN_FUOTA_STAGING_OFFSET + LORAWAN_FUOTA_SLOT_SIZE - JOURNAL_SIZE)
+#define FILE_MAX_SIZE       (LORAWAN_FUOTA_SLOT_SIZE - JOURNAL_SIZE)
+
+#define STAGING             ((const uint8_t*)(XIP_BASE + LORAWAN_FUOTA_STAGING_OFFSET))
+#define JOURNAL             ((const uint8_t*)(XIP_BASE + JOURNAL_OFFSET))
+
+// SHA-512 bytes of the signature check per process step, a few ms
+#define VERIFY_STEP_SIZE    (8 * 1024)
+
+// staging sectors checked for the background erase per process step
+#define ERASE_CHECK_SECTORS 16
+
+enum verify_phase {
+    VERIFY_HEADER,
+    VERIFY_HASH,
+    VERIFY_SIGNATURE,
+    VERIFY_MOVE,
+};
+
+// linker script symbols, see cmake/pico_lorawan_fuota.cmake
+extern char __flash_binary_start;
+extern char __flash_binary_end;
+
+static bool initialized = false;
+static uint8_t public_key[LORAWAN_FUOTA_KEY_SIZE];
+static struct lorawan_fuota_stats stats;
+
+// bootloader state as of this boot, confirm and apply write on from it
+static struct lorawan_fuota_record boot_record;
+static uint64_t boot_us;
+
+// fragment store of the session
+static bool clearing = false;           // FragDecoderInit() is setting the file to 0xff
+static uint32_t cleared_end = 0;        // file bytes known erased while clearing
+static uint8_t fragment_size = 0;
+static uint32_t journal_addr[JOURNAL_ENTRIES];
+static uint32_t journal_count = 0;
+static uint8_t journaled[(FRAG_MAX_NB + 7) / 8];
+static bool store_error = false;
+
+// check and move of a complete file
+static enum verify_phase verify_phase;
+static uint32_t verify_offset;
+static struct lorawan_fuota_ed25519 verify_signature;
+static uint32_t staged_size;
+static uint32_t staged_version;
+static uint32_t staged_crc;
+
+// next staging sector of the background erase, LORAWAN_FUOTA_SLOT_SECTORS when done
+static uint32_t erase_sector = LORAWAN_FUOTA_SLOT_SECTORS;
+
+static uint8_t sector_buffer[FLASH_SECTOR_SIZE];
+
+static int8_t fragment_write(uint32_t addr, uint8_t* data, uint32_t size);
+static int8_t fragment_read(uint32_t addr, uint8_t* data, uint32_t size);
+static void on_fragment_progress(uint16_t fragCounter, uint16_t fragNb, uint8_t fragSize, uint16_t fragNbLost);
+static void on_fragment_done(int32_t status, uint32_t size);
+
+static LmhpFragmentationParams_t fragmentation_params = {
+    .DecoderCallbacks = {
+        .FragDecoderWrite = fragment_write,
+        .FragDecoderRead = fragment_read,
+    },
+    .OnProgress = on_fragment_progress,
+    .OnDone = on_fragment_done,
+};
+
+static void fuota_task_fn(void* context)
+{
+    // continue right after the other ready tasks while there is work
+    if (lorawan_fuota_process()) {
+        lorawan_task_signal(context);
+    }
+}
+
+static struct lorawan_task fuota_task = {
+    .name = "fuota",
+    .fn = fuota_task_fn,
+    .context = &fuota_task,
+    .priority = LORAWAN_FUOTA_TASK_PRIORITY,
+    .period_us = 1000000,
+};
+
+void lorawan_fuota_flash_erase(uint32_t offset)
+{
+    LORAWAN_PROFILE_SCOPE(LORAWAN_PROFILE_FLASH);
+
+    // the SD log writer on core 1 runs from flash too, see EepromMcuFlush()
+    bool lockout = multicore_lockout_victim_is_initialized(1);
+
+    if (lockout) {
+        multicore_lockout_start_blocking();
+    }
+
+    uint32_t interrupts = save_and_disable_interrupts();
+
+    flash_range_erase(offset, FLASH_SECTOR_SIZE);
+
+    restore_interrupts(interrupts);
+
+    if (lockout) {
+        multicore_lockout_end_blocking();
+    }
+
+    stats.flash_erases++;
+}
+
+void lorawan_fuota_flash_program(uint32_t offset, const uint8_t* data, uint32_t length)
+{
+    LORAWAN_PROFILE_SCOPE(LORAWAN_PROFILE_FLASH);
+
+    bool lockout = multicore_lockout_victim_is_initialized(1);
+
+    if (lockout) {
+        multicore_lockout_start_blocking();
+    }
+
+    uint32_t interrupts = save_and_disable_interrupts();
+
+    flash_range_program(offset, data, length);
+
+    restore_interrupts(interrupts);
+
+    if (lockout) {
+        multicore_lockout_end_blocking();
+    }
+
+    stats.flash_programs += length / FLASH_PAGE_SIZE;
+}
+
+static bool blank(const uint8_t* p, uint32_t length)
+{
+    while (length--) {
+        if (*p++ != 0xff) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Programs bytes into erased flash, the rest of the pages is left as it is
+static void program_bytes(uint32_t offset, const uint8_t* data, uint32_t length)
+{
+    static uint8_t page[FLASH_PAGE_SIZE];
+
+    while (length > 0) {
+        uint32_t in_page = offset % FLASH_PAGE_SIZE;
+        uint32_t count = FLASH_PAGE_SIZE - in_page;
+
+        if (count > length) {
+            count = length;
+        }
+
+        memset(page, 0xff, sizeof(page));
+        memcpy(page + in_page, data, count);
+
+        lorawan_fuota_flash_program(offset - in_page, page, FLASH_PAGE_SIZE);
+
+        offset += count;
+        data += count;
+        length -= count;
+    }
+}
+
+static void erase_if_needed(uint32_t offset)
+{
+    if (!blank((const uint8_t*)(XIP_BASE + offset), FLASH_SECTOR_SIZE)) {
+        lorawan_fuota_flash_erase(offset);
+    }
+}
+
+static void session_start(bool clear)
+{
+    clearing = clear;
+    cleared_end = 0;
+    fragment_size = 0;
+    journal_count = 0;
+    memset(journaled, 0, sizeof(journaled));
+    store_error = false;
+
+    // normally erased in the background already
+    for (uint32_t offset = 0; offset < JOURNAL_SIZE; offset += FLASH_SECTOR_SIZE) {
+        erase_if_needed(JOURNAL_OFFSET + offset);
+    }
+
+    stats.status = LORAWAN_FUOTA_RECEIVING;
+    stats.fragments = 0;
+    stats.fragments_received = 0;
+    stats.fragments_lost = 0;
+    stats.fragment_size = 0;
+    stats.file_size = 0;
+    stats.image_version = 0;
+    stats.journal_writes = 0;
+    stats.sessions++;
+}
+
+static int8_t store_write(uint32_t addr, const uint8_t* data, uint32_t size)
+{
+    if (size == 0 || addr + size > FILE_MAX_SIZE) {
+        return -1;
+    }
+
+    // the staging slot holds the image to roll back to
+    if (stats.testing) {
+        return -1;
+    }
+
+    // FragDecoderInit() starts a session by setting the file to 0xff, one
+    // byte at a time from address 0: erase what is not erased yet
+    if (size == 1 && data[0] == 0xff && (addr == 0 || clearing)) {
+        if (addr == 0) {
+            session_start(true);
+        }
+
+        if (addr >= cleared_end) {
+            uint32_t sector = addr / FLASH_SECTOR_SIZE;
+
+            erase_if_needed(LORAWAN_FUOTA_STAGING_OFFSET + sector * FLASH_SECTOR_SIZE);
+            cleared_end = (sector + 1) * FLASH_SECTOR_SIZE;
+        }
+
+        return 0;
+    }
+
+    if (stats.status != LORAWAN_FUOTA_RECEIVING) {
+        session_start(false);
+    }
+
+    clearing = false;
+
+    // the decoder writes whole fragments
+    if (fragment_size == 0) {
+        fragment_size = size;
+    }
+
+    uint32_t index = addr / fragment_size;
+
+    if (size != fragment_size || (addr % fragment_size) != 0 || index >= FRAG_MAX_NB) {
+        return -1;
+    }
+
+    bool rewrite = (journaled[index / 8] & (1 << (index % 8))) != 0;
+
+    if (!rewrite) {
+        const uint8_t* flash = STAGING + addr;
+
+        if (memcmp(flash, data, size) == 0) {
+            return 0;
+        }
+
+        if (blank(flash, size)) {
+            program_bytes(LORAWAN_FUOTA_STAGING_OFFSET + addr, data, size);
+            return 0;
+        }
+    }
+
+    if (journal_count == JOURNAL_ENTRIES) {
+        return -1;
+    }
+
+    program_bytes(JOURNAL_OFFSET + journal_count * FRAG_MAX_SIZE, data, size);
+
+    journal_addr[journal_count++] = addr;
+    journaled[index / 8] |= 1 << (index % 8);
+    stats.journal_writes++;
+
+    return 0;
+}
+
+static int8_t fragment_write(uint32_t addr, uint8_t* data, uint32_t size)
+{
+    LORAWAN_PROFILE_SCOPE(LORAWAN_PROFILE_FUOTA);
+
+    uint32_t start_us = time_us_32();
+    int8_t result = store_write(addr, data, size);
+    uint32_t elapsed_us = time_us_32() - start_us;
+
+    if (elapsed_us > stats.max_write_us) {
+        stats.max_write_us = elapsed_us;
+    }
+
+    if (result < 0) {
+        store_error = true;
+    }
+
+    return result;
+}
+
+static int8_t fragment_read(uint32_t addr, uint8_t* data, uint32_t size)
+{
+    if (addr + size > FILE_MAX_SIZE) {
+        return -1;
+    }
+
+    memcpy(data, STAGING + addr, size);
+
+    if (journal_count == 0) {
+        return 0;
+    }
+
+    // overlay the newest journal entry of every rewritten fragment in range
+    for (uint32_t index = addr / fragment_size; index * fragment_size < addr + size; index++) {
+        if ((journaled[index / 8] & (1 << (index % 8))) == 0) {
+            continue;
+        }
+
+        uint32_t fragment_addr = index * fragment_size;
+        uint32_t entry = journal_count;
+
+        while (journal_addr[--entry] != fragment_addr) {
+        }
+
+        uint32_t from = (fragment_addr > addr) ? fragment_addr : addr;
+        uint32_t to = fragment_addr + fragment_size;
+
+        if (to > addr + size) {
+            to = addr + size;
+        }
+
+        memcpy(data + (from - addr), JOURNAL + entry * FRAG_MAX_SIZE + (from - fragment_addr), to - from);
+    }
+
+    return 0;
+}
+
+static void on_fragment_progress(uint16_t fragCounter, uint16_t fragNb, uint8_t fragSize, uint16_t fragNbLost)
+{
+    if (stats.status != LORAWAN_FUOTA_RECEIVING) {
+        return;
+    }
+
+    stats.fragments_received = fragCounter;
+    stats.fragments = fragNb;
+    stats.fragment_size = fragSize;
+    stats.fragments_lost = fragNbLost;
+}
+
+static void session_failed()
+{
+    stats.status = LORAWAN_FUOTA_FAILED;
+    stats.failures++;
+
+    // make room for the next session
+    erase_sector = 0;
+}
+
+static void on_fragment_done(int32_t status, uint32_t size)
+{
+    if (status != FRAG_SESSION_FINISHED || store_error || size > FILE_MAX_SIZE) {
+        session_failed();
+        return;
+    }
+
+    stats.status = LORAWAN_FUOTA_VERIFYING;
+    stats.file_size = size;
+
+    verify_phase = VERIFY_HEADER;
+    verify_offset = 0;
+}
+
+static uint32_t load_le32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint32_t sectors_of(uint32_t size)
+{
+    return (size + FLASH_SECTOR_SIZE - 1) / FLASH_SECTOR_SIZE;
+}
+
+// One step of checking a complete file and moving its image to the start
+// of the staging slot, returns true when there is more to do
+static bool verify_step()
+{
+    LORAWAN_PROFILE_SCOPE(LORAWAN_PROFILE_FUOTA);
+
+    switch (verify_phase) {
+        case VERIFY_HEADER: {
+            uint8_t header[LORAWAN_FUOTA_FILE_HEADER_SIZE];
+
+            fragment_read(0, header, sizeof(header));
+
+            staged_size = load_le32(header + 8);
+
+            if (load_le32(header) != LORAWAN_FUOTA_FILE_MAGIC || header[4] != LORAWAN_FUOTA_FILE_VERSION ||
+                staged_size == 0 || LORAWAN_FUOTA_FILE_HEADER_SIZE + staged_size > stats.file_size) {
+                session_failed();
+                return false;
+            }
+
+            staged_version = load_le32(header + 12);
+
+            // signed are bytes 0 to 15 and the image
+            if (lorawan_fuota_ed25519_start(&verify_signature, public_key, header + 16) < 0) {
+                session_failed();
+                return false;
+            }
+
+            lorawan_fuota_ed25519_update(&verify_signature, header, 16);
+
+            verify_phase = VERIFY_HASH;
+            verify_offset = 0;
+            return true;
+        }
+
+        case VERIFY_HASH: {
+            uint32_t end = verify_offset + VERIFY_STEP_SIZE;
+
+            if (end > staged_size) {
+                end = staged_size;
+            }
+
+            while (verify_offset < end) {
+                uint32_t count = end - verify_offset;
+
+                if (count > sizeof(sector_buffer)) {
+                    count = sizeof(sector_buffer);
+                }
+
+                fragment_read(LORAWAN_FUOTA_FILE_HEADER_SIZE + verify_offset, sector_buffer, count);
+                lorawan_fuota_ed25519_update(&verify_signature, sector_buffer, count);
+                verify_offset += count;
+            }
+
+            if (verify_offset == staged_size) {
+                verify_phase = VERIFY_SIGNATURE;
+            }
+
+            return true;
+        }
+
+        case VERIFY_SIGNATURE: {
+            int result = lorawan_fuota_ed25519_step(&verify_signature);
+
+            if (result > 0) {
+                return true;
+            } else if (result < 0) {
+                session_failed();
+                return false;
+            }
+
+            verify_phase = VERIFY_MOVE;
+            verify_offset = 0;
+            staged_crc = 0;
+            return true;
+        }
+
+        case VERIFY_MOVE: {
+            // the flash is stalled for a sector erase, not while the MAC
+            // waits for an RX window
+            if (LmHandlerIsBusy()) {
+                return true;
+            }
+
+            uint32_t count = staged_size - verify_offset;
+
+            if (count > sizeof(sector_buffer)) {
+                count = sizeof(sector_buffer);
+            }
+
+            // reads ahead of what is overwritten, the header moves out
+            memset(sector_buffer, 0xff, sizeof(sector_buffer));
+            fragment_read(LORAWAN_FUOTA_FILE_HEADER_SIZE + verify_offset, sector_buffer, count);
+            staged_crc = lorawan_fuota_crc32(staged_crc, sector_buffer, count);
+
+            lorawan_fuota_flash_erase(LORAWAN_FUOTA_STAGING_OFFSET + verify_offset);
+            lorawan_fuota_flash_program(LORAWAN_FUOTA_STAGING_OFFSET + verify_offset, sector_buffer,
+                                        (count + FLASH_PAGE_SIZE - 1) & ~(FLASH_PAGE_SIZE - 1));
+
+            if (memcmp(STAGING + verify_offset, sector_buffer, count) != 0) {
+                session_failed();
+                return false;
+            }
+
+            verify_offset += FLASH_SECTOR_SIZE;
+
+            if (verify_offset < staged_size) {
+                return true;
+            }
+
+            stats.image_version = staged_version;
+            stats.status = LORAWAN_FUOTA_READY;
+            return false;
+        }
+    }
+
+    return false;
+}
+
+// Erases the next sector of the staging slot that is not erased yet,
+// returns true when there is more to do
+static bool erase_step()
+{
+    if (LmHandlerIsBusy()) {
+        return true;
+    }
+
+    for (uint32_t checked = 0; checked < ERASE_CHECK_SECTORS && erase_sector < LORAWAN_FUOTA_SLOT_SECTORS; checked++) {
+        uint32_t offset = LORAWAN_FUOTA_STAGING_OFFSET + erase_sector * FLASH_SECTOR_SIZE;
+
+        erase_sector++;
+
+        if (!blank((const uint8_t*)(XIP_BASE + offset), FLASH_SECTOR_SIZE)) {
+            LORAWAN_PROFILE_SCOPE(LORAWAN_PROFILE_FUOTA);
+
+            lorawan_fuota_flash_erase(offset);
+            break;
+        }
+    }
+
+    return erase_sector < LORAWAN_FUOTA_SLOT_SECTORS;
+}
+
+void lorawan_fuota_feed_watchdog()
+{
+    // an image that never gets to confirm, also one that never joins, is
+    // left to the watchdog once its time is up
+    if (stats.testing && !lorawan_fuota_confirm_expired(boot_us, time_us_64())) {
+        watchdog_update();
+    }
+}
+
+int lorawan_fuota_init(const char* key)
+{
+    if (strlen(key) != 2 * LORAWAN_FUOTA_KEY_SIZE || strspn(key, "0123456789abcdefABCDEF") != strlen(key)) {
+        return -1;
+    }
+
+    // the bootloader starts applications at the slot only
+    if ((uint32_t)&__flash_binary_start != XIP_BASE + LORAWAN_FUOTA_APP_OFFSET) {
+        return -1;
+    }
+
+    for (int i = 0; i < LORAWAN_FUOTA_KEY_SIZE; i++) {
+        unsigned int b;
+
+        sscanf(key + i * 2, "%2x", &b);
+        public_key[i] = b;
+    }
+
+    boot_us = time_us_64();
+
+    lorawan_fuota_state_read(&boot_record);
+
+    stats.testing = (boot_record.state == LORAWAN_FUOTA_BOOT_TESTING);
+    stats.boots = boot_record.boots;
+    stats.last_result = boot_record.result;
+
+    if (stats.testing || boot_record.result == LORAWAN_FUOTA_RESULT_INSTALLED) {
+        stats.running_version = boot_record.image_version;
+    } else if (boot_record.result == LORAWAN_FUOTA_RESULT_ROLLED_BACK) {
+        stats.running_version = boot_record.previous_version;
+    }
+
+    if (stats.testing) {
+        watchdog_update();
+    } else {
+        // left over from a swap or an interrupted session
+        erase_sector = 0;
+    }
+
+    if (LmHandlerPackageRegister(PACKAGE_ID_REMOTE_MCAST_SETUP, NULL) != LORAMAC_HANDLER_SUCCESS ||
+        LmHandlerPackageRegister(PACKAGE_ID_FRAGMENTATION, &fragmentation_params) != LORAMAC_HANDLER_SUCCESS) {
+        return -1;
+    }
+
+    lorawan_scheduler_add(&fuota_task);
+
+    initialized = true;
+
+    return 0;
+}
+
+int lorawan_fuota_process()
+{
+    if (!initialized) {
+        return 0;
+    }
+
+    if (stats.testing) {
+        lorawan_fuota_feed_watchdog();
+
+        // running, but never got to confirm: counts as a failed boot
+        if (lorawan_fuota_confirm_expired(boot_us, time_us_64())) {
+            watchdog_reboot(0, 0, 10);
+        }
+
+        return 0;
+    }
+
+    switch (stats.status) {
+        case LORAWAN_FUOTA_VERIFYING:
+            return verify_step();
+
+        case LORAWAN_FUOTA_IDLE:
+        case LORAWAN_FUOTA_FAILED:
+            return (erase_sector < LORAWAN_FUOTA_SLOT_SECTORS) ? erase_step() : 0;
+
+        default:
+            return 0;
+    }
+}
+
+int lorawan_fuota_ready()
+{
+    return stats.status == LORAWAN_FUOTA_READY;
+}
+
+int lorawan_fuota_apply()
+{
+    if (stats.status != LORAWAN_FUOTA_READY) {
+        return -1;
+    }
+
+    struct lorawan_fuota_record record = boot_record;
+    uint32_t running_size = (uint32_t)(&__flash_binary_end - &__flash_binary_start);
+    uint32_t sectors = sectors_of(staged_size);
+
+    if (sectors_of(running_size) > sectors) {
+        sectors = sectors_of(running_size);
+    }
+
+    record.state = LORAWAN_FUOTA_BOOT_INSTALL;
+    record.result = LORAWAN_FUOTA_RESULT_NONE;
+    record.step = LORAWAN_FUOTA_STEP_NONE;
+    record.boots = 0;
+    record.sector = 0;
+    record.sectors = sectors;
+    record.image_size = staged_size;
+    record.image_crc = staged_crc;
+    record.image_version = stats.image_version;
+    record.previous_size = running_size;
+    record.previous_crc = lorawan_fuota_crc32(0, &__flash_binary_start, running_size);
+    record.previous_version = stats.running_version;
+
+    lorawan_fuota_state_write(&record);
+
+    watchdog_reboot(0, 0, 10);
+
+    while (1) {
+        tight_loop_contents();
+    }
+}
+
+int lorawan_fuota_confirm()
+{
+    if (!stats.testing) {
+        return 0;
+    }
+
+    struct lorawan_fuota_record record = boot_record;
+
+    record.state = LORAWAN_FUOTA_BOOT_NONE;
+    record.result = LORAWAN_FUOTA_RESULT_INSTALLED;
+    record.boots = 0;
+
+    lorawan_fuota_state_write(&record);
+
+    boot_record = record;
+    stats.testing = false;
+    stats.last_result = LORAWAN_FUOTA_RESULT_INSTALLED;
+
+    hw_clear_bits(&watchdog_hw->ctrl, WATCHDOG_CTRL_ENABLE_BITS);
+
+    // the previous image is not needed any more
+    erase_sector = 0;
+
+    return 0;
+}
+
+int lorawan_fuota_get_stats(struct lorawan_fuota_stats* stats_out)
+{
+    *stats_out = stats;
+
+    return 0;
+}
@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "pico/lorawan_fuota_boot.h"
+
+#include "hardware/regs/addressmap.h"
+
+_Static_assert(sizeof(struct lorawan_fuota_record) == LORAWAN_FUOTA_RECORD_SIZE, "state record size");
+_Static_assert((FLASH_PAGE_SIZE % LORAWAN_FUOTA_RECORD_SIZE) == 0, "state records straddle flash pages");
+
+#define RECORDS_PER_SECTOR  (FLASH_SECTOR_SIZE / LORAWAN_FUOTA_RECORD_SIZE)
+#define RECORDS             (LORAWAN_FUOTA_STATE_SECTORS * RECORDS_PER_SECTOR)
+
+// slot and sequence number of the newest record, RECORDS before the log
+// was read
+static uint32_t state_slot = RECORDS;
+static uint32_t state_sequence = 0;
+
+uint32_t lorawan_fuota_crc32(uint32_t crc, const void* data, uint32_t length)
+{
+    // a nibble at a time, small enough for the bootloader
+    static const uint32_t table[16] = {
+        0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+        0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+    };
+    const uint8_t* p = (const uint8_t*)data;
+
+    crc = ~crc;
+
+    while (length--) {
+        crc ^= *p++;
+        crc = (crc >> 4) ^ table[crc & 0x0f];
+        crc = (crc >> 4) ^ table[crc & 0x0f];
+    }
+
+    return ~crc;
+}
+
+static const struct lorawan_fuota_record* record_address(uint32_t slot)
+{
+    return (const struct lorawan_fuota_record*)(XIP_BASE + LORAWAN_FUOTA_STATE_OFFSET + slot * LORAWAN_FUOTA_RECORD_SIZE);
+}
+
+static bool record_valid(const struct lorawan_fuota_record* record)
+{
+    return record->magic == LORAWAN_FUOTA_RECORD_MAGIC &&
+           record->crc == lorawan_fuota_crc32(0, record, offsetof(struct lorawan_fuota_record, crc));
+}
+
+static bool record_blank(uint32_t slot)
+{
+    const uint32_t* p = (const uint32_t*)record_address(slot);
+
+    for (uint32_t i = 0; i < LORAWAN_FUOTA_RECORD_SIZE / 4; i++) {
+        if (p[i] != 0xffffffff) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool lorawan_fuota_state_read(struct lorawan_fuota_record* record)
+{
+    bool found = false;
+
+    state_slot = RECORDS;
+    state_sequence = 0;
+
+    for (uint32_t slot = 0; slot < RECORDS; slot++) {
+        const struct lorawan_fuota_record* candidate = record_address(slot);
+
+        if (!record_valid(candidate)) {
+            continue;
+        }
+
+        if (!found || (int32_t)(candidate->sequence - record->sequence) > 0) {
+            *record = *candidate;
+            state_slot = slot;
+            state_sequence = candidate->sequence;
+            found = true;
+        }
+    }
+
+    if (!found) {
+        memset(record, 0, sizeof(*record));
+    }
+
+    return found;
+}
+
+void lorawan_fuota_state_write(struct lorawan_fuota_record* record)
+{
+    static uint8_t page[FLASH_PAGE_SIZE];
+
+    if (state_slot == RECORDS) {
+        struct lorawan_fuota_record newest;
+
+        lorawan_fuota_state_read(&newest);
+    }
+
+    // an empty log starts in the first sector
+    uint32_t slot = (state_slot == RECORDS) ? 0 : (state_slot + 1) % RECORDS;
+
+    // left over from an interrupted erase or older records, start over in
+    // the next sector, the current one keeps the newest record
+    if ((slot % RECORDS_PER_SECTOR) != 0 && !record_blank(slot)) {
+        slot = (slot / RECORDS_PER_SECTOR + 1) * RECORDS_PER_SECTOR % RECORDS;
+    }
+
+    if ((slot % RECORDS_PER_SECTOR) == 0) {
+        lorawan_fuota_flash_erase(LORAWAN_FUOTA_STATE_OFFSET + (slot / RECORDS_PER_SECTOR) * FLASH_SECTOR_SIZE);
+    }
+
+    record->magic = LORAWAN_FUOTA_RECORD_MAGIC;
+    record->sequence = ++state_sequence;
+    memset(record->reserved, 0, sizeof(record->reserved));
+    record->crc = lorawan_fuota_crc32(0, record, offsetof(struct lorawan_fuota_record, crc));
+
+    uint32_t offset = LORAWAN_FUOTA_STATE_OFFSET + slot * LORAWAN_FUOTA_RECORD_SIZE;
+    uint32_t in_page = offset % FLASH_PAGE_SIZE;
+
+    memset(page, 0xff, sizeof(page));
+    memcpy(page + in_page, record, sizeof(*record));
+
+    lorawan_fuota_flash_program(offset - in_page, page, FLASH_PAGE_SIZE);
+
+    state_slot = slot;
+}
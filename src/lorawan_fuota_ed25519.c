@@ -0,0 +1,575 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "pico/lorawan_fuota_ed25519.h"
+
+// Field elements mod 2^255 - 19 in 16 limbs of 16 bits, products in 64 bit
+// accumulators, after TweetNaCl
+
+typedef lorawan_fuota_gf gf;
+
+static const gf gf0 = { 0 };
+static const gf gf1 = { 1 };
+
+// -121665 / 121666, twice that, and sqrt(-1)
+static const gf ed_d2 = {
+    0xf159, 0x26b2, 0x9b94, 0xebd6, 0xb156, 0x8283, 0x149a, 0x00e0, 0xd130, 0xeef3, 0x80f2, 0x198e, 0xfce7, 0x56df, 0xd9dc, 0x2406
+};
+static const gf ed_d = {
+    0x78a3, 0x1359, 0x4dca, 0x75eb, 0xd8ab, 0x4141, 0x0a4d, 0x0070, 0xe898, 0x7779, 0x4079, 0x8cc7, 0xfe73, 0x2b6f, 0x6cee, 0x5203
+};
+static const gf sqrt_m1 = {
+    0xa0b0, 0x4a0e, 0x1b27, 0xc4ee, 0xe478, 0xad2f, 0x1806, 0x2f43, 0xd7a7, 0x3dfb, 0x0099, 0x2b4d, 0xdf0b, 0x4fc1, 0x2480, 0x2b83
+};
+
+// base point B, extended coordinates
+static const gf base[4] = {
+    { 0xd51a, 0x8f25, 0x2d60, 0xc956, 0xa7b2, 0x9525, 0xc760, 0x692c, 0xdc5c, 0xfdd6, 0xe231, 0xc0a4, 0x53fe, 0xcd6e, 0x36d3, 0x2169 },
+    { 0x6658, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666 },
+    { 1 },
+    { 0xdda3, 0xa5b7, 0x8ab3, 0x6dde, 0x52f5, 0x7751, 0x9f80, 0x20f0, 0xe37d, 0x64ab, 0x4e8e, 0x66ea, 0x7665, 0xd78b, 0x5f0f, 0x6787 },
+};
+
+// group order, little-endian
+static const uint8_t order[32] = {
+    0xed, 0xd3, 0xf5, 0x5c, 0x1a, 0x63, 0x12, 0x58, 0xd6, 0x9c, 0xf7, 0xa2, 0xde, 0xf9, 0xde, 0x14,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10
+};
+
+static const uint64_t sha512_k[80] = {
+    0x428a2f98d728ae22ull, 0x7137449123ef65cdull, 0xb5c0fbcfec4d3b2full, 0xe9b5dba58189dbbcull,
+    0x3956c25bf348b538ull, 0x59f111f1b605d019ull, 0x923f82a4af194f9bull, 0xab1c5ed5da6d8118ull,
+    0xd807aa98a3030242ull, 0x12835b0145706fbeull, 0x243185be4ee4b28cull, 0x550c7dc3d5ffb4e2ull,
+    0x72be5d74f27b896full, 0x80deb1fe3b1696b1ull, 0x9bdc06a725c71235ull, 0xc19bf174cf692694ull,
+    0xe49b69c19ef14ad2ull, 0xefbe4786384f25e3ull, 0x0fc19dc68b8cd5b5ull, 0x240ca1cc77ac9c65ull,
+    0x2de92c6f592b0275ull, 0x4a7484aa6ea6e483ull, 0x5cb0a9dcbd41fbd4ull, 0x76f988da831153b5ull,
+    0x983e5152ee66dfabull, 0xa831c66d2db43210ull, 0xb00327c898fb213full, 0xbf597fc7beef0ee4ull,
+    0xc6e00bf33da88fc2ull, 0xd5a79147930aa725ull, 0x06ca6351e003826full, 0x142929670a0e6e70ull,
+    0x27b70a8546d22ffcull, 0x2e1b21385c26c926ull, 0x4d2c6dfc5ac42aedull, 0x53380d139d95b3dfull,
+    0x650a73548baf63deull, 0x766a0abb3c77b2a8ull, 0x81c2c92e47edaee6ull, 0x92722c851482353bull,
+    0xa2bfe8a14cf10364ull, 0xa81a664bbc423001ull, 0xc24b8b70d0f89791ull, 0xc76c51a30654be30ull,
+    0xd192e819d6ef5218ull, 0xd69906245565a910ull, 0xf40e35855771202aull, 0x106aa07032bbd1b8ull,
+    0x19a4c116b8d2d0c8ull, 0x1e376c085141ab53ull, 0x2748774cdf8eeb99ull, 0x34b0bcb5e19b48a8ull,
+    0x391c0cb3c5c95a63ull, 0x4ed8aa4ae3418acbull, 0x5b9cca4f7763e373ull, 0x682e6ff3d6b2b8a3ull,
+    0x748f82ee5defb2fcull, 0x78a5636f43172f60ull, 0x84c87814a1f0ab72ull, 0x8cc702081a6439ecull,
+    0x90befffa23631e28ull, 0xa4506cebde82bde9ull, 0xbef9a3f7b2c67915ull, 0xc67178f2e372532bull,
+    0xca273eceea26619cull, 0xd186b8c721c0c207ull, 0xeada7dd6cde0eb1eull, 0xf57d4f7fee6ed178ull,
+    0x06f067aa72176fbaull, 0x0a637dc5a2c898a6ull, 0x113f9804bef90daeull, 0x1b710b35131c471bull,
+    0x28db77f523047d84ull, 0x32caab7b40c72493ull, 0x3c9ebe0a15c9bebcull, 0x431d67c49c100d4cull,
+    0x4cc5d4becb3e42b6ull, 0x597f299cfc657e2aull, 0x5fcb6fab3ad6faecull, 0x6c44198c4a475817ull
+};
+
+static const uint64_t sha512_h[8] = {
+    0x6a09e667f3bcc908ull, 0xbb67ae8584caa73bull, 0x3c6ef372fe94f82bull, 0xa54ff53a5f1d36f1ull,
+    0x510e527fade682d1ull, 0x9b05688c2b3e6c1full, 0x1f83d9abfb41bd6bull, 0x5be0cd19137e2179ull
+};
+
+static uint64_t rotr64(uint64_t x, int n)
+{
+    return (x >> n) | (x << (64 - n));
+}
+
+static uint64_t load_be64(const uint8_t* p)
+{
+    uint64_t x = 0;
+
+    for (int i = 0; i < 8; i++) {
+        x = (x << 8) | p[i];
+    }
+
+    return x;
+}
+
+static void store_be64(uint8_t* p, uint64_t x)
+{
+    for (int i = 7; i >= 0; i--) {
+        p[i] = (uint8_t)x;
+        x >>= 8;
+    }
+}
+
+static void sha512_block(uint64_t state[8], const uint8_t* block)
+{
+    uint64_t w[16];
+    uint64_t v[8];
+
+    for (int i = 0; i < 16; i++) {
+        w[i] = load_be64(block + 8 * i);
+    }
+
+    memcpy(v, state, sizeof(v));
+
+    // the message schedule is kept to 16 words, rolled in place
+    for (int i = 0; i < 80; i++) {
+        if (i >= 16) {
+            uint64_t w15 = w[(i - 15) & 15];
+            uint64_t w2 = w[(i - 2) & 15];
+
+            w[i & 15] += (rotr64(w15, 1) ^ rotr64(w15, 8) ^ (w15 >> 7)) + w[(i - 7) & 15] +
+                         (rotr64(w2, 19) ^ rotr64(w2, 61) ^ (w2 >> 6));
+        }
+
+        uint64_t t1 = v[7] + (rotr64(v[4], 14) ^ rotr64(v[4], 18) ^ rotr64(v[4], 41)) +
+                      ((v[4] & v[5]) ^ (~v[4] & v[6])) + sha512_k[i] + w[i & 15];
+        uint64_t t2 = (rotr64(v[0], 28) ^ rotr64(v[0], 34) ^ rotr64(v[0], 39)) +
+                      ((v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]));
+
+        memmove(v + 1, v, 7 * sizeof(v[0]));
+        v[4] += t1;
+        v[0] = t1 + t2;
+    }
+
+    for (int i = 0; i < 8; i++) {
+        state[i] += v[i];
+    }
+}
+
+void lorawan_fuota_sha512_init(struct lorawan_fuota_sha512* ctx)
+{
+    memcpy(ctx->state, sha512_h, sizeof(ctx->state));
+    ctx->length = 0;
+}
+
+void lorawan_fuota_sha512_update(struct lorawan_fuota_sha512* ctx, const uint8_t* data, size_t size)
+{
+    size_t used = ctx->length % sizeof(ctx->buffer);
+
+    ctx->length += size;
+
+    if (used > 0) {
+        size_t count = sizeof(ctx->buffer) - used;
+
+        if (count > size) {
+            count = size;
+        }
+
+        memcpy(ctx->buffer + used, data, count);
+        data += count;
+        size -= count;
+
+        if (used + count < sizeof(ctx->buffer)) {
+            return;
+        }
+
+        sha512_block(ctx->state, ctx->buffer);
+    }
+
+    for (; size >= sizeof(ctx->buffer); size -= sizeof(ctx->buffer)) {
+        sha512_block(ctx->state, data);
+        data += sizeof(ctx->buffer);
+    }
+
+    memcpy(ctx->buffer, data, size);
+}
+
+void lorawan_fuota_sha512_final(struct lorawan_fuota_sha512* ctx, uint8_t digest[64])
+{
+    size_t used = ctx->length % sizeof(ctx->buffer);
+
+    ctx->buffer[used++] = 0x80;
+
+    if (used > sizeof(ctx->buffer) - 16) {
+        memset(ctx->buffer + used, 0, sizeof(ctx->buffer) - used);
+        sha512_block(ctx->state, ctx->buffer);
+        used = 0;
+    }
+
+    // length in bits, 128-bit big-endian, the upper half 0
+    memset(ctx->buffer + used, 0, sizeof(ctx->buffer) - used);
+    store_be64(ctx->buffer + sizeof(ctx->buffer) - 8, ctx->length << 3);
+    store_be64(ctx->buffer + sizeof(ctx->buffer) - 16, ctx->length >> 61);
+    sha512_block(ctx->state, ctx->buffer);
+
+    for (int i = 0; i < 8; i++) {
+        store_be64(digest + 8 * i, ctx->state[i]);
+    }
+}
+
+static void gf_copy(gf o, const gf a)
+{
+    memcpy(o, a, sizeof(gf));
+}
+
+static void gf_carry(gf o)
+{
+    for (int i = 0; i < 16; i++) {
+        int64_t c = o[i] >> 16;
+
+        o[i] -= c * 65536;
+
+        // 2^256 = 38 mod p
+        if (i < 15) {
+            o[i + 1] += c;
+        } else {
+            o[0] += 38 * c;
+        }
+    }
+}
+
+static void gf_add(gf o, const gf a, const gf b)
+{
+    for (int i = 0; i < 16; i++) {
+        o[i] = a[i] + b[i];
+    }
+}
+
+static void gf_sub(gf o, const gf a, const gf b)
+{
+    for (int i = 0; i < 16; i++) {
+        o[i] = a[i] - b[i];
+    }
+}
+
+static void gf_mul(gf o, const gf a, const gf b)
+{
+    int64_t t[31] = { 0 };
+
+    for (int i = 0; i < 16; i++) {
+        for (int j = 0; j < 16; j++) {
+            t[i + j] += a[i] * b[j];
+        }
+    }
+
+    for (int i = 0; i < 15; i++) {
+        t[i] += 38 * t[i + 16];
+    }
+
+    memcpy(o, t, sizeof(gf));
+    gf_carry(o);
+    gf_carry(o);
+}
+
+static void gf_square(gf o, const gf a)
+{
+    gf_mul(o, a, a);
+}
+
+// a^(2^255 - 21) = 1 / a
+static void gf_invert(gf o, const gf a)
+{
+    gf c;
+
+    gf_copy(c, a);
+
+    for (int i = 253; i >= 0; i--) {
+        gf_square(c, c);
+
+        if (i != 2 && i != 4) {
+            gf_mul(c, c, a);
+        }
+    }
+
+    gf_copy(o, c);
+}
+
+// a^(2^252 - 3), for the square root
+static void gf_pow2523(gf o, const gf a)
+{
+    gf c;
+
+    gf_copy(c, a);
+
+    for (int i = 250; i >= 0; i--) {
+        gf_square(c, c);
+
+        if (i != 1) {
+            gf_mul(c, c, a);
+        }
+    }
+
+    gf_copy(o, c);
+}
+
+// fully reduced, little-endian
+static void gf_pack(uint8_t o[32], const gf n)
+{
+    gf m;
+    gf t;
+
+    gf_copy(t, n);
+    gf_carry(t);
+    gf_carry(t);
+    gf_carry(t);
+
+    // subtract p twice where it does not go negative
+    for (int j = 0; j < 2; j++) {
+        m[0] = t[0] - 0xffed;
+
+        for (int i = 1; i < 15; i++) {
+            m[i] = t[i] - 0xffff - ((m[i - 1] >> 16) & 1);
+            m[i - 1] &= 0xffff;
+        }
+
+        m[15] = t[15] - 0x7fff - ((m[14] >> 16) & 1);
+        m[14] &= 0xffff;
+
+        if (((m[15] >> 16) & 1) == 0) {
+            gf_copy(t, m);
+        }
+    }
+
+    for (int i = 0; i < 16; i++) {
+        o[2 * i] = (uint8_t)t[i];
+        o[2 * i + 1] = (uint8_t)(t[i] >> 8);
+    }
+}
+
+static void gf_unpack(gf o, const uint8_t n[32])
+{
+    for (int i = 0; i < 16; i++) {
+        o[i] = n[2 * i] + ((int64_t)n[2 * i + 1] << 8);
+    }
+
+    o[15] &= 0x7fff;
+}
+
+static bool gf_equal(const gf a, const gf b)
+{
+    uint8_t c[32];
+    uint8_t d[32];
+
+    gf_pack(c, a);
+    gf_pack(d, b);
+
+    return memcmp(c, d, sizeof(c)) == 0;
+}
+
+static int gf_parity(const gf a)
+{
+    uint8_t d[32];
+
+    gf_pack(d, a);
+
+    return d[0] & 1;
+}
+
+// p += q, also for p == q, complete on the curve
+static void point_add(gf p[4], const gf q[4])
+{
+    gf a, b, c, d, e, f, g, h, t;
+
+    gf_sub(a, p[1], p[0]);
+    gf_sub(t, q[1], q[0]);
+    gf_mul(a, a, t);
+    gf_add(b, p[0], p[1]);
+    gf_add(t, q[0], q[1]);
+    gf_mul(b, b, t);
+    gf_mul(c, p[3], q[3]);
+    gf_mul(c, c, ed_d2);
+    gf_mul(d, p[2], q[2]);
+    gf_add(d, d, d);
+    gf_sub(e, b, a);
+    gf_sub(f, d, c);
+    gf_add(g, d, c);
+    gf_add(h, b, a);
+
+    gf_mul(p[0], e, f);
+    gf_mul(p[1], h, g);
+    gf_mul(p[2], g, f);
+    gf_mul(p[3], e, h);
+}
+
+static void point_pack(uint8_t r[32], const gf p[4])
+{
+    gf z;
+    gf x;
+    gf y;
+
+    gf_invert(z, p[2]);
+    gf_mul(x, p[0], z);
+    gf_mul(y, p[1], z);
+    gf_pack(r, y);
+    r[31] ^= gf_parity(x) << 7;
+}
+
+// -P of the encoded point P, false if it is not on the curve
+static bool point_unpack_negated(gf r[4], const uint8_t p[32])
+{
+    gf num, den, den2, den4, den6, t, check;
+
+    gf_copy(r[2], gf1);
+    gf_unpack(r[1], p);
+
+    // x^2 = (y^2 - 1) / (d y^2 + 1)
+    gf_square(num, r[1]);
+    gf_mul(den, num, ed_d);
+    gf_sub(num, num, r[2]);
+    gf_add(den, r[2], den);
+
+    gf_square(den2, den);
+    gf_square(den4, den2);
+    gf_mul(den6, den4, den2);
+    gf_mul(t, den6, num);
+    gf_mul(t, t, den);
+
+    gf_pow2523(t, t);
+    gf_mul(t, t, num);
+    gf_mul(t, t, den);
+    gf_mul(t, t, den);
+    gf_mul(r[0], t, den);
+
+    gf_square(check, r[0]);
+    gf_mul(check, check, den);
+
+    if (!gf_equal(check, num)) {
+        gf_mul(r[0], r[0], sqrt_m1);
+    }
+
+    gf_square(check, r[0]);
+    gf_mul(check, check, den);
+
+    if (!gf_equal(check, num)) {
+        return false;
+    }
+
+    if (gf_parity(r[0]) == (p[31] >> 7)) {
+        gf_sub(r[0], gf0, r[0]);
+    }
+
+    gf_mul(r[3], r[0], r[1]);
+
+    return true;
+}
+
+// r = x mod the group order, x of 64 bytes in signed 64 bit limbs
+static void reduce_order(uint8_t r[32], int64_t x[64])
+{
+    int64_t carry;
+
+    for (int i = 63; i >= 32; i--) {
+        int j;
+
+        carry = 0;
+
+        for (j = i - 32; j < i - 12; j++) {
+            x[j] += carry - 16 * x[i] * order[j - (i - 32)];
+            carry = (x[j] + 128) >> 8;
+            x[j] -= carry * 256;
+        }
+
+        x[j] += carry;
+        x[i] = 0;
+    }
+
+    carry = 0;
+
+    for (int j = 0; j < 32; j++) {
+        x[j] += carry - (x[31] >> 4) * order[j];
+        carry = x[j] >> 8;
+        x[j] &= 255;
+    }
+
+    for (int j = 0; j < 32; j++) {
+        x[j] -= carry * order[j];
+    }
+
+    for (int i = 0; i < 32; i++) {
+        x[i + 1] += x[i] >> 8;
+        r[i] = (uint8_t)(x[i] & 255);
+    }
+}
+
+// s < the group order, RFC 8032 rejects the other encodings
+static bool scalar_canonical(const uint8_t s[32])
+{
+    for (int i = 31; i >= 0; i--) {
+        if (s[i] != order[i]) {
+            return s[i] < order[i];
+        }
+    }
+
+    return false;
+}
+
+int lorawan_fuota_ed25519_start(struct lorawan_fuota_ed25519* ctx,
+                                const uint8_t public_key[LORAWAN_FUOTA_ED25519_KEY_SIZE],
+                                const uint8_t signature[LORAWAN_FUOTA_ED25519_SIGNATURE_SIZE])
+{
+    memcpy(ctx->r, signature, sizeof(ctx->r));
+    memcpy(ctx->s, signature + 32, sizeof(ctx->s));
+
+    ctx->bit = -1;
+
+    if (!scalar_canonical(ctx->s) || !point_unpack_negated(ctx->minus_a, public_key)) {
+        return -1;
+    }
+
+    memcpy(ctx->base_minus_a, base, sizeof(ctx->base_minus_a));
+    point_add(ctx->base_minus_a, (const gf*)ctx->minus_a);
+
+    // h = SHA-512(R || A || message)
+    lorawan_fuota_sha512_init(&ctx->hash);
+    lorawan_fuota_sha512_update(&ctx->hash, ctx->r, sizeof(ctx->r));
+    lorawan_fuota_sha512_update(&ctx->hash, public_key, LORAWAN_FUOTA_ED25519_KEY_SIZE);
+
+    ctx->bit = 256;
+
+    return 0;
+}
+
+void lorawan_fuota_ed25519_update(struct lorawan_fuota_ed25519* ctx, const uint8_t* data, size_t size)
+{
+    lorawan_fuota_sha512_update(&ctx->hash, data, size);
+}
+
+int lorawan_fuota_ed25519_step(struct lorawan_fuota_ed25519* ctx)
+{
+    if (ctx->bit < 0) {
+        return -1;
+    }
+
+    if (ctx->bit == 256) {
+        uint8_t digest[64];
+        int64_t x[64];
+
+        lorawan_fuota_sha512_final(&ctx->hash, digest);
+
+        for (int i = 0; i < 64; i++) {
+            x[i] = digest[i];
+        }
+
+        reduce_order(ctx->h, x);
+
+        // the neutral element
+        gf_copy(ctx->sum[0], gf0);
+        gf_copy(ctx->sum[1], gf1);
+        gf_copy(ctx->sum[2], gf1);
+        gf_copy(ctx->sum[3], gf0);
+
+        ctx->bit = 255;
+        return 1;
+    }
+
+    // [s]B + [h](-A), both scalars at once, from the top bit
+    for (int n = 0; n < LORAWAN_FUOTA_ED25519_STEP_BITS && ctx->bit >= 0; n++, ctx->bit--) {
+        int s_bit = (ctx->s[ctx->bit / 8] >> (ctx->bit % 8)) & 1;
+        int h_bit = (ctx->h[ctx->bit / 8] >> (ctx->bit % 8)) & 1;
+
+        point_add(ctx->sum, (const gf*)ctx->sum);
+
+        if (s_bit && h_bit) {
+            point_add(ctx->sum, (const gf*)ctx->base_minus_a);
+        } else if (s_bit) {
+            point_add(ctx->sum, base);
+        } else if (h_bit) {
+            point_add(ctx->sum, (const gf*)ctx->minus_a);
+        }
+    }
+
+    if (ctx->bit >= 0) {
+        return 1;
+    }
+
+    uint8_t r[32];
+
+    point_pack(r, (const gf*)ctx->sum);
+
+    return (memcmp(r, ctx->r, sizeof(r)) == 0) ? 0 : -1;
+}
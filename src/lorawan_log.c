@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#include "pico/lorawan_log.h"
+#include "pico/lorawan_ram.h"
+
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+
+#define LOG_BUFFER_WORDS (LORAWAN_LOG_BUFFER_SIZE / 4)
+#define LOG_BUFFER_MASK  (LOG_BUFFER_WORDS - 1)
+
+#if (LORAWAN_LOG_BUFFER_SIZE & (LORAWAN_LOG_BUFFER_SIZE - 1)) != 0
+#error "LORAWAN_LOG_BUFFER_SIZE must be a power of 2"
+#endif
+
+// Record layout in 32-bit words:
+//
+//   [0] format string address, with the argument count in bits 24..27
+//       (always zero in RP2040 flash and SRAM addresses)
+//   [1] time_us_32() timestamp
+//   [2..] arguments
+static uint32_t log_buffer[LOG_BUFFER_WORDS];
+
+// free running word indices, head is written by producers, tail by the drain
+static volatile uint32_t log_head = 0;
+static volatile uint32_t log_tail = 0;
+static volatile uint32_t log_dropped = 0;
+
+void LORAWAN_RAM_FUNC(lorawan_log_write)(const char* fmt, uint32_t nargs, const uint32_t* args)
+{
+    if (nargs > LORAWAN_LOG_MAX_ARGS) {
+        nargs = LORAWAN_LOG_MAX_ARGS;
+    }
+
+    uint32_t words = 2 + nargs;
+    uint32_t timestamp = time_us_32();
+
+    // producers run in thread and interrupt context, so reserve and write
+    // with interrupts masked, this is a handful of stores
+    uint32_t mask = save_and_disable_interrupts();
+
+    uint32_t head = log_head;
+
+    if ((LOG_BUFFER_WORDS - (head - log_tail)) < words) {
+        log_dropped++;
+        restore_interrupts(mask);
+        return;
+    }
+
+    log_buffer[head++ & LOG_BUFFER_MASK] = (uint32_t)fmt | (nargs << 24);
+    log_buffer[head++ & LOG_BUFFER_MASK] = timestamp;
+
+    for (uint32_t i = 0; i < nargs; i++) {
+        log_buffer[head++ & LOG_BUFFER_MASK] = args[i];
+    }
+
+    log_head = head;
+
+    restore_interrupts(mask);
+}
+
+size_t lorawan_log_drain(uint8_t* buffer, size_t buffer_len)
+{
+    uint32_t tail = log_tail;
+    uint32_t head = log_head;
+    size_t length = 0;
+    uint8_t checksum = 0;
+
+    if (buffer_len <= LORAWAN_LOG_CHUNK_OVERHEAD) {
+        return 0;
+    }
+
+    // copy whole records only
+    while (tail != head) {
+        uint32_t words = 2 + ((log_buffer[tail & LOG_BUFFER_MASK] >> 24) & 0x0f);
+
+        if ((length + words * 4 + LORAWAN_LOG_CHUNK_OVERHEAD) > buffer_len || (length + words * 4) > 0xffff) {
+            break;
+        }
+
+        for (uint32_t i = 0; i < words; i++) {
+            uint32_t word = log_buffer[tail++ & LOG_BUFFER_MASK];
+            uint8_t* p = buffer + 4 + length;
+
+            p[0] = word;
+            p[1] = word >> 8;
+            p[2] = word >> 16;
+            p[3] = word >> 24;
+
+            checksum ^= p[0] ^ p[1] ^ p[2] ^ p[3];
+            length += 4;
+        }
+    }
+
+    if (length == 0) {
+        return 0;
+    }
+
+    log_tail = tail;
+
+    buffer[0] = LORAWAN_LOG_SYNC_0;
+    buffer[1] = LORAWAN_LOG_SYNC_1;
+    buffer[2] = length & 0xff;
+    buffer[3] = length >> 8;
+    buffer[4 + length] = checksum;
+
+    return length + LORAWAN_LOG_CHUNK_OVERHEAD;
+}
+
+size_t lorawan_log_pending()
+{
+    return (log_head - log_tail) * 4;
+}
+
+uint32_t lorawan_log_dropped()
+{
+    return log_dropped;
+}
@@ -0,0 +1,259 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#include <string.h>
+
+#include "pico/lorawan_profile.h"
+
+#include "hardware/clocks.h"
+#include "hardware/structs/systick.h"
+#include "hardware/structs/xip_ctrl.h"
+#include "hardware/timer.h"
+
+#define SYSTICK_MASK                0x00ffffff
+
+/*!
+ * Format version of lorawan_profile_encode
+ */
+#define LORAWAN_PROFILE_ENCODING_VERSION    1
+
+static const char* const stage_names[LORAWAN_PROFILE_STAGES] = {
+    "acquisition",
+    "dsp",
+    "encode",
+    "mac",
+    "display",
+    "flash",
+    "fuota",
+};
+
+static struct lorawan_profile_stats stage_stats[LORAWAN_PROFILE_STAGES];
+
+static uint32_t cycles_per_us = 0;
+static uint32_t systick_wrap_us = 0;
+
+static uint64_t window_start_us = 0;
+static uint64_t idle_us = 0;
+
+static uint64_t xip_hits = 0;
+static uint64_t xip_accesses = 0;
+
+static void stats_reset(struct lorawan_profile_stats* stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->min_cycles = UINT32_MAX;
+}
+
+void lorawan_profile_init()
+{
+    if (cycles_per_us != 0) {
+        return;
+    }
+
+    // SysTick clocked from the processor clock, free running, no interrupt
+    systick_hw->rvr = SYSTICK_MASK;
+    systick_hw->cvr = 0;
+    systick_hw->csr = M0PLUS_SYST_CSR_CLKSOURCE_BITS | M0PLUS_SYST_CSR_ENABLE_BITS;
+
+    cycles_per_us = clock_get_hz(clk_sys) / 1000000;
+    systick_wrap_us = (SYSTICK_MASK + 1) / cycles_per_us;
+
+    lorawan_profile_reset();
+}
+
+#if LORAWAN_PROFILE
+
+static uint8_t bucket_of(uint32_t cycles)
+{
+    if (cycles < (1u << 8)) {
+        return 0;
+    }
+
+    uint32_t bucket = (31 - __builtin_clz(cycles)) - 7;
+
+    return (bucket < LORAWAN_PROFILE_BUCKETS) ? bucket : (LORAWAN_PROFILE_BUCKETS - 1);
+}
+
+void lorawan_profile_end(enum lorawan_profile_stage stage, struct lorawan_profile_timer start)
+{
+    // SysTick counts down
+    uint32_t cycles = (start.cycles - systick_hw->cvr) & SYSTICK_MASK;
+    uint32_t us = time_us_32() - start.us;
+
+    if (stage >= LORAWAN_PROFILE_STAGES || cycles_per_us == 0) {
+        return;
+    }
+
+    // one microsecond of margin for the two clocks not being read together
+    if (us + 1 >= systick_wrap_us) {
+        cycles = (us < UINT32_MAX / cycles_per_us) ? us * cycles_per_us : UINT32_MAX;
+    }
+
+    struct lorawan_profile_stats* stats = &stage_stats[stage];
+
+    stats->count++;
+    stats->total_cycles += cycles;
+    stats->histogram[bucket_of(cycles)]++;
+
+    if (cycles < stats->min_cycles) {
+        stats->min_cycles = cycles;
+    }
+
+    if (cycles > stats->max_cycles) {
+        stats->max_cycles = cycles;
+    }
+}
+
+#endif
+
+static void xip_collect()
+{
+    uint32_t hits = xip_ctrl_hw->ctr_hit;
+    uint32_t accesses = xip_ctrl_hw->ctr_acc;
+
+    // any write clears, the accesses between the reads and the writes are lost
+    xip_ctrl_hw->ctr_hit = 0;
+    xip_ctrl_hw->ctr_acc = 0;
+
+    xip_hits += hits;
+    xip_accesses += accesses;
+}
+
+void lorawan_profile_idle(uint32_t us)
+{
+    idle_us += us;
+
+    xip_collect();
+}
+
+void lorawan_profile_get(enum lorawan_profile_stage stage, struct lorawan_profile_stats* stats)
+{
+    if (stage >= LORAWAN_PROFILE_STAGES) {
+        stats_reset(stats);
+        return;
+    }
+
+    *stats = stage_stats[stage];
+}
+
+const char* lorawan_profile_stage_name(enum lorawan_profile_stage stage)
+{
+    return (stage < LORAWAN_PROFILE_STAGES) ? stage_names[stage] : "unknown";
+}
+
+uint32_t lorawan_profile_mean(const struct lorawan_profile_stats* stats)
+{
+    if (stats->count == 0) {
+        return 0;
+    }
+
+    return (uint32_t)(stats->total_cycles / stats->count);
+}
+
+uint32_t lorawan_profile_percentile(const struct lorawan_profile_stats* stats, uint8_t percentile)
+{
+    if (stats->count == 0) {
+        return 0;
+    }
+
+    // smallest bucket with at least the percentile of the runs at or below it
+    uint64_t target = ((uint64_t)stats->count * percentile + 99) / 100;
+    uint64_t seen = 0;
+
+    for (int i = 0; i < LORAWAN_PROFILE_BUCKETS - 1; i++) {
+        seen += stats->histogram[i];
+
+        if (seen >= target) {
+            return 1u << (8 + i);
+        }
+    }
+
+    return UINT32_MAX;
+}
+
+void lorawan_profile_get_idle(uint64_t* elapsed_us, uint64_t* idle)
+{
+    *elapsed_us = time_us_64() - window_start_us;
+    *idle = idle_us;
+}
+
+uint16_t lorawan_profile_busy_permille()
+{
+    uint64_t elapsed;
+    uint64_t idle;
+
+    lorawan_profile_get_idle(&elapsed, &idle);
+
+    if (elapsed == 0 || idle >= elapsed) {
+        return 0;
+    }
+
+    return (uint16_t)(((elapsed - idle) * 1000) / elapsed);
+}
+
+void lorawan_profile_get_xip_cache(uint64_t* hits, uint64_t* accesses)
+{
+    xip_collect();
+
+    *hits = xip_hits;
+    *accesses = xip_accesses;
+}
+
+uint32_t lorawan_profile_cycles_to_us(uint32_t cycles)
+{
+    return (cycles_per_us != 0) ? (cycles / cycles_per_us) : 0;
+}
+
+void lorawan_profile_reset()
+{
+    for (int i = 0; i < LORAWAN_PROFILE_STAGES; i++) {
+        stats_reset(&stage_stats[i]);
+    }
+
+    window_start_us = time_us_64();
+    idle_us = 0;
+
+    xip_ctrl_hw->ctr_hit = 0;
+    xip_ctrl_hw->ctr_acc = 0;
+    xip_hits = 0;
+    xip_accesses = 0;
+}
+
+static uint8_t* PutU16Saturated(uint8_t* p, uint32_t value)
+{
+    if (value > 0xffff) {
+        value = 0xffff;
+    }
+
+    *p++ = value & 0xff;
+    *p++ = value >> 8;
+
+    return p;
+}
+
+int lorawan_profile_encode(uint8_t* buffer, uint8_t buffer_len)
+{
+    if (buffer_len < LORAWAN_PROFILE_ENCODED_MAX_SIZE) {
+        return -1;
+    }
+
+    uint8_t* p = buffer;
+
+    *p++ = LORAWAN_PROFILE_ENCODING_VERSION;
+    p = PutU16Saturated(p, lorawan_profile_busy_permille());
+    *p++ = LORAWAN_PROFILE_STAGES;
+
+    for (int i = 0; i < LORAWAN_PROFILE_STAGES; i++) {
+        const struct lorawan_profile_stats* stats = &stage_stats[i];
+
+        p = PutU16Saturated(p, stats->count);
+        p = PutU16Saturated(p, lorawan_profile_cycles_to_us(lorawan_profile_mean(stats)));
+        p = PutU16Saturated(p, lorawan_profile_cycles_to_us(stats->max_cycles));
+    }
+
+    return p - buffer;
+}
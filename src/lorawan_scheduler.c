@@ -0,0 +1,278 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#include <string.h>
+
+#include "pico/lorawan.h"
+#include "pico/lorawan_ram.h"
+#include "pico/lorawan_scheduler.h"
+#include "pico/time.h"
+
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+
+#include "board.h"
+
+static struct lorawan_task* task_list = NULL;
+static struct lorawan_task* rx_task = NULL;
+static struct lorawan_scheduler_stats scheduler_stats;
+
+static void mac_task_fn(void* context)
+{
+    (void)context;
+
+    // a notification raised while processing signals the task again
+    lorawan_process();
+}
+
+static struct lorawan_task mac_task = {
+    .name = "mac",
+    .fn = mac_task_fn,
+    .priority = LORAWAN_TASK_PRIORITY_MAC,
+    // an RX window is opened from the timer interrupt, but the MAC has to
+    // finish the previous exchange well within the RX1 delay
+    .deadline_us = 100000,
+};
+
+static int64_t LORAWAN_RAM_FUNC(wake_alarm_callback)(alarm_id_t id, void* user_data)
+{
+    (void)id;
+    (void)user_data;
+
+    // taking the interrupt is enough to wake the WFE
+    return 0;
+}
+
+static uint64_t task_deadline(const struct lorawan_task* task, uint64_t release)
+{
+    uint32_t deadline = task->deadline_us ? task->deadline_us : task->period_us;
+
+    return release + deadline;
+}
+
+void lorawan_scheduler_init()
+{
+    lorawan_scheduler_add(&mac_task);
+
+    // the MAC may already have work queued from the join or init
+    lorawan_task_signal(&mac_task);
+}
+
+int lorawan_scheduler_add(struct lorawan_task* task)
+{
+    struct lorawan_task** link = &task_list;
+
+    if (task->fn == NULL) {
+        return -1;
+    }
+
+    // the MAC priority is reserved
+    if (task != &mac_task && task->priority == LORAWAN_TASK_PRIORITY_MAC) {
+        return -1;
+    }
+
+    memset(&task->stats, 0, sizeof(task->stats));
+    task->release_us = time_us_64() + task->period_us;
+    task->pending = false;
+
+    // keep the list sorted by priority, equal priorities in insertion order
+    while (*link != NULL && (*link)->priority <= task->priority) {
+        link = &(*link)->next;
+    }
+
+    task->next = *link;
+    *link = task;
+
+    return 0;
+}
+
+void LORAWAN_RAM_FUNC(lorawan_task_signal)(struct lorawan_task* task)
+{
+    uint32_t mask = save_and_disable_interrupts();
+
+    if (!task->pending) {
+        task->signal_us = time_us_64();
+        task->pending = true;
+    }
+
+    restore_interrupts(mask);
+
+    // wake the scheduler if it is about to sleep
+    __sev();
+}
+
+void lorawan_task_set_period(struct lorawan_task* task, uint32_t period_us)
+{
+    task->period_us = period_us;
+    task->release_us = time_us_64() + period_us;
+}
+
+void lorawan_scheduler_set_rx_task(struct lorawan_task* task)
+{
+    rx_task = task;
+}
+
+void lorawan_scheduler_notify_mac()
+{
+    lorawan_task_signal(&mac_task);
+}
+
+void lorawan_scheduler_notify_rx()
+{
+    if (rx_task != NULL) {
+        lorawan_task_signal(rx_task);
+    }
+}
+
+static void run_task(struct lorawan_task* task, uint64_t now)
+{
+    uint64_t release;
+    uint64_t scheduled = task->release_us;
+    bool periodic = task->period_us > 0 && now >= task->release_us;
+
+    if (periodic) {
+        release = task->release_us;
+    } else {
+        release = task->signal_us;
+    }
+
+    // clear before running so a signal raised while running is kept, a
+    // signal that coincides with a periodic release is served by this run
+    uint32_t mask = save_and_disable_interrupts();
+    task->pending = false;
+    restore_interrupts(mask);
+
+    uint64_t start = time_us_64();
+
+    task->fn(task->context);
+
+    uint64_t end = time_us_64();
+    uint32_t run_time = (uint32_t)(end - start);
+    uint32_t latency = (uint32_t)(start - release);
+
+    task->stats.runs++;
+    task->stats.run_time_us += run_time;
+
+    if (run_time > task->stats.max_run_time_us) {
+        task->stats.max_run_time_us = run_time;
+    }
+
+    if (latency > task->stats.max_latency_us) {
+        task->stats.max_latency_us = latency;
+    }
+
+    if ((task->deadline_us || task->period_us) && end > task_deadline(task, release)) {
+        task->stats.deadline_misses++;
+    }
+
+    // a task that changed its own period was rescheduled already
+    if (periodic && task->period_us > 0 && task->release_us == scheduled) {
+        // keep the phase, every release that has already passed is a miss
+        task->release_us += task->period_us;
+
+        while (task->release_us <= end) {
+            task->release_us += task->period_us;
+            task->stats.deadline_misses++;
+        }
+    }
+
+    scheduler_stats.busy_us += run_time;
+}
+
+int lorawan_scheduler_run_once()
+{
+    uint64_t now = time_us_64();
+    struct lorawan_task* next = NULL;
+    uint64_t next_deadline = 0;
+    uint64_t next_release = UINT64_MAX;
+
+    // the list is sorted by priority, so the first ready priority level wins
+    // and within it the earliest deadline
+    for (struct lorawan_task* task = task_list; task != NULL; task = task->next) {
+        uint64_t release;
+
+        if (next != NULL && task->priority != next->priority) {
+            break;
+        }
+
+        if (task->pending) {
+            release = task->signal_us;
+        } else if (task->period_us > 0 && now >= task->release_us) {
+            release = task->release_us;
+        } else {
+            if (task->period_us > 0 && task->release_us < next_release) {
+                next_release = task->release_us;
+            }
+            continue;
+        }
+
+        uint64_t deadline = task_deadline(task, release);
+
+        if (next == NULL || deadline < next_deadline) {
+            next = task;
+            next_deadline = deadline;
+        }
+    }
+
+    if (next != NULL) {
+        run_task(next, now);
+        return 1;
+    }
+
+    // nothing ready, sleep until the next periodic release or an interrupt,
+    // a signal raised after the scan sets the event register so the WFE in
+    // BoardLowPowerHandler() returns straight away
+    alarm_id_t alarm = -1;
+
+    if (next_release != UINT64_MAX) {
+        absolute_time_t wake;
+
+        update_us_since_boot(&wake, next_release);
+        alarm = add_alarm_at(wake, wake_alarm_callback, NULL, true);
+    }
+
+    // 0: the release is already due, -1: no alarm slot, do not risk
+    // sleeping past it
+    if (alarm > 0 || next_release == UINT64_MAX) {
+        BoardLowPowerHandler();
+    }
+
+    if (alarm > 0) {
+        cancel_alarm(alarm);
+    }
+
+    scheduler_stats.idle_us += time_us_64() - now;
+    scheduler_stats.sleeps++;
+
+    return 0;
+}
+
+void lorawan_scheduler_run()
+{
+    while (1) {
+        lorawan_scheduler_run_once();
+    }
+}
+
+struct lorawan_task* lorawan_scheduler_tasks()
+{
+    return task_list;
+}
+
+void lorawan_scheduler_get_stats(struct lorawan_scheduler_stats* stats)
+{
+    *stats = scheduler_stats;
+}
+
+void lorawan_scheduler_reset_stats()
+{
+    memset(&scheduler_stats, 0, sizeof(scheduler_stats));
+
+    for (struct lorawan_task* task = task_list; task != NULL; task = task->next) {
+        memset(&task->stats, 0, sizeof(task->stats));
+    }
+}
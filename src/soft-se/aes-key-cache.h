@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef _AES_KEY_CACHE_H_
+#define _AES_KEY_CACHE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*!
+ * Number of expanded AES-128 keys kept in RAM.
+ *
+ * \remark An activated device uses AppSKey, FNwkSIntKey, SNwkSIntKey and
+ *         NwkSEncKey on every frame, plus AppKey / NwkKey during a join.
+ */
+#ifndef AES_KEY_CACHE_ENTRIES
+#define AES_KEY_CACHE_ENTRIES                       6
+#endif
+
+/*!
+ * AES-128 round count and expanded schedule size in 32-bit words
+ */
+#define AES_KEY_CACHE_ROUNDS                        10
+#define AES_KEY_CACHE_SCHEDULE_WORDS                ( 4 * ( AES_KEY_CACHE_ROUNDS + 1 ) )
+
+typedef struct sAesKeyCacheEntry
+{
+    /*!
+     * Expanded key schedule, word i holds key bytes 4i..4i+3 little-endian
+     */
+    uint32_t RoundKeys[AES_KEY_CACHE_SCHEDULE_WORDS];
+    /*!
+     * CMAC subkeys K1 and K2, valid when HasSubkeys is set
+     */
+    uint32_t CmacK1[4];
+    uint32_t CmacK2[4];
+    bool HasSubkeys;
+    /*!
+     * Last use stamp, used to evict the least recently used entry
+     */
+    uint32_t LastUse;
+} AesKeyCacheEntry_t;
+
+typedef struct sAesKeyCacheStats
+{
+    uint32_t Hits;
+    uint32_t Misses;
+} AesKeyCacheStats_t;
+
+/*!
+ * \brief Returns the cached schedule for an AES-128 key, expanding and
+ *        inserting it on a miss.
+ *
+ * \param [IN] key 16 byte AES key
+ * \retval entry Cache entry, valid until the next call that inserts a key
+ */
+AesKeyCacheEntry_t* AesKeyCacheGet( const uint8_t key[16] );
+
+/*!
+ * \brief Returns the CMAC subkeys K1 / K2 for the given cache entry,
+ *        deriving them on first use.
+ */
+void AesKeyCacheGetCmacSubkeys( AesKeyCacheEntry_t* entry, const uint32_t** k1, const uint32_t** k2 );
+
+/*!
+ * \brief Drops every cached schedule, e.g. after a re-join or key change.
+ */
+void AesKeyCacheFlush( void );
+
+/*!
+ * \brief Reads the hit / miss counters.
+ */
+void AesKeyCacheGetStats( AesKeyCacheStats_t* stats );
+
+/*!
+ * \brief Encrypts one block held as four little-endian column words in place.
+ *
+ * \param [IN]    roundKeys Expanded key schedule
+ * \param [IN]    rounds    Number of rounds (10, 12 or 14)
+ * \param [INOUT] state     Block to encrypt
+ */
+void AesEncryptWords( const uint32_t* roundKeys, uint8_t rounds, uint32_t state[4] );
+
+/*!
+ * \brief Expands a 16, 24 or 32 byte key into roundKeys.
+ *
+ * \retval rounds Number of rounds, 0 for an invalid key length
+ */
+uint8_t AesExpandKey( const uint8_t* key, uint8_t keyLength, uint32_t* roundKeys );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _AES_KEY_CACHE_H_
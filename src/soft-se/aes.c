@@ -0,0 +1,382 @@
+/*!
+ * \file      aes.c
+ *
+ * \brief     Table-based AES encryption, drop-in replacement for the
+ *            LoRaMac-node soft-se aes.c.
+ *
+ * \remark    Implements the aes.h interface of the upstream byte-oriented
+ *            implementation with one 1 KB T-table (the other three are
+ *            derived by rotation, which is a single instruction on the
+ *            Cortex-M0+) and keeps AES-128 key schedules in a small cache so
+ *            that the secure element does not re-expand the session keys for
+ *            every MIC and payload block.
+ *
+ *            Key schedules are stored in aes_context::ksch as native 32-bit
+ *            words; both the RP2040 and the host builds are little-endian,
+ *            so the byte layout matches the upstream schedule.
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "aes.h"
+#include "aes-key-cache.h"
+
+#define ROTL8( x )                                  ( ( ( x ) << 8 ) | ( ( x ) >> 24 ) )
+#define ROTL16( x )                                 ( ( ( x ) << 16 ) | ( ( x ) >> 16 ) )
+#define ROTL24( x )                                 ( ( ( x ) << 24 ) | ( ( x ) >> 8 ) )
+
+static const uint8_t Sbox[256] =
+{
+    0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+    0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+    0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+    0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+    0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+    0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+    0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+    0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+    0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+    0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+    0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+    0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+    0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+    0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+    0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+    0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16,
+};
+
+static const uint32_t Te0[256] =
+{
+    0xa56363c6U, 0x847c7cf8U, 0x997777eeU, 0x8d7b7bf6U, 0x0df2f2ffU, 0xbd6b6bd6U,
+    0xb16f6fdeU, 0x54c5c591U, 0x50303060U, 0x03010102U, 0xa96767ceU, 0x7d2b2b56U,
+    0x19fefee7U, 0x62d7d7b5U, 0xe6abab4dU, 0x9a7676ecU, 0x45caca8fU, 0x9d82821fU,
+    0x40c9c989U, 0x877d7dfaU, 0x15fafaefU, 0xeb5959b2U, 0xc947478eU, 0x0bf0f0fbU,
+    0xecadad41U, 0x67d4d4b3U, 0xfda2a25fU, 0xeaafaf45U, 0xbf9c9c23U, 0xf7a4a453U,
+    0x967272e4U, 0x5bc0c09bU, 0xc2b7b775U, 0x1cfdfde1U, 0xae93933dU, 0x6a26264cU,
+    0x5a36366cU, 0x413f3f7eU, 0x02f7f7f5U, 0x4fcccc83U, 0x5c343468U, 0xf4a5a551U,
+    0x34e5e5d1U, 0x08f1f1f9U, 0x937171e2U, 0x73d8d8abU, 0x53313162U, 0x3f15152aU,
+    0x0c040408U, 0x52c7c795U, 0x65232346U, 0x5ec3c39dU, 0x28181830U, 0xa1969637U,
+    0x0f05050aU, 0xb59a9a2fU, 0x0907070eU, 0x36121224U, 0x9b80801bU, 0x3de2e2dfU,
+    0x26ebebcdU, 0x6927274eU, 0xcdb2b27fU, 0x9f7575eaU, 0x1b090912U, 0x9e83831dU,
+    0x742c2c58U, 0x2e1a1a34U, 0x2d1b1b36U, 0xb26e6edcU, 0xee5a5ab4U, 0xfba0a05bU,
+    0xf65252a4U, 0x4d3b3b76U, 0x61d6d6b7U, 0xceb3b37dU, 0x7b292952U, 0x3ee3e3ddU,
+    0x712f2f5eU, 0x97848413U, 0xf55353a6U, 0x68d1d1b9U, 0x00000000U, 0x2cededc1U,
+    0x60202040U, 0x1ffcfce3U, 0xc8b1b179U, 0xed5b5bb6U, 0xbe6a6ad4U, 0x46cbcb8dU,
+    0xd9bebe67U, 0x4b393972U, 0xde4a4a94U, 0xd44c4c98U, 0xe85858b0U, 0x4acfcf85U,
+    0x6bd0d0bbU, 0x2aefefc5U, 0xe5aaaa4fU, 0x16fbfbedU, 0xc5434386U, 0xd74d4d9aU,
+    0x55333366U, 0x94858511U, 0xcf45458aU, 0x10f9f9e9U, 0x06020204U, 0x817f7ffeU,
+    0xf05050a0U, 0x443c3c78U, 0xba9f9f25U, 0xe3a8a84bU, 0xf35151a2U, 0xfea3a35dU,
+    0xc0404080U, 0x8a8f8f05U, 0xad92923fU, 0xbc9d9d21U, 0x48383870U, 0x04f5f5f1U,
+    0xdfbcbc63U, 0xc1b6b677U, 0x75dadaafU, 0x63212142U, 0x30101020U, 0x1affffe5U,
+    0x0ef3f3fdU, 0x6dd2d2bfU, 0x4ccdcd81U, 0x140c0c18U, 0x35131326U, 0x2fececc3U,
+    0xe15f5fbeU, 0xa2979735U, 0xcc444488U, 0x3917172eU, 0x57c4c493U, 0xf2a7a755U,
+    0x827e7efcU, 0x473d3d7aU, 0xac6464c8U, 0xe75d5dbaU, 0x2b191932U, 0x957373e6U,
+    0xa06060c0U, 0x98818119U, 0xd14f4f9eU, 0x7fdcdca3U, 0x66222244U, 0x7e2a2a54U,
+    0xab90903bU, 0x8388880bU, 0xca46468cU, 0x29eeeec7U, 0xd3b8b86bU, 0x3c141428U,
+    0x79dedea7U, 0xe25e5ebcU, 0x1d0b0b16U, 0x76dbdbadU, 0x3be0e0dbU, 0x56323264U,
+    0x4e3a3a74U, 0x1e0a0a14U, 0xdb494992U, 0x0a06060cU, 0x6c242448U, 0xe45c5cb8U,
+    0x5dc2c29fU, 0x6ed3d3bdU, 0xefacac43U, 0xa66262c4U, 0xa8919139U, 0xa4959531U,
+    0x37e4e4d3U, 0x8b7979f2U, 0x32e7e7d5U, 0x43c8c88bU, 0x5937376eU, 0xb76d6ddaU,
+    0x8c8d8d01U, 0x64d5d5b1U, 0xd24e4e9cU, 0xe0a9a949U, 0xb46c6cd8U, 0xfa5656acU,
+    0x07f4f4f3U, 0x25eaeacfU, 0xaf6565caU, 0x8e7a7af4U, 0xe9aeae47U, 0x18080810U,
+    0xd5baba6fU, 0x887878f0U, 0x6f25254aU, 0x722e2e5cU, 0x241c1c38U, 0xf1a6a657U,
+    0xc7b4b473U, 0x51c6c697U, 0x23e8e8cbU, 0x7cdddda1U, 0x9c7474e8U, 0x211f1f3eU,
+    0xdd4b4b96U, 0xdcbdbd61U, 0x868b8b0dU, 0x858a8a0fU, 0x907070e0U, 0x423e3e7cU,
+    0xc4b5b571U, 0xaa6666ccU, 0xd8484890U, 0x05030306U, 0x01f6f6f7U, 0x120e0e1cU,
+    0xa36161c2U, 0x5f35356aU, 0xf95757aeU, 0xd0b9b969U, 0x91868617U, 0x58c1c199U,
+    0x271d1d3aU, 0xb99e9e27U, 0x38e1e1d9U, 0x13f8f8ebU, 0xb398982bU, 0x33111122U,
+    0xbb6969d2U, 0x70d9d9a9U, 0x898e8e07U, 0xa7949433U, 0xb69b9b2dU, 0x221e1e3cU,
+    0x92878715U, 0x20e9e9c9U, 0x49cece87U, 0xff5555aaU, 0x78282850U, 0x7adfdfa5U,
+    0x8f8c8c03U, 0xf8a1a159U, 0x80898909U, 0x170d0d1aU, 0xdabfbf65U, 0x31e6e6d7U,
+    0xc6424284U, 0xb86868d0U, 0xc3414182U, 0xb0999929U, 0x772d2d5aU, 0x110f0f1eU,
+    0xcbb0b07bU, 0xfc5454a8U, 0xd6bbbb6dU, 0x3a16162cU,
+};
+
+/*!
+ * Round constants for the key expansion
+ */
+static const uint8_t Rcon[10] = { 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36 };
+
+static uint8_t CacheKeys[AES_KEY_CACHE_ENTRIES][16];
+static bool CacheValid[AES_KEY_CACHE_ENTRIES];
+static AesKeyCacheEntry_t CacheEntries[AES_KEY_CACHE_ENTRIES];
+static uint32_t CacheClock = 0;
+static AesKeyCacheStats_t CacheStats = { 0 };
+
+static inline uint32_t LoadLe32( const uint8_t* p )
+{
+    return ( uint32_t )p[0] | ( ( uint32_t )p[1] << 8 ) | ( ( uint32_t )p[2] << 16 ) | ( ( uint32_t )p[3] << 24 );
+}
+
+static inline void StoreLe32( uint8_t* p, uint32_t v )
+{
+    p[0] = ( uint8_t )v;
+    p[1] = ( uint8_t )( v >> 8 );
+    p[2] = ( uint8_t )( v >> 16 );
+    p[3] = ( uint8_t )( v >> 24 );
+}
+
+static inline uint32_t SubWord( uint32_t w )
+{
+    return ( uint32_t )Sbox[w & 0xff] |
+           ( ( uint32_t )Sbox[( w >> 8 ) & 0xff] << 8 ) |
+           ( ( uint32_t )Sbox[( w >> 16 ) & 0xff] << 16 ) |
+           ( ( uint32_t )Sbox[w >> 24] << 24 );
+}
+
+uint8_t AesExpandKey( const uint8_t* key, uint8_t keyLength, uint32_t* roundKeys )
+{
+    uint8_t nk;
+    uint8_t rounds;
+
+    switch( keyLength )
+    {
+        case 16: nk = 4; rounds = 10; break;
+        case 24: nk = 6; rounds = 12; break;
+        case 32: nk = 8; rounds = 14; break;
+        default: return 0;
+    }
+
+    for( uint8_t i = 0; i < nk; i++ )
+    {
+        roundKeys[i] = LoadLe32( key + 4 * i );
+    }
+
+    const uint8_t total = 4 * ( rounds + 1 );
+
+    for( uint8_t i = nk; i < total; i++ )
+    {
+        uint32_t temp = roundKeys[i - 1];
+
+        if( ( i % nk ) == 0 )
+        {
+            // RotWord moves byte 0 to byte 3, a right rotation of the little-endian word
+            temp = SubWord( ROTL24( temp ) ) ^ Rcon[i / nk - 1];
+        }
+        else if( ( nk > 6 ) && ( ( i % nk ) == 4 ) )
+        {
+            temp = SubWord( temp );
+        }
+
+        roundKeys[i] = roundKeys[i - nk] ^ temp;
+    }
+
+    return rounds;
+}
+
+void AesEncryptWords( const uint32_t* rk, uint8_t rounds, uint32_t state[4] )
+{
+    uint32_t s0 = state[0] ^ rk[0];
+    uint32_t s1 = state[1] ^ rk[1];
+    uint32_t s2 = state[2] ^ rk[2];
+    uint32_t s3 = state[3] ^ rk[3];
+    uint32_t t0, t1, t2, t3;
+
+    for( uint8_t r = 1; r < rounds; r++ )
+    {
+        rk += 4;
+
+        t0 = Te0[s0 & 0xff] ^ ROTL8( Te0[( s1 >> 8 ) & 0xff] ) ^ ROTL16( Te0[( s2 >> 16 ) & 0xff] ) ^ ROTL24( Te0[s3 >> 24] ) ^ rk[0];
+        t1 = Te0[s1 & 0xff] ^ ROTL8( Te0[( s2 >> 8 ) & 0xff] ) ^ ROTL16( Te0[( s3 >> 16 ) & 0xff] ) ^ ROTL24( Te0[s0 >> 24] ) ^ rk[1];
+        t2 = Te0[s2 & 0xff] ^ ROTL8( Te0[( s3 >> 8 ) & 0xff] ) ^ ROTL16( Te0[( s0 >> 16 ) & 0xff] ) ^ ROTL24( Te0[s1 >> 24] ) ^ rk[2];
+        t3 = Te0[s3 & 0xff] ^ ROTL8( Te0[( s0 >> 8 ) & 0xff] ) ^ ROTL16( Te0[( s1 >> 16 ) & 0xff] ) ^ ROTL24( Te0[s2 >> 24] ) ^ rk[3];
+
+        s0 = t0;
+        s1 = t1;
+        s2 = t2;
+        s3 = t3;
+    }
+
+    rk += 4;
+
+    // Final round: SubBytes and ShiftRows without MixColumns
+    state[0] = ( ( uint32_t )Sbox[s0 & 0xff] | ( ( uint32_t )Sbox[( s1 >> 8 ) & 0xff] << 8 ) |
+                 ( ( uint32_t )Sbox[( s2 >> 16 ) & 0xff] << 16 ) | ( ( uint32_t )Sbox[s3 >> 24] << 24 ) ) ^ rk[0];
+    state[1] = ( ( uint32_t )Sbox[s1 & 0xff] | ( ( uint32_t )Sbox[( s2 >> 8 ) & 0xff] << 8 ) |
+                 ( ( uint32_t )Sbox[( s3 >> 16 ) & 0xff] << 16 ) | ( ( uint32_t )Sbox[s0 >> 24] << 24 ) ) ^ rk[1];
+    state[2] = ( ( uint32_t )Sbox[s2 & 0xff] | ( ( uint32_t )Sbox[( s3 >> 8 ) & 0xff] << 8 ) |
+                 ( ( uint32_t )Sbox[( s0 >> 16 ) & 0xff] << 16 ) | ( ( uint32_t )Sbox[s1 >> 24] << 24 ) ) ^ rk[2];
+    state[3] = ( ( uint32_t )Sbox[s3 & 0xff] | ( ( uint32_t )Sbox[( s0 >> 8 ) & 0xff] << 8 ) |
+                 ( ( uint32_t )Sbox[( s1 >> 16 ) & 0xff] << 16 ) | ( ( uint32_t )Sbox[s2 >> 24] << 24 ) ) ^ rk[3];
+}
+
+AesKeyCacheEntry_t* AesKeyCacheGet( const uint8_t key[16] )
+{
+    uint8_t victim = 0;
+
+    CacheClock++;
+
+    for( uint8_t i = 0; i < AES_KEY_CACHE_ENTRIES; i++ )
+    {
+        if( CacheValid[i] && ( memcmp( CacheKeys[i], key, 16 ) == 0 ) )
+        {
+            CacheStats.Hits++;
+            CacheEntries[i].LastUse = CacheClock;
+            return &CacheEntries[i];
+        }
+
+        if( !CacheValid[i] )
+        {
+            victim = i;
+        }
+        else if( CacheValid[victim] && ( CacheEntries[i].LastUse < CacheEntries[victim].LastUse ) )
+        {
+            victim = i;
+        }
+    }
+
+    CacheStats.Misses++;
+
+    AesKeyCacheEntry_t* entry = &CacheEntries[victim];
+
+    memcpy( CacheKeys[victim], key, 16 );
+    AesExpandKey( key, 16, entry->RoundKeys );
+    entry->HasSubkeys = false;
+    entry->LastUse = CacheClock;
+    CacheValid[victim] = true;
+
+    return entry;
+}
+
+static void CmacDouble( const uint8_t in[16], uint8_t out[16] )
+{
+    const uint8_t carry = in[0] >> 7;
+
+    for( uint8_t i = 0; i < 15; i++ )
+    {
+        out[i] = ( uint8_t )( ( in[i] << 1 ) | ( in[i + 1] >> 7 ) );
+    }
+    out[15] = ( uint8_t )( ( in[15] << 1 ) ^ ( carry ? 0x87 : 0x00 ) );
+}
+
+void AesKeyCacheGetCmacSubkeys( AesKeyCacheEntry_t* entry, const uint32_t** k1, const uint32_t** k2 )
+{
+    if( !entry->HasSubkeys )
+    {
+        uint32_t l[4] = { 0, 0, 0, 0 };
+        uint8_t bytes[16];
+        uint8_t doubled[16];
+
+        AesEncryptWords( entry->RoundKeys, AES_KEY_CACHE_ROUNDS, l );
+
+        for( uint8_t i = 0; i < 4; i++ )
+        {
+            StoreLe32( bytes + 4 * i, l[i] );
+        }
+
+        CmacDouble( bytes, doubled );
+        for( uint8_t i = 0; i < 4; i++ )
+        {
+            entry->CmacK1[i] = LoadLe32( doubled + 4 * i );
+        }
+
+        CmacDouble( doubled, bytes );
+        for( uint8_t i = 0; i < 4; i++ )
+        {
+            entry->CmacK2[i] = LoadLe32( bytes + 4 * i );
+        }
+
+        entry->HasSubkeys = true;
+    }
+
+    *k1 = entry->CmacK1;
+    *k2 = entry->CmacK2;
+}
+
+void AesKeyCacheFlush( void )
+{
+    memset( CacheValid, 0, sizeof( CacheValid ) );
+    memset( CacheKeys, 0, sizeof( CacheKeys ) );
+    memset( CacheEntries, 0, sizeof( CacheEntries ) );
+}
+
+void AesKeyCacheGetStats( AesKeyCacheStats_t* stats )
+{
+    *stats = CacheStats;
+}
+
+return_type aes_set_key( const uint8_t key[], length_type keylen, aes_context ctx[1] )
+{
+    if( keylen == 16 )
+    {
+        const AesKeyCacheEntry_t* entry = AesKeyCacheGet( key );
+
+        memcpy( ctx->ksch, entry->RoundKeys, sizeof( entry->RoundKeys ) );
+        ctx->rnd = AES_KEY_CACHE_ROUNDS;
+
+        return 0;
+    }
+
+    uint32_t roundKeys[4 * ( N_MAX_ROUNDS + 1 )];
+    uint8_t rounds = AesExpandKey( key, keylen, roundKeys );
+
+    if( rounds == 0 )
+    {
+        ctx->rnd = 0;
+        return ( return_type )-1;
+    }
+
+    memcpy( ctx->ksch, roundKeys, 16 * ( rounds + 1 ) );
+    ctx->rnd = rounds;
+
+    return 0;
+}
+
+return_type aes_encrypt( const uint8_t in[N_BLOCK], uint8_t out[N_BLOCK], const aes_context ctx[1] )
+{
+    uint32_t aligned[4 * ( N_MAX_ROUNDS + 1 )];
+    const uint32_t* rk;
+    uint32_t state[4];
+
+    if( ctx->rnd == 0 )
+    {
+        return ( return_type )-1;
+    }
+
+    if( ( ( uintptr_t )ctx->ksch & 3 ) == 0 )
+    {
+        rk = ( const uint32_t* )ctx->ksch;
+    }
+    else
+    {
+        memcpy( aligned, ctx->ksch, 16 * ( ctx->rnd + 1 ) );
+        rk = aligned;
+    }
+
+    state[0] = LoadLe32( in );
+    state[1] = LoadLe32( in + 4 );
+    state[2] = LoadLe32( in + 8 );
+    state[3] = LoadLe32( in + 12 );
+
+    AesEncryptWords( rk, ctx->rnd, state );
+
+    StoreLe32( out, state[0] );
+    StoreLe32( out + 4, state[1] );
+    StoreLe32( out + 8, state[2] );
+    StoreLe32( out + 12, state[3] );
+
+    return 0;
+}
+
+return_type aes_cbc_encrypt( const uint8_t *in, uint8_t *out, int32_t n_block, uint8_t iv[N_BLOCK], const aes_context ctx[1] )
+{
+    while( n_block-- > 0 )
+    {
+        for( uint8_t i = 0; i < N_BLOCK; i++ )
+        {
+            iv[i] ^= in[i];
+        }
+
+        if( aes_encrypt( iv, iv, ctx ) != 0 )
+        {
+            return ( return_type )-1;
+        }
+
+        memcpy( out, iv, N_BLOCK );
+        in += N_BLOCK;
+        out += N_BLOCK;
+    }
+
+    return 0;
+}
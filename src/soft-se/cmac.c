@@ -0,0 +1,158 @@
+/*!
+ * \file      cmac.c
+ *
+ * \brief     AES-CMAC (RFC 4493), drop-in replacement for the LoRaMac-node
+ *            soft-se cmac.c.
+ *
+ * \remark    Keeps the chaining value in registers as 32-bit words for the
+ *            whole message instead of round-tripping through aes_encrypt()
+ *            per block, and takes the K1 / K2 subkeys from the key schedule
+ *            cache instead of deriving them with an extra AES block on every
+ *            AES_CMAC_Final().
+ */
+
+#include <string.h>
+
+#include "cmac.h"
+#include "aes-key-cache.h"
+
+static inline uint32_t LoadLe32( const uint8_t* p )
+{
+    return ( uint32_t )p[0] | ( ( uint32_t )p[1] << 8 ) | ( ( uint32_t )p[2] << 16 ) | ( ( uint32_t )p[3] << 24 );
+}
+
+static inline void StoreLe32( uint8_t* p, uint32_t v )
+{
+    p[0] = ( uint8_t )v;
+    p[1] = ( uint8_t )( v >> 8 );
+    p[2] = ( uint8_t )( v >> 16 );
+    p[3] = ( uint8_t )( v >> 24 );
+}
+
+static inline void LoadBlock( uint32_t words[4], const uint8_t* bytes )
+{
+    words[0] = LoadLe32( bytes );
+    words[1] = LoadLe32( bytes + 4 );
+    words[2] = LoadLe32( bytes + 8 );
+    words[3] = LoadLe32( bytes + 12 );
+}
+
+static inline void StoreBlock( uint8_t* bytes, const uint32_t words[4] )
+{
+    StoreLe32( bytes, words[0] );
+    StoreLe32( bytes + 4, words[1] );
+    StoreLe32( bytes + 8, words[2] );
+    StoreLe32( bytes + 12, words[3] );
+}
+
+static inline void XorBlock( uint32_t x[4], const uint8_t* bytes )
+{
+    x[0] ^= LoadLe32( bytes );
+    x[1] ^= LoadLe32( bytes + 4 );
+    x[2] ^= LoadLe32( bytes + 8 );
+    x[3] ^= LoadLe32( bytes + 12 );
+}
+
+void AES_CMAC_Init( AES_CMAC_CTX* ctx )
+{
+    // The key schedule is fully overwritten by AES_CMAC_SetKey, only the
+    // chaining state needs clearing.
+    memset( ctx->X, 0, sizeof( ctx->X ) );
+    memset( ctx->M_last, 0, sizeof( ctx->M_last ) );
+    ctx->M_n = 0;
+}
+
+void AES_CMAC_SetKey( AES_CMAC_CTX* ctx, const uint8_t key[AES_CMAC_KEY_LENGTH] )
+{
+    aes_set_key( key, AES_CMAC_KEY_LENGTH, &ctx->rijndael );
+}
+
+void AES_CMAC_Update( AES_CMAC_CTX* ctx, const uint8_t* data, uint32_t len )
+{
+    // For AES-128 the first round key is the cipher key itself
+    const AesKeyCacheEntry_t* entry = AesKeyCacheGet( ctx->rijndael.ksch );
+    uint32_t x[4];
+
+    if( ctx->M_n > 0 )
+    {
+        uint32_t mlen = AES_CMAC_KEY_LENGTH - ctx->M_n;
+
+        if( mlen > len )
+        {
+            mlen = len;
+        }
+
+        memcpy( ctx->M_last + ctx->M_n, data, mlen );
+        ctx->M_n += mlen;
+
+        // The last block is held back for AES_CMAC_Final
+        if( ( ctx->M_n < AES_CMAC_KEY_LENGTH ) || ( len == mlen ) )
+        {
+            return;
+        }
+
+        LoadBlock( x, ctx->X );
+        XorBlock( x, ctx->M_last );
+        AesEncryptWords( entry->RoundKeys, AES_KEY_CACHE_ROUNDS, x );
+        StoreBlock( ctx->X, x );
+
+        data += mlen;
+        len -= mlen;
+    }
+
+    if( len > AES_CMAC_KEY_LENGTH )
+    {
+        LoadBlock( x, ctx->X );
+
+        do
+        {
+            XorBlock( x, data );
+            AesEncryptWords( entry->RoundKeys, AES_KEY_CACHE_ROUNDS, x );
+
+            data += AES_CMAC_KEY_LENGTH;
+            len -= AES_CMAC_KEY_LENGTH;
+        } while( len > AES_CMAC_KEY_LENGTH );
+
+        StoreBlock( ctx->X, x );
+    }
+
+    memcpy( ctx->M_last, data, len );
+    ctx->M_n = len;
+}
+
+void AES_CMAC_Final( uint8_t digest[AES_CMAC_DIGEST_LENGTH], AES_CMAC_CTX* ctx )
+{
+    AesKeyCacheEntry_t* entry = AesKeyCacheGet( ctx->rijndael.ksch );
+    const uint32_t* k1;
+    const uint32_t* k2;
+    const uint32_t* subkey;
+    uint32_t x[4];
+
+    AesKeyCacheGetCmacSubkeys( entry, &k1, &k2 );
+
+    if( ctx->M_n == AES_CMAC_KEY_LENGTH )
+    {
+        subkey = k1;
+    }
+    else
+    {
+        // Pad the incomplete last block with 10..0
+        ctx->M_last[ctx->M_n] = 0x80;
+        memset( ctx->M_last + ctx->M_n + 1, 0, AES_CMAC_KEY_LENGTH - ctx->M_n - 1 );
+        subkey = k2;
+    }
+
+    LoadBlock( x, ctx->X );
+    XorBlock( x, ctx->M_last );
+    x[0] ^= subkey[0];
+    x[1] ^= subkey[1];
+    x[2] ^= subkey[2];
+    x[3] ^= subkey[3];
+
+    AesEncryptWords( entry->RoundKeys, AES_KEY_CACHE_ROUNDS, x );
+    StoreBlock( digest, x );
+
+    memset( ctx->X, 0, sizeof( ctx->X ) );
+    memset( ctx->M_last, 0, sizeof( ctx->M_last ) );
+    ctx->M_n = 0;
+}
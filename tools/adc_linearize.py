@@ -0,0 +1,198 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+#
+# SPDX-License-Identifier: BSD-3-Clause
+#
+
+"""ADC linearization table of the current_voltage_sensor example, from a
+ramp capture.
+
+Feed a slow triangle or sawtooth over slightly more than the whole ADC
+input range (0 to 3.3 V) into one of the inputs, capture it as a trace with
+tools/waveform_capture.py and build the table:
+
+  python3 tools/waveform_capture.py /dev/ttyACM0 ramp.mtr --seconds 60
+  python3 tools/adc_linearize.py ramp.mtr adc.uf2
+  python3 tools/adc_linearize.py ramp.mtr adc.bin --channel 1
+
+A linear ramp hits every code in proportion to its width (code density
+test), so the widths give the transition levels and where the middle of
+every code really is. The straight line through those is taken out, gain
+and offset are left to the calibration, and what remains is saved per
+code in 1/8 ADC counts (meter/include/meter/linearization.h). The codes at
+the ends of the ramp, clipped or not reached, are left uncorrected.
+
+UF2 files are drag-and-dropped or loaded with picotool onto the two flash
+sectors below the example's configuration, without touching the rest of
+the flash; BIN files are the table as saved there, for meter_replay
+--linearization. Aim for some 100 samples per code, a million samples in
+total, fewer make the corrections noisy.
+"""
+
+import argparse
+import struct
+import sys
+import zlib
+
+CODES = 4096
+STEPS = 8
+VERSION = 1
+
+TRACE_HEADER = struct.Struct('<4sBBBBII')
+TRACE_BLOCK = struct.Struct('<IIHH')
+
+# two sectors below the configuration, two below the billing registers,
+# two below the LoRaWAN NVM sector, see examples/current_voltage_sensor;
+# inside PICO_LORAWAN_FUOTA_APP_DATA_SECTORS with firmware update
+XIP_BASE = 0x10000000
+FLASH_SECTOR_SIZE = 4096
+TABLE_SECTORS_FROM_END = 7
+
+UF2_MAGIC_START0 = 0x0a324655
+UF2_MAGIC_START1 = 0x9e5d5157
+UF2_MAGIC_END = 0x0ab16f30
+UF2_FLAG_FAMILY_ID = 0x00002000
+UF2_FAMILY_RP2040 = 0xe48bff56
+UF2_PAYLOAD = 256
+
+
+def read_trace(path, channel):
+    """Returns the samples of one channel of an ADC trace"""
+    with open(path, 'rb') as f:
+        data = f.read()
+
+    magic, version, channels, bits, _, _, _ = TRACE_HEADER.unpack_from(data)
+    if magic != b'MTRC' or version != 1 or bits != 12:
+        raise ValueError('%s: not a trace' % path)
+    if channel >= channels:
+        raise ValueError('%s: %d channels' % (path, channels))
+
+    samples = []
+    pos = TRACE_HEADER.size
+    while pos + TRACE_BLOCK.size <= len(data):
+        _, _, rows, _ = TRACE_BLOCK.unpack_from(data, pos)
+        count = rows * channels
+        size = (count * 3 + 1) // 2
+        packed = data[pos + TRACE_BLOCK.size:pos + TRACE_BLOCK.size + size]
+        pos += TRACE_BLOCK.size + size
+        if len(packed) < size:
+            break
+        for i in range(channel, count, channels):
+            b = packed[3 * (i // 2):3 * (i // 2) + 3]
+            samples.append(b[0] | ((b[1] & 0x0f) << 8) if i % 2 == 0 else (b[1] >> 4) | (b[2] << 4))
+
+    return samples
+
+
+def corrections(samples):
+    """Returns the corrections per code in ADC counts, the first and last
+    corrected code and the largest DNL"""
+    hits = [0] * CODES
+    for s in samples:
+        hits[s] += 1
+
+    used = [code for code in range(CODES) if hits[code] > 0]
+    if len(used) < 2:
+        raise ValueError('no ramp in the capture')
+
+    # the end codes also count everything beyond the ramp
+    first, last = used[0] + 1, used[-1] - 1
+    if last - first < CODES // 2:
+        raise ValueError('ramp covers codes %d to %d only, it should cover them all' % (used[0], used[-1]))
+
+    mean = sum(hits[first:last + 1]) / (last - first + 1)
+    widths = [hits[code] / mean for code in range(first, last + 1)]
+
+    # middle of every code from the transition levels below it
+    middles = []
+    level = first - 0.5
+    for width in widths:
+        middles.append(level + width / 2)
+        level += width
+
+    # least squares line through the middles, the calibration takes it
+    codes = range(first, last + 1)
+    n = len(middles)
+    mean_code = sum(codes) / n
+    mean_middle = sum(middles) / n
+    slope = (sum((c - mean_code) * (m - mean_middle) for c, m in zip(codes, middles)) /
+             sum((c - mean_code) ** 2 for c in codes))
+
+    table = [0.0] * CODES
+    for code, middle in zip(codes, middles):
+        table[code] = (middle - mean_middle) / slope + mean_code - code
+
+    dnl = max(abs(width - 1) for width in widths)
+
+    return table, first, last, dnl, mean
+
+
+def pack(table, ramp_samples):
+    steps = []
+    clipped = 0
+    for correction in table:
+        step = int(round(correction * STEPS))
+        if not -128 <= step <= 127:
+            clipped += 1
+            step = max(-128, min(127, step))
+        steps.append(step)
+
+    data = struct.pack('<2sBBI', b'AL', VERSION, 0, ramp_samples & 0xffffffff)
+    data += struct.pack('<%db' % CODES, *steps)
+    data += struct.pack('<I', zlib.crc32(data))
+
+    return data, clipped
+
+
+def uf2(data, address):
+    """UF2 blocks of data at address, 256 bytes each like picotool writes"""
+    data += bytes(-len(data) % UF2_PAYLOAD)
+    count = len(data) // UF2_PAYLOAD
+    blocks = bytearray()
+
+    for i in range(count):
+        payload = data[i * UF2_PAYLOAD:(i + 1) * UF2_PAYLOAD]
+        blocks += struct.pack('<IIIIIIII', UF2_MAGIC_START0, UF2_MAGIC_START1, UF2_FLAG_FAMILY_ID,
+                              address + i * UF2_PAYLOAD, UF2_PAYLOAD, i, count, UF2_FAMILY_RP2040)
+        blocks += payload + bytes(476 - UF2_PAYLOAD)
+        blocks += struct.pack('<I', UF2_MAGIC_END)
+
+    return bytes(blocks)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('trace', help='ramp capture, .mtr')
+    parser.add_argument('output', help='table, .uf2 or .bin')
+    parser.add_argument('--channel', type=int, default=0, help='trace channel of the ramp, 0 voltage, 1 current')
+    parser.add_argument('--flash-size', type=lambda text: int(text, 0), default=2 * 1024 * 1024,
+                        help='PICO_FLASH_SIZE_BYTES of the board (2 MB)')
+    args = parser.parse_args()
+
+    try:
+        samples = read_trace(args.trace, args.channel)
+        table, first, last, dnl, mean = corrections(samples)
+    except (OSError, ValueError, struct.error) as e:
+        sys.exit(str(e))
+
+    data, clipped = pack(table, len(samples))
+
+    print('%d samples, codes %d to %d corrected, %.0f samples per code' % (len(samples), first, last, mean))
+    print('max DNL %.2f, max INL %.2f counts' % (dnl, max(abs(c) for c in table)))
+    if mean < 32:
+        print('warning: few samples per code, use a slower ramp or a longer capture', file=sys.stderr)
+    if clipped:
+        print('warning: %d corrections beyond 16 counts clipped' % clipped, file=sys.stderr)
+
+    if args.output.endswith('.uf2'):
+        address = XIP_BASE + args.flash_size - TABLE_SECTORS_FROM_END * FLASH_SECTOR_SIZE
+        data = uf2(data, address)
+        print('table at 0x%08x' % address)
+
+    with open(args.output, 'wb') as f:
+        f.write(data)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,60 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+#
+# SPDX-License-Identifier: BSD-3-Clause
+#
+
+"""Multi-circuit uplinks of the current_voltage_sensor example, port 7.
+
+With more than one circuit configured (tools/config.py set --circuits),
+the readings of all of them are sent together instead of the port 2
+readings. Decodes one given in hex:
+
+  python3 tools/circuits.py 0102d8590002...
+
+The format is described in meter/include/meter/circuits.h, the age of the
+values in s follows it.
+"""
+
+import argparse
+import struct
+import sys
+
+ENCODING_VERSION = 1
+HEADER = struct.Struct('<BBH')
+CIRCUIT = struct.Struct('<HihII')
+AGE = struct.Struct('<H')
+
+
+def decode(payload):
+    if len(payload) < HEADER.size or payload[0] != ENCODING_VERSION:
+        sys.exit('not a version %u circuits uplink' % ENCODING_VERSION)
+
+    _, count, voltage = HEADER.unpack_from(payload)
+    if len(payload) != HEADER.size + count * CIRCUIT.size + AGE.size:
+        sys.exit('%u circuits take %u bytes' % (count, HEADER.size + count * CIRCUIT.size + AGE.size))
+
+    age, = AGE.unpack_from(payload, HEADER.size + count * CIRCUIT.size)
+
+    print('voltage         %.2f V' % (voltage / 100))
+    print('age             %u s' % age)
+    for i in range(count):
+        current, power, power_factor, imported, exported = CIRCUIT.unpack_from(payload, HEADER.size + i * CIRCUIT.size)
+        print('circuit %u' % (i + 1))
+        print('  current       %.2f A' % (current / 100))
+        print('  active power  %.1f W' % (power / 10))
+        print('  power factor  %.3f' % (power_factor / 1000))
+        print('  energy        %u Wh import, %u Wh export' % (imported, exported))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('payload', help='hex')
+    args = parser.parse_args()
+
+    decode(bytes.fromhex(args.payload))
+
+
+if __name__ == '__main__':
+    main()
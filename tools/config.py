@@ -0,0 +1,121 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+#
+# SPDX-License-Identifier: BSD-3-Clause
+#
+
+"""Configuration downlinks and answers of the current_voltage_sensor
+example, port 6.
+
+Builds the hex payload of a downlink that reads the configuration, sets
+some of its parameters, all of them or none if one is out of range, or
+restores the defaults:
+
+  python3 tools/config.py get
+  python3 tools/config.py set --samples 2000 --report-interval 60
+  python3 tools/config.py set --current-calibration 51.61 --voltage-calibration 897.6
+  python3 tools/config.py set --circuits 3 --circuit2-calibration 30 --circuit3-calibration 30
+  python3 tools/config.py defaults
+
+and decodes the answer uplink given in hex:
+
+  python3 tools/config.py decode 0200d007...
+"""
+
+import argparse
+import struct
+import sys
+
+COMMAND_GET = 0x01
+COMMAND_SET = 0x02
+COMMAND_DEFAULTS = 0x03
+
+# id, option, value format, scale, unit, range checked by the device
+PARAMETERS = [
+    (0x01, 'samples', 'H', 1, '', (100, 10000)),
+    (0x02, 'current_calibration', 'I', 1000, ' A full scale', (1, 10000)),
+    (0x03, 'voltage_calibration', 'I', 1000, ' V full scale', (1, 10000)),
+    (0x04, 'report_interval', 'H', 1, ' s', (10, 3600)),
+    (0x05, 'measure_period', 'H', 1, ' ms', (200, 60000)),
+    (0x06, 'circuits', 'H', 1, '', (1, 3)),
+    (0x07, 'circuit2_calibration', 'I', 1000, ' A full scale', (1, 10000)),
+    (0x08, 'circuit3_calibration', 'I', 1000, ' A full scale', (1, 10000)),
+]
+
+COMMANDS = {COMMAND_GET: 'get', COMMAND_SET: 'set', COMMAND_DEFAULTS: 'defaults'}
+STATUS_OK = 0x00
+STATUS_MALFORMED = 0xff
+ANSWER = struct.Struct('<BBHIIHHHII')
+
+
+def encode_set(args):
+    payload = struct.pack('<B', COMMAND_SET)
+    for parameter_id, name, value_format, scale, _, (low, high) in PARAMETERS:
+        value = getattr(args, name)
+        if value is None:
+            continue
+        if not low <= value <= high:
+            sys.exit('%s: %s out of range, %s to %s' % (name.replace('_', '-'), value, low, high))
+        payload += struct.pack('<B' + value_format, parameter_id, round(value * scale))
+    if len(payload) == 1:
+        sys.exit('nothing to set')
+    return payload
+
+
+def decode(payload):
+    if len(payload) != ANSWER.size:
+        sys.exit('not an answer of %u bytes' % ANSWER.size)
+
+    command, status, *values = ANSWER.unpack(payload)
+
+    if status == STATUS_OK:
+        status_text = 'applied' if command != COMMAND_GET else 'ok'
+    elif status == STATUS_MALFORMED:
+        status_text = 'malformed or unknown command, nothing changed'
+    else:
+        names = {parameter[0]: parameter[1] for parameter in PARAMETERS}
+        status_text = '%s out of range, nothing changed' % names.get(status, 'parameter %u' % status).replace('_', '-')
+
+    print('%-20s %s' % ('command', COMMANDS.get(command, '%02x' % command)))
+    print('%-20s %s' % ('status', status_text))
+    for (_, name, _, scale, unit, _), value in zip(PARAMETERS, values):
+        print('%-20s %s%s' % (name.replace('_', '-'), value / scale if scale > 1 else value, unit))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    commands = parser.add_subparsers(dest='command', required=True)
+
+    commands.add_parser('get', help='configuration request downlink')
+
+    set_parser = commands.add_parser('set', help='set parameters downlink')
+    set_parser.add_argument('--samples', type=int, help='samples per input and measurement')
+    set_parser.add_argument('--current-calibration', type=float, help='A at ADC full scale, 3 decimals')
+    set_parser.add_argument('--voltage-calibration', type=float, help='V at ADC full scale, 3 decimals')
+    set_parser.add_argument('--report-interval', type=int, help='readings uplink period in s')
+    set_parser.add_argument('--measure-period', type=int, help='measurement period in ms')
+    set_parser.add_argument('--circuits', type=int, help='currents on ADC1 onwards, 1 for the single circuit, '
+                            'up to 2 on boards with VSYS on ADC3')
+    set_parser.add_argument('--circuit2-calibration', type=float, help='circuit 2, A at ADC full scale, 3 decimals')
+    set_parser.add_argument('--circuit3-calibration', type=float, help='circuit 3, A at ADC full scale, 3 decimals')
+
+    commands.add_parser('defaults', help='restore the defaults downlink')
+
+    decode_parser = commands.add_parser('decode', help='decode an answer uplink')
+    decode_parser.add_argument('payload', help='hex')
+
+    args = parser.parse_args()
+
+    if args.command == 'get':
+        print('%02x' % COMMAND_GET)
+    elif args.command == 'set':
+        print(encode_set(args).hex())
+    elif args.command == 'defaults':
+        print('%02x' % COMMAND_DEFAULTS)
+    else:
+        decode(bytes.fromhex(args.payload))
+
+
+if __name__ == '__main__':
+    main()
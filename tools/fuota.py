@@ -0,0 +1,215 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+#
+# SPDX-License-Identifier: BSD-3-Clause
+#
+
+"""Firmware update files for pico_lorawan_bootloader, see
+src/include/pico/lorawan_fuota.h.
+
+Makes the Ed25519 key pair of the updates, the private key goes to a file
+that stays with whoever builds them, the public key is printed for the
+device (LORAWAN_FUOTA_PUBLIC_KEY in the example's config.h):
+
+  python3 tools/fuota.py keygen update.key
+
+packs the .bin of an application linked with pico_lorawan_fuota_app(...)
+into an update file signed with the private key:
+
+  python3 tools/fuota.py pack --key update.key --version 2 app.bin app.fuota
+
+and splits an update file into the DataFragment commands of a
+fragmentation session on port 201, one hex payload per line, the uncoded
+fragments followed by parity fragments as TS004 specifies:
+
+  python3 tools/fuota.py fragment --size 232 --redundancy 10 app.fuota
+
+The fragment count and padding for FragSessionSetupReq go to stderr.
+"""
+
+import argparse
+import hashlib
+import os
+import struct
+import sys
+
+FILE_MAGIC = 0x57464c50
+FILE_VERSION = 1
+FILE_HEADER_SIZE = 80
+
+DATA_FRAGMENT = 0x08
+PORT = 201
+
+# Ed25519 signing after the reference code of RFC 8032, section 6
+P = 2 ** 255 - 19
+Q = 2 ** 252 + 27742317777372353535851937790883648493
+D = -121665 * pow(121666, P - 2, P) % P
+SQRT_M1 = pow(2, (P - 1) // 4, P)
+
+
+def recover_x(y, sign):
+    x2 = (y * y - 1) * pow(D * y * y + 1, P - 2, P)
+    x = pow(x2, (P + 3) // 8, P)
+    if (x * x - x2) % P != 0:
+        x = x * SQRT_M1 % P
+    if x & 1 != sign:
+        x = P - x
+    return x
+
+
+BASE_Y = 4 * pow(5, P - 2, P) % P
+BASE_X = recover_x(BASE_Y, 0)
+BASE = (BASE_X, BASE_Y, 1, BASE_X * BASE_Y % P)
+
+
+def point_add(p, q):
+    a = (p[1] - p[0]) * (q[1] - q[0]) % P
+    b = (p[1] + p[0]) * (q[1] + q[0]) % P
+    c = 2 * p[3] * q[3] * D % P
+    d = 2 * p[2] * q[2] % P
+    e, f, g, h = b - a, d - c, d + c, b + a
+    return (e * f, g * h, f * g, e * h)
+
+
+def point_mul(s, p):
+    q = (0, 1, 1, 0)
+    while s > 0:
+        if s & 1:
+            q = point_add(q, p)
+        p = point_add(p, p)
+        s >>= 1
+    return q
+
+
+def point_compress(p):
+    z = pow(p[2], P - 2, P)
+    x = p[0] * z % P
+    y = p[1] * z % P
+    return (y | (x & 1) << 255).to_bytes(32, 'little')
+
+
+def secret_expand(secret):
+    h = hashlib.sha512(secret).digest()
+    a = int.from_bytes(h[:32], 'little')
+    a &= (1 << 254) - 8
+    a |= 1 << 254
+    return a, h[32:]
+
+
+def public_key(secret):
+    return point_compress(point_mul(secret_expand(secret)[0], BASE))
+
+
+def sign(secret, message):
+    a, prefix = secret_expand(secret)
+    r = int.from_bytes(hashlib.sha512(prefix + message).digest(), 'little') % Q
+    encoded_r = point_compress(point_mul(r, BASE))
+    h = int.from_bytes(hashlib.sha512(encoded_r + public_key(secret) + message).digest(), 'little') % Q
+    return encoded_r + ((r + h * a) % Q).to_bytes(32, 'little')
+
+
+def read_key(path):
+    try:
+        with open(path) as f:
+            key = bytes.fromhex(f.read().strip())
+    except (OSError, ValueError):
+        key = b''
+    if len(key) != 32:
+        raise argparse.ArgumentTypeError('%s does not hold a private key of 64 hex digits' % path)
+    return key
+
+
+def pack(key, version, image):
+    if image[0x100 + 4:0x100 + 8] == bytes(4):
+        print('warning: no reset vector at 0x100, is the image linked with pico_lorawan_fuota_app(...)?', file=sys.stderr)
+    header = struct.pack('<IB3xII', FILE_MAGIC, FILE_VERSION, len(image), version)
+    return header + sign(key, header + image) + image
+
+
+def prbs23(x):
+    return (x >> 1) + (((x & 1) ^ ((x & 0x20) >> 5)) << 22)
+
+
+def parity_row(n, m):
+    """Uncoded fragments XORed into parity fragment n, TS004 section 3.2"""
+    m_temp = 1 if m & (m - 1) == 0 else 0
+    x = 1 + 1001 * n
+    row = [0] * m
+    coefficients = 0
+    while coefficients < m // 2:
+        r = 1 << 16
+        while r >= m:
+            x = prbs23(x)
+            r = x % (m + m_temp)
+        row[r] = 1
+        coefficients += 1
+    return row
+
+
+def fragments(data, size, redundancy, index):
+    padding = -len(data) % size
+    data = data + bytes(padding)
+    uncoded = [data[i:i + size] for i in range(0, len(data), size)]
+    m = len(uncoded)
+
+    if m >= 1 << 14:
+        raise SystemExit('%u fragments, at most %u fit the fragment counter' % (m, (1 << 14) - 1))
+
+    coded = []
+    for n in range(1, redundancy + 1):
+        parity = bytearray(size)
+        for j, used in enumerate(parity_row(n, m)):
+            if used:
+                for i in range(size):
+                    parity[i] ^= uncoded[j][i]
+        coded.append(bytes(parity))
+
+    for counter, fragment in enumerate(uncoded + coded, 1):
+        yield struct.pack('<BH', DATA_FRAGMENT, index << 14 | counter) + fragment
+
+    print('%u fragments of %u bytes, padding %u, %u parity fragments, port %u' %
+          (m, size, padding, redundancy, PORT), file=sys.stderr)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    commands = parser.add_subparsers(dest='command', required=True)
+
+    keygen_parser = commands.add_parser('keygen', help='make a key pair, print the public key')
+    keygen_parser.add_argument('key', help='private key file to create')
+
+    pack_parser = commands.add_parser('pack', help='build an update file from an application .bin')
+    pack_parser.add_argument('--key', type=read_key, required=True, help='private key file from keygen')
+    pack_parser.add_argument('--version', type=lambda text: int(text, 0), required=True, help='image version, 32-bit')
+    pack_parser.add_argument('image', type=argparse.FileType('rb'))
+    pack_parser.add_argument('output', type=argparse.FileType('wb'))
+
+    fragment_parser = commands.add_parser('fragment', help='DataFragment payloads of an update file')
+    fragment_parser.add_argument('--size', type=int, default=232, help='fragment size, at most FRAG_MAX_SIZE')
+    fragment_parser.add_argument('--redundancy', type=int, default=10, help='parity fragments')
+    fragment_parser.add_argument('--index', type=int, choices=range(4), default=0, help='fragmentation session')
+    fragment_parser.add_argument('file', type=argparse.FileType('rb'))
+
+    args = parser.parse_args()
+
+    if args.command == 'keygen':
+        secret = os.urandom(32)
+        try:
+            fd = os.open(args.key, os.O_WRONLY | os.O_CREAT | os.O_EXCL, 0o600)
+        except FileExistsError:
+            raise SystemExit('%s exists, not overwriting a private key' % args.key)
+        with os.fdopen(fd, 'w') as f:
+            f.write(secret.hex() + '\n')
+        print(public_key(secret).hex().upper())
+    elif args.command == 'pack':
+        data = pack(args.key, args.version, args.image.read())
+        args.output.write(data)
+        print('%u bytes, signed by %s' % (len(data), public_key(args.key).hex().upper()), file=sys.stderr)
+    else:
+        for payload in fragments(args.file.read(), args.size, args.redundancy, args.index):
+            print(payload.hex())
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,192 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+#
+# SPDX-License-Identifier: BSD-3-Clause
+#
+
+"""Decoder for pico/lorawan_log.h deferred binary log records.
+
+Reads the USB serial stream (a capture file, stdin, or a tty), passes plain
+text through unchanged and renders every binary log chunk using the format
+strings from the firmware ELF:
+
+  python3 tools/log_decode.py build/examples/current_voltage_sensor/app.elf /dev/ttyACM0
+  python3 tools/log_decode.py app.elf capture.bin
+"""
+
+import argparse
+import re
+import struct
+import sys
+
+SYNC = b'\xa5\x5a'
+
+SHT_NOBITS = 8
+SHF_ALLOC = 0x2
+
+CONVERSION_RE = re.compile(r'%([-+ #0]*)(\*|\d+)?(?:\.(\*|\d+))?(hh|h|ll|l|j|z|t|L)?([diouxXeEfFgGaAcspn%])')
+
+
+class Elf:
+    def __init__(self, path):
+        with open(path, 'rb') as f:
+            self.data = f.read()
+
+        if self.data[:4] != b'\x7fELF' or self.data[4] != 1 or self.data[5] != 1:
+            raise ValueError('%s is not a little-endian ELF32 file' % path)
+
+        shoff, = struct.unpack_from('<I', self.data, 0x20)
+        shentsize, shnum = struct.unpack_from('<HH', self.data, 0x2e)
+
+        self.sections = []
+        for i in range(shnum):
+            (name, type_, flags, addr, offset, size) = struct.unpack_from('<IIIIII', self.data, shoff + i * shentsize)
+            if (flags & SHF_ALLOC) and type_ != SHT_NOBITS and size > 0:
+                self.sections.append((addr, size, offset))
+
+    def string(self, address):
+        for addr, size, offset in self.sections:
+            if addr <= address < addr + size:
+                start = offset + address - addr
+                end = self.data.index(b'\0', start)
+                return self.data[start:end].decode('utf-8', errors='replace')
+        return None
+
+
+def render(elf, fmt, args):
+    out = []
+    pos = 0
+    args = list(args)
+
+    for m in CONVERSION_RE.finditer(fmt):
+        out.append(fmt[pos:m.start()])
+        pos = m.end()
+
+        flags, width, precision, _length, conv = m.groups()
+        if conv == '%':
+            out.append('%')
+            continue
+
+        value = args.pop(0) if args else 0
+        spec = '%' + (flags or '') + (width if width and width != '*' else '') + ('.' + precision if precision and precision != '*' else '')
+
+        if conv in 'di':
+            out.append((spec + 'd') % struct.unpack('<i', struct.pack('<I', value))[0])
+        elif conv in 'ouxX':
+            out.append((spec + (conv if conv != 'u' else 'd')) % value)
+        elif conv in 'eEfFgGaA':
+            out.append((spec + (conv if conv not in 'aA' else 'e')) % struct.unpack('<f', struct.pack('<I', value))[0])
+        elif conv == 'c':
+            out.append(chr(value & 0xff))
+        elif conv == 's':
+            text = elf.string(value)
+            out.append((spec + 's') % (text if text is not None else '<0x%08x>' % value))
+        elif conv == 'p':
+            out.append('0x%08x' % value)
+
+    out.append(fmt[pos:])
+    return ''.join(out)
+
+
+class Decoder:
+    def __init__(self, elf, output):
+        self.elf = elf
+        self.output = output
+        self.pending = b''
+        self.last_timestamp = None
+        self.time_base = 0
+        self.at_line_start = True
+
+    def text(self, data):
+        self.output.write(data.decode('utf-8', errors='replace'))
+        if data:
+            self.at_line_start = data.endswith(b'\n')
+
+    def records(self, data):
+        pos = 0
+        while pos + 8 <= len(data):
+            header, timestamp = struct.unpack_from('<II', data, pos)
+            nargs = (header >> 24) & 0x0f
+            address = header & 0xf0ffffff
+            args = struct.unpack_from('<%dI' % nargs, data, pos + 8)
+            pos += 8 + 4 * nargs
+
+            # time_us_32() wraps every ~71.6 minutes
+            if self.last_timestamp is not None and timestamp < self.last_timestamp:
+                self.time_base += 1 << 32
+            self.last_timestamp = timestamp
+            seconds = (self.time_base + timestamp) / 1e6
+
+            fmt = self.elf.string(address)
+            if fmt is None:
+                line = '<unknown format 0x%08x> %s\n' % (address, ' '.join('0x%08x' % a for a in args))
+            else:
+                line = render(self.elf, fmt, args)
+
+            if not self.at_line_start:
+                self.output.write('\n')
+            self.output.write('[%12.6f] %s' % (seconds, line))
+            self.at_line_start = line.endswith('\n')
+
+    def feed(self, data):
+        self.pending += data
+
+        while self.pending:
+            start = self.pending.find(SYNC)
+            if start < 0:
+                # keep a trailing first sync byte, it may be completed by the next read
+                keep = 1 if self.pending.endswith(SYNC[:1]) else 0
+                self.text(self.pending[:len(self.pending) - keep])
+                self.pending = self.pending[len(self.pending) - keep:]
+                return
+
+            self.text(self.pending[:start])
+            self.pending = self.pending[start:]
+
+            if len(self.pending) < 4:
+                return
+
+            length, = struct.unpack_from('<H', self.pending, 2)
+            if len(self.pending) < 5 + length:
+                return
+
+            payload = self.pending[4:4 + length]
+            checksum = 0
+            for b in payload:
+                checksum ^= b
+
+            if checksum != self.pending[4 + length] or length % 4:
+                # not a chunk, pass the sync bytes through as text
+                self.text(self.pending[:1])
+                self.pending = self.pending[1:]
+                continue
+
+            self.records(payload)
+            self.pending = self.pending[5 + length:]
+
+        self.output.flush()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('elf', help='firmware ELF file the stream was produced by')
+    parser.add_argument('input', nargs='?', help='capture file or serial device, stdin if omitted')
+    args = parser.parse_args()
+
+    decoder = Decoder(Elf(args.elf), sys.stdout)
+
+    stream = open(args.input, 'rb', buffering=0) if args.input else sys.stdin.buffer
+
+    try:
+        while True:
+            data = stream.read(4096)
+            if not data:
+                break
+            decoder.feed(data)
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == '__main__':
+    main()
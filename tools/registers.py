@@ -0,0 +1,121 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+#
+# SPDX-License-Identifier: BSD-3-Clause
+#
+
+"""Billing register downlinks and snapshots of the current_voltage_sensor
+example, port 5.
+
+Builds the hex payload of a time-of-use schedule downlink, switch points as
+local HH:MM=tariff, the first one at 00:00:
+
+  python3 tools/registers.py schedule --utc-offset=-5:00 \\
+      --weekday 00:00=0 07:00=1 19:00=0 --weekend 00:00=2
+  python3 tools/registers.py reset-peaks
+  python3 tools/registers.py snapshot
+
+and decodes a register snapshot uplink given in hex:
+
+  python3 tools/registers.py decode 01c0c49265...
+
+The formats are described in meter/include/meter/registers.h.
+"""
+
+import argparse
+import datetime
+import struct
+import sys
+
+COMMAND_SCHEDULE = 0x01
+COMMAND_RESET_PEAKS = 0x02
+COMMAND_SNAPSHOT = 0x03
+
+TARIFFS = 4
+SWITCHES = 8
+ENCODING_VERSION = 1
+SNAPSHOT = struct.Struct('<BIIIHHHIHI')
+
+
+def parse_offset(text):
+    sign = -1 if text.startswith('-') else 1
+    hours, _, minutes = text.lstrip('+-').partition(':')
+    offset = sign * (int(hours) * 60 + int(minutes or 0))
+    if offset % 15 or abs(offset) > 14 * 60:
+        raise argparse.ArgumentTypeError('UTC offset must be whole quarter hours up to 14:00')
+    return offset
+
+
+def parse_switch(text):
+    clock, _, tariff = text.partition('=')
+    hours, _, minutes = clock.partition(':')
+    minute = int(hours) * 60 + int(minutes or 0)
+    tariff = int(tariff)
+    if minute >= 1440 or not 0 <= tariff < TARIFFS:
+        raise argparse.ArgumentTypeError('switch point %s: time up to 23:59, tariff below %u' % (text, TARIFFS))
+    return minute, tariff
+
+
+def encode_profile(name, switches):
+    minutes = [minute for minute, _ in switches]
+    if not 1 <= len(switches) <= SWITCHES or minutes[0] != 0 or minutes != sorted(set(minutes)):
+        sys.exit('%s: 1 to %u switch points, rising, the first at 00:00' % (name, SWITCHES))
+    return b''.join(struct.pack('<H', tariff << 12 | minute) for minute, tariff in switches)
+
+
+def time_text(time):
+    if time == 0:
+        return '-'
+    return datetime.datetime.fromtimestamp(time, datetime.timezone.utc).strftime('%Y-%m-%d %H:%M:%S UTC')
+
+
+def decode(payload):
+    if len(payload) != SNAPSHOT.size + 4 * TARIFFS or payload[0] != ENCODING_VERSION:
+        sys.exit('not a version %u snapshot of %u bytes' % (ENCODING_VERSION, SNAPSHOT.size + 4 * TARIFFS))
+
+    (_, time, imported, exported, block, sliding, block_peak, block_peak_time,
+     sliding_peak, sliding_peak_time) = SNAPSHOT.unpack_from(payload)
+    tariffs = struct.unpack_from('<%uI' % TARIFFS, payload, SNAPSHOT.size)
+
+    print('time            %s' % time_text(time))
+    print('import          %u Wh' % imported)
+    for tariff, energy in enumerate(tariffs):
+        print('  tariff %u      %u Wh' % (tariff, energy))
+    print('export          %u Wh' % exported)
+    print('demand          %u W last block, %u W sliding' % (block, sliding))
+    print('peak block      %u W, interval ending %s' % (block_peak, time_text(block_peak_time)))
+    print('peak sliding    %u W, interval ending %s' % (sliding_peak, time_text(sliding_peak_time)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    commands = parser.add_subparsers(dest='command', required=True)
+
+    schedule = commands.add_parser('schedule', help='time-of-use schedule downlink')
+    schedule.add_argument('--utc-offset', type=parse_offset, default=0, help='local time - UTC, [-]HH:MM')
+    schedule.add_argument('--weekday', type=parse_switch, nargs='+', required=True, help='Monday to Friday')
+    schedule.add_argument('--weekend', type=parse_switch, nargs='+', required=True, help='Saturday and Sunday')
+
+    commands.add_parser('reset-peaks', help='new billing period downlink')
+    commands.add_parser('snapshot', help='snapshot request downlink')
+
+    decode_parser = commands.add_parser('decode', help='decode a snapshot uplink')
+    decode_parser.add_argument('payload', help='hex')
+
+    args = parser.parse_args()
+
+    if args.command == 'schedule':
+        payload = (struct.pack('<BbB', COMMAND_SCHEDULE, args.utc_offset // 15, len(args.weekday) << 4 | len(args.weekend)) +
+                   encode_profile('weekday', args.weekday) + encode_profile('weekend', args.weekend))
+        print(payload.hex())
+    elif args.command == 'reset-peaks':
+        print('%02x' % COMMAND_RESET_PEAKS)
+    elif args.command == 'snapshot':
+        print('%02x' % COMMAND_SNAPSHOT)
+    else:
+        decode(bytes.fromhex(args.payload))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,172 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+#
+# SPDX-License-Identifier: BSD-3-Clause
+#
+
+"""Reader for the current_voltage_sensor SD card log (LOGnnnnn.MLG).
+
+Checks every sector (magic, CRC, sequence) and writes the measurement
+records, or with --events the voltage event records, as CSV:
+
+  python3 tools/sdlog_read.py LOG00003.MLG > readings.csv
+  python3 tools/sdlog_read.py LOG00003.MLG --events > events.csv
+  python3 tools/sdlog_read.py LOG00003.MLG --from 3600 --to 7200
+
+--from / --to select records by their time stamp, in the time base of the
+file header (seconds since boot or since 1970 UTC). The start is found
+through the index sectors without reading the data before it.
+
+The format is described in meter/include/meter/sector_log.h. Bad sectors,
+sequence gaps and records the device dropped for lack of buffers are
+reported on stderr.
+"""
+
+import argparse
+import struct
+import sys
+import zlib
+
+SECTOR_SIZE = 512
+VERSION = 1
+HEADER = struct.Struct('<2sBBIIHH')
+
+SECTOR_HEADER = 0
+SECTOR_DATA = 1
+SECTOR_INDEX = 2
+
+RECORD_MEASUREMENT = 1
+RECORD_EVENT = 2
+RECORD_DROPPED = 255
+
+TIME_BASES = {0: 'uptime', 1: 'unix'}
+EVENT_TYPES = {1: 'sag', 2: 'swell', 3: 'interruption'}
+
+
+class Sector:
+    def __init__(self, data):
+        (magic, self.type, version, self.sequence, self.time, self.length, self.count) = HEADER.unpack_from(data)
+        (crc,) = struct.unpack_from('<I', data, SECTOR_SIZE - 4)
+        self.valid = (magic == b'ML' and version == VERSION and
+                      self.length <= SECTOR_SIZE - HEADER.size - 4 and
+                      crc == zlib.crc32(data[:SECTOR_SIZE - 4]) & 0xffffffff)
+        self.payload = data[HEADER.size:HEADER.size + self.length]
+
+
+class Log:
+    def __init__(self, path):
+        self.file = open(path, 'rb')
+        self.file.seek(0, 2)
+        self.sectors = self.file.tell() // SECTOR_SIZE
+
+        header = self.read(0)
+        if header is None or not header.valid or header.type != SECTOR_HEADER:
+            raise ValueError('%s: no log header' % path)
+
+        (self.time_base, self.interval, _, self.start) = struct.unpack_from('<BBHI', header.payload)
+        self.device = header.payload[8:].split(b'\0')[0].decode('ascii', 'replace')
+
+    def read(self, position):
+        if position >= self.sectors:
+            return None
+        self.file.seek(position * SECTOR_SIZE)
+        return Sector(self.file.read(SECTOR_SIZE))
+
+    def index(self, k):
+        """Entries (sequence, time) of the k-th index sector, None past the end"""
+        sector = self.read(k * (self.interval + 1))
+        if sector is None or not sector.valid or sector.type != SECTOR_INDEX:
+            return None
+        return [struct.unpack_from('<II', sector.payload, 8 * i) for i in range(sector.count)]
+
+    def seek(self, time):
+        """Position of the first data sector that can hold records at or after time"""
+        start = 1
+        k = 1
+        while True:
+            entries = self.index(k)
+            if not entries:
+                return start
+            for sequence, first in entries:
+                if first > time:
+                    return start
+                start = sequence
+            k += 1
+
+
+def records(payload, count):
+    offset = 0
+    for _ in range(count):
+        if offset + 6 > len(payload):
+            break
+        (kind, length, time) = struct.unpack_from('<BBI', payload, offset)
+        yield kind, time, payload[offset + 6:offset + 6 + length]
+        offset += 6 + length
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('input', help='log file copied from the card')
+    parser.add_argument('--events', action='store_true', help='write the event records instead of the measurements')
+    parser.add_argument('--from', dest='start', type=int, default=None, help='first time stamp to include')
+    parser.add_argument('--to', dest='end', type=int, default=None, help='last time stamp to include')
+    args = parser.parse_args()
+
+    log = Log(args.input)
+    print('%s: device %s, %s time base, started at %u, %u sectors' %
+          (args.input, log.device, TIME_BASES.get(log.time_base, '?'), log.start, log.sectors), file=sys.stderr)
+
+    if args.events:
+        print('time,type,start_ms,duration_ms,depth_permille')
+    else:
+        print('time,current_rms,voltage_rms,active_power,apparent_power,reactive_power,power_factor')
+
+    position = log.seek(args.start) if args.start is not None else 1
+    expected = None
+    bad = 0
+    gaps = 0
+    dropped = 0
+    written = 0
+
+    while position < log.sectors:
+        sector = log.read(position)
+        position += 1
+
+        if not sector.valid:
+            bad += 1
+            continue
+        if expected is not None and sector.sequence != expected:
+            print('gap: %u sectors missing before sector %u' % ((sector.sequence - expected) & 0xffffffff, sector.sequence),
+                  file=sys.stderr)
+            gaps += 1
+        expected = sector.sequence + 1
+
+        if sector.type != SECTOR_DATA:
+            continue
+        if args.end is not None and sector.time > args.end:
+            break
+
+        for kind, time, data in records(sector.payload, sector.count):
+            if kind == RECORD_DROPPED:
+                (count,) = struct.unpack_from('<I', data)
+                print('dropped: %u records before %u' % (count, time), file=sys.stderr)
+                dropped += count
+                continue
+            if (args.start is not None and time < args.start) or (args.end is not None and time > args.end):
+                continue
+
+            if kind == RECORD_MEASUREMENT and not args.events:
+                print('%u,%s' % (time, ','.join('%.4f' % v for v in struct.unpack_from('<6f', data))))
+                written += 1
+            elif kind == RECORD_EVENT and args.events:
+                (event_type, start_ms, duration_ms, depth) = struct.unpack_from('<BIIH', data)
+                print('%u,%s,%u,%u,%u' % (time, EVENT_TYPES.get(event_type, event_type), start_ms, duration_ms, depth))
+                written += 1
+
+    print('%u records, %u bad sectors, %u gaps, %u records dropped on the device' % (written, bad, gaps, dropped),
+          file=sys.stderr)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,171 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+#
+# SPDX-License-Identifier: BSD-3-Clause
+#
+
+"""Flash / RAM footprint report from a GNU ld map file.
+
+Every input section of the final link is attributed to the object file it
+came from, and object files are grouped into components (one per LoRaWAN
+region, the MAC, the radio driver, the application, ...). Sections placed in
+XIP flash count towards flash, .bss-like sections in SRAM count towards RAM,
+and initialised SRAM sections (.data, .time_critical) count towards both
+since they are copied from flash at boot.
+
+usage: size_report.py <map file> [--config NAME=VALUE ...] [--output FILE]
+"""
+
+import argparse
+import os
+import re
+import sys
+
+FLASH_BASE, FLASH_END = 0x10000000, 0x11000000
+RAM_BASE, RAM_END = 0x20000000, 0x20042000
+
+RAM_ONLY_PREFIXES = ('.bss', 'COMMON', '.noinit', '.uninitialized', '.heap', '.stack', '.scratch_x.stack', '.scratch_y.stack')
+
+SECTION_RE = re.compile(r'^ (\S+)?\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s+(\S.*)$')
+
+
+def component(path):
+    name = os.path.basename(path)
+    name = re.sub(r'\.(obj|o)$', '', name)
+    name = re.sub(r'\.(c|cpp|S)$', '', name)
+
+    archive = re.match(r'^(lib\S+\.a)\(', name)
+    if archive:
+        return 'toolchain ' + archive.group(1)
+
+    m = re.match(r'^Region(\w+)$', name)
+    if m:
+        region = m.group(1)
+        if region in ('Common',):
+            return 'region common'
+        if region.startswith('CN470'):
+            return 'region CN470'
+        return 'region ' + region
+    if name == 'Region':
+        return 'region common'
+    if name.startswith('LoRaMac'):
+        return 'loramac mac'
+    if name in ('aes', 'cmac', 'soft-se', 'soft-se-hal'):
+        return 'loramac soft-se'
+    if name.startswith('sx1276'):
+        return 'radio sx1276'
+    if name.startswith(('LmHandler', 'Lmhp', 'FragDecoder', 'NvmDataMgmt', 'CayenneLpp', 'cli')):
+        return 'loramac lmhandler'
+    if name in ('delay', 'gpio', 'nvmm', 'systime', 'timer', 'utilities'):
+        return 'loramac system'
+    if '/src/boards/rp2040/' in path.replace('\\', '/') or name.endswith('-board'):
+        return 'pico_lorawan board'
+    if name == 'lorawan':
+        return 'pico_lorawan'
+    if '/pico-sdk/' in path.replace('\\', '/') or '/pico_sdk/' in path.replace('\\', '/'):
+        return 'pico-sdk'
+    if 'ssd1306' in path.lower() or 'TextRenderer' in path:
+        return 'ssd1306'
+    return 'application ' + name
+
+
+def classify(section, address):
+    if FLASH_BASE <= address < FLASH_END:
+        return True, False
+    if RAM_BASE <= address < RAM_END:
+        if section.startswith(RAM_ONLY_PREFIXES):
+            return False, True
+        return True, True
+    return False, False
+
+
+def parse(map_path):
+    totals = {}
+    pending = None
+    in_memory_map = False
+
+    with open(map_path, errors='replace') as f:
+        for line in f:
+            line = line.rstrip('\n')
+
+            if not in_memory_map:
+                in_memory_map = line.startswith('Linker script and memory map')
+                continue
+
+            if line.startswith(' *fill*'):
+                continue
+
+            # Long section names put the address/size/file on the next line
+            m = re.match(r'^ (\.\S+|COMMON)$', line)
+            if m:
+                pending = m.group(1)
+                continue
+
+            m = SECTION_RE.match(line)
+            if not m:
+                pending = None
+                continue
+
+            section = m.group(1) or pending
+            pending = None
+            if section is None or not section.startswith(('.', 'COMMON')):
+                continue
+
+            address = int(m.group(2), 16)
+            size = int(m.group(3), 16)
+            path = m.group(4).strip()
+
+            if size == 0 or path.startswith('0x'):
+                continue
+
+            flash, ram = classify(section, address)
+            entry = totals.setdefault(component(path), [0, 0])
+            if flash:
+                entry[0] += size
+            if ram:
+                entry[1] += size
+
+    return totals
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('map', help='linker map file')
+    parser.add_argument('--config', action='append', default=[], help='configuration NAME=VALUE to record in the report')
+    parser.add_argument('--output', help='write the report to this file as well as stdout')
+    args = parser.parse_args()
+
+    totals = parse(args.map)
+
+    lines = []
+    lines.append('# size report for ' + os.path.basename(args.map))
+    for config in args.config:
+        lines.append('# ' + config)
+    lines.append('%-32s %10s %10s' % ('component', 'flash', 'ram'))
+
+    flash_total = 0
+    ram_total = 0
+    for name in sorted(totals, key=lambda n: -totals[n][0]):
+        flash, ram = totals[name]
+        flash_total += flash
+        ram_total += ram
+        lines.append('%-32s %10d %10d' % (name, flash, ram))
+
+    lines.append('%-32s %10d %10d' % ('total', flash_total, ram_total))
+
+    regions = sorted(n for n in totals if n.startswith('region '))
+    lines.append('%-32s %10d %10d' % ('total regions',
+                                       sum(totals[n][0] for n in regions),
+                                       sum(totals[n][1] for n in regions)))
+
+    report = '\n'.join(lines) + '\n'
+    sys.stdout.write(report)
+
+    if args.output:
+        with open(args.output, 'w') as f:
+            f.write(report)
+
+
+if __name__ == '__main__':
+    main()
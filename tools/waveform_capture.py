@@ -0,0 +1,309 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+#
+# SPDX-License-Identifier: BSD-3-Clause
+#
+
+"""Capture tool for the current_voltage_sensor raw waveform stream.
+
+Starts streaming on the device, checks every frame (sync, checksum, block
+sequence) and writes the voltage / current samples to a file:
+
+  python3 tools/waveform_capture.py /dev/ttyACM0 capture.wav --seconds 10
+  python3 tools/waveform_capture.py /dev/ttyACM0 capture.csv --clkdiv 959
+  python3 tools/waveform_capture.py /dev/ttyACM0 capture.wav --compress
+
+WAV files are stereo 16-bit PCM at the per-input sample rate, left is
+voltage and right is current, holding the raw 12-bit ADC counts minus 2048.
+CSV files have one "time_us,voltage,current" row per pair with raw counts.
+MTR files are ADC traces (meter/include/meter/trace.h) that meter_replay
+runs through the metering code.
+
+With --compress the device sends the samples losslessly compressed
+(meter/include/meter/wave_codec.h), about a third of the raw size for
+mains waveforms, and the tool decodes them.
+
+Dropped blocks are reported. In WAV and CSV files they are filled with
+mid-scale samples so the time axis stays continuous, traces record the gap. Reading from a capture file instead of a device
+(e.g. recorded with cat) skips the start / stop commands.
+"""
+
+import argparse
+import os
+import struct
+import sys
+import termios
+import time
+import tty
+import wave
+
+SYNC = b'WF'
+VERSION = 2
+HEADER = struct.Struct('<2sBBIIIHH')
+FLAG_GAP = 0x01
+FLAG_COMPRESSED = 0x02
+
+WAVE_VERBATIM = 15
+WAVE_ESCAPE = 16
+WAVE_PREDICTORS = (
+    lambda x1, x2, x3: 2048,
+    lambda x1, x2, x3: x1,
+    lambda x1, x2, x3: 2 * x1 - x2,
+    lambda x1, x2, x3: 3 * x1 - 3 * x2 + x3,
+)
+
+
+def checksum(data):
+    value = 0
+    for b in data:
+        value ^= b
+    return value
+
+
+def wave_decode(data, count):
+    """Decodes a meter_wave_encode block, returns (samples, bytes used)"""
+    order, k = data[0] >> 4, data[0] & 0x0f
+    bits = ''.join(format(b, '08b') for b in data[1:])
+    pos = 0
+    samples = []
+
+    if k == WAVE_VERBATIM:
+        order = count
+    elif order > 3 or k > 13:
+        raise ValueError('bad block header')
+
+    for i in range(count):
+        if i < order:
+            x = int(bits[pos:pos + 12], 2)
+            pos += 12
+        else:
+            one = bits.find('1', pos, pos + WAVE_ESCAPE)
+            if one < 0:
+                zz = int(bits[pos + WAVE_ESCAPE:pos + WAVE_ESCAPE + 16], 2)
+                pos += WAVE_ESCAPE + 16
+            else:
+                q = one - pos
+                pos = one + 1
+                zz = (q << k) | (int(bits[pos:pos + k], 2) if k else 0)
+                pos += k
+            e = (zz >> 1) ^ -(zz & 1)
+            x1 = samples[-1] if i > 0 else 0
+            x2 = samples[-2] if i > 1 else 0
+            x3 = samples[-3] if i > 2 else 0
+            x = WAVE_PREDICTORS[order](x1, x2, x3) + e
+        if pos > len(bits) or not 0 <= x <= 0x0fff:
+            raise ValueError('bad block')
+        samples.append(x)
+
+    return samples, 1 + (pos + 7) // 8
+
+
+def pack_pairs(voltage, current):
+    payload = bytearray()
+    for v, c in zip(voltage, current):
+        payload += bytes((v & 0xff, (v >> 8) | ((c & 0x0f) << 4), c >> 4))
+    return bytes(payload)
+
+
+def unpack_pairs(payload, pairs):
+    voltage = [0] * pairs
+    current = [0] * pairs
+    for i in range(pairs):
+        b0, b1, b2 = payload[3 * i], payload[3 * i + 1], payload[3 * i + 2]
+        voltage[i] = b0 | ((b1 & 0x0f) << 8)
+        current[i] = (b1 >> 4) | (b2 << 4)
+    return voltage, current
+
+
+class Frames:
+    """Splits the byte stream into checked frames, resynchronizing on errors"""
+
+    def __init__(self):
+        self.buffer = bytearray()
+        self.bad = 0
+
+    def feed(self, data):
+        """Returns (flags, sequence, time_us, rate, pairs, payload) per complete frame"""
+        self.buffer += data
+        frames = []
+
+        while True:
+            start = self.buffer.find(SYNC)
+            if start < 0:
+                del self.buffer[:-1]
+                return frames
+            del self.buffer[:start]
+            if len(self.buffer) < HEADER.size:
+                return frames
+
+            (_, version, flags, sequence, time_us, rate, pairs, length) = HEADER.unpack_from(self.buffer)
+            if version == 1:
+                # packed samples only, bytes 18-19 reserved
+                flags &= FLAG_GAP
+            if not flags & FLAG_COMPRESSED:
+                length = 3 * pairs
+            size = HEADER.size + length + 1
+            if version not in (1, VERSION) or pairs == 0 or pairs > 4096 or rate == 0 or length > 3 * pairs + 2:
+                # not a frame, e.g. text that happens to contain "WF"
+                del self.buffer[:2]
+                self.bad += 1
+                continue
+            if len(self.buffer) < size:
+                return frames
+
+            frame = bytes(self.buffer[:size])
+            if checksum(frame[2:-1]) != frame[-1]:
+                del self.buffer[:2]
+                self.bad += 1
+                continue
+
+            del self.buffer[:size]
+            payload = frame[HEADER.size:-1]
+            if flags & FLAG_COMPRESSED:
+                try:
+                    voltage, used = wave_decode(payload, pairs)
+                    current, _ = wave_decode(payload[used:], pairs)
+                except ValueError:
+                    self.bad += 1
+                    continue
+                payload = pack_pairs(voltage, current)
+            frames.append((flags, sequence, time_us, rate, pairs, payload))
+
+
+class WavWriter:
+    def __init__(self, path):
+        self.path = path
+        self.wav = None
+
+    def write(self, rate, time_us, voltage, current):
+        if self.wav is None:
+            self.wav = wave.open(self.path, 'wb')
+            self.wav.setnchannels(2)
+            self.wav.setsampwidth(2)
+            self.wav.setframerate(rate // 2)
+        data = bytearray(4 * len(voltage))
+        for i, (v, c) in enumerate(zip(voltage, current)):
+            struct.pack_into('<hh', data, 4 * i, v - 2048, c - 2048)
+        self.wav.writeframes(bytes(data))
+
+    def close(self):
+        if self.wav is not None:
+            self.wav.close()
+
+
+class CsvWriter:
+    def __init__(self, path):
+        self.file = open(path, 'w')
+        self.file.write('time_us,voltage,current\n')
+
+    def write(self, rate, time_us, voltage, current):
+        # time_us is when the last sample was written, 2 samples per pair
+        period = 2e6 / rate
+        first = time_us - period * (len(voltage) - 1)
+        for i, (v, c) in enumerate(zip(voltage, current)):
+            self.file.write('%.1f,%d,%d\n' % (first + i * period, v, c))
+
+    def close(self):
+        self.file.close()
+
+
+class TraceWriter:
+    """meter/include/meter/trace.h, the frame payload is already packed the same way"""
+
+    def __init__(self, path):
+        self.file = open(path, 'wb')
+        self.rate = None
+
+    def write_frame(self, sequence, time_us, rate, pairs, payload):
+        if self.rate is None:
+            self.rate = rate
+            self.file.write(struct.pack('<4sBBBBII', b'MTRC', 1, 2, 12, 0, rate // 2, 0))
+        self.file.write(struct.pack('<IIHH', (sequence * pairs) & 0xffffffff, time_us & 0xffffffff, pairs, 0))
+        self.file.write(payload)
+
+    def close(self):
+        self.file.close()
+
+
+def open_input(path):
+    fd = os.open(path, os.O_RDWR | os.O_NOCTTY)
+    is_tty = os.isatty(fd)
+    if is_tty:
+        tty.setraw(fd)
+        termios.tcflush(fd, termios.TCIFLUSH)
+    return fd, is_tty
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('input', help='serial device, or a capture file')
+    parser.add_argument('output', help='output file, .wav, .csv or .mtr')
+    parser.add_argument('--seconds', type=float, default=None, help='stop after this long, default until Ctrl-C')
+    parser.add_argument('--clkdiv', type=float, default=0, help='ADC clock divider, 0 for the full 500 ksps')
+    parser.add_argument('--compress', action='store_true', help='stream losslessly compressed samples')
+    args = parser.parse_args()
+
+    if args.output.endswith('.mtr'):
+        writer = TraceWriter(args.output)
+    elif args.output.endswith('.csv'):
+        writer = CsvWriter(args.output)
+    else:
+        writer = WavWriter(args.output)
+    fd, is_tty = open_input(args.input)
+
+    if is_tty:
+        command = b'Z' if args.compress else b'S'
+        os.write(fd, command + (b' %g\n' % args.clkdiv if args.clkdiv else b'\n'))
+
+    frames = Frames()
+    expected = None
+    received = 0
+    lost = 0
+    start = time.monotonic()
+
+    try:
+        while args.seconds is None or time.monotonic() - start < args.seconds:
+            data = os.read(fd, 65536)
+            if not data:
+                if not is_tty:
+                    break
+                continue
+
+            for flags, sequence, time_us, rate, pairs, payload in frames.feed(data):
+                trace = isinstance(writer, TraceWriter)
+
+                if expected is not None and sequence != expected:
+                    missing = (sequence - expected) & 0xffffffff
+                    where = 'dropped on the device' if flags & FLAG_GAP else 'lost in transfer'
+                    print('gap: %u blocks %s before block %u' % (missing, where, sequence), file=sys.stderr)
+                    lost += missing
+
+                    # traces keep the gap in the row index
+                    if not trace:
+                        fill = [2048] * pairs
+                        block_us = pairs * 2e6 / rate
+                        for k in range(min(missing, 10000), 0, -1):
+                            writer.write(rate, time_us - k * block_us, fill, fill)
+                expected = (sequence + 1) & 0xffffffff
+
+                if trace:
+                    # traces are stamped with the first row
+                    writer.write_frame(sequence, time_us - int((pairs - 1) * 2e6 / rate), rate, pairs, payload)
+                else:
+                    voltage, current = unpack_pairs(payload, pairs)
+                    writer.write(rate, time_us, voltage, current)
+                received += 1
+    except KeyboardInterrupt:
+        pass
+    finally:
+        if is_tty:
+            os.write(fd, b'X\n')
+        os.close(fd)
+        writer.close()
+
+    print('%u blocks received, %u lost, %u bad frames' % (received, lost, frames.bad), file=sys.stderr)
+
+
+if __name__ == '__main__':
+    main()